@@ -0,0 +1,49 @@
+#
+# Find libspng
+#
+# Try to find the libspng PNG decoding library (https://libspng.org).
+# This module defines the following variables:
+# - SPNG_INCLUDE_DIR
+# - SPNG_LIBRARY
+# - SPNG_FOUND
+#
+# The following variables can be set as arguments for the module.
+# - SPNG_ROOT_DIR : Root library directory of libspng
+#
+
+# Additional modules
+include(FindPackageHandleStandardArgs)
+
+# Find include files
+find_path(
+  SPNG_INCLUDE_DIR
+  NAMES spng.h
+  PATHS
+    /usr/include
+    /usr/local/include
+    /opt/local/include
+    /opt/homebrew/include
+    $ENV{SPNG_ROOT_DIR}/include
+    ${SPNG_ROOT_DIR}/include
+  DOC "The directory where spng.h resides")
+
+# Find library files
+find_library(
+  SPNG_LIBRARY
+  NAMES spng spng_static
+  PATHS
+    /usr/lib64
+    /usr/lib
+    /usr/local/lib64
+    /usr/local/lib
+    /opt/local/lib
+    /opt/homebrew/lib
+    $ENV{SPNG_ROOT_DIR}/lib
+    ${SPNG_ROOT_DIR}/lib
+  DOC "The libspng library")
+
+# Handle REQUIRED argument, define *_FOUND variable
+find_package_handle_standard_args(SPNG DEFAULT_MSG SPNG_INCLUDE_DIR SPNG_LIBRARY)
+
+# Hide some variables
+mark_as_advanced(SPNG_INCLUDE_DIR SPNG_LIBRARY)
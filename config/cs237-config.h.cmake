@@ -32,6 +32,9 @@ extern "C" {
 //! flag for windows build
 #cmakedefine CS237_WINDOWS
 
+//! is the libspng PNG decoder available?
+#cmakedefine CS237_HAVE_SPNG
+
 #ifdef __cplusplus
 }
 #endif // C++
@@ -0,0 +1,76 @@
+/*! \file bcn.hpp
+ *
+ * Support for the BC1, BC3, and BC5 block-compressed texture formats.  These
+ * formats represent 4x4 blocks of pixels in a fixed number of bytes and can
+ * be sampled directly by most desktop GPUs.  We provide a (simple) encoder,
+ * which is used by offline tools, and a decoder, which is used as a fallback
+ * when the device does not support a compressed format.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _BCN_HPP_
+#define _BCN_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bcn {
+
+/// the supported block-compression formats
+enum class Format : uint32_t {
+    BC1 = 1,    ///< RGB color (alpha is ignored); 8 bytes per block
+    BC3 = 3,    ///< RGBA color with interpolated alpha; 16 bytes per block
+    BC5 = 5     ///< two-channel (RG) data, such as the XY of a normal map; 16 bytes per block
+};
+
+/// convert a Format value to a printable string
+std::string to_string (Format fmt);
+
+/// the number of bytes used to represent a 4x4 block of pixels
+inline size_t blockSize (Format fmt) { return (fmt == Format::BC1) ? 8 : 16; }
+
+/// the number of bytes required to represent a wid x ht image
+inline size_t imageSize (Format fmt, uint32_t wid, uint32_t ht)
+{
+    return size_t((wid + 3) >> 2) * size_t((ht + 3) >> 2) * blockSize(fmt);
+}
+
+/// the number of 8-bit channels per pixel produced by decoding the format
+/// (4 for BC1 and BC3, and 2 for BC5)
+inline uint32_t decodedChannels (Format fmt) { return (fmt == Format::BC5) ? 2 : 4; }
+
+/// \brief encode an image
+/// \param fmt   the block-compression format
+/// \param wid   the width of the image in pixels
+/// \param ht    the height of the image in pixels
+/// \param rgba  the source pixels in 8-bit RGBA order (BC5 only uses R and G)
+/// \param dst   the destination, which must have room for imageSize(fmt, wid, ht) bytes
+void encodeImage (Format fmt, uint32_t wid, uint32_t ht, const uint8_t *rgba, uint8_t *dst);
+
+/// \brief decode an image
+/// \param fmt   the block-compression format
+/// \param wid   the width of the image in pixels
+/// \param ht    the height of the image in pixels
+/// \param src   the block-compressed data
+/// \param dst   the destination, which must have room for wid*ht*decodedChannels(fmt)
+///              bytes
+void decodeImage (Format fmt, uint32_t wid, uint32_t ht, const uint8_t *src, uint8_t *dst);
+
+/// \brief flip a block-compressed image vertically in place
+/// \param fmt   the block-compression format
+/// \param wid   the width of the image in pixels
+/// \param ht    the height of the image in pixels; this value must either be
+///              less than 4 or be a multiple of 4
+/// \param data  the block-compressed data
+void flipImage (Format fmt, uint32_t wid, uint32_t ht, uint8_t *data);
+
+} // namespace bcn
+
+#endif // !_BCN_HPP_
@@ -90,7 +90,7 @@ struct AABB {
     {
         if ((! this->_empty) && (! bb._empty)) {
             this->_min = glm::min(this->_min, bb._min);
-            this->_max = glm::min(this->_max, bb._max);
+            this->_max = glm::max(this->_max, bb._max);
         }
         else if (this->_empty) {
             this->_empty = false;
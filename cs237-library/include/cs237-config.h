@@ -32,6 +32,9 @@ extern "C" {
 //! flag for windows build
 /* #undef CS237_WINDOWS */
 
+//! is the libspng PNG decoder available?
+/* #undef CS237_HAVE_SPNG */
+
 #ifdef __cplusplus
 }
 #endif // C++
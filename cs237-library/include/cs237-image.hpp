@@ -18,6 +18,7 @@
 #endif
 
 #include <fstream>
+#include "bcn.hpp"
 
 namespace cs237 {
 
@@ -50,6 +51,47 @@ enum class ChannelTy {
 //! convert a ChannelTy value to a printable string
 std::string to_string (ChannelTy ty);
 
+//! the properties of a PNG image once it has been decoded
+struct PNGInfo {
+    uint32_t wid;           //!< the width of the image
+    uint32_t ht;            //!< the height of the image
+    Channels chans;         //!< the channels of the decoded pixels (RGB images are
+                            //!  expanded to RGBA)
+    ChannelTy type;         //!< the type of the channels (U8 or U16)
+    bool sRGB;              //!< should the image be interpreted as sRGB encoded?
+    size_t nBytes;          //!< the size of the decoded image in bytes
+};
+
+//! A pool of pixel buffers shared by the image classes.  Streaming texture tiles
+//! allocates and frees many buffers of the same few sizes, so rather than
+//! returning freed buffers to the system allocator, the pool keeps them in
+//! size classes and hands them out again.  There are four size classes per
+//! power of two (e.g., 256K, 320K, 384K, 448K, 512K, ...), so at most 25% of
+//! a buffer is wasted.  The pool is thread safe.
+class ImageBufferPool {
+  public:
+  //! \brief allocate a buffer
+  //! \param nBytes  the requested size of the buffer
+  //! \return a buffer of at least nBytes bytes, or nullptr if the allocation fails
+    static void *alloc (size_t nBytes);
+
+  //! \brief return a buffer to the pool
+  //! \param buf     the buffer, which must have been returned by `alloc`
+  //! \param nBytes  the size that was passed to `alloc` when `buf` was allocated
+    static void release (void *buf, size_t nBytes);
+
+  //! \brief set the maximum number of bytes of free buffers that the pool retains
+  //!        (the default is 64Mb); buffers that are released when the pool is full
+  //!        are returned to the system.
+    static void setCapacity (size_t nBytes);
+
+  //! \brief return all of the free buffers in the pool to the system
+    static void purge ();
+
+  //! the number of bytes of free buffers that are currently held by the pool
+    static size_t nBytesRetained ();
+};
+
 namespace __detail {
 
     //! \brief convert an image format and channel type to a Vulkan image format
@@ -63,6 +105,8 @@ namespace __detail {
         Channels channels () const { return this->_chans; }
         //! returns the type of the channels
         ChannelTy type () const { return this->_type; }
+        //! should the image be interpreted as sRGB encoded?
+        bool sRGB () const { return this->_sRGB; }
         //! return the vulkan format of the image data
         vk::Format format () const { return toVkFormat(this->_chans, this->_type, this->_sRGB); }
         //! the data pointer
@@ -84,30 +128,122 @@ namespace __detail {
         //! support 24-bit pixels.
         void addAlphaChannel ();
 
+        //! swap the red and blue channels of the image, which converts between
+        //! RGB and BGR (or RGBA and BGRA) pixel formats.
+        //!
+        //! This operation only works on images with 8-bit 3 or 4-channel pixels;
+        //! and is a no-op for other formats.
+        void swapRedBlue ();
+
+        //! does the image own its data (i.e., will the data be freed when the
+        //! image is destroyed)?
+        bool ownsData () const { return this->_ownsData; }
+
+        ImageBase (ImageBase const &) = delete;
+        ImageBase &operator= (ImageBase const &) = delete;
+
     protected:
         uint32_t _nDims;        //!< the number of dimensions (1 or 2)
         Channels _chans;        //!< the texture format
         ChannelTy _type;        //!< the representation type of the data
         bool _sRGB;             //!< should the image be interpreted as an sRGB encoded image?
+        bool _ownsData;         //!< true if `_data` should be freed by the destructor; it is
+                                //!  false when the data is in a caller-provided buffer
+        bool _pooled;           //!< true if `_data` was allocated from the `ImageBufferPool`;
+                                //!  otherwise it was allocated by `malloc`
         size_t _nBytes;         //!< size in bytes of image data
         void *_data;            //!< the raw image data
 
         explicit ImageBase ()
           : _nDims(0), _chans(Channels::UNKNOWN), _type(ChannelTy::UNKNOWN), _sRGB(false),
-            _nBytes(0), _data(nullptr)
+            _ownsData(true), _pooled(false), _nBytes(0), _data(nullptr)
         { }
         explicit ImageBase (uint32_t nd)
           : _nDims(nd), _chans(Channels::UNKNOWN), _type(ChannelTy::UNKNOWN), _sRGB(false),
-            _nBytes(0), _data(nullptr)
+            _ownsData(true), _pooled(false), _nBytes(0), _data(nullptr)
         { }
         explicit ImageBase (uint32_t nd, Channels chans, ChannelTy ty, size_t nPixels);
+        //! create an image over externally owned memory
+        explicit ImageBase (uint32_t nd, Channels chans, ChannelTy ty, size_t nPixels, void *data);
+
+        //! move constructor; `img` is left empty
+        ImageBase (ImageBase &&img);
+        //! move assignment; `img` is left empty
+        ImageBase &operator= (ImageBase &&img);
 
         virtual ~ImageBase ();
 
+        //! free the image data (if it is owned by the image)
+        void _freeData ();
+
+        //! decode a PNG image held in memory into the image's data.  Unless the
+        //! caller supplies a large enough buffer, the pixels are decoded into a
+        //! buffer allocated from the buffer pool.
+        //! \return true on success
+        bool _decode (
+            const uint8_t *data, size_t len, bool flip, PNGInfo &info,
+            void *buf, size_t bufSz);
+
     };
 
 } /* namespace __detail */
 
+//! The interface to a PNG decoder.  The library provides a decoder based on
+//! libpng and, when it is configured with `CS237_ENABLE_SPNG`, a faster decoder
+//! based on libspng.  All PNG decoding in the library (e.g., by the `Image2D`
+//! constructors and by texture quadtrees) goes through the current decoder.
+class ImageDecoder {
+  public:
+    virtual ~ImageDecoder () { }
+
+  //! the name of the decoder (for diagnostics)
+    virtual const char *name () const = 0;
+
+  //! get the properties of a PNG image without decoding it; see `readPNGInfo`
+    virtual bool readInfo (const uint8_t *data, size_t len, PNGInfo &info) = 0;
+
+  //! decode a PNG image held in memory; see `decodePNG`
+    virtual void *decode (
+        const uint8_t *data, size_t len, bool flip, PNGInfo &info,
+        void *buf, size_t bufSz) = 0;
+
+  //! the decoder used by the library; by default, this is the libspng decoder when
+  //! it is available and the libpng decoder otherwise
+    static ImageDecoder *current ();
+
+  //! set the decoder used by the library
+  //! \param decoder  the decoder to use (nullptr restores the default)
+    static void setCurrent (ImageDecoder *decoder);
+
+  //! the decoder based on libpng
+    static ImageDecoder *libpng ();
+
+  //! the decoder based on libspng, or nullptr if it is not available
+    static ImageDecoder *spng ();
+};
+
+//! \brief get the properties of a PNG image held in memory without decoding it
+//! \param data  the encoded image
+//! \param len   the length of the encoded image in bytes
+//! \param[out] info  the properties of the decoded image
+//! \return true if the image header is valid
+bool readPNGInfo (const uint8_t *data, size_t len, PNGInfo &info);
+
+//! \brief decode a PNG image held in memory (e.g., in a memory-mapped file)
+//! \param data  the encoded image
+//! \param len   the length of the encoded image in bytes
+//! \param flip  true if the rows of the image should be flipped to match OpenGL coordinates
+//! \param[out] info  the properties of the decoded image
+//! \param buf   optional buffer for the decoded pixels (e.g., a staging buffer)
+//! \param bufSz the size of `buf` in bytes
+//! \return a pointer to the decoded pixels, or nullptr on error.  If `buf` is large
+//!         enough to hold the image, then the pixels are decoded directly into it and
+//!         `buf` is returned; otherwise, the result is allocated using `malloc` and
+//!         it is the caller's responsibility to free it.
+void *decodePNG (
+    const uint8_t *data, size_t len, bool flip, PNGInfo &info,
+    void *buf = nullptr, size_t bufSz = 0);
+
 /* 1D images */
 class Image1D : public __detail::ImageBase {
   public:
@@ -157,6 +293,34 @@ class Image2D : public __detail::ImageBase {
   //!        texture coordinates (default true)
     Image2D (std::ifstream &inS, bool flip = true);
 
+  //! create and initialize an image by decoding a PNG image held in memory
+  //! \param data  the encoded image
+  //! \param len   the length of the encoded image in bytes
+  //! \param flip  set to true if the image should be flipped vertically to match OpenGL
+  //!        texture coordinates
+  //! \param buf   optional buffer for the decoded pixels; if it is large enough, then
+  //!        the image uses it for its data, but does not take ownership of it
+  //! \param bufSz the size of `buf` in bytes
+    Image2D (const uint8_t *data, size_t len, bool flip = true,
+        void *buf = nullptr, size_t bufSz = 0);
+
+  //! create an image over externally owned memory; the image does not take ownership
+  //! of the memory, which must outlive the image
+  //! \param wid the width of the image
+  //! \param ht the height of the image
+  //! \param chans the image format
+  //! \param ty the type of the elements
+  //! \param data the pixels, which must hold at least wid*ht pixels
+    Image2D (uint32_t wid, uint32_t ht, Channels chans, ChannelTy ty, void *data);
+
+  //! move constructor; the data of `img` is transferred to the new image and
+  //! `img` is left empty
+    Image2D (Image2D &&img);
+
+  //! move assignment; the data of `img` is transferred to this image and
+  //! `img` is left empty
+    Image2D &operator= (Image2D &&img);
+
   //! return the width of the image
     size_t width () const { return this->_wid; }
 
@@ -167,21 +331,27 @@ class Image2D : public __detail::ImageBase {
   //! \param file the name of the PNG file
   //! \param flip set to true if the image should be flipped vertically to match standard
   //!        image-file coordinates (default true)
+  //! \param nThreads the number of threads used to compress the image; 1 (the default)
+  //!        means use the single-threaded libpng encoder and 0 means use all of the
+  //!        hardware threads.
   //! \return true if successful, false otherwise
   //!
   //! Note that the type of the image must be either GL_UNSIGNED_BYTE,
   //! or GL_UNSIGNED_SHORT to write it as a PNG file.
-    bool write (const char *file, bool flip = true);
+    bool write (const char *file, bool flip = true, unsigned int nThreads = 1);
 
   //! write the texture to an output stream in PNG format
   //! \param outS the output stream to write the PNG image to
   //! \param flip set to true if the image should be flipped vertically to match standard
   //!        image-file coordinates (default true)
+  //! \param nThreads the number of threads used to compress the image; 1 (the default)
+  //!        means use the single-threaded libpng encoder and 0 means use all of the
+  //!        hardware threads.
   //! \return true if successful, false otherwise
   //!
   //! Note that the type of the image must be either GL_UNSIGNED_BYTE,
   //! or GL_UNSIGNED_SHORT to write it to an output stream.
-    bool write (std::ofstream &outS, bool flip = true);
+    bool write (std::ofstream &outS, bool flip = true, unsigned int nThreads = 1);
 
   //! copy the contents of another image into this image
   //! \param src the image to blt into this image
@@ -195,6 +365,9 @@ class Image2D : public __detail::ImageBase {
   protected:
     uint32_t _wid;      //!< the width of the image in pixels
     uint32_t _ht;       //!< the height of the image in pixels
+
+  //! initialize the image properties from the result of decoding a PNG
+    void _init (PNGInfo const &info);
 };
 
 //! A 2D Image used to store 2D data, such as a normal map.
@@ -231,6 +404,139 @@ class DataImage2D : public Image2D {
         this->_sRGB = false;
     }
 
+  //! create and initialize an image by decoding a PNG image held in memory
+  //! \param data  the encoded image
+  //! \param len   the length of the encoded image in bytes
+  //! \param flip  set to true if the image should be flipped vertically to match OpenGL
+  //!        texture coordinates
+  //! \param buf   optional buffer for the decoded pixels
+  //! \param bufSz the size of `buf` in bytes
+    DataImage2D (const uint8_t *data, size_t len, bool flip = true,
+        void *buf = nullptr, size_t bufSz = 0)
+      : Image2D (data, len, flip, buf, bufSz)
+    {
+        this->_sRGB = false;
+    }
+
+  //! create an image over externally owned memory; the image does not take ownership
+  //! of the memory, which must outlive the image
+  //! \param wid the width of the image
+  //! \param ht the height of the image
+  //! \param chans the image format
+  //! \param ty the type of the elements
+  //! \param data the pixels, which must hold at least wid*ht pixels
+    DataImage2D (uint32_t wid, uint32_t ht, Channels chans, ChannelTy ty, void *data)
+      : Image2D (wid, ht, chans, ty, data)
+    {
+        this->_sRGB = false;
+    }
+
+};
+
+//! A 2D image together with a chain of mipmap levels.  The levels are stored
+//! contiguously in a single buffer, starting with the base level, so that all of
+//! them can be uploaded to the GPU with a single copy.  The pixels either are
+//! uncompressed 8-bit data or are block compressed using one of the BCn formats.
+class MipmapImage2D {
+  public:
+  //! the location and size of a mipmap level in the image data
+    struct Level {
+        uint32_t wid;           //!< the width of the level in pixels
+        uint32_t ht;            //!< the height of the level in pixels
+        size_t offset;          //!< offset in bytes of the level from the start of the data
+        size_t nBytes;          //!< the size in bytes of the level's data
+    };
+
+  //! create and allocate space for an uninitialized chain of uncompressed levels
+  //! \param wid      the width of the base level
+  //! \param ht       the height of the base level
+  //! \param nLevels  the number of levels in the chain
+  //! \param chans    the channels of the pixels (R, RG, or RGBA), which are 8-bit
+  //! \param sRGB     true if the pixels should be interpreted as sRGB encoded
+    MipmapImage2D (uint32_t wid, uint32_t ht, uint32_t nLevels, Channels chans, bool sRGB);
+
+  //! create and allocate space for an uninitialized chain of block-compressed levels
+  //! \param wid      the width of the base level
+  //! \param ht       the height of the base level
+  //! \param nLevels  the number of levels in the chain
+  //! \param fmt      the block-compression format
+  //! \param sRGB     true if the pixels should be interpreted as sRGB encoded
+  //!                 (ignored for BC5)
+    MipmapImage2D (uint32_t wid, uint32_t ht, uint32_t nLevels, bcn::Format fmt, bool sRGB);
+
+  //! create a mipmap chain from an image by computing the levels on the CPU.  The
+  //! levels are computed with a box filter; for sRGB images, the color channels
+  //! are averaged in linear space.
+  //! \param img      the base level, which must have 8-bit R, RG, or RGBA pixels
+  //! \param nLevels  the number of levels in the chain (0 means a complete chain)
+    explicit MipmapImage2D (Image2D const *img, uint32_t nLevels = 0);
+
+    MipmapImage2D (MipmapImage2D const &) = delete;
+    MipmapImage2D &operator= (MipmapImage2D const &) = delete;
+
+  //! move constructor; `img` is left empty
+    MipmapImage2D (MipmapImage2D &&img);
+
+    ~MipmapImage2D ();
+
+  //! return the width of the base level
+    uint32_t width () const { return this->_wid; }
+  //! return the height of the base level
+    uint32_t height () const { return this->_ht; }
+  //! return the number of levels in the chain
+    uint32_t nLevels () const { return static_cast<uint32_t>(this->_levels.size()); }
+  //! return the description of the i'th level
+    Level const &level (uint32_t i) const { return this->_levels[i]; }
+  //! is the data block compressed?
+    bool isCompressed () const { return this->_compressed; }
+  //! the block-compression format (only meaningful when isCompressed() is true)
+    bcn::Format compression () const { return this->_bcFmt; }
+  //! the channels of the pixels (once decompressed)
+    Channels channels () const { return this->_chans; }
+  //! should the image be interpreted as sRGB encoded?
+    bool sRGB () const { return this->_sRGB; }
+  //! the data pointer
+    void *data () const { return this->_data; }
+  //! the data pointer for the i'th level
+    void *levelData (uint32_t i) const
+    {
+        return static_cast<uint8_t *>(this->_data) + this->_levels[i].offset;
+    }
+  //! the total number of bytes of image data
+    size_t nBytes () const { return this->_nBytes; }
+
+  //! return the Vulkan format of the image data
+    vk::Format format () const;
+
+  //! return the Vulkan format of the data produced by `decompress`
+    vk::Format decodedFormat () const;
+
+  //! return an uncompressed copy of a block-compressed image; the pixels of the
+  //! result are RGBA for BC1 and BC3 data and RG for BC5 data.
+    MipmapImage2D *decompress () const;
+
+  //! flip all of the levels of the image vertically
+    void flip ();
+
+  //! recompute the levels of an uncompressed chain, starting at level `first` (> 0),
+  //! from the preceding levels
+    void generateLevels (uint32_t first = 1);
+
+  //! the number of levels in a complete mipmap chain for a wid x ht image
+    static uint32_t fullChainLength (uint32_t wid, uint32_t ht);
+
+  private:
+    uint32_t _wid;              //!< the width of the base level in pixels
+    uint32_t _ht;               //!< the height of the base level in pixels
+    Channels _chans;            //!< the channels of the (decompressed) pixels
+    bool _compressed;           //!< is the data block compressed?
+    bcn::Format _bcFmt;         //!< the block-compression format
+    bool _sRGB;                 //!< should the image be interpreted as sRGB encoded?
+    std::vector<Level> _levels; //!< the levels of the chain
+    size_t _nBytes;             //!< the total size in bytes of the image data
+    void *_data;                //!< the raw image data
+
+    void _init (uint32_t nLevels);
 };
 
 } /* namespace cs237 */
@@ -40,6 +40,10 @@ protected:
         Application *app,
         uint32_t wid, uint32_t ht, uint32_t mipLvls,
         cs237::__detail::ImageBase const *img);
+    TextureBase (
+        Application *app,
+        uint32_t wid, uint32_t ht, uint32_t mipLvls,
+        vk::Format fmt);
     ~TextureBase ();
 
     /// \brief create a vk::Buffer object
@@ -87,9 +91,27 @@ public:
     /// \param app     the owning application
     /// \param img     the source image for the texture
     /// \param mipmap  if true, generate mipmap levels for the texture.
+    ///
+    /// The mipmap levels are generated on the GPU using blits when the format
+    /// supports linear filtering and are computed on the CPU otherwise.  Use
+    /// the `MipmapImage2D` constructor to always compute them on the CPU.
+    /// Images that support neither (e.g., 16-bit images with integer formats)
+    /// get a texture with only the base level.
     Texture2D (Application *app, Image2D const *img, bool mipmap = false);
 
+    /// \brief Construct a 2D texture from an image with precomputed mipmap levels.
+    /// \param app     the owning application
+    /// \param img     the source image for the texture
+    ///
+    /// All of the levels are uploaded using a single copy command.  If the image is
+    /// block compressed and the device does not support sampling the compressed
+    /// format, then the image is decompressed on the CPU before being uploaded.
+    Texture2D (Application *app, MipmapImage2D const *img);
+
 private:
+    /// helper function for uploading the levels of a mipmap chain
+    void _initLevels (cs237::MipmapImage2D const *img);
+
     /// helper function for generating the mipmap levels; the number of levels
     /// is determined by the size of the image.
     void _generateMipMaps (cs237::Image2D const *img);
@@ -21,8 +21,18 @@
 
 #include <vector>
 #include <string>
-#include <map>
+#include <string_view>
 #include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <new>
+#include <utility>
+
+namespace cs237 {
+    namespace __detail {
+        class MappedFile;
+    }
+}
 
 namespace json {
 
@@ -46,8 +56,192 @@ namespace json {
     class String;
     class Bool;
     class Null;
+    class Document;
+
+  //! A bump allocator for the values of a document.  Memory is allocated in large
+  //! chunks and is only freed (all at once) when the arena is destroyed, so the
+  //! values allocated in it are never destructed.
+    class Arena {
+      public:
+        Arena () : _chunks(), _next(nullptr), _avail(0), _nBytes(0) { }
+        ~Arena ();
+
+        Arena (Arena const &) = delete;
+        Arena &operator= (Arena const &) = delete;
+
+      //! allocate nb bytes of memory aligned to align bytes
+        void *alloc (size_t nb, size_t align = alignof(std::max_align_t))
+        {
+            size_t pad = (align - (reinterpret_cast<uintptr_t>(this->_next) & (align - 1)))
+                & (align - 1);
+            if (this->_avail < nb + pad) {
+                return this->_allocSlow (nb, align);
+            }
+            void *p = this->_next + pad;
+            this->_next += nb + pad;
+            this->_avail -= nb + pad;
+            return p;
+        }
+
+      //! allocate and construct an object in the arena
+        template <typename T, typename... Args>
+        T *make (Args&&... args)
+        {
+            return new (this->alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+      //! copy a string into the arena
+        std::string_view copy (std::string_view s);
+
+      //! the total number of bytes allocated from the system for the arena
+        size_t nBytes () const { return this->_nBytes; }
+
+      private:
+        std::vector<char *> _chunks;    //!< the chunks of memory
+        char *_next;                    //!< the next free byte in the current chunk
+        size_t _avail;                  //!< the number of free bytes in the current chunk
+        size_t _nBytes;                 //!< the total size of the chunks
+
+        void *_allocSlow (size_t nb, size_t align);
+    };
+
+  //! A pull parser for JSON text.  Each call to `next` consumes the next token
+  //! of the input and returns an event that describes it; the parser checks
+  //! that the tokens form a well-formed JSON value.  This interface allows
+  //! large files to be processed without building a `Document`.
+    class Reader {
+      public:
+      //! the parsing events
+        enum class Event {
+            BeginObject,        //!< the start of an object
+            EndObject,          //!< the end of an object
+            BeginArray,         //!< the start of an array
+            EndArray,           //!< the end of an array
+            Key,                //!< the key of an object field; it is followed by the
+                                //!  field's value
+            String,             //!< a string value
+            Integer,            //!< an integer value
+            Real,               //!< a real value
+            Bool,               //!< a boolean value
+            Null,               //!< the null value
+            End,                //!< the end of the input (after a complete value)
+            Error               //!< a parsing error (which has been reported)
+        };
+
+      //! create a reader for JSON text held in memory
+      //! \param text  the JSON text, which must outlive the reader
+      //! \param len   the length of the text in bytes
+      //! \param name  the name of the source of the text (for error messages)
+        Reader (const char *text, size_t len, std::string const &name = "<string>");
+
+      //! create a reader for a JSON file, which is mapped into memory
+      //! \param filename  the file to read
+        explicit Reader (std::string const &filename);
+
+        ~Reader ();
+
+        Reader (Reader const &) = delete;
+        Reader &operator= (Reader const &) = delete;
+
+      //! was the input successfully opened?
+        bool isValid () const { return (this->_text != nullptr); }
+
+      //! advance to the next event
+        Event next ();
+
+      //! skip a value.  If the last event was Key, then the field's value is
+      //! skipped; if it was BeginObject or BeginArray, then the rest of the object
+      //! or array is skipped; otherwise this does nothing.
+      //! \return false if there was a parsing error
+        bool skip ();
+
+      //! the text of the last Key or String event; it is only valid until the next
+      //! call to `next`
+        std::string_view string () const { return this->_str; }
+      //! the value of the last Integer event
+        int64_t intVal () const { return this->_int; }
+      //! the value of the last Integer or Real event
+        double realVal () const { return this->_real; }
+      //! the value of the last Bool event
+        bool boolVal () const { return this->_bool; }
+
+      //! report an error at the current position in the input
+        void error (std::string const &msg);
+
+      //! the name of the input (e.g., the filename)
+        std::string const &name () const { return this->_name; }
+
+      private:
+      //! what the parser expects next
+        enum State {
+            S_VALUE,            //!< a value
+            S_VALUE_OR_END,     //!< a value or the end of an array (after '[')
+            S_KEY,              //!< a key (after a ',' in an object)
+            S_KEY_OR_END,       //!< a key or the end of an object (after '{')
+            S_COMMA_OR_END,     //!< a ',' or the end of the enclosing value
+            S_DONE,             //!< the complete value has been read
+            S_ERROR             //!< an error was detected
+        };
+
+        std::string _name;              //!< the name of the input
+        cs237::__detail::MappedFile *_file; //!< the mapped file (if reading a file)
+        const char *_text;              //!< the input text
+        size_t _len;                    //!< the length of the input
+        size_t _pos;                    //!< the current position in the input
+        int _lnum;                      //!< the current line number
+        State _state;                   //!< the parser state
+        std::vector<bool> _nest;        //!< stack of enclosing values (true for objects)
+        std::string_view _str;          //!< the text of the last Key or String
+        std::string _buf;               //!< buffer for strings with escape sequences
+        int64_t _int;                   //!< the value of the last Integer
+        double _real;                   //!< the value of the last Integer or Real
+        bool _bool;                     //!< the value of the last Bool
+
+        void _skipWhitespace ();
+        bool _string ();
+        Event _value ();
+        Event _number ();
+        void _endValue () { this->_state = this->_nest.empty() ? S_DONE : S_COMMA_OR_END; }
+        Event _error (std::string const &msg);
+    };
+
+  //! A parsed JSON document.  All of the values in the document are allocated
+  //! in an arena that is owned by the document, so they are valid until the
+  //! document is destroyed.
+    class Document {
+      public:
+        Document () : _arena(), _root(nullptr) { }
+
+        Document (Document const &) = delete;
+        Document &operator= (Document const &) = delete;
 
-  // parse a JSON file; this returns nullptr if there is a parsing error
+      //! parse a JSON file
+      //! \param filename  the file to parse
+      //! \return true on success and false if there was an I/O or parsing error
+        bool parseFile (std::string const &filename);
+
+      //! parse JSON text held in memory
+      //! \param text  the JSON text
+      //! \param len   the length of the text in bytes
+      //! \param name  the name of the source of the text (for error messages)
+      //! \return true on success and false if there was a parsing error
+        bool parse (const char *text, size_t len, std::string const &name = "<string>");
+
+      //! the root value of the document (nullptr if the document has not been
+      //! successfully parsed)
+        Value *root () const { return this->_root; }
+
+      //! the arena that holds the document's values
+        Arena &arena () { return this->_arena; }
+
+      private:
+        Arena _arena;           //!< the storage for the document's values
+        Value *_root;           //!< the root value
+    };
+
+  //! parse a JSON file; this returns nullptr if there is a parsing error.  The
+  //! result is allocated in a document that is never freed, so `json::Document`
+  //! should be used instead when the lifetime of the values matters.
     Value *parseFile (std::string filename);
 
   // virtual base class of JSON values
@@ -120,25 +314,55 @@ namespace json {
         return s << v->toString();
     }
 
-  //! JSON objects
+  //! JSON objects.  The fields are stored in an array that is sorted by key, so
+  //! lookup is a binary search.  The keys of parsed objects are interned in the
+  //! document, so that the storage for a key is shared by all of the objects that
+  //! use it.
     class Object : public Value {
       public:
-        Object () : Value(T_OBJECT), _value() { };
+      //! a field of an object
+        struct Field {
+            std::string_view key;       //!< the field's name
+            Value *value;               //!< the field's value
+        };
+
+      //! construct an empty object that is not part of a document; the object
+      //! owns an arena for the storage that `insert` needs
+        Object ();
+
+      //! construct an empty object whose storage is allocated in an arena
+        explicit Object (Arena &arena)
+          : Value(T_OBJECT), _arena(&arena), _ownsArena(false),
+            _fields(nullptr), _n(0), _cap(0)
+        { }
+
+      //! construct an object from an array of fields that is allocated in the
+      //! arena; the fields are sorted in place.  If a key occurs more than once,
+      //! then the first occurrence is the one that is found by lookups.
+        Object (Arena &arena, Field *fields, int n);
         ~Object ();
 
+        Object (Object const &) = delete;
+        Object &operator= (Object const &) = delete;
+
       //! return the number of fields in the object
-        int size () const { return this->_value.size(); }
+        int size () const { return this->_n; }
 
-      //! insert a key-value pair into the object
-        void insert (std::string key, Value *val);
+      //! insert a key-value pair into the object; the key is copied into the
+      //! object's arena.  As with `std::map::insert`, the object is unchanged
+      //! if the key is already present.
+        void insert (std::string_view key, Value *val);
+
+      //! return the i'th field of the object (in key order)
+        Field const &field (int i) const { return this->_fields[i]; }
 
       //! return the value corresponding to the given key.
       //! \returns nil if the key is not defined in the object
-        Value *operator[] (std::string key) const;
+        Value *operator[] (std::string_view key) const;
 
       //! return an object-valued field
       //! \returns nullptr if the field is not present or is not an object
-        const Object *fieldAsObject (std::string key) const
+        const Object *fieldAsObject (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asObject() : nullptr;
@@ -146,7 +370,7 @@ namespace json {
 
       //! return an array-valued field
       //! \returns nullptr if the field is not present or is not an array
-        const Array *fieldAsArray (std::string key) const
+        const Array *fieldAsArray (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asArray() : nullptr;
@@ -154,7 +378,7 @@ namespace json {
 
       //! return a number-valued field
       //! \returns nullptr if the field is not present or is not a number
-        const Number *fieldAsNumber (std::string key) const
+        const Number *fieldAsNumber (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asNumber() : nullptr;
@@ -162,7 +386,7 @@ namespace json {
 
       //! return an integer-valued field
       //! \returns nullptr if the field is not present or is not an integer
-        const Integer *fieldAsInteger (std::string key) const
+        const Integer *fieldAsInteger (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asInteger() : nullptr;
@@ -170,7 +394,7 @@ namespace json {
 
       //! return an real-valued field
       //! \returns nullptr if the field is not present or is not a real
-        const Real *fieldAsReal (std::string key) const
+        const Real *fieldAsReal (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asReal() : nullptr;
@@ -178,7 +402,7 @@ namespace json {
 
       //! return an string-valued field
       //! \returns nullptr if the field is not present or is not a string
-        const String *fieldAsString (std::string key) const
+        const String *fieldAsString (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asString() : nullptr;
@@ -186,7 +410,7 @@ namespace json {
 
       //! return an bool-valued field
       //! \returns nullptr if the field is not present or is not a bool
-        const Bool *fieldAsBool (std::string key) const
+        const Bool *fieldAsBool (std::string_view key) const
         {
             const Value *v = (*this)[key];
             return (v != nullptr) ? v->asBool() : nullptr;
@@ -195,24 +419,51 @@ namespace json {
         std::string toString();
 
       private:
-        std::map<std::string, Value *> _value;
+        Arena *_arena;          //!< the arena that holds the fields
+        bool _ownsArena;        //!< true if the object owns its arena
+        Field *_fields;         //!< the fields sorted by key
+        int _n;                 //!< the number of fields
+        int _cap;               //!< the capacity of the _fields array
     };
 
   //! JSON arrays
     class Array : public Value {
       public:
-        Array () : Value(T_ARRAY), _value() { };
+      //! construct an empty array that is not part of a document; the array
+      //! owns an arena for the storage that `add` needs
+        Array ();
+
+      //! construct an empty array whose storage is allocated in an arena
+        explicit Array (Arena &arena)
+          : Value(T_ARRAY), _arena(&arena), _ownsArena(false),
+            _elems(nullptr), _n(0), _cap(0)
+        { }
+
+      //! construct an array from a sequence of values that is allocated in the arena
+        Array (Arena &arena, Value **elems, int n)
+          : Value(T_ARRAY), _arena(&arena), _ownsArena(false),
+            _elems(elems), _n(n), _cap(n)
+        { }
         ~Array ();
 
-        int length () const { return static_cast<int>(this->_value.size()); }
-        void add (Value *v) { this->_value.push_back(v); }
+        Array (Array const &) = delete;
+        Array &operator= (Array const &) = delete;
+
+        int length () const { return this->_n; }
 
-        Value *operator[] (int idx) const { return this->_value[idx]; }
+      //! add a value to the end of the array
+        void add (Value *v);
+
+        Value *operator[] (int idx) const { return this->_elems[idx]; }
 
         std::string toString();
 
       private:
-        std::vector<Value *> _value;
+        Arena *_arena;          //!< the arena that holds the elements
+        bool _ownsArena;        //!< true if the array owns its arena
+        Value **_elems;         //!< the elements
+        int _n;                 //!< the number of elements
+        int _cap;               //!< the capacity of the _elems array
     };
 
   //! base class for JSON numbers
@@ -257,15 +508,29 @@ namespace json {
 
     class String : public Value {
       public:
-        String (std::string v) : Value(T_STRING), _value(v) { };
+      //! construct a string value that owns a copy of its characters
+        String (std::string v) : Value(T_STRING), _owned(std::move(v)), _value(this->_owned) { };
+
+      //! construct a string value whose characters are copied into an arena
+        String (Arena &arena, std::string_view v)
+          : Value(T_STRING), _owned(), _value(arena.copy(v))
+        { };
         ~String ();
 
-        std::string value () const { return this->_value; }
+        String (String const &) = delete;
+        String &operator= (String const &) = delete;
+
+        std::string value () const { return std::string(this->_value); }
+
+      //! the characters of the string without copying them
+        std::string_view view () const { return this->_value; }
 
         std::string toString();
 
       private:
-        std::string _value;
+        std::string _owned;             //!< the characters of a string that is not
+                                        //!  in an arena (empty otherwise)
+        std::string_view _value;        //!< the characters of the string
     };
 
     class Bool : public Value {
@@ -16,6 +16,12 @@
 
 #include "cs237.hpp"
 
+namespace cs237 {
+    namespace __detail {
+        class MappedFile;
+    }
+}
+
 namespace OBJ {
 
 /// Illumination modes define how to interpret the material values.
@@ -65,9 +71,22 @@ struct Material {
     std::string         normalMap;      ///< optional normal map for bump mapping
 }; // struct Material
 
+/// A level of detail (LOD) of a group, which is a range of the group's index
+/// array.  All of the levels of a group share its vertex data.
+struct LOD {
+    uint32_t            firstIndex;     ///< the position of the level's first index
+    uint32_t            nIndices;       ///< the number of indices in the level
+    float               error;          ///< the geometric error of the level (i.e., how
+                                        ///  far it deviates from the full-resolution
+                                        ///  mesh) in model-space units
+};
+
 /// A Group is a connected mesh that has a single material.  It is represented
 /// by per-vertex data (position, normal, and texture coordinate) and an index
-/// array that defines a list of triangles.
+/// array that defines a list of triangles.  The index array is always 32-bit;
+/// 16-bit indices are only used for the GPU-side copy (see `PackedGroup`).
+/// The index array holds the triangles of each of the group's levels of detail,
+/// starting with the full-resolution mesh, which is the first `nIndices` indices.
 struct Group {
     std::string         name;           ///< name of this group
     int                 material;       ///< index to material for group (-1 for no material)
@@ -76,19 +95,264 @@ struct Group {
     glm::vec3           *verts;         ///< array of nVerts vertex coordinates
     glm::vec3           *norms;         ///< array of nVerts normal vectors (or nullptr)
     glm::vec2           *txtCoords;     ///< array of nVerts texture coordinates (or nullptr)
-    uint32_t            *indices;       ///< array of nIndices element indices that can be used
-                                        ///  to render the group
+    uint32_t            *indices;       ///< array of element indices that can be used to
+                                        ///  render the group (see `totalIndices`)
+    uint32_t            nLODs;          ///< the number of levels of detail (at least 1)
+    LOD                 *lods;          ///< array of nLODs levels of detail in order of
+                                        ///  increasing error; lods[0] is the full mesh
+
+    /// the total number of indices of all of the levels of detail
+    uint32_t totalIndices () const
+    {
+        return this->lods[this->nLODs - 1].firstIndex + this->lods[this->nLODs - 1].nIndices;
+    }
 }; // struct Group
 
+/// An interleaved vertex with full-precision attributes (32 bytes).
+struct Vertex {
+    glm::vec3           pos;            ///< position
+    glm::vec3           norm;           ///< normal vector
+    glm::vec2           txtCoord;       ///< texture coordinate
+
+    static std::vector<vk::VertexInputBindingDescription> getBindingDescriptions()
+    {
+        std::vector<vk::VertexInputBindingDescription> bindings(1);
+        bindings[0].binding = 0;
+        bindings[0].stride = sizeof(Vertex);
+        bindings[0].inputRate = vk::VertexInputRate::eVertex;
+
+        return bindings;
+    }
+
+    static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions()
+    {
+        std::vector<vk::VertexInputAttributeDescription> attrs(3);
+        // pos
+        attrs[0].binding = 0;
+        attrs[0].location = 0;
+        attrs[0].format = vk::Format::eR32G32B32Sfloat;
+        attrs[0].offset = offsetof(Vertex, pos);
+        // norm
+        attrs[1].binding = 0;
+        attrs[1].location = 1;
+        attrs[1].format = vk::Format::eR32G32B32Sfloat;
+        attrs[1].offset = offsetof(Vertex, norm);
+        // txtCoord
+        attrs[2].binding = 0;
+        attrs[2].location = 2;
+        attrs[2].format = vk::Format::eR32G32Sfloat;
+        attrs[2].offset = offsetof(Vertex, txtCoord);
+
+        return attrs;
+    }
+};
+
+/// An interleaved vertex with quantized attributes (16 bytes).  The attribute
+/// formats are chosen so that the vertex-input stage does the conversion to
+/// floats:
+///
+///   - the position is 16-bit fixed point relative to the group's bounding box,
+///     which is read as a `vec4` in [0..1] (the fourth component is always 1);
+///     the shader computes the position as `posBias + posScale * pos.xyz`.
+///   - the normal is octahedral encoded as two 16-bit signed normalized values,
+///     which is read as a `vec2` in [-1..1] and decoded in the shader (see
+///     `PackedGroup::norm` for the decoding).
+///   - the texture coordinate is a pair of half floats.
+struct PackedVertex {
+    uint16_t            pos[4];         ///< quantized position (pos[3] is 0xffff)
+    int16_t             norm[2];        ///< octahedral-encoded normal vector
+    uint16_t            txtCoord[2];    ///< half-float texture coordinate
+
+    static std::vector<vk::VertexInputBindingDescription> getBindingDescriptions()
+    {
+        std::vector<vk::VertexInputBindingDescription> bindings(1);
+        bindings[0].binding = 0;
+        bindings[0].stride = sizeof(PackedVertex);
+        bindings[0].inputRate = vk::VertexInputRate::eVertex;
+
+        return bindings;
+    }
+
+    static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions()
+    {
+        std::vector<vk::VertexInputAttributeDescription> attrs(3);
+        // pos
+        attrs[0].binding = 0;
+        attrs[0].location = 0;
+        attrs[0].format = vk::Format::eR16G16B16A16Unorm;
+        attrs[0].offset = offsetof(PackedVertex, pos);
+        // norm
+        attrs[1].binding = 0;
+        attrs[1].location = 1;
+        attrs[1].format = vk::Format::eR16G16Snorm;
+        attrs[1].offset = offsetof(PackedVertex, norm);
+        // txtCoord
+        attrs[2].binding = 0;
+        attrs[2].location = 2;
+        attrs[2].format = vk::Format::eR16G16Sfloat;
+        attrs[2].offset = offsetof(PackedVertex, txtCoord);
+
+        return attrs;
+    }
+};
+
+/// A group whose vertex data has been interleaved (and optionally quantized)
+/// into a single stream for uploading to a vertex buffer.  Exactly one of the
+/// `verts` and `packedVerts` vectors is non-empty, and exactly one of the
+/// `indices` and `indices16` vectors is non-empty.  Missing normals and texture
+/// coordinates are filled with zeros (a zero octahedral normal decodes to +Z),
+/// so that all groups have the same vertex layout.
+struct PackedGroup {
+    std::string         name;           ///< name of this group
+    int                 material;       ///< index to material for group (-1 for no material)
+    uint32_t            nVerts;         ///< the number of vertices in this group
+    uint32_t            nIndices;       ///< the number of indices (3 * number of triangles)
+    bool                hasNorms;       ///< does the source group have normals?
+    bool                hasTxtCoords;   ///< does the source group have texture coordinates?
+    glm::vec3           posScale;       ///< scale for decoding quantized positions
+    glm::vec3           posBias;        ///< bias for decoding quantized positions
+    std::vector<Vertex> verts;          ///< the vertices when not quantized
+    std::vector<PackedVertex> packedVerts; ///< the vertices when quantized
+    std::vector<uint32_t> indices;      ///< 32-bit indices (when nVerts > 65536)
+    std::vector<uint16_t> indices16;    ///< 16-bit indices (when nVerts <= 65536)
+    std::vector<LOD>    lods;           ///< the levels of detail, which are ranges of
+                                        ///  the index data
+
+    /// are the vertices quantized?
+    bool isQuantized () const { return !this->packedVerts.empty(); }
+
+    /// the size of a vertex in bytes
+    uint32_t vertexSize () const
+    {
+        return this->isQuantized() ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+    /// a pointer to the vertex data
+    const void *vertexData () const
+    {
+        return this->isQuantized()
+            ? static_cast<const void *>(this->packedVerts.data())
+            : static_cast<const void *>(this->verts.data());
+    }
+    /// the size of an index in bytes (2 or 4)
+    uint32_t indexSize () const { return this->indices16.empty() ? 4 : 2; }
+    /// a pointer to the index data
+    const void *indexData () const
+    {
+        return this->indices16.empty()
+            ? static_cast<const void *>(this->indices.data())
+            : static_cast<const void *>(this->indices16.data());
+    }
+    /// the Vulkan index type of the index data
+    vk::IndexType indexType () const
+    {
+        return this->indices16.empty() ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
+    }
+    /// the total size of the vertex and index data in bytes
+    size_t sizeInBytes () const
+    {
+        return size_t(this->nVerts) * this->vertexSize()
+            + (this->indices.size() + this->indices16.size()) * this->indexSize();
+    }
+
+    /// the decoded position of the i'th vertex
+    glm::vec3 pos (uint32_t i) const;
+    /// the decoded normal of the i'th vertex
+    glm::vec3 norm (uint32_t i) const;
+    /// the decoded texture coordinate of the i'th vertex
+    glm::vec2 txtCoord (uint32_t i) const;
+
+    /// the vertex-input binding descriptions for the group's vertex layout
+    std::vector<vk::VertexInputBindingDescription> getBindingDescriptions () const
+    {
+        return this->isQuantized()
+            ? PackedVertex::getBindingDescriptions()
+            : Vertex::getBindingDescriptions();
+    }
+    /// the vertex-input attribute descriptions for the group's vertex layout
+    std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions () const
+    {
+        return this->isQuantized()
+            ? PackedVertex::getAttributeDescriptions()
+            : Vertex::getAttributeDescriptions();
+    }
+}; // struct PackedGroup
+
+/// \brief interleave the vertex data of a group into a single stream
+/// \param g         the group
+/// \param quantize  if true, then the vertices are quantized to `PackedVertex`
+///                  (half the size of `Vertex`); otherwise they are `Vertex`
+/// \return the packed group; the indices are 16 bits wide when the group has at
+///         most 65536 vertices
+PackedGroup pack (Group const &g, bool quantize = true);
+
+/// the size of the FIFO post-transform vertex cache that the triangle order of
+/// groups is optimized for
+constexpr uint32_t kVertexCacheSize = 16;
+
+/// \brief the average cache miss ratio (ACMR) of a group, which is the average
+///        number of vertices per triangle that miss in a FIFO post-transform
+///        vertex cache.  It ranges from about 0.5 for a well-ordered regular mesh
+///        to 3 for a mesh with no vertex reuse.
+/// \param g          the group
+/// \param cacheSize  the number of entries in the simulated cache
+float acmr (Group const &g, uint32_t cacheSize = kVertexCacheSize);
+
 /// A model from an OBJ file
 class Model {
   public:
 
   /// create a Model by loading it from the specified OBJ file
   /// \param filename the path of the OBJ file to be loaded
-    Model (std::string filename);
+  /// \param optimize if true, then the triangles of each group are reordered for
+  ///                 the vertex cache and to reduce overdraw, the vertices
+  ///                 are reordered for fetch locality, and a chain of simplified
+  ///                 levels of detail is generated for each group
+  /// \param nThreads the number of threads used to build the groups of a large
+  ///                 model; 1 (the default) builds them on the calling thread and
+  ///                 0 means use all of the hardware threads
+    Model (std::string filename, bool optimize = true, unsigned int nThreads = 1);
     ~Model ();
 
+    Model (Model const &) = delete;
+    Model &operator= (Model const &) = delete;
+
+  /// \brief load a model, using its binary model file (see `binaryPath`) when
+  ///        that file is up to date with respect to the OBJ and MTL files.
+  /// \param filename     the path of the OBJ file
+  /// \param updateCache  if true, then a missing or stale binary file is
+  ///                     rewritten after the OBJ file is parsed
+  /// \param nThreads     the number of threads used to build the model when the
+  ///                     OBJ file is parsed (see the constructor)
+  /// \return the model; it is an error if the OBJ file cannot be read
+    static Model *load (
+        std::string const &filename,
+        bool updateCache = true,
+        unsigned int nThreads = 1);
+
+  /// \brief map a binary model file into memory.  The group and material data
+  ///        is used in place, so loading does no parsing.
+  /// \param binFile  the path of the binary model file
+  /// \param objFile  the path of the OBJ file that the binary file was made from
+  /// \return the model or nullptr if the file is not a valid binary model file
+    static Model *readBinary (std::string const &binFile, std::string const &objFile);
+
+  /// \brief write the model to a binary model file that is stamped with the
+  ///        current size and modification time of its OBJ and MTL files
+  /// \param binFile  the path of the binary model file
+  /// \return true if the file was written successfully
+    bool writeBinary (std::string const &binFile) const;
+
+  /// \brief is a binary model file up to date with respect to its OBJ file and
+  ///        that file's material library?
+    static bool isBinaryCurrent (std::string const &binFile, std::string const &objFile);
+
+  /// the name of the binary model file for an OBJ file
+    static std::string binaryPath (std::string const &objFile) { return objFile + ".bin"; }
+
+  /// the path of the OBJ file that this model came from
+    std::string const &path () const { return this->_path; }
+  /// the name of the material library for this model ("" if there is none)
+    std::string const &mtlLibName () const { return this->_mtlLibName; }
   /// the model's axis-aligned bounding box
     const cs237::AABBf_t &bounds () const { return this->_bbox; }
 
@@ -113,6 +377,11 @@ class Model {
 
     std::vector<OBJ::Material> _materials;
     std::vector<OBJ::Group> _groups;
+    cs237::__detail::MappedFile *_binary;  ///< the binary model file that holds the
+                                        ///  group data (nullptr if the model was
+                                        ///  loaded from an OBJ file)
+
+    Model () : _bbox(), _binary(nullptr) { }
 
   // read a material library
     bool readMaterial (std::string m);
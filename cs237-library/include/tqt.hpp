@@ -14,10 +14,26 @@
 #define _TQT_HPP_
 
 #include "cs237.hpp"
+#include <functional>
 #include <vector>
 
+namespace cs237 {
+    namespace __detail {
+        class MappedFile;
+    }
+}
+
 namespace tqt {
 
+/// The representation of the tiles in a version 2 TQT file.  The block-compressed
+/// formats use the same numbering as `bcn::Format`.
+enum class TileFormat : uint32_t {
+    RGBA8 = 0,      ///< uncompressed 8-bit RGBA pixels
+    BC1 = 1,        ///< BC1 compressed color
+    BC3 = 3,        ///< BC3 compressed color with alpha
+    BC5 = 5         ///< BC5 compressed two-channel data (e.g., normal-map XY)
+};
+
 /// Manages a disk-based texture-image quadtree and supports loading individual
 /// texture images at different levels and locations in the tree.
 class TextureQTree {
@@ -36,6 +52,14 @@ public:
     int depth() const { return this->_depth; }
     /// the size of a texture tile measured in pixels (tiles are always square)
     int tileSize() const { return this->_tileSize; }
+    /// the version of the file format.  Version 1 files represent the tiles as PNG
+    /// images, while the tiles of version 2 files are mipmap chains that can be
+    /// copied directly to the GPU.
+    int version () const { return this->_version; }
+    /// do the tiles include precomputed mipmap levels (i.e., is this a version 2 TQT)?
+    bool hasMipmaps () const { return this->_version >= 2; }
+    /// the format of the tiles in a version 2 TQT
+    TileFormat tileFormat () const { return this->_tileFmt; }
 
     /// \brief return the image tile at the specified quadtree node.
     /// \param[in] level the level of the node in the tree (root = 0)
@@ -44,25 +68,64 @@ public:
     /// \return a pointer to the image; nullptr is returned if there is
     ///         an error.  It is the caller's responsibility to manage the
     ///         image's storage.
+    ///
+    /// Tiles are always returned as RGBA images; single and two-channel tiles
+    /// (i.e., R and RG tiles in version 1 files and BC5 tiles in version 2 files)
+    /// are expanded with zero for the missing color channels and an opaque
+    /// alpha.  BC5 tiles hold non-color data, so they are never sRGB.
     cs237::Image2D *loadImage (int level, int row, int col);
 
+    /// \brief return the mipmap chain for the tile at the specified quadtree node.
+    /// \param[in] level the level of the node in the tree (root = 0)
+    /// \param[in] row the row of the node on its level (north == 0)
+    /// \param[in] col the column of the node on its level (west == 0)
+    /// \return a pointer to the image; nullptr is returned if there is
+    ///         an error.  It is the caller's responsibility to manage the
+    ///         image's storage.
+    ///
+    /// For version 1 files, the mipmap levels are computed on the CPU (after
+    /// expanding the tile to RGBA as for `loadImage`).
+    cs237::MipmapImage2D *loadMipmaps (int level, int row, int col);
+
     /// are the images sRGB?
     bool sRGB () const { return this->_sRGB; }
 
+    /// are the images flipped in the Y dimension (i.e., is the north edge at t == 1)?
+    bool flip () const { return this->_flip; }
+
     /// return true if the file looks like a TQT file of the right version
     static bool isTQTFile (std::string const &filename);
 
 private:
-    std::vector<std::streamoff> _toc;       ///< stream offsets for images
+    std::vector<uint64_t> _toc;             ///< file offsets for images
     int _depth;                             ///< the depth of the TQT
     int _tileSize;                          ///< the size of a texture tile in pixels
+    int _version;                           ///< the file-format version
+    TileFormat _tileFmt;                    ///< the tile format (version 2 only)
+    uint32_t _nLevels;                      ///< the number of mipmap levels per tile
+                                            ///  (version 2 only)
     bool _flip;                             ///< true if we are flipping the Y dimension
                                             ///  of the loaded images
     bool _sRGB;                             ///< true if we are loading sRGB images
-    std::ifstream *_source;                 ///< the source file for the textures
+    cs237::__detail::MappedFile *_source;   ///< the memory-mapped source file for
+                                            ///  the textures
 
 };  // class TextureQTree
 
+/// \brief write a version 2 TQT file, where each tile is a mipmap chain
+/// \param filename  the name of the output file
+/// \param depth     the depth of the tree
+/// \param tileSize  the size of the tiles in pixels (must be a power of 2)
+/// \param fmt       the format of the tiles
+/// \param getTile   a function that returns the mipmap chain for the tile at the
+///                  specified level, row, and column.  The chain must be a complete
+///                  chain with the size and format of the file; it is deleted once
+///                  it has been written.
+/// \return true if successful, false otherwise
+bool writeMipmapTQT (
+    std::string const &filename, int depth, int tileSize, TileFormat fmt,
+    std::function<cs237::MipmapImage2D *(int level, int row, int col)> const &getTile);
+
 } // namespace tqt
 
 #endif // !_TQT_HPP_
@@ -337,6 +337,9 @@ void Application::_createLogicalDevice ()
     vk::PhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.fillModeNonSolid = VK_TRUE;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // enable block-compressed textures when the device supports them; otherwise
+    // compressed textures are decoded on the CPU (see Texture2D).
+    deviceFeatures.textureCompressionBC = this->features()->textureCompressionBC;
 
     // initialize the create info
     vk::DeviceCreateInfo createInfo(
@@ -572,7 +575,7 @@ vk::Sampler Application::createSampler (Application::SamplerInfo const &info)
         VK_FALSE, /* compare enable */
         vk::CompareOp::eNever, /* compare op */
         0, /* min LOD */
-        0, /* max LOD */
+        VK_LOD_CLAMP_NONE, /* max LOD (i.e., use all of the texture's mipmap levels) */
         info.borderColor, /* borderColor */
         VK_FALSE); /* unnormalized coordinates */
 
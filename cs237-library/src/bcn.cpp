@@ -0,0 +1,457 @@
+/*! \file bcn.cpp
+ *
+ * Encoding and decoding of the BC1, BC3, and BC5 block-compressed formats.
+ *
+ * The encoder uses the extreme pixels of the block along the principal axis
+ * of its colors as the endpoints.  It is fast and gives reasonable quality, but
+ * a high-quality offline compressor will do better.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "bcn.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace bcn {
+
+std::string to_string (Format fmt)
+{
+    switch (fmt) {
+    case Format::BC1: return "BC1";
+    case Format::BC3: return "BC3";
+    case Format::BC5: return "BC5";
+    }
+    return "<unknown>";
+}
+
+namespace {
+
+/***** Utility functions *****/
+
+inline uint16_t load16 (const uint8_t *p)
+{
+    return uint16_t(p[0]) | (uint16_t(p[1]) << 8);
+}
+
+inline void store16 (uint8_t *p, uint16_t v)
+{
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+}
+
+inline uint32_t load32 (const uint8_t *p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline void store32 (uint8_t *p, uint32_t v)
+{
+    for (int i = 0;  i < 4;  ++i) {
+        p[i] = uint8_t(v >> (8*i));
+    }
+}
+
+inline uint64_t load48 (const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0;  i < 6;  ++i) {
+        v |= uint64_t(p[i]) << (8*i);
+    }
+    return v;
+}
+
+inline void store48 (uint8_t *p, uint64_t v)
+{
+    for (int i = 0;  i < 6;  ++i) {
+        p[i] = uint8_t(v >> (8*i));
+    }
+}
+
+// pack an 8-bit RGB color into 5:6:5 format
+inline uint16_t pack565 (const uint8_t *rgb)
+{
+    uint16_t r = (uint16_t(rgb[0]) * 31 + 127) / 255;
+    uint16_t g = (uint16_t(rgb[1]) * 63 + 127) / 255;
+    uint16_t b = (uint16_t(rgb[2]) * 31 + 127) / 255;
+    return (r << 11) | (g << 5) | b;
+}
+
+// expand a 5:6:5 color to 8-bit RGB
+inline void unpack565 (uint16_t c, int rgb[3])
+{
+    int r = (c >> 11) & 0x1f;
+    int g = (c >> 5) & 0x3f;
+    int b = c & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+/***** Color blocks *****/
+
+// compute the palette for a color block.  BC3 color blocks always use the
+// four-color mode, whereas BC1 blocks use the three-color mode (with transparent
+// black) when c0 <= c1.
+void colorPalette (uint16_t c0, uint16_t c1, bool fourColor, int pal[4][4])
+{
+    unpack565 (c0, pal[0]);
+    unpack565 (c1, pal[1]);
+    pal[0][3] = pal[1][3] = 255;
+    if (fourColor || (c0 > c1)) {
+        for (int k = 0;  k < 3;  ++k) {
+            pal[2][k] = (2*pal[0][k] + pal[1][k]) / 3;
+            pal[3][k] = (pal[0][k] + 2*pal[1][k]) / 3;
+        }
+        pal[2][3] = pal[3][3] = 255;
+    } else {
+        for (int k = 0;  k < 3;  ++k) {
+            pal[2][k] = (pal[0][k] + pal[1][k]) / 2;
+            pal[3][k] = 0;
+        }
+        pal[2][3] = 255;
+        pal[3][3] = 0;
+    }
+}
+
+// encode the RGB channels of a 4x4 block of RGBA pixels as an 8-byte color block
+void encodeColorBlock (const uint8_t px[16][4], uint8_t *blk)
+{
+    // compute the mean color
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0;  i < 16;  ++i) {
+        for (int k = 0;  k < 3;  ++k) {
+            mean[k] += float(px[i][k]);
+        }
+    }
+    for (int k = 0;  k < 3;  ++k) {
+        mean[k] *= (1.0f / 16.0f);
+    }
+
+    // compute the covariance matrix (xx, xy, xz, yy, yz, zz)
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0;  i < 16;  ++i) {
+        float r = float(px[i][0]) - mean[0];
+        float g = float(px[i][1]) - mean[1];
+        float b = float(px[i][2]) - mean[2];
+        cov[0] += r*r;  cov[1] += r*g;  cov[2] += r*b;
+        cov[3] += g*g;  cov[4] += g*b;  cov[5] += b*b;
+    }
+
+    // a few steps of power iteration give a good estimate of the principal axis
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iter = 0;  iter < 4;  ++iter) {
+        float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+        float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+        float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+        float m = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+        if (m <= 1e-6f) {
+            break;
+        }
+        axis[0] = x / m;  axis[1] = y / m;  axis[2] = z / m;
+    }
+
+    // find the extreme pixels along the axis
+    int minIdx = 0, maxIdx = 0;
+    float minD = 0.0f, maxD = 0.0f;
+    for (int i = 0;  i < 16;  ++i) {
+        float d = (float(px[i][0]) - mean[0]) * axis[0]
+            + (float(px[i][1]) - mean[1]) * axis[1]
+            + (float(px[i][2]) - mean[2]) * axis[2];
+        if ((i == 0) || (d < minD)) { minD = d;  minIdx = i; }
+        if ((i == 0) || (d > maxD)) { maxD = d;  maxIdx = i; }
+    }
+
+    uint16_t c0 = pack565 (px[maxIdx]);
+    uint16_t c1 = pack565 (px[minIdx]);
+    if (c0 < c1) {
+        std::swap (c0, c1);
+    }
+
+    // assign pixels to the nearest palette entry; note that when c0 == c1, all
+    // of the indices are 0.
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int pal[4][4];
+        colorPalette (c0, c1, true, pal);
+        for (int i = 0;  i < 16;  ++i) {
+            int best = 0;
+            int bestErr = 0;
+            for (int j = 0;  j < 4;  ++j) {
+                int dr = int(px[i][0]) - pal[j][0];
+                int dg = int(px[i][1]) - pal[j][1];
+                int db = int(px[i][2]) - pal[j][2];
+                int err = dr*dr + dg*dg + db*db;
+                if ((j == 0) || (err < bestErr)) {
+                    best = j;
+                    bestErr = err;
+                }
+            }
+            indices |= uint32_t(best) << (2*i);
+        }
+    }
+
+    store16 (blk, c0);
+    store16 (blk+2, c1);
+    store32 (blk+4, indices);
+}
+
+// decode an 8-byte color block into a 4x4 block of RGBA pixels
+void decodeColorBlock (const uint8_t *blk, bool fourColor, uint8_t px[16][4])
+{
+    int pal[4][4];
+    colorPalette (load16(blk), load16(blk+2), fourColor, pal);
+    uint32_t indices = load32(blk+4);
+    for (int i = 0;  i < 16;  ++i) {
+        int j = (indices >> (2*i)) & 3;
+        for (int k = 0;  k < 4;  ++k) {
+            px[i][k] = uint8_t(pal[j][k]);
+        }
+    }
+}
+
+/***** Single-channel (aka BC4) blocks *****/
+
+// compute the palette for a single-channel block
+void channelPalette (int a0, int a1, int pal[8])
+{
+    pal[0] = a0;
+    pal[1] = a1;
+    if (a0 > a1) {
+        for (int k = 1;  k < 7;  ++k) {
+            pal[k+1] = ((7-k)*a0 + k*a1) / 7;
+        }
+    } else {
+        for (int k = 1;  k < 5;  ++k) {
+            pal[k+1] = ((5-k)*a0 + k*a1) / 5;
+        }
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+}
+
+// encode 16 channel values as an 8-byte block
+void encodeChannelBlock (const uint8_t v[16], uint8_t *blk)
+{
+    int a0 = v[0], a1 = v[0];
+    for (int i = 1;  i < 16;  ++i) {
+        a0 = std::max(a0, int(v[i]));
+        a1 = std::min(a1, int(v[i]));
+    }
+
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        int pal[8];
+        channelPalette (a0, a1, pal);
+        for (int i = 0;  i < 16;  ++i) {
+            int best = 0;
+            int bestErr = 256;
+            for (int j = 0;  j < 8;  ++j) {
+                int err = std::abs(int(v[i]) - pal[j]);
+                if (err < bestErr) {
+                    best = j;
+                    bestErr = err;
+                }
+            }
+            indices |= uint64_t(best) << (3*i);
+        }
+    }
+
+    blk[0] = uint8_t(a0);
+    blk[1] = uint8_t(a1);
+    store48 (blk+2, indices);
+}
+
+// decode an 8-byte single-channel block
+void decodeChannelBlock (const uint8_t *blk, uint8_t v[16])
+{
+    int pal[8];
+    channelPalette (blk[0], blk[1], pal);
+    uint64_t indices = load48(blk+2);
+    for (int i = 0;  i < 16;  ++i) {
+        v[i] = uint8_t(pal[(indices >> (3*i)) & 7]);
+    }
+}
+
+/***** Blocks *****/
+
+// copy the 4x4 block of RGBA pixels with the upper-left corner at (x, y) from the
+// source image.  Pixels that lie outside the image are clamped to the edge.
+void gatherBlock (
+    uint32_t wid, uint32_t ht, const uint8_t *rgba,
+    uint32_t x, uint32_t y,
+    uint8_t px[16][4])
+{
+    for (uint32_t r = 0;  r < 4;  ++r) {
+        uint32_t yy = std::min(y + r, ht - 1);
+        for (uint32_t c = 0;  c < 4;  ++c) {
+            uint32_t xx = std::min(x + c, wid - 1);
+            std::memcpy (px[4*r + c], rgba + 4 * (size_t(yy) * wid + xx), 4);
+        }
+    }
+}
+
+void encodeBlock (Format fmt, const uint8_t px[16][4], uint8_t *blk)
+{
+    switch (fmt) {
+    case Format::BC1:
+        encodeColorBlock (px, blk);
+        break;
+    case Format::BC3: {
+            uint8_t alpha[16];
+            for (int i = 0;  i < 16;  ++i) {
+                alpha[i] = px[i][3];
+            }
+            encodeChannelBlock (alpha, blk);
+            encodeColorBlock (px, blk+8);
+        } break;
+    case Format::BC5: {
+            uint8_t red[16], green[16];
+            for (int i = 0;  i < 16;  ++i) {
+                red[i] = px[i][0];
+                green[i] = px[i][1];
+            }
+            encodeChannelBlock (red, blk);
+            encodeChannelBlock (green, blk+8);
+        } break;
+    }
+}
+
+// decode a block into a 4x4 block of pixels with decodedChannels(fmt) channels
+void decodeBlock (Format fmt, const uint8_t *blk, uint8_t px[16][4])
+{
+    switch (fmt) {
+    case Format::BC1:
+        decodeColorBlock (blk, false, px);
+        break;
+    case Format::BC3: {
+            uint8_t alpha[16];
+            decodeColorBlock (blk+8, true, px);
+            decodeChannelBlock (blk, alpha);
+            for (int i = 0;  i < 16;  ++i) {
+                px[i][3] = alpha[i];
+            }
+        } break;
+    case Format::BC5: {
+            uint8_t red[16], green[16];
+            decodeChannelBlock (blk, red);
+            decodeChannelBlock (blk+8, green);
+            for (int i = 0;  i < 16;  ++i) {
+                px[i][0] = red[i];
+                px[i][1] = green[i];
+            }
+        } break;
+    }
+}
+
+// reverse the order of the first nRows rows of a color block
+void flipColorRows (uint8_t *blk, uint32_t nRows)
+{
+    // each byte of the index word holds one row of 2-bit indices
+    std::reverse (blk + 4, blk + 4 + nRows);
+}
+
+// reverse the order of the first nRows rows of a single-channel block
+void flipChannelRows (uint8_t *blk, uint32_t nRows)
+{
+    // each row is represented by 12 bits of the 48-bit index word
+    uint64_t indices = load48(blk+2);
+    uint64_t flipped = indices;
+    for (uint32_t r = 0;  r < nRows;  ++r) {
+        uint64_t row = (indices >> (12*r)) & 0xfff;
+        uint32_t shift = 12 * (nRows - 1 - r);
+        flipped = (flipped & ~(uint64_t(0xfff) << shift)) | (row << shift);
+    }
+    store48 (blk+2, flipped);
+}
+
+void flipBlock (Format fmt, uint8_t *blk, uint32_t nRows)
+{
+    switch (fmt) {
+    case Format::BC1:
+        flipColorRows (blk, nRows);
+        break;
+    case Format::BC3:
+        flipChannelRows (blk, nRows);
+        flipColorRows (blk+8, nRows);
+        break;
+    case Format::BC5:
+        flipChannelRows (blk, nRows);
+        flipChannelRows (blk+8, nRows);
+        break;
+    }
+}
+
+} // anonymous namespace
+
+void encodeImage (Format fmt, uint32_t wid, uint32_t ht, const uint8_t *rgba, uint8_t *dst)
+{
+    size_t blkSz = blockSize(fmt);
+    uint8_t px[16][4];
+    for (uint32_t y = 0;  y < ht;  y += 4) {
+        for (uint32_t x = 0;  x < wid;  x += 4) {
+            gatherBlock (wid, ht, rgba, x, y, px);
+            encodeBlock (fmt, px, dst);
+            dst += blkSz;
+        }
+    }
+}
+
+void decodeImage (Format fmt, uint32_t wid, uint32_t ht, const uint8_t *src, uint8_t *dst)
+{
+    size_t blkSz = blockSize(fmt);
+    uint32_t nChans = decodedChannels(fmt);
+    uint8_t px[16][4];
+    for (uint32_t y = 0;  y < ht;  y += 4) {
+        for (uint32_t x = 0;  x < wid;  x += 4) {
+            decodeBlock (fmt, src, px);
+            src += blkSz;
+            // copy the pixels that lie inside the image to the destination
+            uint32_t nRows = std::min(4u, ht - y);
+            uint32_t nCols = std::min(4u, wid - x);
+            for (uint32_t r = 0;  r < nRows;  ++r) {
+                uint8_t *out = dst + nChans * (size_t(y + r) * wid + x);
+                for (uint32_t c = 0;  c < nCols;  ++c) {
+                    std::memcpy (out + nChans * c, px[4*r + c], nChans);
+                }
+            }
+        }
+    }
+}
+
+void flipImage (Format fmt, uint32_t wid, uint32_t ht, uint8_t *data)
+{
+    assert ((ht < 4) || ((ht & 3) == 0));
+
+    size_t blkSz = blockSize(fmt);
+    uint32_t nBlkCols = (wid + 3) >> 2;
+    uint32_t nBlkRows = (ht + 3) >> 2;
+    uint32_t nRows = std::min(4u, ht);
+    size_t rowBytes = nBlkCols * blkSz;
+
+    // first flip the rows inside each block
+    uint8_t *blk = data;
+    for (uint32_t i = 0;  i < nBlkCols * nBlkRows;  ++i, blk += blkSz) {
+        flipBlock (fmt, blk, nRows);
+    }
+
+    // then reverse the order of the rows of blocks
+    std::vector<uint8_t> tmp(rowBytes);
+    for (uint32_t r = 0;  r < nBlkRows / 2;  ++r) {
+        uint8_t *top = data + r * rowBytes;
+        uint8_t *bot = data + (nBlkRows - 1 - r) * rowBytes;
+        std::memcpy (tmp.data(), top, rowBytes);
+        std::memcpy (top, bot, rowBytes);
+        std::memcpy (bot, tmp.data(), rowBytes);
+    }
+}
+
+} // namespace bcn
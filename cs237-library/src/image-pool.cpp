@@ -0,0 +1,157 @@
+/*! \file image-pool.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * A size-class pool of pixel buffers.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include <mutex>
+
+namespace cs237 {
+
+//! the log2 of the smallest size class; smaller requests are rounded up to it
+constexpr uint32_t kMinLog2 = 12;
+//! the log2 of the largest pooled size; larger buffers bypass the pool
+constexpr uint32_t kMaxLog2 = 30;
+//! the number of size classes per power of two
+constexpr uint32_t kSubClasses = 4;
+//! the total number of size classes
+constexpr uint32_t kNumClasses = (kMaxLog2 - kMinLog2) * kSubClasses + 1;
+
+//! the state of the pool
+struct Pool {
+    std::mutex lock;                            //!< protects the rest of the state
+    std::vector<void *> free[kNumClasses];      //!< free buffers by size class
+    size_t capacity = 64 * 1024 * 1024;         //!< the limit on retained bytes
+    size_t retained = 0;                        //!< the number of retained bytes
+};
+
+static Pool &thePool ()
+{
+    static Pool pool;
+    return pool;
+}
+
+// floor(log2(n)) for n > 0
+inline uint32_t floorLog2 (size_t n)
+{
+    uint32_t k = 0;
+    while (n >>= 1) {
+        k++;
+    }
+    return k;
+}
+
+//! map a request size to its size class and the size of the buffers in the class
+//! \return the class index, or kNumClasses if the size is too large to pool
+static uint32_t sizeClass (size_t nBytes, size_t &clsSize)
+{
+    if (nBytes <= (size_t(1) << kMinLog2)) {
+        clsSize = size_t(1) << kMinLog2;
+        return 0;
+    }
+    // nBytes is in (2^k, 2^(k+1)], which is divided into kSubClasses steps
+    uint32_t k = floorLog2(nBytes - 1);
+    if (k >= kMaxLog2) {
+        clsSize = nBytes;
+        return kNumClasses;
+    }
+    size_t step = size_t(1) << (k - 2);
+    size_t nSteps = (nBytes + step - 1) / step;     // in 5..8
+    clsSize = nSteps * step;
+    return (k - kMinLog2) * kSubClasses + uint32_t(nSteps - kSubClasses);
+}
+
+//! the size of the buffers in a size class
+static size_t classSize (uint32_t cls)
+{
+    if (cls == 0) {
+        return size_t(1) << kMinLog2;
+    }
+    uint32_t k = (cls - 1) / kSubClasses + kMinLog2;
+    size_t nSteps = (cls - 1) % kSubClasses + kSubClasses + 1;
+    return nSteps << (k - 2);
+}
+
+void *ImageBufferPool::alloc (size_t nBytes)
+{
+    size_t clsSize;
+    uint32_t cls = sizeClass (nBytes, clsSize);
+    if (cls < kNumClasses) {
+        Pool &pool = thePool();
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (! pool.free[cls].empty()) {
+            void *buf = pool.free[cls].back();
+            pool.free[cls].pop_back();
+            pool.retained -= clsSize;
+            return buf;
+        }
+    }
+    return std::malloc (clsSize);
+}
+
+void ImageBufferPool::release (void *buf, size_t nBytes)
+{
+    if (buf == nullptr) {
+        return;
+    }
+    size_t clsSize;
+    uint32_t cls = sizeClass (nBytes, clsSize);
+    if (cls < kNumClasses) {
+        Pool &pool = thePool();
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (pool.retained + clsSize <= pool.capacity) {
+            pool.free[cls].push_back (buf);
+            pool.retained += clsSize;
+            return;
+        }
+    }
+    std::free (buf);
+}
+
+void ImageBufferPool::setCapacity (size_t nBytes)
+{
+    Pool &pool = thePool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    pool.capacity = nBytes;
+    // release buffers, starting with the largest, until we are under the limit
+    for (int cls = kNumClasses - 1;  (cls >= 0) && (pool.retained > pool.capacity);  --cls) {
+        size_t clsSize = classSize(cls);
+        auto &bufs = pool.free[cls];
+        while (!bufs.empty() && (pool.retained > pool.capacity)) {
+            std::free (bufs.back());
+            bufs.pop_back();
+            pool.retained -= clsSize;
+        }
+    }
+}
+
+void ImageBufferPool::purge ()
+{
+    Pool &pool = thePool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    for (auto &bufs : pool.free) {
+        for (auto buf : bufs) {
+            std::free (buf);
+        }
+        bufs.clear();
+    }
+    pool.retained = 0;
+}
+
+size_t ImageBufferPool::nBytesRetained ()
+{
+    Pool &pool = thePool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    return pool.retained;
+}
+
+} /* namespace cs237 */
@@ -13,6 +13,9 @@
  */
 
 #include "cs237.hpp"
+#include "mapped-file.hpp"
+#include "pixel-ops.hpp"
+#include "png-encode.hpp"
 #include "png.h"
 #include <fstream>
 
@@ -68,35 +71,48 @@ static void readData (png_struct *pngPtr, png_bytep data, png_size_t length)
     }
 }
 
-//! \brief helper function to read a PNG image from an input stream
-//! \param inS the input stream
-//! \param flip true if the rows of the image should be flipped to match OpenGL coordinates
-//! \param widOut output variable for the image width
-//! \param htOut output variable for the image height (nullptr for 1D images)
-//! \param fmtOut output variable for the channel format
-//! \param tyOut output variable for the channel representation type
-//! \param sRGBOut output variable set to true if the image should be interpreted as sRGB
-//! \return a pointer to the image data, or nullptr on error
-void *readPNG (
-    std::ifstream &inS, bool flip, uint32_t *widOut, uint32_t *htOut,
-    Channels *fmtOut, ChannelTy *tyOut, bool *sRGBOut)
+//! the source of bytes for decoding a PNG image held in memory
+struct MemSource {
+    const uint8_t *data;        //!< the encoded image
+    size_t len;                 //!< the length of the encoded image
+    size_t pos;                 //!< the current read position
+};
+
+//! \brief read function for PNG images held in memory
+static void readMemData (png_struct *pngPtr, png_bytep data, png_size_t length)
 {
-  /* check PNG signature */
-    unsigned char sig[8];
-    inS.read (reinterpret_cast<char *>(sig), sizeof(sig));
-    if (! inS.good()) {
-#ifndef NDEBUG
-        std::cerr << "readPNG: I/O error reading header" << std::endl;
-#endif
-        return nullptr;
-    }
-    if (png_sig_cmp(sig, 0, 8)) {
-#ifndef NDEBUG
-        std::cerr << "readPNG: bogus header" << std::endl;
+    MemSource *src = reinterpret_cast<MemSource *>(png_get_io_ptr(pngPtr));
+    if (src->len - src->pos < length) {
+#if ((PNG_LIBPNG_VER_MAJOR == 1) && (PNG_LIBPNG_VER_MINOR < 5))
+        longjmp(pngPtr->jmpbuf, 1);
+#else
+        png_longjmp (pngPtr, 1);
 #endif
-        return nullptr;
     }
+    std::memcpy (data, src->data + src->pos, length);
+    src->pos += length;
+}
 
+//! \brief helper function to decode a PNG image.  The caller is responsible for
+//! checking the 8-byte signature, which must have already been consumed from the
+//! input.
+//! \param readFn the function used to read the input
+//! \param ioPtr the source of the input (passed to readFn)
+//! \param flip true if the rows of the image should be flipped to match OpenGL coordinates
+//! \param[out] info the properties of the decoded image
+//! \param buf optional output buffer for the pixels
+//! \param bufSz the size of buf in bytes
+//! \param headerOnly when true, only the info is computed
+//! \return a pointer to the image data, which is `buf` when it is non-null and large
+//!         enough, or else freshly malloc'd storage.  nullptr is returned on error or
+//!         when `headerOnly` is true.
+//!
+//! RGB images are expanded to RGBA as they are decoded, because Vulkan prefers
+//! 4-channel images.
+static void *pngDecode (
+    png_rw_ptr readFn, void *ioPtr, bool flip, PNGInfo &info,
+    void *buf, size_t bufSz, bool headerOnly)
+{
   /* setup read structures */
     png_structp pngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
     if (pngPtr == nullptr) {
@@ -113,32 +129,33 @@ void *readPNG (
         png_destroy_read_struct(&pngPtr, nullptr, nullptr);
         return nullptr;
     }
-    png_infop endPtr = png_create_info_struct(pngPtr);
-    if (!endPtr) {
-#ifndef NDEBUG
-        std::cerr << "readPNG: error creating info_struct" << std::endl;
-#endif
-        png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
-        return nullptr;
-    }
+
+  /* the image storage; this variable is volatile, since it is modified between
+   * the setjmp and a possible longjmp
+   */
+    png_byte * volatile img = nullptr;
+    volatile bool ownsImg = false;
 
   /* error handler */
     if (setjmp (png_jmpbuf(pngPtr))) {
 #ifndef NDEBUG
         std::cerr << "readPNG: I/O error" << std::endl;
 #endif
-        png_destroy_read_struct (&pngPtr, &infoPtr, &endPtr);
+        png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
+        if (ownsImg) {
+            std::free (img);
+        }
         return nullptr;
     }
 
   /* set up input */
-    png_set_read_fn (pngPtr, reinterpret_cast<void *>(&inS), readData);
+    png_set_read_fn (pngPtr, ioPtr, readFn);
 
   /* let the PNG library know that we already checked the signature */
     png_set_sig_bytes (pngPtr, 8);
 
   /* get file info */
-    png_uint_32 width, height, bytesPerPixel;
+    png_uint_32 width, height;
     int bitDepth, colorType;
     png_read_info (pngPtr, infoPtr);
     png_get_IHDR (pngPtr, infoPtr, &width, &height,
@@ -146,64 +163,32 @@ void *readPNG (
         0 /* compression type */, 0 /* filter method */);
 
     Channels fmt;
-    ChannelTy ty;
+    ChannelTy ty = ChannelTy::U8;
     bool sRGB = false;
     switch (colorType) {
       case PNG_COLOR_TYPE_GRAY:
         fmt = Channels::R;
-        ty = ChannelTy::U8;
-        bytesPerPixel = 1;
         if (bitDepth < 8) {
             png_set_expand_gray_1_2_4_to_8(pngPtr);
         }
-        else if (bitDepth == 16) {
-          // PNG files store date in network byte order (big-endian), but the x86 is little-endian
-            png_set_swap (pngPtr);
-            ty = ChannelTy::U16;
-            bytesPerPixel = 2;
-        }
         break;
       case PNG_COLOR_TYPE_GRAY_ALPHA:
         fmt = Channels::RG;
-        ty = ChannelTy::U8;
-        bytesPerPixel = 2;
-        if (bitDepth == 16) {
-          // PNG files store date in network byte order (big-endian), but the x86 is little-endian
-            png_set_swap (pngPtr);
-            bytesPerPixel = 4;
-            ty = ChannelTy::U16;
-        }
         break;
       case PNG_COLOR_TYPE_PALETTE:
-        fmt = Channels::RGB;
-        ty = ChannelTy::U8;
-        bytesPerPixel = 3;
+        fmt = Channels::RGBA;
         png_set_palette_to_rgb (pngPtr);
+        png_set_add_alpha (pngPtr, 0xffff, PNG_FILLER_AFTER);
         break;
       case PNG_COLOR_TYPE_RGB:
-        fmt = Channels::RGB;
-        ty = ChannelTy::U8;
-        bytesPerPixel = 3;
-        if (bitDepth == 16) {
-          // PNG files store data in network byte order (big-endian), but the x86 is little-endian
-            png_set_swap (pngPtr);
-            bytesPerPixel = 6;
-            ty = ChannelTy::U16;
-        }
+        fmt = Channels::RGBA;
+        png_set_add_alpha (pngPtr, 0xffff, PNG_FILLER_AFTER);
         // assume that any 3-channel color image is sRGB, since figuring this out from the
         // PNG file does not seem reliable
         sRGB = true;
         break;
       case PNG_COLOR_TYPE_RGB_ALPHA:
         fmt = Channels::RGBA;
-        ty = ChannelTy::U8;
-        bytesPerPixel = 4;
-        if (bitDepth == 16) {
-          // PNG files store data in network byte order (big-endian), but the x86 is little-endian
-            png_set_swap (pngPtr);
-            bytesPerPixel = 8;
-            ty = ChannelTy::U16;
-        }
         // assume that any 3-channel color image is sRGB, since figuring this out from the
         // PNG file does not seem reliable
         sRGB = true;
@@ -212,60 +197,169 @@ void *readPNG (
 #ifndef NDEBUG
         std::cerr << "unknown color type " << colorType << std::endl;
 #endif
-        png_destroy_read_struct (&pngPtr, &infoPtr, (png_infopp)0);
+        png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
         return nullptr;
     }
+    if (bitDepth == 16) {
+      // PNG files store data in network byte order (big-endian), but the x86 is little-endian
+        png_set_swap (pngPtr);
+        ty = ChannelTy::U16;
+    }
 
   /* sanity check the image dimensions: max size is 20k x 20k */
     if ((20*1024 < width) || (20*1024 < height)) {
 #ifndef NDEBUG
         std::cerr << "readPNG: image too large" << std::endl;
 #endif
+        png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
         return nullptr;
     }
 
-  /* allocate image data */
-    int bytesPerRow = bytesPerPixel * width;
-    png_byte *img = (png_bytep) std::malloc (height * bytesPerRow);
-    if (img == nullptr) {
-#ifndef NDEBUG
-        std::cerr << "readPNG: unable to allocate image" << std::endl;
-#endif
-        png_destroy_read_struct (&pngPtr, &infoPtr, &endPtr);
+  /* apply the transformations and get the size of the decoded rows */
+    int nPasses = png_set_interlace_handling (pngPtr);
+    png_read_update_info (pngPtr, infoPtr);
+    size_t bytesPerRow = png_get_rowbytes (pngPtr, infoPtr);
+
+    info.wid = width;
+    info.ht = height;
+    info.chans = fmt;
+    info.type = ty;
+    info.sRGB = sRGB;
+    info.nBytes = bytesPerRow * height;
+
+    if (headerOnly) {
+        png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
         return nullptr;
     }
 
-    png_bytepp rowPtrs = new png_bytep[height];
-    if (flip) {
-      /* setup row pointers so that the texture has OpenGL orientation */
-        for (png_uint_32 i = 1;  i <= height;  i++)
-            rowPtrs[height - i] = img + (i-1)*bytesPerRow;
+  /* allocate image data, unless the caller has provided a large enough buffer */
+    if ((buf != nullptr) && (info.nBytes <= bufSz)) {
+        img = static_cast<png_bytep>(buf);
     }
     else {
-        for (png_uint_32 i = 0;  i < height;  i++)
-            rowPtrs[i] = img + i*bytesPerRow;
+        img = static_cast<png_bytep>(std::malloc (info.nBytes));
+        if (img == nullptr) {
+#ifndef NDEBUG
+            std::cerr << "readPNG: unable to allocate image" << std::endl;
+#endif
+            png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
+            return nullptr;
+        }
+        ownsImg = true;
     }
 
-  /* read the image */
-    png_read_image(pngPtr, rowPtrs);
+  /* read the image one row at a time; when flipping, the rows are stored bottom-up
+   * so that the texture has OpenGL orientation
+   */
+    for (int pass = 0;  pass < nPasses;  pass++) {
+        for (png_uint_32 i = 0;  i < height;  i++) {
+            png_uint_32 r = flip ? (height - 1 - i) : i;
+            png_read_row (pngPtr, img + r * bytesPerRow, nullptr);
+        }
+    }
 
   /* Clean up. */
-    png_destroy_read_struct (&pngPtr, &infoPtr, &endPtr);
-    delete[] rowPtrs;
+    png_destroy_read_struct (&pngPtr, &infoPtr, nullptr);
+
+    return img;
+
+} /* pngDecode */
+
+//! \brief check the PNG signature of an image held in memory
+static bool checkSig (const uint8_t *data, size_t len)
+{
+    if ((len < 8) || png_sig_cmp(const_cast<png_bytep>(data), 0, 8)) {
+#ifndef NDEBUG
+        std::cerr << "readPNG: bogus header" << std::endl;
+#endif
+        return false;
+    }
+    return true;
+}
 
-    if ((htOut == nullptr) && (height > 1)) {
-        width *= height;
+//! The PNG decoder implemented using libpng
+class LibPNGDecoder : public ImageDecoder {
+  public:
+    const char *name () const override { return "libpng"; }
+
+    bool readInfo (const uint8_t *data, size_t len, PNGInfo &info) override
+    {
+        info.chans = Channels::UNKNOWN;
+        if (! checkSig (data, len)) {
+            return false;
+        }
+        MemSource src{data, len, 8};
+        pngDecode (readMemData, &src, false, info, nullptr, 0, true);
+        return (info.chans != Channels::UNKNOWN);
     }
 
-    *widOut = width;
-    if (htOut != nullptr) *htOut = height;
-    *fmtOut = fmt;
-    *tyOut = ty;
-    if (sRGBOut != nullptr) {
-        *sRGBOut = sRGB;
+    void *decode (
+        const uint8_t *data, size_t len, bool flip, PNGInfo &info,
+        void *buf, size_t bufSz) override
+    {
+        if (! checkSig (data, len)) {
+            return nullptr;
+        }
+        MemSource src{data, len, 8};
+        return pngDecode (readMemData, &src, flip, info, buf, bufSz, false);
     }
+};
 
-    return img;
+//! the decoder selected by `ImageDecoder::setCurrent` (nullptr for the default)
+static ImageDecoder *currentDecoder = nullptr;
+
+ImageDecoder *ImageDecoder::current ()
+{
+    if (currentDecoder == nullptr) {
+        ImageDecoder *dec = ImageDecoder::spng();
+        currentDecoder = (dec != nullptr) ? dec : ImageDecoder::libpng();
+    }
+    return currentDecoder;
+}
+
+void ImageDecoder::setCurrent (ImageDecoder *decoder)
+{
+    currentDecoder = decoder;
+}
+
+ImageDecoder *ImageDecoder::libpng ()
+{
+    static LibPNGDecoder decoder;
+    return &decoder;
+}
+
+bool readPNGInfo (const uint8_t *data, size_t len, PNGInfo &info)
+{
+    return ImageDecoder::current()->readInfo (data, len, info);
+}
+
+void *decodePNG (
+    const uint8_t *data, size_t len, bool flip, PNGInfo &info, void *buf, size_t bufSz)
+{
+    return ImageDecoder::current()->decode (data, len, flip, info, buf, bufSz);
+}
+
+//! \brief helper function to read a PNG image from an input stream
+//! \param inS the input stream
+//! \param flip true if the rows of the image should be flipped to match OpenGL coordinates
+//! \param[out] info the properties of the decoded image
+//! \return a pointer to the image data, or nullptr on error
+static void *readPNG (std::ifstream &inS, bool flip, PNGInfo &info)
+{
+  /* check PNG signature */
+    unsigned char sig[8];
+    inS.read (reinterpret_cast<char *>(sig), sizeof(sig));
+    if (! inS.good()) {
+#ifndef NDEBUG
+        std::cerr << "readPNG: I/O error reading header" << std::endl;
+#endif
+        return nullptr;
+    }
+    if (! checkSig (sig, sizeof(sig))) {
+        return nullptr;
+    }
+
+    return pngDecode (readData, reinterpret_cast<void *>(&inS), flip, info, nullptr, 0, false);
 
 } /* readPNG */
 
@@ -481,17 +575,87 @@ vk::Format toVkFormat (Channels chans, ChannelTy ty, bool isRGB)
 /***** virtual base class __detail::ImageBase member functions *****/
 
 ImageBase::ImageBase (uint32_t nd, Channels chans, ChannelTy ty, size_t npixels)
-  : _nDims(nd), _chans(chans), _type(ty),
+  : _nDims(nd), _chans(chans), _type(ty), _sRGB(false), _ownsData(true), _pooled(true),
     _nBytes(numChannels(chans) * npixels * sizeOfType(ty))
 {
-    this->_data = std::malloc(this->_nBytes);
+    this->_data = ImageBufferPool::alloc(this->_nBytes);
+}
+
+ImageBase::ImageBase (uint32_t nd, Channels chans, ChannelTy ty, size_t npixels, void *data)
+  : _nDims(nd), _chans(chans), _type(ty), _sRGB(false), _ownsData(false), _pooled(false),
+    _nBytes(numChannels(chans) * npixels * sizeOfType(ty)), _data(data)
+{ }
+
+ImageBase::ImageBase (ImageBase &&img)
+  : _nDims(img._nDims), _chans(img._chans), _type(img._type), _sRGB(img._sRGB),
+    _ownsData(img._ownsData), _pooled(img._pooled), _nBytes(img._nBytes), _data(img._data)
+{
+    img._ownsData = false;
+    img._nBytes = 0;
+    img._data = nullptr;
+}
+
+ImageBase &ImageBase::operator= (ImageBase &&img)
+{
+    if (this != &img) {
+        this->_freeData();
+        this->_nDims = img._nDims;
+        this->_chans = img._chans;
+        this->_type = img._type;
+        this->_sRGB = img._sRGB;
+        this->_ownsData = img._ownsData;
+        this->_pooled = img._pooled;
+        this->_nBytes = img._nBytes;
+        this->_data = img._data;
+        img._ownsData = false;
+        img._nBytes = 0;
+        img._data = nullptr;
+    }
+    return *this;
 }
 
 ImageBase::~ImageBase ()
 {
-    if (this->_data != nullptr) {
-        std::free(this->_data);
+    this->_freeData();
+}
+
+void ImageBase::_freeData ()
+{
+    if (this->_ownsData && (this->_data != nullptr)) {
+        if (this->_pooled) {
+            ImageBufferPool::release (this->_data, this->_nBytes);
+        } else {
+            std::free(this->_data);
+        }
+    }
+    this->_data = nullptr;
+}
+
+bool ImageBase::_decode (
+    const uint8_t *data, size_t len, bool flip, PNGInfo &info,
+    void *buf, size_t bufSz)
+{
+    bool pooled = false;
+    if ((buf == nullptr) && readPNGInfo (data, len, info)) {
+        // decode into a buffer from the pool
+        bufSz = info.nBytes;
+        buf = ImageBufferPool::alloc (bufSz);
+        pooled = true;
+    }
+    void *img = decodePNG (data, len, flip, info, buf, bufSz);
+    if (pooled && (img != buf)) {
+        ImageBufferPool::release (buf, bufSz);
+        pooled = false;
     }
+    if (img == nullptr) {
+        return false;
+    }
+    // the image does not own a caller-provided buffer
+    this->_data = img;
+    this->_ownsData = pooled || (img != buf);
+    this->_pooled = pooled;
+    this->_nBytes = info.nBytes;
+    return true;
 }
 
 unsigned int ImageBase::nChannels () const
@@ -506,55 +670,65 @@ size_t ImageBase::nBytesPerPixel () const
 
 void ImageBase::addAlphaChannel ()
 {
+    Channels newChans;
     if (this->_chans == Channels::RGB) {
-        this->_chans = Channels::RGBA;
+        newChans = Channels::RGBA;
     }
-    else if (this->_chans != Channels::BGR) {
-        this->_chans = Channels::BGRA;
+    else if (this->_chans == Channels::BGR) {
+        newChans = Channels::BGRA;
     }
     else {
         return;
     }
 
+    size_t nPixels;
+    size_t newSz = (this->_nBytes / 3) * 4;
+    void *newImg = ImageBufferPool::alloc (newSz);
     switch (this->_type) {
-    case ChannelTy::U8: {
-            uint32_t nPixels = this->_nBytes / 3;
-            uint8_t *newImg = (uint8_t *) std::malloc (4 * nPixels);
-            uint8_t *dstP = newImg;
-            uint8_t *srcP = reinterpret_cast<uint8_t *>(this->_data);
-            for (int i = 0;  i < nPixels;  ++i) {
-                dstP[0] = srcP[0];
-                dstP[1] = srcP[1];
-                dstP[2] = srcP[2];
-                dstP[3] = 0xff;
-                dstP += 4;
-                srcP += 3;
-            }
-            std::free(this->_data);
-            this->_data = newImg;
-            this->_nBytes = 4 * nPixels;
-        } break;
-    case ChannelTy::U16: {
-            uint32_t nPixels = this->_nBytes / 6;
-            uint16_t *newImg = (uint16_t *) std::malloc (8 * nPixels);
-            uint16_t *dstP = newImg;
-            uint16_t *srcP = reinterpret_cast<uint16_t *>(this->_data);
-            for (int i = 0;  i < nPixels;  ++i) {
-                dstP[0] = srcP[0];
-                dstP[1] = srcP[1];
-                dstP[2] = srcP[2];
-                dstP[3] = 0xffff;
-                dstP += 4;
-                srcP += 3;
-            }
-            std::free(this->_data);
-            this->_data = newImg;
-            this->_nBytes = 8 * nPixels;
-        } break;
+    case ChannelTy::U8:
+        nPixels = this->_nBytes / 3;
+        expandRGB8 (
+            reinterpret_cast<const uint8_t *>(this->_data),
+            reinterpret_cast<uint8_t *>(newImg),
+            nPixels);
+        break;
+    case ChannelTy::U16:
+        nPixels = this->_nBytes / 6;
+        expandRGB16 (
+            reinterpret_cast<const uint16_t *>(this->_data),
+            reinterpret_cast<uint16_t *>(newImg),
+            nPixels);
+        break;
     default:
         ERROR ("unsupported channel type");
     }
 
+    this->_freeData();
+    this->_data = newImg;
+    this->_ownsData = true;
+    this->_pooled = true;
+    this->_nBytes = newSz;
+    this->_chans = newChans;
+
+}
+
+void ImageBase::swapRedBlue ()
+{
+    if (this->_type != ChannelTy::U8) {
+        return;
+    }
+
+    switch (this->_chans) {
+    case Channels::RGB: this->_chans = Channels::BGR; break;
+    case Channels::BGR: this->_chans = Channels::RGB; break;
+    case Channels::RGBA: this->_chans = Channels::BGRA; break;
+    case Channels::BGRA: this->_chans = Channels::RGBA; break;
+    default: return;
+    }
+
+    uint32_t nChans = numChannels (this->_chans);
+    swapRB8 (reinterpret_cast<uint8_t *>(this->_data), nChans, this->_nBytes / nChans);
+
 }
 
 } /* namespace __detail */
@@ -569,31 +743,25 @@ Image1D::Image1D (uint32_t wid, Channels chans, ChannelTy ty)
 Image1D::Image1D (std::string const &file)
     : __detail::ImageBase (1)
 {
-  // open the image file for reading
-    std::ifstream inS(file, std::ifstream::in | std::ifstream::binary);
-    if (inS.fail()) {
+  // map the image file into memory
+    __detail::MappedFile f(file);
+    if (! f.isValid()) {
 #ifndef NDEBUG
         std::cerr << "Image2D::Image1D: unable to open \"" << file << "\"" << std::endl;
 #endif
         exit (1);
     }
 
-    this->_data = readPNG(
-        inS, false, &this->_wid, nullptr, &this->_chans, &this->_type, &this->_sRGB);
-    if (this->_data == nullptr) {
-        inS.close();
+    PNGInfo info;
+    if (! this->_decode (f.data(), f.size(), false, info, nullptr, 0)) {
         std::cerr << "Image2D::Image1D: unable to load image file \"" << file << "\"" << std::endl;
         exit (1);
     }
-    int nChannels = numChannels(this->_chans);
-    this->_nBytes = nChannels * this->_wid * sizeOfType(this->_type);
-
-    // because Vulkan prefers 4-channel images
-    if (nChannels == 3) {
-        this->addAlphaChannel();
-    }
+    this->_wid = info.wid * info.ht;
+    this->_chans = info.chans;
+    this->_type = info.type;
+    this->_sRGB = info.sRGB;
 
-    inS.close();
 }
 
 // write the image
@@ -620,58 +788,94 @@ bool Image1D::write (const char *file)
 
 Image2D::Image2D (uint32_t wid, uint32_t ht, Channels chans, ChannelTy ty)
     : __detail::ImageBase (2, chans, ty, wid * ht), _wid(wid), _ht(ht)
-{ }
+{
+    this->_sRGB = true;
+}
 
 Image2D::Image2D (std::string const &file, bool flip)
     : __detail::ImageBase (2)
 {
-  // open the image file for reading
-    std::ifstream inS(file, std::ifstream::in | std::ifstream::binary);
-    if (inS.fail()) {
+  // map the image file into memory
+    __detail::MappedFile f(file);
+    if (! f.isValid()) {
 #ifndef NDEBUG
         std::cerr << "Image2D::Image2D: unable to open \"" << file << "\"" << std::endl;
 #endif
         exit (1);
     }
 
-    this->_data = readPNG(
-        inS, flip, &this->_wid, &this->_ht, &this->_chans, &this->_type, &this->_sRGB);
-    if (this->_data == nullptr) {
-        inS.close();
+    PNGInfo info;
+    if (! this->_decode (f.data(), f.size(), flip, info, nullptr, 0)) {
         std::cerr << "Image2D::Image2D: unable to load image file \"" << file << "\"" << std::endl;
         exit (1);
     }
-    int nChannels = numChannels(this->_chans);
-    this->_nBytes = nChannels * this->_wid * this->_ht * sizeOfType(this->_type);
+    this->_init (info);
+
+}
+
+Image2D::Image2D (const uint8_t *data, size_t len, bool flip, void *buf, size_t bufSz)
+    : __detail::ImageBase (2)
+{
+    PNGInfo info;
+    if (! this->_decode (data, len, flip, info, buf, bufSz)) {
+        std::cerr << "Image2D::Image2D: unable to decode 2D image" << std::endl;
+        exit (1);
+    }
+    this->_init (info);
+
+}
+
+Image2D::Image2D (uint32_t wid, uint32_t ht, Channels chans, ChannelTy ty, void *data)
+    : __detail::ImageBase (2, chans, ty, wid * ht, data), _wid(wid), _ht(ht)
+{
+    this->_sRGB = true;
+}
 
-    inS.close();
+Image2D::Image2D (Image2D &&img)
+    : __detail::ImageBase (std::move(img)), _wid(img._wid), _ht(img._ht)
+{
+    img._wid = 0;
+    img._ht = 0;
+}
 
-    // because Vulkan prefers 4-channel images
-    if (nChannels == 3) {
-        this->addAlphaChannel();
+Image2D &Image2D::operator= (Image2D &&img)
+{
+    if (this != &img) {
+        __detail::ImageBase::operator= (std::move(img));
+        this->_wid = img._wid;
+        this->_ht = img._ht;
+        img._wid = 0;
+        img._ht = 0;
     }
+    return *this;
 }
 
 Image2D::Image2D (std::ifstream &inS, bool flip)
     : __detail::ImageBase (2)
 {
-    this->_data = readPNG(
-        inS, flip, &this->_wid, &this->_ht, &this->_chans, &this->_type, &this->_sRGB);
+    PNGInfo info;
+    this->_data = readPNG (inS, flip, info);
     if (this->_data == nullptr) {
         std::cerr << "Image2D::Image2D: unable to load 2D image" << std::endl;
         exit (1);
     }
-    int nChannels = numChannels(this->_chans);
-    this->_nBytes = nChannels * this->_wid * this->_ht * sizeOfType(this->_type);
+    this->_init (info);
 
-    // because Vulkan prefers 4-channel images
-    if (nChannels == 3) {
-        this->addAlphaChannel();
-    }
+}
+
+// initialize the image properties from the result of decoding a PNG
+void Image2D::_init (PNGInfo const &info)
+{
+    this->_wid = info.wid;
+    this->_ht = info.ht;
+    this->_chans = info.chans;
+    this->_type = info.type;
+    this->_sRGB = info.sRGB;
+    this->_nBytes = info.nBytes;
 }
 
 // write the image to a file
-bool Image2D::write (const char *file, bool flip)
+bool Image2D::write (const char *file, bool flip, unsigned int nThreads)
 {
   // open the image file for writing
     std::ofstream outS(file, std::ofstream::out | std::ifstream::binary);
@@ -682,7 +886,7 @@ bool Image2D::write (const char *file, bool flip)
         return false;
     }
 
-    bool sts = writePNG (outS, flip, this->_wid, this->_ht, this->_chans, this->_type, this->_data);
+    bool sts = this->write (outS, flip, nThreads);
 
     outS.close();
 
@@ -690,9 +894,17 @@ bool Image2D::write (const char *file, bool flip)
 }
 
 // write the image to an output stream
-bool Image2D::write (std::ofstream &outS, bool flip)
+bool Image2D::write (std::ofstream &outS, bool flip, unsigned int nThreads)
 {
-    bool sts = writePNG (outS, flip, this->_wid, this->_ht, this->_chans, this->_type, this->_data);
+    bool sts;
+    if (nThreads == 1) {
+        sts = writePNG (
+            outS, flip, this->_wid, this->_ht, this->_chans, this->_type, this->_data);
+    } else {
+        sts = __detail::writePNGParallel (
+            outS, flip, this->_wid, this->_ht, this->_chans, this->_type, this->_data,
+            nThreads);
+    }
 
     return sts;
 }
@@ -727,6 +939,140 @@ void Image2D::bitblt (Image2D const &src, uint32_t row, uint32_t col)
     }
 }
 
+/***** class MipmapImage2D member functions *****/
+
+MipmapImage2D::MipmapImage2D (
+    uint32_t wid, uint32_t ht, uint32_t nLevels, Channels chans, bool sRGB)
+  : _wid(wid), _ht(ht), _chans(chans), _compressed(false), _bcFmt(bcn::Format::BC1),
+    _sRGB(sRGB), _nBytes(0), _data(nullptr)
+{
+    if ((chans != Channels::R) && (chans != Channels::RG) && (chans != Channels::RGBA)) {
+        ERROR("MipmapImage2D: unsupported channels " + to_string(chans));
+    }
+    this->_init (nLevels);
+}
+
+MipmapImage2D::MipmapImage2D (
+    uint32_t wid, uint32_t ht, uint32_t nLevels, bcn::Format fmt, bool sRGB)
+  : _wid(wid), _ht(ht),
+    _chans((bcn::decodedChannels(fmt) == 2) ? Channels::RG : Channels::RGBA),
+    _compressed(true), _bcFmt(fmt), _sRGB(sRGB && (fmt != bcn::Format::BC5)),
+    _nBytes(0), _data(nullptr)
+{
+    this->_init (nLevels);
+}
+
+MipmapImage2D::MipmapImage2D (MipmapImage2D &&img)
+  : _wid(img._wid), _ht(img._ht), _chans(img._chans), _compressed(img._compressed),
+    _bcFmt(img._bcFmt), _sRGB(img._sRGB), _levels(std::move(img._levels)),
+    _nBytes(img._nBytes), _data(img._data)
+{
+    img._levels.clear();
+    img._nBytes = 0;
+    img._data = nullptr;
+}
+
+MipmapImage2D::~MipmapImage2D ()
+{
+    ImageBufferPool::release (this->_data, this->_nBytes);
+}
+
+// compute the layout of the levels and allocate storage for them.  We align the
+// start of each level to 16 bytes, which satisfies the buffer-offset alignment
+// requirements of vkCmdCopyBufferToImage for all of the supported formats.
+void MipmapImage2D::_init (uint32_t nLevels)
+{
+    assert ((0 < nLevels) && (nLevels <= fullChainLength(this->_wid, this->_ht)));
+
+    uint32_t nChans = numChannels(this->_chans);
+    uint32_t wid = this->_wid;
+    uint32_t ht = this->_ht;
+    size_t offset = 0;
+    this->_levels.reserve(nLevels);
+    for (uint32_t i = 0;  i < nLevels;  ++i) {
+        size_t nb = this->_compressed
+            ? bcn::imageSize(this->_bcFmt, wid, ht)
+            : size_t(wid) * size_t(ht) * nChans;
+        this->_levels.push_back(Level{wid, ht, offset, nb});
+        offset = (offset + nb + 15) & ~size_t(15);
+        wid = std::max(1u, wid >> 1);
+        ht = std::max(1u, ht >> 1);
+    }
+    this->_nBytes = offset;
+    this->_data = ImageBufferPool::alloc(this->_nBytes);
+}
+
+vk::Format MipmapImage2D::format () const
+{
+    if (this->_compressed) {
+        switch (this->_bcFmt) {
+        case bcn::Format::BC1:
+            return (this->_sRGB ? vk::Format::eBc1RgbaSrgbBlock : vk::Format::eBc1RgbaUnormBlock);
+        case bcn::Format::BC3:
+            return (this->_sRGB ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock);
+        case bcn::Format::BC5:
+            return vk::Format::eBc5UnormBlock;
+        }
+    }
+    return this->decodedFormat();
+}
+
+vk::Format MipmapImage2D::decodedFormat () const
+{
+    switch (this->_chans) {
+    case Channels::R: return vk::Format::eR8Unorm;
+    case Channels::RG: return vk::Format::eR8G8Unorm;
+    case Channels::RGBA:
+        return (this->_sRGB ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm);
+    default:
+        ERROR("MipmapImage2D: unexpected channels " + to_string(this->_chans));
+    }
+}
+
+MipmapImage2D *MipmapImage2D::decompress () const
+{
+    MipmapImage2D *img = new MipmapImage2D (
+        this->_wid, this->_ht, this->nLevels(), this->_chans, this->_sRGB);
+
+    if (! this->_compressed) {
+        std::memcpy (img->_data, this->_data, this->_nBytes);
+        return img;
+    }
+
+    for (uint32_t i = 0;  i < this->nLevels();  ++i) {
+        auto const &lvl = this->_levels[i];
+        bcn::decodeImage (
+            this->_bcFmt, lvl.wid, lvl.ht,
+            static_cast<const uint8_t *>(this->levelData(i)),
+            static_cast<uint8_t *>(img->levelData(i)));
+    }
+
+    return img;
+}
+
+void MipmapImage2D::flip ()
+{
+    uint32_t nChans = numChannels(this->_chans);
+    for (uint32_t i = 0;  i < this->nLevels();  ++i) {
+        auto const &lvl = this->_levels[i];
+        uint8_t *data = static_cast<uint8_t *>(this->levelData(i));
+        if (this->_compressed) {
+            bcn::flipImage (this->_bcFmt, lvl.wid, lvl.ht, data);
+        } else {
+            __detail::flipRows (data, size_t(lvl.wid) * nChans, lvl.ht);
+        }
+    }
+}
+
+uint32_t MipmapImage2D::fullChainLength (uint32_t wid, uint32_t ht)
+{
+    uint32_t n = 1;
+    for (uint32_t sz = std::max(wid, ht);  sz > 1;  sz >>= 1) {
+        ++n;
+    }
+    return n;
+}
+
 std::string to_string (Channels ch)
 {
     switch (ch) {
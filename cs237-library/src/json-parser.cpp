@@ -17,10 +17,14 @@
 
 #include "cs237-config.h"
 #include "json.hpp"
-#include <filesystem>
+#include "mapped-file.hpp"
+#include <unordered_set>
 #include <iostream>
-#include <fstream>
 #include <cctype>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstdint>
 #include <locale>
 #ifdef INCLUDE_STRINGS_H
 #include INCLUDE_STRINGS_H
@@ -45,140 +49,216 @@ static int strncasecmp (const char *s1, const char *s2, size_t n)
 
 namespace json {
 
-// a wrapper class around file input that reads the entire file in one go.
-class Input {
-  public:
-    Input (std::string filename);
-    ~Input () { delete this->_buffer; }
+/***** class Reader member functions *****/
 
-    Input const &operator++ (int _unused) {
-        if (this->_buffer[this->_i++] == '\n') this->_lnum++;
-        return *this;
-    }
-    Input const &operator += (int n) { this->_i += n;  return *this; }
-    const char *operator() () const { return &(this->_buffer[this->_i]); }
-    char operator[] (int j) const { return this->_buffer[this->_i + j]; }
-    char operator* () const { return this->_buffer[this->_i]; }
-    int avail () const { return this->_len - this->_i; }
-    bool eof () const { return this->_i >= this->_len; }
-
-    /// get the filename as a std::string
-    std::string filename () const
-    {
-        return this->_path.string();
-    }
+Reader::Reader (const char *text, size_t len, std::string const &name)
+  : _name(name), _file(nullptr), _text(text), _len(len), _pos(0), _lnum(1),
+    _state(S_VALUE), _nest(), _str(), _buf(), _int(0), _real(0.0), _bool(false)
+{ }
 
-    void error (std::string msg)
-    {
-        std::cerr << "json::parseFile(" << this->filename() << "): " << msg
-            << " at line " << this->_lnum << std::endl;
-        std::cerr << "    input = \"";
-        int n = this->avail();
-        if (20 < n) n = 20;
-        for (int i = 0;  (i < 20);  i++) {
-            if (isprint(this->_buffer[this->_i+i]))
-                std::cerr << this->_buffer[this->_i+i];
-            else
-                std::cerr << ".";
-        }
-        std::cerr << " ...\n" << std::endl;
+Reader::Reader (std::string const &filename)
+  : _name(filename), _file(new cs237::__detail::MappedFile(filename)),
+    _text(nullptr), _len(0), _pos(0), _lnum(1),
+    _state(S_VALUE), _nest(), _str(), _buf(), _int(0), _real(0.0), _bool(false)
+{
+    if (this->_file->isValid()) {
+        this->_text = reinterpret_cast<const char *>(this->_file->data());
+        this->_len = this->_file->size();
     }
+}
 
-  private:
-    std::filesystem::path _path;
-    char        *_buffer;
-    int         _i;     // character index
-    int         _lnum;  // current line number
-    int         _len;   // buffer size
-
-};
-
-Input::Input (std::string filename)
-  : _path(filename, std::filesystem::path::generic_format),
-    _buffer(nullptr), _i(0), _lnum(0), _len(0)
+Reader::~Reader ()
 {
-    // figure out the size of the file
-    auto length = std::filesystem::file_size(this->_path);
+    delete this->_file;
+}
 
-    // open the json file for reading
-    std::ifstream inS(this->_path.c_str(), std::ios::in);
-    if (inS.fail()) {
-        return;
+void Reader::error (std::string const &msg)
+{
+    std::cerr << "json::parseFile(" << this->_name << "): " << msg
+        << " at line " << this->_lnum << std::endl;
+    std::cerr << "    input = \"";
+    size_t n = this->_len - this->_pos;
+    if (20 < n) n = 20;
+    for (size_t i = 0;  (i < n);  i++) {
+        if (isprint(this->_text[this->_pos+i]))
+            std::cerr << this->_text[this->_pos+i];
+        else
+            std::cerr << ".";
     }
+    std::cerr << " ...\n" << std::endl;
+}
 
-    // read length bytes
-    this->_lnum = 1;
-    this->_buffer = new char[length];
-    inS.read (this->_buffer, length);
-
-// it has been reported that inS.fail() is true on Windows even if the read was
-// successful, so we skip the check for now.
-#ifndef CS237_WINDOWS
-    if (inS.fail()) {
-        delete this->_buffer;
-        this->_buffer = 0;
-        return;
+Reader::Event Reader::_error (std::string const &msg)
+{
+    if (this->_state != S_ERROR) {
+        this->error (msg);
+        this->_state = S_ERROR;
     }
-#endif
-
-    this->_len = length;
+    return Event::Error;
 }
 
-// forward decls
-static bool skipWhitespace (Input &datap);
-static Value *parse (Input &datap);
-
-// parse a json file; this returns nullptr if there is a parsing error
-Value *parseFile (std::string filename)
+void Reader::_skipWhitespace ()
 {
-  // open the json file for reading
-    Input datap(filename);
-    if (datap.eof()) {
-        std::cerr << "json::parseFile: unable to read \"" << filename << "\"" << std::endl;
-        return nullptr;
+    // we test the characters directly, since isspace() is locale dependent and
+    // is not inlined
+    const char *text = this->_text;
+    size_t pos = this->_pos;
+    while (pos < this->_len) {
+        char c = text[pos];
+        if (c == '\n') {
+            this->_lnum++;
+        }
+        else if ((c != ' ') && (c != '\t') && (c != '\r') && (c != '\f') && (c != '\v')) {
+            break;
+        }
+        pos++;
     }
+    this->_pos = pos;
+}
 
-    if (! skipWhitespace (datap)) {
-        return nullptr;
+Reader::Event Reader::next ()
+{
+    if (this->_state == S_ERROR) {
+        return Event::Error;
+    }
+    if (this->_text == nullptr) {
+        return this->_error ("unable to read input");
     }
 
-    Value *value = parse (datap);
+    while (true) {
+        this->_skipWhitespace ();
+        if (this->_pos >= this->_len) {
+            if (this->_state == S_DONE) {
+                return Event::End;
+            }
+            return this->_error ("unexpected eof");
+        }
+        char c = this->_text[this->_pos];
+
+        switch (this->_state) {
+        case S_DONE:
+          // we ignore any trailing input
+            return Event::End;
+
+        case S_KEY_OR_END:
+            if (c == '}') {
+                this->_pos++;
+                this->_nest.pop_back();
+                this->_endValue();
+                return Event::EndObject;
+            }
+            // fall through
+        case S_KEY:
+            if (c != '"') {
+                return this->_error ("expected label");
+            }
+            if (! this->_string()) {
+                return Event::Error;
+            }
+          // the ':' that separates the key from the value
+            this->_skipWhitespace ();
+            if ((this->_pos >= this->_len) || (this->_text[this->_pos] != ':')) {
+                return this->_error ("expected ':'");
+            }
+            this->_pos++;
+            this->_state = S_VALUE;
+            return Event::Key;
+
+        case S_VALUE_OR_END:
+            if (c == ']') {
+                this->_pos++;
+                this->_nest.pop_back();
+                this->_endValue();
+                return Event::EndArray;
+            }
+            // fall through
+        case S_VALUE:
+            return this->_value ();
+
+        case S_COMMA_OR_END:
+            this->_pos++;
+            if (this->_nest.back()) {
+                if (c == '}') {
+                    this->_nest.pop_back();
+                    this->_endValue();
+                    return Event::EndObject;
+                }
+                this->_state = S_KEY;
+            }
+            else {
+                if (c == ']') {
+                    this->_nest.pop_back();
+                    this->_endValue();
+                    return Event::EndArray;
+                }
+                this->_state = S_VALUE;
+            }
+            if (c != ',') {
+                this->_pos--;
+                return this->_error ("expected ','");
+            }
+            break; // look for the next key/value
 
-    return value;
+        case S_ERROR:
+            return Event::Error;
+        }
+    }
 
 }
 
-static bool skipWhitespace (Input &datap)
+bool Reader::skip ()
 {
-    while ((! datap.eof()) && isspace(*datap))
-        datap++;
-
-    if (datap.eof()) {
-        datap.error("unexpected eof");
-        return false;
+    if (this->_state == S_VALUE) {
+        // the last event was a key, so we skip the field's value
+        Event ev = this->next();
+        if (ev == Event::Error) {
+            return false;
+        }
+        else if ((ev != Event::BeginObject) && (ev != Event::BeginArray)) {
+            return true;
+        }
     }
-    else
-        return true;
+    else if ((this->_state != S_KEY_OR_END) && (this->_state != S_VALUE_OR_END)) {
+        // the last event was not the beginning of an object or array
+        return (this->_state != S_ERROR);
+    }
+    // skip to the end of the current object or array
+    size_t depth = this->_nest.size();
+    while (this->_nest.size() >= depth) {
+        if (this->next() == Event::Error) {
+            return false;
+        }
+    }
+    return true;
 }
 
-static bool extractString (Input &datap, std::string &str)
+// scan a string; the current character is the opening '"'.  If the string does
+// not contain any escape sequences, then _str refers directly to the input text;
+// otherwise, the string is decoded into _buf.
+bool Reader::_string ()
 {
-    str = "";
-
-    if (*datap != '\"')
-        return false;
-    datap++;
+    const char *text = this->_text;
+    size_t len = this->_len;
+    size_t start = ++this->_pos;
+    bool escapes = false;
 
-    while (! datap.eof()) {
+    while (this->_pos < len) {
         // Save the char so we can change it if need be
-        char nextChar = *datap;
+        char nextChar = text[this->_pos];
 
         // Escaping something?
         if (nextChar == '\\') {
+            if (! escapes) {
+                // copy the prefix of the string into the buffer
+                this->_buf.assign (text + start, this->_pos - start);
+                escapes = true;
+            }
             // Move over the escape char
-            datap++;
+            if (++this->_pos >= len) {
+                break;
+            }
             // Deal with the escaped char
-            switch (*datap) {
+            switch (text[this->_pos]) {
                 case '"': nextChar = '"'; break;
                 case '\\': nextChar = '\\'; break;
                 case '/': nextChar = '/'; break;
@@ -190,310 +270,381 @@ static bool extractString (Input &datap, std::string &str)
                 case 'u': /* no UNICODE support */
                 // By the spec, only the above cases are allowed
                 default:
-                    datap.error("invalid escape sequence in string");
+                    this->_error ("invalid escape sequence in string");
                     return false;
             }
         }
       // End of the string?
         else if (nextChar == '"') {
-            datap++;
-            str.reserve(); // Remove unused capacity
+            if (escapes) {
+                this->_str = this->_buf;
+            } else {
+                this->_str = std::string_view(text + start, this->_pos - start);
+            }
+            this->_pos++;
             return true;
         }
       // Disallowed char?
         else if (! isprint(nextChar) && (nextChar != '\t')) {
           // SPEC Violation: Allow tabs due to real world cases
-            datap.error("invalid character in string");
+            this->_error ("invalid character in string");
             return false;
         }
       // Add the next char
-        str += nextChar;
+        if (escapes) {
+            this->_buf += nextChar;
+        }
       // Move on
-        datap++;
+        this->_pos++;
     }
 
   // If we're here, the string ended incorrectly
+    this->_error ("unexpected eof in string");
     return false;
 }
 
-static int64_t parseInt (Input &datap)
-{
-    int64_t n = 0;
-    while (*datap != 0 && isdigit(*datap)) {
-        n = n * 10 + (*datap - '0');
-        datap++;
-    }
-
-    return n;
-}
-
-static double parseDecimal (Input &datap)
-{
-    double decimal = 0.0;
-    double factor = 0.1;
-
-    while ((! datap.eof()) && isdigit(*datap)) {
-        int digit = (*datap - '0');
-        decimal = decimal + digit * factor;
-        factor *= 0.1;
-        datap++;
-    }
-    return decimal;
-}
-
-static Value *parse (Input &datap)
+// scan a value; the current character is the first character of the value
+Reader::Event Reader::_value ()
 {
-    if (datap.eof()) {
-        datap.error("unexpected end of file");
-        return nullptr;
-    }
+    const char *p = this->_text + this->_pos;
+    size_t avail = this->_len - this->_pos;
 
+    switch (*p) {
   // Is it a string?
-    if (*datap == '"') {
-        std::string str;
-        if (! extractString(datap, str))
-            return nullptr;
-        else
-            return new String(str);
-    }
+    case '"':
+        if (! this->_string()) {
+            return Event::Error;
+        }
+        this->_endValue();
+        return Event::String;
+  // An object?
+    case '{':
+        this->_pos++;
+        this->_nest.push_back (true);
+        this->_state = S_KEY_OR_END;
+        return Event::BeginObject;
+  // An array?
+    case '[':
+        this->_pos++;
+        this->_nest.push_back (false);
+        this->_state = S_VALUE_OR_END;
+        return Event::BeginArray;
+  // Is it a number?
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        return this->_number();
   // Is it a boolean?
-    else if ((datap.avail() >= 4) && strncasecmp(datap(), "true", 4) == 0) {
-        datap += 4;
-        return new Bool(true);
-    }
-    else if ((datap.avail() >=  5) && strncasecmp(datap(), "false", 5) == 0) {
-        datap += 5;
-        return new Bool(false);
-    }
+    case 't': case 'T':
+        if ((avail >= 4) && strncasecmp(p, "true", 4) == 0) {
+            this->_pos += 4;
+            this->_bool = true;
+            this->_endValue();
+            return Event::Bool;
+        }
+        break;
+    case 'f': case 'F':
+        if ((avail >=  5) && strncasecmp(p, "false", 5) == 0) {
+            this->_pos += 5;
+            this->_bool = false;
+            this->_endValue();
+            return Event::Bool;
+        }
+        break;
   // Is it a null?
-    else if ((datap.avail() >=  4) && strncasecmp(datap(), "null", 4) == 0) {
-        datap += 4;
-        return new Null();
-    }
-  // Is it a number?
-    else if (*datap == '-' || isdigit(*datap)) {
-      // Negative?
-        bool neg = *datap == '-';
-        bool isReal = false;
-        if (neg) datap++;
-
-        int64_t whole = 0;
-
-      // parse the whole part of the number - only if it wasn't 0
-        if (*datap == '0')
-            datap++;
-        else if (isdigit(*datap))
-            whole = parseInt(datap);
-        else {
-            datap.error("invalid number");
-            return nullptr;
+    case 'n': case 'N':
+        if ((avail >=  4) && strncasecmp(p, "null", 4) == 0) {
+            this->_pos += 4;
+            this->_endValue();
+            return Event::Null;
         }
+        break;
+    default:
+        break;
+    }
 
-        double r;
+  // Ran out of possibilites, it's bad!
+    return this->_error ("bogus input");
+}
 
-      // Could be a decimal now...
-        if (*datap == '.') {
-            r = (double)whole;
-            isReal = true;
-            datap++;
+/***** number parsing *****/
 
-            // Not get any digits?
-            if (! isdigit(*datap)) {
-                datap.error("invalid number");
-                return nullptr;
-            }
+// Most of the numbers in our JSON files are short decimal fractions (positions,
+// axes, and colors), which we convert using Clinger's fast path: when the decimal
+// significand fits in 53 bits and the power of ten is at most 22, both are
+// exactly representable as doubles, so a single IEEE multiplication or division
+// gives the correctly rounded result.  Other numbers fall back to
+// `std::from_chars` (or `strtod` when the library does not support
+// floating-point `from_chars`), which is also correctly rounded.
 
-            // Find the decimal and sort the decimal place out
-            // Use parseDecimal as parseInt won't work with decimals less than 0.1
-            // thanks to Javier Abadia for the report & fix
-            double decimal = parseDecimal(datap);
+//! exact powers of ten
+static const double kPow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
 
-            // Save the number
-            r += decimal;
-        }
+//! the largest significand that is exactly representable as a double
+constexpr uint64_t kMaxExactInt = uint64_t(1) << 53;
 
-        // Could be an exponent now...
-        if (*datap == 'E' || *datap == 'e') {
-            if (!isReal) {
-                r = (double)whole;
-                isReal = true;
-            }
-            datap++;
+//! the maximum number of significant digits that we accumulate; 19 digits
+//! always fit in a uint64_t
+constexpr int kMaxDigits = 19;
 
-            // Check signage of expo
-            bool neg_expo = false;
-            if (*datap == '-' || *datap == '+') {
-                neg_expo = *datap == '-';
-                datap++;
-            }
+inline bool isDigit (char c) { return (unsigned(c) - unsigned('0')) < 10; }
 
-            // Not get any digits?
-            if (! isdigit(*datap)) {
-                datap.error("invalid number");
-                return nullptr;
-            }
+//! slow-path conversion of the text of a number to a double
+static double slowStrToD (const char *start, const char *end)
+{
+#if defined(__cpp_lib_to_chars)
+    double r = 0.0;
+    std::from_chars (start, end, r);
+    return r;
+#else
+    // strtod requires a NUL-terminated string, which the input is not
+    std::string s(start, end);
+    return std::strtod (s.c_str(), nullptr);
+#endif
+}
 
-            // Sort the expo out
-            double expo = parseInt(datap);
-            for (double i = 0.0; i < expo; i++) {
-                r = neg_expo ? (r / 10.0) : (r * 10.0);
+// scan a number; the current character is either '-' or a digit
+Reader::Event Reader::_number ()
+{
+    const char *start = this->_text + this->_pos;
+    const char *end = this->_text + this->_len;
+    const char *p = start;
+
+  // Negative?
+    bool neg = (*p == '-');
+    if (neg) p++;
+
+  // accumulate the first kMaxDigits significant digits of the integer and
+  // fractional parts in the significand; we keep track of the decimal exponent
+  // and of whether any nonzero digits were dropped
+    uint64_t sig = 0;
+    int nDigits = 0;
+    int exp10 = 0;
+    bool truncated = false;
+
+  // the whole part of the number: either '0' or a nonzero digit followed by digits
+    if ((p < end) && (*p == '0')) {
+        p++;
+    }
+    else if ((p < end) && isDigit(*p)) {
+        while ((p < end) && isDigit(*p)) {
+            if (nDigits < kMaxDigits) {
+                sig = 10 * sig + (*p - '0');
+                nDigits++;
+            } else {
+                exp10++;
+                truncated |= (*p != '0');
             }
-        }
-
-        if (isReal) {
-            return new Real (neg ? -r : r);
-        }
-        else {
-            return new Integer (neg ? -whole : whole);
+            p++;
         }
     }
-  // An object?
-    else if (*datap == '{') {
-        Object *object = new Object();
-
-        datap++;
-
-        while (!datap.eof()) {
-          // Whitespace at the start?
-            if (! skipWhitespace(datap)) {
-                delete object;
-                return nullptr;
-            }
+    else {
+        this->_pos = p - this->_text;
+        return this->_error ("invalid number");
+    }
 
-          // Special case: empty object
-            if ((object->size() == 0) && (*datap == '}')) {
-                datap++;
-                return object;
-            }
+    bool isReal = false;
 
-          // We want a string now...
-            std::string name;
-// CHECK: do we need to look for "?
-            if (! extractString(datap, name)) {
-                datap.error("expected label");
-                delete object;
-                return nullptr;
+  // Could be a decimal now...
+    if ((p < end) && (*p == '.')) {
+        isReal = true;
+        p++;
+        // Not get any digits?
+        if ((p >= end) || !isDigit(*p)) {
+            this->_pos = p - this->_text;
+            return this->_error ("invalid number");
+        }
+        while ((p < end) && isDigit(*p)) {
+            if ((nDigits == 0) && (*p == '0')) {
+                // leading zeros of the fraction are not significant
+                exp10--;
+            } else if (nDigits < kMaxDigits) {
+                sig = 10 * sig + (*p - '0');
+                nDigits++;
+                exp10--;
+            } else {
+                truncated |= (*p != '0');
             }
+            p++;
+        }
+    }
 
-          // More whitespace?
-            if (! skipWhitespace(datap)) {
-                delete object;
-                return nullptr;
+  // Could be an exponent now...
+    if ((p < end) && ((*p == 'E') || (*p == 'e'))) {
+        isReal = true;
+        p++;
+        // Check signage of expo
+        bool negExp = false;
+        if ((p < end) && ((*p == '-') || (*p == '+'))) {
+            negExp = (*p == '-');
+            p++;
+        }
+        // Not get any digits?
+        if ((p >= end) || !isDigit(*p)) {
+            this->_pos = p - this->_text;
+            return this->_error ("invalid number");
+        }
+        int e = 0;
+        while ((p < end) && isDigit(*p)) {
+            // clamp the exponent, which is way out of range at this point anyway
+            if (e < 100000) {
+                e = 10 * e + (*p - '0');
             }
+            p++;
+        }
+        exp10 += negExp ? -e : e;
+    }
 
-          // Need a : now
-            if (*datap != ':') {
-                datap.error("expected ':'");
-                delete object;
-                return nullptr;
-            }
-            datap++;
+    this->_pos = p - this->_text;
+    this->_endValue();
 
-          // More whitespace?
-            if (! skipWhitespace(datap)) {
-                delete object;
-                return nullptr;
-            }
+    if (! isReal) {
+        if ((exp10 == 0) && (sig <= uint64_t(INT64_MAX))) {
+            this->_int = neg ? -int64_t(sig) : int64_t(sig);
+            this->_real = static_cast<double>(this->_int);
+            return Event::Integer;
+        }
+        // the integer is too large for an int64_t, so we treat it as a real
+    }
 
-          // The value is here
-            Value *value = parse(datap);
-            if (value == nullptr) {
-                delete object;
-                return nullptr;
-            }
+    if (!truncated && (sig <= kMaxExactInt) && (-22 <= exp10) && (exp10 <= 22)) {
+        // Clinger's fast path
+        double r = static_cast<double>(sig);
+        r = (exp10 < 0) ? r / kPow10[-exp10] : r * kPow10[exp10];
+        this->_real = neg ? -r : r;
+    }
+    else {
+        this->_real = slowStrToD (start, p);
+    }
+    return Event::Real;
+}
 
-          // Add the name:value
-            object->insert(name, value);
+/***** building documents *****/
 
-          // More whitespace?
-            if (! skipWhitespace(datap)) {
-                delete object;
-                return nullptr;
-            }
+// the state used to build a document from the events of a reader: the arena
+// where values are allocated and scratch storage that is reused across values
+struct Builder {
+    Arena &arena;                               //!< where to allocate values
+    std::unordered_set<std::string_view> keys;  //!< interned object keys
+    std::vector<Object::Field> fields;          //!< stack of fields of pending objects
+    std::vector<Value *> elems;                 //!< stack of elements of pending arrays
 
-            // End of object?
-            if (*datap == '}') {
-                datap++;
-                return object;
-            }
+    explicit Builder (Arena &a) : arena(a) { }
 
-            // Want a , now
-            if (*datap != ',') {
-                datap.error("expected ','");
-                delete object;
-                return nullptr;
-            }
-
-            datap++;
+    // return the interned copy of a key
+    std::string_view intern (std::string_view key)
+    {
+        auto got = this->keys.find(key);
+        if (got != this->keys.end()) {
+            return *got;
         }
-
-      // Only here if we ran out of data
-        datap.error("unexpected eof");
-        delete object;
-        return nullptr;
+        std::string_view k = this->arena.copy(key);
+        this->keys.insert(k);
+        return k;
     }
+};
 
-    // An array?
-    else if (*datap == '[') {
-        Array *array = new Array();
-
-        datap++;
-
-        while (! datap.eof()) {
-          // Whitespace at the start?
-            if (! skipWhitespace(datap)) {
-                delete array;
-                return nullptr;
-            }
-
-          // Special case - empty array
-            if ((array->length() == 0) && (*datap == ']')) {
-                datap++;
-                return array;
+// build the value that starts with the event ev
+static Value *build (Reader &rd, Reader::Event ev, Builder &b)
+{
+    switch (ev) {
+    case Reader::Event::String:
+        return b.arena.make<String>(b.arena, rd.string());
+    case Reader::Event::Integer:
+        return b.arena.make<Integer>(rd.intVal());
+    case Reader::Event::Real:
+        return b.arena.make<Real>(rd.realVal());
+    case Reader::Event::Bool:
+        return b.arena.make<Bool>(rd.boolVal());
+    case Reader::Event::Null:
+        return b.arena.make<Null>();
+
+    case Reader::Event::BeginObject: {
+          // the fields are accumulated on the builder's field stack and then copied
+          // into the arena once we know how many there are
+            size_t base = b.fields.size();
+            while ((ev = rd.next()) == Reader::Event::Key) {
+                std::string_view name = b.intern(rd.string());
+                Value *value = build (rd, rd.next(), b);
+                if (value == nullptr) {
+                    return nullptr;
+                }
+                b.fields.push_back (Object::Field{name, value});
             }
-
-          // Get the value
-            Value *value = parse(datap);
-            if (value == nullptr) {
-                delete array;
+            if (ev != Reader::Event::EndObject) {
                 return nullptr;
             }
+            int n = static_cast<int>(b.fields.size() - base);
+            Object::Field *fields = static_cast<Object::Field *>(
+                b.arena.alloc(n * sizeof(Object::Field), alignof(Object::Field)));
+            std::copy (b.fields.begin() + base, b.fields.end(), fields);
+            b.fields.resize (base);
+            return b.arena.make<Object>(b.arena, fields, n);
+        }
 
-          // Add the value
-            array->add(value);
-
-          // More whitespace?
-            if (! skipWhitespace(datap)) {
-                delete array;
-                return nullptr;
+    case Reader::Event::BeginArray: {
+          // as with objects, the elements are accumulated on a stack
+            size_t base = b.elems.size();
+            while ((ev = rd.next()) != Reader::Event::EndArray) {
+                Value *value = build (rd, ev, b);
+                if (value == nullptr) {
+                    return nullptr;
+                }
+                b.elems.push_back (value);
             }
+            int n = static_cast<int>(b.elems.size() - base);
+            Value **elems = static_cast<Value **>(
+                b.arena.alloc(n * sizeof(Value *), alignof(Value *)));
+            std::copy (b.elems.begin() + base, b.elems.end(), elems);
+            b.elems.resize (base);
+            return b.arena.make<Array>(b.arena, elems, n);
+        }
 
-          // End of array?
-            if (*datap == ']') {
-                datap++;
-                return array;
-            }
+    default:
+        return nullptr;
+    }
+}
 
-            // Want a , now
-            if (*datap != ',') {
-                datap.error("expected ','");
-                delete array;
-                return nullptr;
-            }
+// build a document from the events of a reader
+static Value *build (Reader &rd, Arena &arena)
+{
+    Builder b(arena);
+    return build (rd, rd.next(), b);
+}
 
-            datap++;
-        }
+bool Document::parse (const char *text, size_t len, std::string const &name)
+{
+    Reader rd(text, len, name);
+    this->_root = build (rd, this->_arena);
+    return (this->_root != nullptr);
+}
 
-      // Only here if we ran out of data
-        datap.error("unexpected eof");
-        delete array;
-        return nullptr;
+bool Document::parseFile (std::string const &filename)
+{
+    Reader rd(filename);
+    if (! rd.isValid()) {
+        std::cerr << "json::parseFile: unable to read \"" << filename << "\"" << std::endl;
+        this->_root = nullptr;
+        return false;
     }
-  // Ran out of possibilites, it's bad!
-    else {
-        datap.error("bogus input");
+    this->_root = build (rd, this->_arena);
+    return (this->_root != nullptr);
+}
+
+// parse a json file; this returns nullptr if there is a parsing error
+Value *parseFile (std::string filename)
+{
+    // the document is never freed, since the caller has no way to free it
+    Document *doc = new Document;
+    if (! doc->parseFile (filename)) {
+        delete doc;
         return nullptr;
     }
+
+    return doc->root();
+
 }
 
 } // namespace json
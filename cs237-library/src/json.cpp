@@ -13,76 +13,189 @@
  */
 
 #include "json.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 namespace json {
 
+/***** class Arena member functions *****/
+
+//! the default size of an arena chunk
+constexpr size_t kChunkSize = 64 * 1024;
+
+Arena::~Arena ()
+{
+    for (auto chunk : this->_chunks) {
+        std::free (chunk);
+    }
+}
+
+void *Arena::_allocSlow (size_t nb, size_t align)
+{
+    // allocate a new chunk that is big enough for the request; the current
+    // chunk's free space is abandoned
+    size_t sz = std::max(kChunkSize, nb + align);
+    char *chunk = static_cast<char *>(std::malloc (sz));
+    if (chunk == nullptr) {
+        throw std::bad_alloc();
+    }
+    this->_chunks.push_back (chunk);
+    this->_nBytes += sz;
+    this->_next = chunk;
+    this->_avail = sz;
+    return this->alloc (nb, align);
+}
+
+std::string_view Arena::copy (std::string_view s)
+{
+    char *p = static_cast<char *>(this->alloc (s.size(), 1));
+    std::memcpy (p, s.data(), s.size());
+    return std::string_view(p, s.size());
+}
+
 /***** class Value member functions *****/
 
+// Since we know the dynamic type of a value from its type tag, we can use
+// static casts for the downcasts.
+
 Value::~Value () { }
 
 const Object *Value::asObject () const
 {
-    return dynamic_cast<const Object *>(this);
+    return this->isObject() ? static_cast<const Object *>(this) : nullptr;
 }
 
 const Array *Value::asArray () const
 {
-    return dynamic_cast<const Array *>(this);
+    return this->isArray() ? static_cast<const Array *>(this) : nullptr;
 }
 
 const Number *Value::asNumber () const
 {
-    return dynamic_cast<const Number *>(this);
+    return this->isNumber() ? static_cast<const Number *>(this) : nullptr;
 }
 
 const Integer *Value::asInteger () const
 {
-    return dynamic_cast<const Integer *>(this);
+    return this->isInteger() ? static_cast<const Integer *>(this) : nullptr;
 }
 
 const Real *Value::asReal () const
 {
-    return dynamic_cast<const Real *>(this);
+    return this->isReal() ? static_cast<const Real *>(this) : nullptr;
 }
 
 const String *Value::asString () const
 {
-    return dynamic_cast<const String *>(this);
+    return this->isString() ? static_cast<const String *>(this) : nullptr;
 }
 
 const Bool *Value::asBool () const
 {
-    return dynamic_cast<const Bool *>(this);
+    return this->isBool() ? static_cast<const Bool *>(this) : nullptr;
 }
 
 /***** class Object member functions *****/
 
+Object::Object ()
+  : Value(T_OBJECT), _arena(new Arena), _ownsArena(true),
+    _fields(nullptr), _n(0), _cap(0)
+{ }
+
+Object::Object (Arena &arena, Field *fields, int n)
+  : Value(T_OBJECT), _arena(&arena), _ownsArena(false), _fields(fields), _n(n), _cap(n)
+{
+    // the sort must be stable, so that the first occurrence of a duplicate key
+    // is the one that is found.  Most objects only have a few fields, for which
+    // insertion sort is fastest (and it does not allocate a temporary buffer).
+    if (n <= 16) {
+        for (int i = 1;  i < n;  ++i) {
+            Field f = fields[i];
+            int j = i;
+            while ((j > 0) && (f.key < fields[j-1].key)) {
+                fields[j] = fields[j-1];
+                --j;
+            }
+            fields[j] = f;
+        }
+    } else {
+        std::stable_sort (fields, fields + n,
+            [](Field const &a, Field const &b) { return a.key < b.key; });
+    }
+}
+
 Object::~Object ()
 {
-  // need to delete contents
+    if (this->_ownsArena) {
+        delete this->_arena;
+    }
 }
 
-void Object::insert (std::string key, Value *val)
+void Object::insert (std::string_view key, Value *val)
 {
-    this->_value.insert (std::pair<std::string, Value *>(key, val));
+    Field *end = this->_fields + this->_n;
+    Field *pos = std::lower_bound (this->_fields, end, key,
+        [](Field const &f, std::string_view k) { return f.key < k; });
+    if ((pos != end) && (pos->key == key)) {
+        return;
+    }
+    int idx = static_cast<int>(pos - this->_fields);
+    if (this->_n == this->_cap) {
+        // grow the array; the old array is abandoned in the arena
+        int cap = (this->_cap < 4) ? 4 : 2 * this->_cap;
+        Field *fields = static_cast<Field *>(
+            this->_arena->alloc(cap * sizeof(Field), alignof(Field)));
+        std::copy (this->_fields, this->_fields + this->_n, fields);
+        this->_fields = fields;
+        this->_cap = cap;
+    }
+    std::copy_backward (
+        this->_fields + idx, this->_fields + this->_n, this->_fields + this->_n + 1);
+    this->_fields[idx] = Field{this->_arena->copy(key), val};
+    this->_n++;
 }
 
-Value *Object::operator[] (std::string key) const
+Value *Object::operator[] (std::string_view key) const
 {
-    std::map<std::string, Value *>::const_iterator got = this->_value.find(key);
-    if (got == this->_value.end())
+    const Field *begin = this->_fields;
+    const Field *end = begin + this->_n;
+    const Field *got = std::lower_bound (begin, end, key,
+        [](Field const &f, std::string_view k) { return f.key < k; });
+    if ((got == end) || (got->key != key))
         return nullptr;
     else
-        return got->second;
+        return got->value;
 }
 
 std::string Object::toString() { return std::string("<object>"); }
 
 /***** class Array member functions *****/
 
+Array::Array ()
+  : Value(T_ARRAY), _arena(new Arena), _ownsArena(true),
+    _elems(nullptr), _n(0), _cap(0)
+{ }
+
 Array::~Array ()
 {
-  // need to delete contents
+    if (this->_ownsArena) {
+        delete this->_arena;
+    }
+}
+
+void Array::add (Value *v)
+{
+    if (this->_n == this->_cap) {
+        // grow the array; the old array is abandoned in the arena
+        int cap = (this->_cap < 4) ? 4 : 2 * this->_cap;
+        Value **elems = static_cast<Value **>(
+            this->_arena->alloc(cap * sizeof(Value *), alignof(Value *)));
+        std::copy (this->_elems, this->_elems + this->_n, elems);
+        this->_elems = elems;
+        this->_cap = cap;
+    }
+    this->_elems[this->_n++] = v;
 }
 
 std::string Array::toString() { return std::string("<array>"); }
@@ -107,7 +220,7 @@ std::string Real::toString() { return std::string("<real>"); }
 
 String::~String () { }
 
-std::string String::toString () { return this->_value; }
+std::string String::toString () { return std::string(this->_value); }
 
 /***** class Bool member functions *****/
 
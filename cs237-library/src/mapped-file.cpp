@@ -0,0 +1,107 @@
+/*! \file mapped-file.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Read-only memory-mapped files.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "mapped-file.hpp"
+
+#ifdef CS237_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace cs237 {
+
+namespace __detail {
+
+#ifdef CS237_WINDOWS
+
+MappedFile::MappedFile (std::string const &file)
+  : _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+{
+    HANDLE fh = CreateFileA (
+        file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fh == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    this->_file = fh;
+
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx (fh, &sz) || (sz.QuadPart == 0)) {
+        return;
+    }
+    this->_mapping = CreateFileMappingA (fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (this->_mapping == nullptr) {
+        return;
+    }
+    void *p = MapViewOfFile (this->_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (p != nullptr) {
+        this->_data = static_cast<const uint8_t *>(p);
+        this->_size = static_cast<size_t>(sz.QuadPart);
+    }
+}
+
+MappedFile::~MappedFile ()
+{
+    if (this->_data != nullptr) {
+        UnmapViewOfFile (this->_data);
+    }
+    if (this->_mapping != nullptr) {
+        CloseHandle (this->_mapping);
+    }
+    if (this->_file != INVALID_HANDLE_VALUE) {
+        CloseHandle (this->_file);
+    }
+}
+
+#else // POSIX
+
+MappedFile::MappedFile (std::string const &file)
+  : _data(nullptr), _size(0)
+{
+    int fd = open (file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if ((fstat (fd, &st) == 0) && (st.st_size > 0)) {
+        void *p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            this->_data = static_cast<const uint8_t *>(p);
+            this->_size = static_cast<size_t>(st.st_size);
+        }
+    }
+
+    // the mapping stays valid after the file is closed
+    close (fd);
+}
+
+MappedFile::~MappedFile ()
+{
+    if (this->_data != nullptr) {
+        munmap (const_cast<uint8_t *>(this->_data), this->_size);
+    }
+}
+
+#endif // CS237_WINDOWS
+
+} /* namespace __detail */
+
+} /* namespace cs237 */
@@ -0,0 +1,61 @@
+/*! \file mapped-file.hpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Read-only memory-mapped files.  This header is private to the library.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+#include "cs237-config.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace cs237 {
+
+namespace __detail {
+
+    //! A file that is mapped read-only into the address space.  On POSIX systems
+    //! the file is mapped using `mmap`; on Windows it is mapped using a file-mapping
+    //! object.
+    class MappedFile {
+    public:
+        //! map a file
+        //! \param file  the name of the file
+        explicit MappedFile (std::string const &file);
+
+        ~MappedFile ();
+
+        MappedFile (MappedFile const &) = delete;
+        MappedFile &operator= (MappedFile const &) = delete;
+
+        //! was the file successfully mapped?
+        bool isValid () const { return this->_data != nullptr; }
+        //! the contents of the file
+        const uint8_t *data () const { return this->_data; }
+        //! the size of the file in bytes
+        size_t size () const { return this->_size; }
+
+    private:
+        const uint8_t *_data;   //!< the mapped data (nullptr on error)
+        size_t _size;           //!< the size of the file
+#ifdef CS237_WINDOWS
+        void *_file;            //!< the file handle
+        void *_mapping;         //!< the file-mapping object
+#endif
+    };
+
+} /* namespace __detail */
+
+} /* namespace cs237 */
+
+#endif /* !_MAPPED_FILE_HPP_ */
@@ -0,0 +1,285 @@
+/*! \file mesh-opt.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Reordering of indexed triangle meshes for the GPU's post-transform vertex
+ * cache, for overdraw, and for vertex-fetch locality.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "obj.hpp"
+#include "mesh-opt.hpp"
+
+namespace OBJ {
+
+namespace __details {
+
+std::vector<uint32_t> tipsify (
+    uint32_t *indices, uint32_t nIndices, uint32_t nVerts, uint32_t cacheSize)
+{
+    uint32_t nTris = nIndices / 3;
+    int64_t k = cacheSize;
+
+    // the triangle adjacency of the vertices, in compressed form: the triangles
+    // that use vertex v are adj[offset[v]] .. adj[offset[v+1]-1]
+    std::vector<uint32_t> offset(nVerts + 1, 0);
+    for (uint32_t i = 0;  i < nIndices;  i++) {
+        offset[indices[i] + 1]++;
+    }
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        offset[v + 1] += offset[v];
+    }
+    std::vector<uint32_t> adj(nIndices);
+    {
+        std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+        for (uint32_t i = 0;  i < nIndices;  i++) {
+            adj[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    // the number of live (i.e., unemitted) triangles of each vertex
+    std::vector<uint32_t> live(nVerts);
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        live[v] = offset[v + 1] - offset[v];
+    }
+
+    std::vector<int64_t> cacheTime(nVerts, 0);  // when the vertex entered the cache
+    std::vector<uint32_t> deadEnd;              // stack of recently used vertices
+    std::vector<bool> emitted(nTris, false);
+    std::vector<uint32_t> candidates;           // the 1-ring of the fanning vertex
+    std::vector<uint32_t> out;                  // the reordered indices
+    std::vector<uint32_t> deadEnds;             // the dead-end positions
+    out.reserve (nIndices);
+    deadEnd.reserve (nIndices);
+
+    int64_t time = k + 1;
+    uint32_t cursor = 0;
+    int64_t fan = (nVerts > 0) ? 0 : -1;
+    bool atDeadEnd = false;
+
+    while (fan >= 0) {
+        if (atDeadEnd) {
+            deadEnds.push_back (out.size() / 3);
+            atDeadEnd = false;
+        }
+        // emit the live triangles around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = offset[fan];  a < offset[fan + 1];  a++) {
+            uint32_t t = adj[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (int j = 0;  j < 3;  j++) {
+                uint32_t v = indices[3*t + j];
+                out.push_back (v);
+                deadEnd.push_back (v);
+                candidates.push_back (v);
+                live[v]--;
+                if (time - cacheTime[v] > k) {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // pick the candidate that will still be in the cache after its remaining
+        // triangles are emitted, preferring the one that has been in the cache
+        // longest
+        fan = -1;
+        int64_t best = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] > 0) {
+                int64_t p = 0;
+                if (time - cacheTime[v] + 2 * int64_t(live[v]) <= k) {
+                    p = time - cacheTime[v];
+                }
+                if (p > best) {
+                    best = p;
+                    fan = v;
+                }
+            }
+        }
+
+        if (fan < 0) {
+            // dead end: try the recently used vertices, and then the vertices in
+            // input order
+            while (!deadEnd.empty() && (fan < 0)) {
+                uint32_t d = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[d] > 0) {
+                    fan = d;
+                }
+            }
+            while ((fan < 0) && (cursor < nVerts)) {
+                if (live[cursor] > 0) {
+                    fan = cursor;
+                }
+                cursor++;
+            }
+            atDeadEnd = true;
+        }
+    }
+
+    std::copy (out.begin(), out.end(), indices);
+
+    return deadEnds;
+}
+
+// Split the triangles at the dead ends of the Tipsify order into clusters.
+// Reordering the clusters flushes the cache at each cluster boundary, so, following
+// Sander et al., we only end a cluster at a dead end once the cluster's cache miss
+// ratio, simulated with a cold cache, is within a factor of lambda of the ratio of
+// the whole mesh.
+static std::vector<uint32_t> splitClusters (
+    const uint32_t *indices, uint32_t nIndices, uint32_t nVerts,
+    std::vector<uint32_t> const &deadEnds,
+    uint32_t cacheSize, float lambda)
+{
+    uint32_t nTris = nIndices / 3;
+    int64_t k = cacheSize;
+
+    // the miss ratio of the whole mesh
+    std::vector<int64_t> stamp(nVerts, -k - 1);
+    int64_t nMisses = 0;
+    for (uint32_t i = 0;  i < nIndices;  i++) {
+        if (nMisses - stamp[indices[i]] > k) {
+            stamp[indices[i]] = nMisses++;
+        }
+    }
+    float limit = lambda * float(nMisses) / float(nTris);
+
+    // resimulate, flushing the cache at the start of each cluster
+    std::fill (stamp.begin(), stamp.end(), -k - 1);
+    nMisses = 0;
+    int64_t clusterMisses = 0;      // the value of nMisses at the start of the cluster
+    std::vector<uint32_t> clusters(1, 0);
+    size_t next = 0;
+    for (uint32_t t = 0;  t < nTris;  t++) {
+        while ((next < deadEnds.size()) && (deadEnds[next] < t)) {
+            next++;
+        }
+        if ((next < deadEnds.size()) && (deadEnds[next] == t) && (t > clusters.back())) {
+            float ratio = float(nMisses - clusterMisses) / float(t - clusters.back());
+            if (ratio <= limit) {
+                clusters.push_back (t);
+                clusterMisses = nMisses;
+            }
+        }
+        for (int j = 0;  j < 3;  j++) {
+            uint32_t v = indices[3*t + j];
+            if ((nMisses - stamp[v] > k) || (stamp[v] < clusterMisses)) {
+                stamp[v] = nMisses++;
+            }
+        }
+    }
+
+    return clusters;
+}
+
+void sortClustersForOverdraw (
+    uint32_t *indices, uint32_t nIndices, uint32_t nVerts,
+    const glm::vec3 *pos,
+    std::vector<uint32_t> const &deadEnds,
+    uint32_t cacheSize, float lambda)
+{
+    uint32_t nTris = nIndices / 3;
+    std::vector<uint32_t> clusters = splitClusters (
+        indices, nIndices, nVerts, deadEnds, cacheSize, lambda);
+    uint32_t nClusters = clusters.size();
+    if (nClusters < 2) {
+        return;
+    }
+
+    // the area-weighted centroid and normal of each cluster
+    std::vector<glm::vec3> centroid(nClusters, glm::vec3(0.0f));
+    std::vector<glm::vec3> normal(nClusters, glm::vec3(0.0f));
+    std::vector<float> area(nClusters, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (uint32_t c = 0;  c < nClusters;  c++) {
+        uint32_t end = (c + 1 < nClusters) ? clusters[c + 1] : nTris;
+        for (uint32_t t = clusters[c];  t < end;  t++) {
+            glm::vec3 p0 = pos[indices[3*t]];
+            glm::vec3 p1 = pos[indices[3*t+1]];
+            glm::vec3 p2 = pos[indices[3*t+2]];
+            glm::vec3 n = glm::cross (p1 - p0, p2 - p0);   // length is twice the area
+            float a = glm::length (n);
+            centroid[c] += a * (p0 + p1 + p2) / 3.0f;
+            normal[c] += n;
+            area[c] += a;
+        }
+        meshCentroid += centroid[c];
+        meshArea += area[c];
+        if (area[c] > 0.0f) {
+            centroid[c] /= area[c];
+        }
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    // sort the clusters by how much they face away from the center of the mesh
+    std::vector<float> key(nClusters);
+    std::vector<uint32_t> order(nClusters);
+    for (uint32_t c = 0;  c < nClusters;  c++) {
+        key[c] = glm::dot (centroid[c] - meshCentroid, normal[c]);
+        order[c] = c;
+    }
+    std::stable_sort (order.begin(), order.end(),
+        [&key] (uint32_t a, uint32_t b) { return key[a] > key[b]; });
+
+    std::vector<uint32_t> out;
+    out.reserve (nIndices);
+    for (uint32_t c : order) {
+        uint32_t end = (c + 1 < nClusters) ? clusters[c + 1] : nTris;
+        out.insert (out.end(), indices + 3 * clusters[c], indices + 3 * end);
+    }
+    std::copy (out.begin(), out.end(), indices);
+}
+
+std::vector<uint32_t> remapForFetch (uint32_t *indices, uint32_t nIndices, uint32_t nVerts)
+{
+    const uint32_t kUnused = ~0u;
+    std::vector<uint32_t> newIdx(nVerts, kUnused);
+    std::vector<uint32_t> remap;
+    remap.reserve (nVerts);
+    for (uint32_t i = 0;  i < nIndices;  i++) {
+        uint32_t v = indices[i];
+        if (newIdx[v] == kUnused) {
+            newIdx[v] = remap.size();
+            remap.push_back (v);
+        }
+        indices[i] = newIdx[v];
+    }
+    return remap;
+}
+
+} // namespace __details
+
+float acmr (Group const &g, uint32_t cacheSize)
+{
+    if (g.nIndices < 3) {
+        return 0.0f;
+    }
+
+    // simulate a FIFO cache, where stamp[v] is the number of misses at the
+    // time that v was loaded into the cache
+    std::vector<int64_t> stamp(g.nVerts, -int64_t(cacheSize) - 1);
+    int64_t nMisses = 0;
+    for (uint32_t i = 0;  i < g.nIndices;  i++) {
+        uint32_t v = g.indices[i];
+        if (nMisses - stamp[v] > int64_t(cacheSize)) {
+            stamp[v] = nMisses++;
+        }
+    }
+
+    return float(nMisses) / float(g.nIndices / 3);
+}
+
+} // namespace OBJ
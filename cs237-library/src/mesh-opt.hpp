@@ -0,0 +1,135 @@
+/*! \file mesh-opt.hpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Reordering of indexed triangle meshes for the GPU's post-transform vertex
+ * cache, for overdraw, and for vertex-fetch locality, and simplification of
+ * meshes for levels of detail.  This header is private to the library.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _MESH_OPT_HPP_
+#define _MESH_OPT_HPP_
+
+#include "cs237.hpp"
+#include <vector>
+
+namespace OBJ {
+
+namespace __details {
+
+    //! \brief reorder the triangles of a mesh for the post-transform vertex cache
+    //!        using the Tipsify algorithm (Sander, Nehab, and Barczak, "Fast
+    //!        Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007).
+    //! \param indices    the index array, which is reordered in place
+    //! \param nIndices   the number of indices (3 * number of triangles)
+    //! \param nVerts     the number of vertices
+    //! \param cacheSize  the size of the vertex cache to optimize for
+    //! \return the positions (in triangles) of the dead ends in the new order,
+    //!         where the algorithm had to jump to a vertex that was not adjacent
+    //!         to the previous triangles
+    std::vector<uint32_t> tipsify (
+        uint32_t *indices, uint32_t nIndices, uint32_t nVerts, uint32_t cacheSize);
+
+    //! \brief split the output of `tipsify` into clusters at its dead ends and
+    //!        reorder the clusters so that clusters that face away from the center
+    //!        of the mesh are drawn first, which tends to reduce overdraw.  The
+    //!        order of triangles within a cluster is preserved.
+    //! \param indices    the index array, which is reordered in place
+    //! \param nIndices   the number of indices
+    //! \param nVerts     the number of vertices
+    //! \param pos        the vertex positions
+    //! \param deadEnds   the dead ends returned by `tipsify`
+    //! \param cacheSize  the size of the vertex cache
+    //! \param lambda     the allowed increase in the cache miss ratio (>= 1)
+    void sortClustersForOverdraw (
+        uint32_t *indices, uint32_t nIndices, uint32_t nVerts,
+        const glm::vec3 *pos,
+        std::vector<uint32_t> const &deadEnds,
+        uint32_t cacheSize, float lambda);
+
+    //! \brief compute a renumbering of the vertices in order of first use by
+    //!        the index array, which improves the locality of vertex fetches.
+    //!        The index array is rewritten to use the new numbering.
+    //! \param indices   the index array, which is renumbered in place
+    //! \param nIndices  the number of indices
+    //! \param nVerts    the number of vertices
+    //! \return remap, where remap[i] is the old index of new vertex i
+    std::vector<uint32_t> remapForFetch (
+        uint32_t *indices, uint32_t nIndices, uint32_t nVerts);
+
+    //! \brief simplification of an indexed triangle mesh by edge collapses that are
+    //!        ordered by quadric error metrics (Garland and Heckbert, "Surface
+    //!        Simplification Using Quadric Error Metrics", 1997).  Each collapse
+    //!        moves a vertex onto one of its neighbors, so the simplified meshes
+    //!        only need new index arrays and can share the original vertex data.
+    //!        Vertices on attribute seams (i.e., vertices that share a position
+    //!        with another vertex) are not moved, which keeps seams closed, and
+    //!        vertices on the boundary of the mesh only move along the boundary.
+    class Simplifier {
+      public:
+        //! \param indices   the index array of the mesh
+        //! \param nIndices  the number of indices
+        //! \param nVerts    the number of vertices
+        //! \param pos       the vertex positions
+        Simplifier (
+            const uint32_t *indices, uint32_t nIndices, uint32_t nVerts,
+            const glm::vec3 *pos);
+
+        //! \brief continue simplifying the mesh until it has at most the target
+        //!        number of triangles or no further edge can be collapsed
+        //! \param targetTris  the target number of triangles
+        void simplify (uint32_t targetTris);
+
+        //! the current number of triangles
+        uint32_t nTriangles () const { return this->_indices.size() / 3; }
+        //! the index array of the current mesh
+        std::vector<uint32_t> const &indices () const { return this->_indices; }
+        //! the geometric error of the current mesh, which is the largest
+        //! (area-weighted RMS) distance between a moved vertex and the surface
+        //! that it came from
+        float error () const { return std::sqrt(float(this->_maxError)); }
+
+      private:
+        //! the accumulated quadric of a vertex position
+        struct Quadric {
+            double a00, a01, a02, a11, a12, a22;        //!< the matrix A
+            double b0, b1, b2;                          //!< the vector b
+            double c;                                   //!< the constant
+            double w;                                   //!< the total weight
+
+            //! add the plane n.p + d = 0 with weight w
+            void addPlane (glm::dvec3 const &n, double d, double w);
+            //! the weighted mean squared distance of p from the planes
+            double error (glm::dvec3 const &p) const;
+            Quadric &operator+= (Quadric const &q);
+        };
+
+        uint32_t _nVerts;
+        std::vector<glm::dvec3> _pos;           //!< the vertex positions
+        std::vector<uint32_t> _weld;            //!< the first vertex with the same position
+        std::vector<bool> _seam;                //!< is the vertex on an attribute seam?
+        std::vector<Quadric> _quadrics;         //!< the quadrics indexed by _weld
+        std::vector<uint32_t> _indices;         //!< the current index array
+        double _maxError;                       //!< the largest collapse error so far
+
+        //! the welded edge between two vertices as a sortable key
+        uint64_t _edgeKey (uint32_t a, uint32_t b) const;
+        //! would replacing a by b flip (or degenerate) any of a's triangles?
+        bool _flips (uint32_t a, uint32_t b,
+            std::vector<uint32_t> const &offset, std::vector<uint32_t> const &adj) const;
+        //! one round of non-overlapping collapses; returns the number removed
+        uint32_t _pass (uint32_t targetTris);
+    };
+
+} // namespace __details
+
+} // namespace OBJ
+
+#endif // !_MESH_OPT_HPP_
@@ -0,0 +1,342 @@
+/*! \file mesh-simplify.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Simplification of indexed triangle meshes using quadric error metrics.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "obj.hpp"
+#include "mesh-opt.hpp"
+
+namespace OBJ {
+
+namespace __details {
+
+//! the weight of the planes that constrain boundary vertices to the boundary,
+//! relative to the squared length of the boundary edge
+constexpr double kBorderWeight = 10.0;
+
+//! the kinds of vertices
+enum {
+    kManifold = 0,              //!< the vertex can collapse onto any neighbor
+    kBorder = 1,                //!< the vertex can only collapse along the boundary
+    kLocked = 2                 //!< the vertex cannot be moved
+};
+
+/***** Quadrics *****/
+
+void Simplifier::Quadric::addPlane (glm::dvec3 const &n, double d, double w)
+{
+    this->a00 += w * n.x * n.x;
+    this->a01 += w * n.x * n.y;
+    this->a02 += w * n.x * n.z;
+    this->a11 += w * n.y * n.y;
+    this->a12 += w * n.y * n.z;
+    this->a22 += w * n.z * n.z;
+    this->b0 += w * n.x * d;
+    this->b1 += w * n.y * d;
+    this->b2 += w * n.z * d;
+    this->c += w * d * d;
+    this->w += w;
+}
+
+double Simplifier::Quadric::error (glm::dvec3 const &p) const
+{
+    if (this->w <= 0.0) {
+        return 0.0;
+    }
+    double e = this->a00 * p.x * p.x + this->a11 * p.y * p.y + this->a22 * p.z * p.z
+        + 2.0 * (this->a01 * p.x * p.y + this->a02 * p.x * p.z + this->a12 * p.y * p.z)
+        + 2.0 * (this->b0 * p.x + this->b1 * p.y + this->b2 * p.z)
+        + this->c;
+    return std::max(e, 0.0) / this->w;
+}
+
+Simplifier::Quadric &Simplifier::Quadric::operator+= (Quadric const &q)
+{
+    this->a00 += q.a00;  this->a01 += q.a01;  this->a02 += q.a02;
+    this->a11 += q.a11;  this->a12 += q.a12;  this->a22 += q.a22;
+    this->b0 += q.b0;  this->b1 += q.b1;  this->b2 += q.b2;
+    this->c += q.c;
+    this->w += q.w;
+    return *this;
+}
+
+/***** class Simplifier member functions *****/
+
+Simplifier::Simplifier (
+    const uint32_t *indices, uint32_t nIndices, uint32_t nVerts,
+    const glm::vec3 *pos)
+  : _nVerts(nVerts), _pos(nVerts), _weld(nVerts), _seam(nVerts, false),
+    _quadrics(nVerts, Quadric{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}),
+    _indices(indices, indices + nIndices), _maxError(0.0)
+{
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        this->_pos[v] = glm::dvec3(pos[v]);
+    }
+
+    // weld the vertices that have the same position; these are vertices that
+    // differ in their normals or texture coordinates
+    std::vector<uint32_t> order(nVerts);
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        order[v] = v;
+    }
+    auto less = [pos] (uint32_t a, uint32_t b) {
+        if (pos[a].x != pos[b].x) { return pos[a].x < pos[b].x; }
+        if (pos[a].y != pos[b].y) { return pos[a].y < pos[b].y; }
+        if (pos[a].z != pos[b].z) { return pos[a].z < pos[b].z; }
+        return a < b;
+    };
+    std::sort (order.begin(), order.end(), less);
+    for (uint32_t i = 0;  i < nVerts;  ) {
+        uint32_t j = i + 1;
+        while ((j < nVerts) && (pos[order[j]] == pos[order[i]])) {
+            j++;
+        }
+        for (uint32_t k = i;  k < j;  k++) {
+            this->_weld[order[k]] = order[i];
+            this->_seam[order[k]] = (j - i > 1);
+        }
+        i = j;
+    }
+
+    // the planes of the triangles
+    uint32_t nTris = nIndices / 3;
+    std::vector<uint64_t> edges;
+    edges.reserve (nIndices);
+    for (uint32_t t = 0;  t < nTris;  t++) {
+        const uint32_t *tri = &indices[3*t];
+        glm::dvec3 n = glm::cross (
+            this->_pos[tri[1]] - this->_pos[tri[0]],
+            this->_pos[tri[2]] - this->_pos[tri[0]]);
+        double len = glm::length(n);
+        if (len > 0.0) {
+            n /= len;
+            double d = -glm::dot(n, this->_pos[tri[0]]);
+            for (int j = 0;  j < 3;  j++) {
+                this->_quadrics[this->_weld[tri[j]]].addPlane (n, d, 0.5 * len);
+            }
+        }
+        for (int j = 0;  j < 3;  j++) {
+            edges.push_back (this->_edgeKey (tri[j], tri[(j+1) % 3]));
+        }
+    }
+    std::sort (edges.begin(), edges.end());
+
+    // planes that are perpendicular to the boundary edges, which keep the
+    // boundary from shrinking
+    for (uint32_t t = 0;  t < nTris;  t++) {
+        const uint32_t *tri = &indices[3*t];
+        glm::dvec3 n = glm::cross (
+            this->_pos[tri[1]] - this->_pos[tri[0]],
+            this->_pos[tri[2]] - this->_pos[tri[0]]);
+        for (int j = 0;  j < 3;  j++) {
+            uint32_t a = tri[j], b = tri[(j+1) % 3];
+            auto r = std::equal_range (edges.begin(), edges.end(), this->_edgeKey (a, b));
+            if (r.second - r.first == 1) {
+                glm::dvec3 e = this->_pos[b] - this->_pos[a];
+                glm::dvec3 m = glm::cross (e, n);
+                double len = glm::length(m);
+                if (len > 0.0) {
+                    m /= len;
+                    double d = -glm::dot(m, this->_pos[a]);
+                    double w = kBorderWeight * glm::dot(e, e);
+                    this->_quadrics[this->_weld[a]].addPlane (m, d, w);
+                    this->_quadrics[this->_weld[b]].addPlane (m, d, w);
+                }
+            }
+        }
+    }
+
+}
+
+uint64_t Simplifier::_edgeKey (uint32_t a, uint32_t b) const
+{
+    uint64_t wa = this->_weld[a], wb = this->_weld[b];
+    return (wa < wb) ? ((wa << 32) | wb) : ((wb << 32) | wa);
+}
+
+bool Simplifier::_flips (
+    uint32_t a, uint32_t b,
+    std::vector<uint32_t> const &offset, std::vector<uint32_t> const &adj) const
+{
+    for (uint32_t i = offset[a];  i < offset[a + 1];  i++) {
+        const uint32_t *tri = &this->_indices[3 * adj[i]];
+        if ((tri[0] == b) || (tri[1] == b) || (tri[2] == b)) {
+            // this triangle is removed by the collapse
+            continue;
+        }
+        glm::dvec3 p[3], q[3];
+        for (int j = 0;  j < 3;  j++) {
+            p[j] = this->_pos[tri[j]];
+            q[j] = (tri[j] == a) ? this->_pos[b] : p[j];
+        }
+        glm::dvec3 n0 = glm::cross (p[1] - p[0], p[2] - p[0]);
+        glm::dvec3 n1 = glm::cross (q[1] - q[0], q[2] - q[0]);
+        if (glm::dot(n0, n1) <= 0.0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t Simplifier::_pass (uint32_t targetTris)
+{
+    uint32_t nTris = this->nTriangles();
+    if (nTris <= targetTris) {
+        return 0;
+    }
+    uint32_t needed = nTris - targetTris;
+    uint32_t *indices = this->_indices.data();
+
+    // count the triangles of the welded edge of each half edge (i.e., the edge
+    // from indices[i] to the next vertex of its triangle); vertices on boundary
+    // edges can only move along the boundary and vertices on non-manifold edges
+    // cannot move
+    struct HalfEdge {
+        uint64_t key;
+        uint32_t i;
+    };
+    std::vector<HalfEdge> edges(3 * nTris);
+    for (uint32_t i = 0;  i < 3 * nTris;  i++) {
+        uint32_t j = (i % 3 == 2) ? i - 2 : i + 1;
+        edges[i] = HalfEdge{this->_edgeKey (indices[i], indices[j]), i};
+    }
+    std::sort (edges.begin(), edges.end(),
+        [] (HalfEdge const &x, HalfEdge const &y) { return x.key < y.key; });
+    std::vector<uint32_t> edgeCount(3 * nTris);
+    for (uint32_t e = 0;  e < 3 * nTris;  ) {
+        uint32_t f = e + 1;
+        while ((f < 3 * nTris) && (edges[f].key == edges[e].key)) {
+            f++;
+        }
+        for (uint32_t k = e;  k < f;  k++) {
+            edgeCount[edges[k].i] = f - e;
+        }
+        e = f;
+    }
+    std::vector<uint8_t> kind(this->_nVerts, kManifold);
+    for (uint32_t i = 0;  i < 3 * nTris;  i++) {
+        uint32_t j = (i % 3 == 2) ? i - 2 : i + 1;
+        uint32_t a = indices[i], b = indices[j];
+        uint32_t n = edgeCount[i];
+        uint8_t k = (n == 1) ? kBorder : ((n > 2) ? kLocked : kManifold);
+        kind[this->_weld[a]] = std::max(kind[this->_weld[a]], k);
+        kind[this->_weld[b]] = std::max(kind[this->_weld[b]], k);
+    }
+
+    // the triangles of each vertex
+    std::vector<uint32_t> offset(this->_nVerts + 1, 0);
+    for (uint32_t i = 0;  i < 3 * nTris;  i++) {
+        offset[indices[i] + 1]++;
+    }
+    for (uint32_t v = 0;  v < this->_nVerts;  v++) {
+        offset[v + 1] += offset[v];
+    }
+    std::vector<uint32_t> adj(3 * nTris);
+    {
+        std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+        for (uint32_t i = 0;  i < 3 * nTris;  i++) {
+            adj[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    // the candidate collapses, in order of increasing error.  An interior edge
+    // appears in opposite directions in its two triangles, so we only need to
+    // consider both directions of boundary edges.
+    struct Collapse {
+        uint32_t from, to;
+        double cost;
+    };
+    std::vector<Collapse> cands;
+    cands.reserve (3 * nTris);
+    for (uint32_t i = 0;  i < 3 * nTris;  i++) {
+        uint32_t j = (i % 3 == 2) ? i - 2 : i + 1;
+        bool border = (edgeCount[i] == 1);
+        for (int dir = 0;  dir < (border ? 2 : 1);  dir++) {
+            uint32_t a = dir ? indices[j] : indices[i];
+            uint32_t b = dir ? indices[i] : indices[j];
+            uint8_t k = kind[this->_weld[a]];
+            if (this->_seam[a] || (k == kLocked) || ((k == kBorder) && !border)) {
+                continue;
+            }
+            Quadric q = this->_quadrics[this->_weld[a]];
+            q += this->_quadrics[this->_weld[b]];
+            cands.push_back (Collapse{a, b, q.error (this->_pos[b])});
+        }
+    }
+    if (cands.empty()) {
+        return 0;
+    }
+    std::sort (cands.begin(), cands.end(),
+        [] (Collapse const &x, Collapse const &y) { return x.cost < y.cost; });
+
+    // perform the cheapest collapses that do not overlap.  A collapse locks the
+    // vertices of the triangles that it changes, so the adjacency information
+    // stays valid for the remaining unlocked vertices.  We only take collapses up
+    // to the cost of the needed'th candidate, so that a pass does not fall back on
+    // expensive collapses when the cheap ones are blocked; the next pass gets them.
+    double limit = cands[std::min<size_t>(cands.size(), needed) - 1].cost;
+    std::vector<bool> locked(this->_nVerts, false);
+    uint32_t removed = 0;
+    for (auto const &c : cands) {
+        if ((removed >= needed) || ((c.cost > limit) && (removed > 0))) {
+            break;
+        }
+        if (locked[c.from] || locked[c.to]
+        || this->_flips (c.from, c.to, offset, adj)) {
+            continue;
+        }
+        this->_quadrics[this->_weld[c.to]] += this->_quadrics[this->_weld[c.from]];
+        for (uint32_t i = offset[c.from];  i < offset[c.from + 1];  i++) {
+            uint32_t *tri = &indices[3 * adj[i]];
+            for (int j = 0;  j < 3;  j++) {
+                if (tri[j] == c.from) {
+                    tri[j] = c.to;
+                }
+                locked[tri[j]] = true;
+            }
+            if ((tri[0] == tri[1]) || (tri[1] == tri[2]) || (tri[2] == tri[0])) {
+                removed++;
+            }
+        }
+        locked[c.from] = true;
+        this->_maxError = std::max(this->_maxError, c.cost);
+    }
+
+    // remove the triangles that have become degenerate
+    uint32_t k = 0;
+    for (uint32_t t = 0;  t < nTris;  t++) {
+        uint32_t w0 = this->_weld[indices[3*t]];
+        uint32_t w1 = this->_weld[indices[3*t+1]];
+        uint32_t w2 = this->_weld[indices[3*t+2]];
+        if ((w0 != w1) && (w1 != w2) && (w2 != w0)) {
+            indices[k++] = indices[3*t];
+            indices[k++] = indices[3*t+1];
+            indices[k++] = indices[3*t+2];
+        }
+    }
+    this->_indices.resize (k);
+
+    return nTris - k / 3;
+}
+
+void Simplifier::simplify (uint32_t targetTris)
+{
+    while (this->nTriangles() > targetTris) {
+        if (this->_pass (targetTris) == 0) {
+            break;
+        }
+    }
+}
+
+} // namespace __details
+
+} // namespace OBJ
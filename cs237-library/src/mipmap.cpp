@@ -0,0 +1,177 @@
+/*! \file mipmap.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * CPU generation of mipmap chains.  Each level is computed from the previous
+ * level using a 2x2 box filter.  For sRGB images, the color channels are
+ * averaged in linear space, while alpha and data channels are averaged
+ * directly.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "pixel-ops.hpp"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cs237 {
+
+using __detail::SRGBTables;
+using __detail::srgbTables;
+using __detail::kLinearTblSize;
+
+/***** Downsampling kernels *****/
+
+// downsample a level using a 2x2 box filter where all channels are linear.
+// Source pixels outside the level are clamped to the edge, which handles odd
+// sizes and levels that are only one pixel wide or high.
+static void downsampleLinear (
+    uint32_t nChans,
+    uint32_t srcWid, uint32_t srcHt, const uint8_t *src,
+    uint32_t dstWid, uint32_t dstHt, uint8_t *dst)
+{
+    size_t srcStride = size_t(srcWid) * nChans;
+    for (uint32_t y = 0;  y < dstHt;  ++y) {
+        const uint8_t *row0 = src + size_t(std::min(2*y, srcHt - 1)) * srcStride;
+        const uint8_t *row1 = src + size_t(std::min(2*y + 1, srcHt - 1)) * srcStride;
+        uint8_t *out = dst + size_t(y) * dstWid * nChans;
+        uint32_t x = 0;
+#if defined(__SSE2__)
+        // process four source pixels (two destination pixels) at a time
+        if ((nChans == 4) && (srcWid >= 2*dstWid)) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            for (;  x + 2 <= dstWid;  x += 2) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 8*x));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 8*x));
+                // vertical sums as 16-bit values
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                // horizontal sums of adjacent pixels
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                __m128i sum = _mm_unpacklo_epi64(lo, hi);
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                _mm_storel_epi64(
+                    reinterpret_cast<__m128i *>(out + 4*x),
+                    _mm_packus_epi16(sum, sum));
+            }
+        }
+#endif
+        for (;  x < dstWid;  ++x) {
+            uint32_t x0 = std::min(2*x, srcWid - 1) * nChans;
+            uint32_t x1 = std::min(2*x + 1, srcWid - 1) * nChans;
+            for (uint32_t k = 0;  k < nChans;  ++k) {
+                uint32_t sum = row0[x0 + k] + row0[x1 + k] + row1[x0 + k] + row1[x1 + k];
+                out[nChans*x + k] = uint8_t((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+// downsample a level of RGBA pixels using a 2x2 box filter, where the RGB channels
+// are sRGB encoded.
+static void downsampleSRGB (
+    uint32_t srcWid, uint32_t srcHt, const uint8_t *src,
+    uint32_t dstWid, uint32_t dstHt, uint8_t *dst)
+{
+    SRGBTables const &tbls = srgbTables();
+    const float *lin = tbls.toLinear;
+    size_t srcStride = size_t(srcWid) * 4;
+
+    for (uint32_t y = 0;  y < dstHt;  ++y) {
+        const uint8_t *row0 = src + size_t(std::min(2*y, srcHt - 1)) * srcStride;
+        const uint8_t *row1 = src + size_t(std::min(2*y + 1, srcHt - 1)) * srcStride;
+        uint8_t *out = dst + size_t(y) * dstWid * 4;
+        for (uint32_t x = 0;  x < dstWid;  ++x) {
+            const uint8_t *p[4] = {
+                    row0 + 4 * std::min(2*x, srcWid - 1),
+                    row0 + 4 * std::min(2*x + 1, srcWid - 1),
+                    row1 + 4 * std::min(2*x, srcWid - 1),
+                    row1 + 4 * std::min(2*x + 1, srcWid - 1)
+                };
+#if defined(__SSE2__)
+            // average the linearized colors and convert them to 16-bit table indices;
+            // the alpha channel is scaled so that it ends up in [0,255].
+            __m128 sum = _mm_setzero_ps();
+            for (int i = 0;  i < 4;  ++i) {
+                sum = _mm_add_ps(sum,
+                    _mm_setr_ps(lin[p[i][0]], lin[p[i][1]], lin[p[i][2]], float(p[i][3])));
+            }
+            const __m128 scale = _mm_setr_ps(
+                0.25f * float(kLinearTblSize - 1),
+                0.25f * float(kLinearTblSize - 1),
+                0.25f * float(kLinearTblSize - 1),
+                0.25f);
+            alignas(16) int32_t idx[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(idx), _mm_cvtps_epi32(_mm_mul_ps(sum, scale)));
+            out[4*x + 0] = tbls.toSRGB[idx[0]];
+            out[4*x + 1] = tbls.toSRGB[idx[1]];
+            out[4*x + 2] = tbls.toSRGB[idx[2]];
+            out[4*x + 3] = uint8_t(idx[3]);
+#else
+            for (int k = 0;  k < 3;  ++k) {
+                float avg = 0.25f * (lin[p[0][k]] + lin[p[1][k]] + lin[p[2][k]] + lin[p[3][k]]);
+                out[4*x + k] = tbls.toSRGB[uint32_t(avg * float(kLinearTblSize - 1) + 0.5f)];
+            }
+            uint32_t alpha = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+            out[4*x + 3] = uint8_t((alpha + 2) >> 2);
+#endif
+        }
+    }
+}
+
+/***** class MipmapImage2D member functions *****/
+
+MipmapImage2D::MipmapImage2D (Image2D const *img, uint32_t nLevels)
+  : _wid(img->width()), _ht(img->height()), _chans(img->channels()),
+    _compressed(false), _bcFmt(bcn::Format::BC1), _sRGB(img->sRGB()),
+    _nBytes(0), _data(nullptr)
+{
+    if (img->type() != ChannelTy::U8) {
+        ERROR("MipmapImage2D: unsupported channel type " + to_string(img->type()));
+    }
+    if ((this->_chans != Channels::R) && (this->_chans != Channels::RG)
+    && (this->_chans != Channels::RGBA)) {
+        ERROR("MipmapImage2D: unsupported channels " + to_string(this->_chans));
+    }
+
+    if (nLevels == 0) {
+        nLevels = fullChainLength(this->_wid, this->_ht);
+    }
+    this->_init (nLevels);
+
+    std::memcpy (this->levelData(0), img->data(), this->_levels[0].nBytes);
+    this->generateLevels (1);
+}
+
+void MipmapImage2D::generateLevels (uint32_t first)
+{
+    assert (first > 0);
+    assert (! this->_compressed);
+
+    uint32_t nChans = (this->_chans == Channels::R) ? 1 : (this->_chans == Channels::RG) ? 2 : 4;
+    bool sRGB = this->_sRGB && (this->_chans == Channels::RGBA);
+    for (uint32_t i = first;  i < this->nLevels();  ++i) {
+        Level const &src = this->_levels[i-1];
+        Level const &dst = this->_levels[i];
+        const uint8_t *srcData = static_cast<const uint8_t *>(this->levelData(i-1));
+        uint8_t *dstData = static_cast<uint8_t *>(this->levelData(i));
+        if (sRGB) {
+            downsampleSRGB (src.wid, src.ht, srcData, dst.wid, dst.ht, dstData);
+        } else {
+            downsampleLinear (nChans, src.wid, src.ht, srcData, dst.wid, dst.ht, dstData);
+        }
+    }
+}
+
+} // namespace cs237
@@ -14,8 +14,8 @@
  */
 
 #include "obj.hpp"
+#include <cstdlib>
 #include <fstream>
-#include <stdexcept>
 #include <utility>
 
 namespace OBJ {
@@ -25,37 +25,34 @@ namespace __details {
 // return the directory part of a pathname
 static std::string dirName (std::string const &path)
 {
-    return path.substr(0, path.find_last_of('/'));
+    size_t pos = path.find_last_of('/');
+    return (pos == std::string::npos) ? std::string(".") : path.substr(0, pos);
 }
 
 // scan one or more floats from a string
-static bool scanFloats (std::string s, int n, float f[3])
+static bool scanFloats (std::string const &s, int n, float f[3])
 {
     assert ((0 < n) && (n <= 3));
-    try {
-        for (int i = 0;  i < n;  i++) {
-            size_t sz;
-            f[i] = std::stof (s, &sz);
-            s = s.substr(sz);
+    const char *p = s.c_str();
+    for (int i = 0;  i < n;  i++) {
+        char *end;
+        f[i] = std::strtof (p, &end);
+        if (end == p) {
+            return false;
         }
-    }
-    catch (std::invalid_argument) {
-        return false;
+        p = end;
     }
 
     return true;
 }
 
-static bool scanInt (std::string s, int &n)
+static bool scanInt (std::string const &s, int &n)
 {
-    try {
-        n = std::stoi (s);
-    }
-    catch (std::invalid_argument) {
-        return false;
-    }
+    const char *p = s.c_str();
+    char *end;
+    n = static_cast<int>(std::strtol (p, &end, 10));
 
-    return true;
+    return (end != p);
 }
 
 static void Error (std::string const &file, int lnum, std::string const &msg)
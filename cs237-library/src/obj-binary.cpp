@@ -0,0 +1,460 @@
+/*! \file obj-binary.cpp
+ *
+ * Binary model files, which hold the contents of an `OBJ::Model` in a form that
+ * can be memory mapped and used in place.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "obj.hpp"
+#include "mapped-file.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace OBJ {
+
+/* The layout of a binary model file is
+ *
+ *      FileHeader
+ *      MaterialRecord[nMaterials]
+ *      GroupRecord[nGroups]
+ *      string table
+ *      vertex and index arrays (each aligned to 8 bytes)
+ *
+ * All offsets are relative to the start of the file and all values are in the
+ * byte order of the host that wrote the file; files with a different byte order
+ * are rejected (and rebuilt by `Model::load`).
+ */
+
+namespace __details {
+
+//! the current version of the format; version 2 files hold groups that have
+//! been reordered for the vertex cache, version 3 files add levels of detail,
+//! and version 4 files always use 32-bit indices
+constexpr uint32_t kVersion = 4;
+
+//! the value of the byteOrder field in the header
+constexpr uint32_t kByteOrder = 0x01020304;
+
+static const char kMagic[8] = { 'O', 'B', 'J', 'M', 'O', 'D', 'E', 'L' };
+
+//! the size and modification time of a source file
+struct Stamp {
+    uint64_t size;
+    int64_t time;
+
+    bool operator== (Stamp const &s) const
+    {
+        return (this->size == s.size) && (this->time == s.time);
+    }
+};
+
+//! a reference to a string in the string table
+struct StrRef {
+    uint32_t offset;            //!< offset of the first character in the table
+    uint32_t length;            //!< the length of the string
+};
+
+struct FileHeader {
+    char magic[8];              //!< "OBJMODEL"
+    uint32_t version;           //!< kVersion
+    uint32_t byteOrder;         //!< kByteOrder
+    Stamp obj;                  //!< the stamp of the OBJ file
+    Stamp mtl;                  //!< the stamp of the MTL file (all zeros if
+                                //!  there is no material library)
+    uint64_t fileSize;          //!< the size of the binary file
+    uint64_t strOffset;         //!< the offset of the string table
+    uint64_t strSize;           //!< the size of the string table
+    float bbox[6];              //!< the bounding box (min followed by max)
+    uint32_t hasBBox;           //!< 1 if the bounding box is non-empty
+    uint32_t nMaterials;        //!< the number of materials
+    uint32_t nGroups;           //!< the number of groups
+    StrRef mtlLibName;          //!< the name of the material library
+};
+
+struct MaterialRecord {
+    StrRef name;
+    int32_t illum;
+    int32_t ambientC, emissiveC, diffuseC, specularC;
+    float ambient[3], emissive[3], diffuse[3], specular[3];
+    float shininess;
+    StrRef ambientMap, emissiveMap, diffuseMap, specularMap, normalMap;
+};
+
+struct GroupRecord {
+    StrRef name;
+    int32_t material;           //!< material index (-1 for none)
+    uint32_t nVerts;
+    uint32_t nIndices;          //!< the number of indices of the full-resolution mesh
+    uint32_t nLODs;             //!< the number of levels of detail
+    uint32_t nTotalIndices;     //!< the number of indices of all levels of detail
+    uint64_t lods;              //!< offset of the LOD array
+    uint64_t verts;             //!< offset of the vertex positions
+    uint64_t norms;             //!< offset of the normals (0 for none)
+    uint64_t txtCoords;         //!< offset of the texture coordinates (0 for none)
+    uint64_t indices;           //!< offset of the indices (nTotalIndices of them)
+};
+
+static_assert ((sizeof(FileHeader) % 8 == 0)
+    && (sizeof(MaterialRecord) % 8 == 0)
+    && (sizeof(GroupRecord) % 8 == 0),
+    "binary model records must preserve 8-byte alignment");
+
+// get the stamp of a file; returns a zero stamp if the file does not exist
+static Stamp getStamp (std::string const &file)
+{
+    Stamp s = { 0, 0 };
+    std::error_code ec;
+    uint64_t sz = fs::file_size (file, ec);
+    if (ec) {
+        return s;
+    }
+    auto t = fs::last_write_time (file, ec);
+    if (ec) {
+        return s;
+    }
+    s.size = sz;
+    s.time = static_cast<int64_t>(t.time_since_epoch().count());
+    return s;
+}
+
+// the path of the material library of an OBJ file
+static std::string mtlPath (std::string const &objFile, std::string const &mtlLib)
+{
+    size_t pos = objFile.find_last_of('/');
+    if (pos == std::string::npos) {
+        return mtlLib;
+    } else {
+        return objFile.substr(0, pos) + "/" + mtlLib;
+    }
+}
+
+//! a helper for building the contents of a binary model file
+class Builder {
+  public:
+    std::vector<char> buf;
+    std::string strs;
+
+    // reserve space for n records of type T and return its offset
+    template <typename T>
+    uint64_t reserve (size_t n)
+    {
+        this->align();
+        uint64_t off = this->buf.size();
+        this->buf.resize (off + n * sizeof(T), 0);
+        return off;
+    }
+
+    // append an array and return its offset
+    uint64_t append (const void *data, size_t nBytes)
+    {
+        this->align();
+        uint64_t off = this->buf.size();
+        const char *p = static_cast<const char *>(data);
+        this->buf.insert (this->buf.end(), p, p + nBytes);
+        return off;
+    }
+
+    // add a string to the string table
+    StrRef string (std::string const &s)
+    {
+        StrRef r;
+        r.offset = static_cast<uint32_t>(this->strs.size());
+        r.length = static_cast<uint32_t>(s.size());
+        this->strs += s;
+        return r;
+    }
+
+    template <typename T>
+    T *at (uint64_t off) { return reinterpret_cast<T *>(this->buf.data() + off); }
+
+  private:
+    void align ()
+    {
+        while ((this->buf.size() & 7) != 0) {
+            this->buf.push_back (0);
+        }
+    }
+};
+
+// check that the levels of detail of a group are consecutive ranges of its
+// index array, starting with the full-resolution mesh
+static bool validLODs (const LOD *lods, GroupRecord const &r)
+{
+    uint32_t next = 0;
+    for (uint32_t i = 0;  i < r.nLODs;  i++) {
+        if ((lods[i].firstIndex != next) || (lods[i].nIndices % 3 != 0)
+        || (r.nTotalIndices - next < lods[i].nIndices)) {
+            return false;
+        }
+        next += lods[i].nIndices;
+    }
+    return (lods[0].nIndices == r.nIndices) && (next == r.nTotalIndices);
+}
+
+static void copy3 (float dst[3], glm::vec3 const &v)
+{
+    dst[0] = v.x; dst[1] = v.y; dst[2] = v.z;
+}
+
+} // namespace __details
+
+using namespace __details;
+
+bool Model::isBinaryCurrent (std::string const &binFile, std::string const &objFile)
+{
+    std::ifstream inS(binFile, std::ios::in | std::ios::binary);
+    if (inS.fail()) {
+        return false;
+    }
+    FileHeader hdr;
+    inS.read (reinterpret_cast<char *>(&hdr), sizeof(hdr));
+    if (inS.fail()
+    || (std::memcmp (hdr.magic, kMagic, sizeof(kMagic)) != 0)
+    || (hdr.version != kVersion)
+    || (hdr.byteOrder != kByteOrder)
+    || !(getStamp(objFile) == hdr.obj)) {
+        return false;
+    }
+
+    if (hdr.mtlLibName.length == 0) {
+        return true;
+    }
+    if (hdr.mtlLibName.offset + uint64_t(hdr.mtlLibName.length) > hdr.strSize) {
+        return false;
+    }
+    std::string mtlLib(hdr.mtlLibName.length, '\0');
+    inS.seekg (hdr.strOffset + hdr.mtlLibName.offset);
+    inS.read (&mtlLib[0], mtlLib.size());
+    return !inS.fail() && (getStamp(mtlPath(objFile, mtlLib)) == hdr.mtl);
+
+}
+
+Model *Model::readBinary (std::string const &binFile, std::string const &objFile)
+{
+    cs237::__detail::MappedFile *f = new cs237::__detail::MappedFile(binFile);
+    if (! f->isValid() || (f->size() < sizeof(FileHeader))) {
+        delete f;
+        return nullptr;
+    }
+    const uint8_t *base = f->data();
+    uint64_t size = f->size();
+    const FileHeader *hdr = reinterpret_cast<const FileHeader *>(base);
+
+    // helpers for checking the structure of the file
+    auto inFile = [size] (uint64_t off, uint64_t nBytes) {
+        return (off <= size) && (nBytes <= size - off) && ((off & 3) == 0);
+    };
+    auto inStrs = [hdr] (StrRef const &r) {
+        return uint64_t(r.offset) + uint64_t(r.length) <= hdr->strSize;
+    };
+
+    uint64_t mtlOff = sizeof(FileHeader);
+    uint64_t grpOff = mtlOff + uint64_t(hdr->nMaterials) * sizeof(MaterialRecord);
+    if ((std::memcmp (hdr->magic, kMagic, sizeof(kMagic)) != 0)
+    || (hdr->version != kVersion)
+    || (hdr->byteOrder != kByteOrder)
+    || (hdr->fileSize != size)
+    || !inFile (grpOff, uint64_t(hdr->nGroups) * sizeof(GroupRecord))
+    || !inFile (hdr->strOffset, hdr->strSize)
+    || !inStrs (hdr->mtlLibName)) {
+        delete f;
+        return nullptr;
+    }
+    const char *strs = reinterpret_cast<const char *>(base + hdr->strOffset);
+    auto str = [strs] (StrRef const &r) { return std::string(strs + r.offset, r.length); };
+
+    Model *model = new Model();
+    model->_path = objFile;
+    model->_mtlLibName = str(hdr->mtlLibName);
+    if (hdr->hasBBox) {
+        model->_bbox = cs237::AABBf_t(
+            glm::vec3(hdr->bbox[0], hdr->bbox[1], hdr->bbox[2]),
+            glm::vec3(hdr->bbox[3], hdr->bbox[4], hdr->bbox[5]));
+    }
+
+    // the materials
+    const MaterialRecord *mtls = reinterpret_cast<const MaterialRecord *>(base + mtlOff);
+    model->_materials.resize (hdr->nMaterials);
+    for (uint32_t i = 0;  i < hdr->nMaterials;  i++) {
+        const MaterialRecord &r = mtls[i];
+        if (!inStrs(r.name) || !inStrs(r.ambientMap) || !inStrs(r.emissiveMap)
+        || !inStrs(r.diffuseMap) || !inStrs(r.specularMap) || !inStrs(r.normalMap)) {
+            delete model;
+            delete f;
+            return nullptr;
+        }
+        Material &m = model->_materials[i];
+        m.name = str(r.name);
+        m.illum = r.illum;
+        m.ambientC = r.ambientC;
+        m.emissiveC = r.emissiveC;
+        m.diffuseC = r.diffuseC;
+        m.specularC = r.specularC;
+        m.ambient = glm::vec3(r.ambient[0], r.ambient[1], r.ambient[2]);
+        m.emissive = glm::vec3(r.emissive[0], r.emissive[1], r.emissive[2]);
+        m.diffuse = glm::vec3(r.diffuse[0], r.diffuse[1], r.diffuse[2]);
+        m.specular = glm::vec3(r.specular[0], r.specular[1], r.specular[2]);
+        m.shininess = r.shininess;
+        m.ambientMap = str(r.ambientMap);
+        m.emissiveMap = str(r.emissiveMap);
+        m.diffuseMap = str(r.diffuseMap);
+        m.specularMap = str(r.specularMap);
+        m.normalMap = str(r.normalMap);
+    }
+
+    // the groups, whose arrays point into the mapped file
+    const GroupRecord *grps = reinterpret_cast<const GroupRecord *>(base + grpOff);
+    model->_groups.resize (hdr->nGroups);
+    for (uint32_t i = 0;  i < hdr->nGroups;  i++) {
+        const GroupRecord &r = grps[i];
+        uint64_t nv = r.nVerts;
+        if (!inStrs(r.name)
+        || (r.material < -1) || (r.material >= int32_t(hdr->nMaterials))
+        || !inFile (r.verts, nv * sizeof(glm::vec3))
+        || ((r.norms != 0) && !inFile (r.norms, nv * sizeof(glm::vec3)))
+        || ((r.txtCoords != 0) && !inFile (r.txtCoords, nv * sizeof(glm::vec2)))
+        || !inFile (r.indices, uint64_t(r.nTotalIndices) * sizeof(uint32_t))
+        || (r.nLODs == 0)
+        || !inFile (r.lods, uint64_t(r.nLODs) * sizeof(LOD))
+        || !validLODs (reinterpret_cast<const LOD *>(base + r.lods), r)) {
+            model->_groups.clear();
+            delete model;
+            delete f;
+            return nullptr;
+        }
+        // the file is mapped read-only, so the group arrays must not be modified
+        uint8_t *p = const_cast<uint8_t *>(base);
+        Group &g = model->_groups[i];
+        g.name = str(r.name);
+        g.material = r.material;
+        g.nVerts = r.nVerts;
+        g.nIndices = r.nIndices;
+        g.verts = reinterpret_cast<glm::vec3 *>(p + r.verts);
+        g.norms = (r.norms != 0) ? reinterpret_cast<glm::vec3 *>(p + r.norms) : nullptr;
+        g.txtCoords = (r.txtCoords != 0)
+            ? reinterpret_cast<glm::vec2 *>(p + r.txtCoords)
+            : nullptr;
+        g.indices = reinterpret_cast<uint32_t *>(p + r.indices);
+        g.nLODs = r.nLODs;
+        g.lods = reinterpret_cast<LOD *>(p + r.lods);
+    }
+
+    model->_binary = f;
+
+    return model;
+
+}
+
+bool Model::writeBinary (std::string const &binFile) const
+{
+    Builder b;
+    b.reserve<FileHeader>(1);
+    uint64_t mtlOff = b.reserve<MaterialRecord>(this->_materials.size());
+    uint64_t grpOff = b.reserve<GroupRecord>(this->_groups.size());
+
+    // the materials
+    for (size_t i = 0;  i < this->_materials.size();  i++) {
+        Material const &m = this->_materials[i];
+        MaterialRecord r;
+        r.name = b.string(m.name);
+        r.illum = m.illum;
+        r.ambientC = m.ambientC;
+        r.emissiveC = m.emissiveC;
+        r.diffuseC = m.diffuseC;
+        r.specularC = m.specularC;
+        copy3 (r.ambient, m.ambient);
+        copy3 (r.emissive, m.emissive);
+        copy3 (r.diffuse, m.diffuse);
+        copy3 (r.specular, m.specular);
+        r.shininess = m.shininess;
+        r.ambientMap = b.string(m.ambientMap);
+        r.emissiveMap = b.string(m.emissiveMap);
+        r.diffuseMap = b.string(m.diffuseMap);
+        r.specularMap = b.string(m.specularMap);
+        r.normalMap = b.string(m.normalMap);
+        *b.at<MaterialRecord>(mtlOff + i * sizeof(MaterialRecord)) = r;
+    }
+
+    // the groups and their arrays
+    for (size_t i = 0;  i < this->_groups.size();  i++) {
+        Group const &g = this->_groups[i];
+        GroupRecord r;
+        r.name = b.string(g.name);
+        r.material = g.material;
+        r.nVerts = g.nVerts;
+        r.nIndices = g.nIndices;
+        r.nLODs = g.nLODs;
+        r.nTotalIndices = g.totalIndices();
+        r.lods = b.append (g.lods, g.nLODs * sizeof(LOD));
+        r.verts = b.append (g.verts, g.nVerts * sizeof(glm::vec3));
+        r.norms = (g.norms != nullptr)
+            ? b.append (g.norms, g.nVerts * sizeof(glm::vec3))
+            : 0;
+        r.txtCoords = (g.txtCoords != nullptr)
+            ? b.append (g.txtCoords, g.nVerts * sizeof(glm::vec2))
+            : 0;
+        r.indices = b.append (g.indices, size_t(r.nTotalIndices) * sizeof(uint32_t));
+        *b.at<GroupRecord>(grpOff + i * sizeof(GroupRecord)) = r;
+    }
+
+    // the header
+    StrRef mtlLibName = b.string(this->_mtlLibName);
+    FileHeader hdr;
+    std::memset (&hdr, 0, sizeof(hdr));
+    std::memcpy (hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.byteOrder = kByteOrder;
+    hdr.obj = getStamp (this->_path);
+    if (! this->_mtlLibName.empty()) {
+        hdr.mtl = getStamp (mtlPath (this->_path, this->_mtlLibName));
+    }
+    hdr.strOffset = b.append (b.strs.data(), b.strs.size());
+    hdr.strSize = b.strs.size();
+    hdr.fileSize = b.buf.size();
+    if (! this->_bbox.isEmpty()) {
+        copy3 (hdr.bbox, this->_bbox.min());
+        copy3 (hdr.bbox + 3, this->_bbox.max());
+        hdr.hasBBox = 1;
+    }
+    hdr.nMaterials = this->_materials.size();
+    hdr.nGroups = this->_groups.size();
+    hdr.mtlLibName = mtlLibName;
+    *b.at<FileHeader>(0) = hdr;
+
+    // write to a temporary file and then rename it, so that a reader never
+    // sees a partial file
+    std::string tmp = binFile + ".tmp";
+    {
+        std::ofstream outS(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (outS.fail()) {
+            return false;
+        }
+        outS.write (b.buf.data(), b.buf.size());
+        outS.close();
+        if (outS.fail()) {
+            std::error_code ec;
+            fs::remove (tmp, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename (tmp, binFile, ec);
+    if (ec) {
+        fs::remove (tmp, ec);
+        return false;
+    }
+
+    return true;
+
+}
+
+} // namespace OBJ
@@ -0,0 +1,197 @@
+/*! \file obj-pack.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Conversion of OBJ groups to interleaved and quantized vertex streams.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "obj.hpp"
+
+namespace OBJ {
+
+// the maximum value of a 16-bit unsigned normalized value
+constexpr float kUnorm16Max = 65535.0f;
+// the maximum value of a 16-bit signed normalized value
+constexpr float kSnorm16Max = 32767.0f;
+
+static inline glm::vec2 signNotZero (glm::vec2 v)
+{
+    return glm::vec2((v.x >= 0.0f) ? 1.0f : -1.0f, (v.y >= 0.0f) ? 1.0f : -1.0f);
+}
+
+// map a unit vector to the [-1..1]^2 square by projecting it onto the octahedron
+// |x| + |y| + |z| = 1 and then folding the lower hemisphere over the upper
+// (Cigolle et al., "A Survey of Efficient Representations for Independent Unit
+// Vectors", JCGT 2014).
+static glm::vec2 octEncode (glm::vec3 n)
+{
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+    if (n.z < 0.0f) {
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(p);
+    }
+    return p;
+}
+
+static glm::vec3 octDecode (glm::vec2 p)
+{
+    glm::vec3 n(p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y));
+    if (n.z < 0.0f) {
+        glm::vec2 xy = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero(glm::vec2(n));
+        n.x = xy.x;
+        n.y = xy.y;
+    }
+    return glm::normalize(n);
+}
+
+// quantize a normal vector to two 16-bit signed normalized values.  Rounding
+// each coordinate to the nearest value is not always the closest encoding
+// after decoding, so we try the four neighbors and keep the best one.
+static void packNorm (glm::vec3 n, int16_t out[2])
+{
+    glm::vec2 p = octEncode (n) * kSnorm16Max;
+    if ((p.x == 0.0f) && (p.y == 0.0f)) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    glm::vec3 un = glm::normalize(n);
+    float best = -2.0f;
+    for (int i = 0;  i < 4;  i++) {
+        float x = (i & 1) ? std::ceil(p.x) : std::floor(p.x);
+        float y = (i & 2) ? std::ceil(p.y) : std::floor(p.y);
+        float d = glm::dot (un, octDecode (glm::vec2(x, y) / kSnorm16Max));
+        if (d > best) {
+            best = d;
+            out[0] = int16_t(x);
+            out[1] = int16_t(y);
+        }
+    }
+}
+
+/***** class PackedGroup member functions *****/
+
+glm::vec3 PackedGroup::pos (uint32_t i) const
+{
+    if (this->isQuantized()) {
+        const uint16_t *q = this->packedVerts[i].pos;
+        glm::vec3 p = glm::vec3(q[0], q[1], q[2]);
+        return this->posBias + this->posScale * (p / kUnorm16Max);
+    } else {
+        return this->verts[i].pos;
+    }
+}
+
+glm::vec3 PackedGroup::norm (uint32_t i) const
+{
+    if (this->isQuantized()) {
+        const int16_t *q = this->packedVerts[i].norm;
+        glm::vec2 p = glm::max(
+            glm::vec2(q[0], q[1]) / kSnorm16Max,
+            glm::vec2(-1.0f));
+        return octDecode (p);
+    } else {
+        return this->verts[i].norm;
+    }
+}
+
+glm::vec2 PackedGroup::txtCoord (uint32_t i) const
+{
+    if (this->isQuantized()) {
+        const uint16_t *q = this->packedVerts[i].txtCoord;
+        return glm::vec2(glm::unpackHalf1x16(q[0]), glm::unpackHalf1x16(q[1]));
+    } else {
+        return this->verts[i].txtCoord;
+    }
+}
+
+/***** Packing *****/
+
+PackedGroup pack (Group const &g, bool quantize)
+{
+    PackedGroup pg;
+
+    pg.name = g.name;
+    pg.material = g.material;
+    pg.nVerts = g.nVerts;
+    pg.nIndices = g.nIndices;
+    pg.hasNorms = (g.norms != nullptr);
+    pg.hasTxtCoords = (g.txtCoords != nullptr);
+    pg.posScale = glm::vec3(1.0f);
+    pg.posBias = glm::vec3(0.0f);
+
+    if (quantize) {
+        // the positions are quantized relative to the group's bounding box
+        glm::vec3 lo(0.0f), hi(0.0f);
+        if (g.nVerts > 0) {
+            lo = hi = g.verts[0];
+            for (uint32_t i = 1;  i < g.nVerts;  i++) {
+                lo = glm::min(lo, g.verts[i]);
+                hi = glm::max(hi, g.verts[i]);
+            }
+        }
+        pg.posBias = lo;
+        pg.posScale = hi - lo;
+        // avoid dividing by zero for groups that are flat in some dimension
+        glm::vec3 invScale(
+            (pg.posScale.x > 0.0f) ? kUnorm16Max / pg.posScale.x : 0.0f,
+            (pg.posScale.y > 0.0f) ? kUnorm16Max / pg.posScale.y : 0.0f,
+            (pg.posScale.z > 0.0f) ? kUnorm16Max / pg.posScale.z : 0.0f);
+
+        pg.packedVerts.resize (g.nVerts);
+        for (uint32_t i = 0;  i < g.nVerts;  i++) {
+            PackedVertex &v = pg.packedVerts[i];
+            glm::vec3 q = glm::clamp (
+                glm::round((g.verts[i] - lo) * invScale),
+                glm::vec3(0.0f), glm::vec3(kUnorm16Max));
+            v.pos[0] = uint16_t(q.x);
+            v.pos[1] = uint16_t(q.y);
+            v.pos[2] = uint16_t(q.z);
+            v.pos[3] = 0xffff;
+            if (pg.hasNorms) {
+                packNorm (g.norms[i], v.norm);
+            } else {
+                v.norm[0] = v.norm[1] = 0;
+            }
+            if (pg.hasTxtCoords) {
+                v.txtCoord[0] = glm::packHalf1x16(g.txtCoords[i].x);
+                v.txtCoord[1] = glm::packHalf1x16(g.txtCoords[i].y);
+            } else {
+                v.txtCoord[0] = v.txtCoord[1] = 0;
+            }
+        }
+    } else {
+        pg.verts.resize (g.nVerts);
+        for (uint32_t i = 0;  i < g.nVerts;  i++) {
+            Vertex &v = pg.verts[i];
+            v.pos = g.verts[i];
+            v.norm = pg.hasNorms ? g.norms[i] : glm::vec3(0.0f);
+            v.txtCoord = pg.hasTxtCoords ? g.txtCoords[i] : glm::vec2(0.0f);
+        }
+    }
+
+    // narrow the indices when the vertices can be addressed with 16 bits
+    uint32_t nIndices = g.totalIndices();
+    if (g.nVerts <= 0x10000) {
+        pg.indices16.resize (nIndices);
+        for (uint32_t i = 0;  i < nIndices;  i++) {
+            pg.indices16[i] = uint16_t(g.indices[i]);
+        }
+    } else {
+        pg.indices.assign (g.indices, g.indices + nIndices);
+    }
+    pg.lods.assign (g.lods, g.lods + g.nLODs);
+
+    return pg;
+}
+
+} // namespace OBJ
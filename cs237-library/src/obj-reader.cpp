@@ -6,407 +6,432 @@
       Nate Robins, 1997, 2000
       nate@pobox.com, http://www.pobox.com/~nate
 
-      Wavefront OBJ model file format reader/writer/manipulator.
+      Wavefront OBJ model file format reader.
 
-      Includes routines for generating smooth normals with
-      preservation of edges, welding redundant vertices & texture
-      coordinate generation (spheremap and planar projections) + more.
+      The reader makes a single pass over a memory-mapped image of the file,
+      appending to growable arrays; numbers are converted by hand, since the
+      C library's scanning functions dominated the load time of large models.
 
 */
 
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
+#include <charconv>
+#include <unordered_map>
 #include "obj-reader.hpp"
+#include "mapped-file.hpp"
 
-#define FREE(p)         std::free(p)
+/***** number parsing *****/
 
-#define T(x) (model->triangles[(x)])
+// Most of the numbers in OBJ files are short decimal fractions.  We convert
+// these using Clinger's fast path in double precision: when the decimal
+// significand fits in 53 bits and the power of ten is at most 22, a single
+// IEEE multiplication or division gives the correctly rounded double.  Rounding
+// that double to a float is then correct, unless it lies exactly halfway between
+// two floats (in which case the true value may not), so we use the C library
+// for those values and for numbers that do not fit the fast path.
 
-/* OBJAbs: returns the absolute value of a float */
-static inline float OBJAbs(float f)
+//! exact powers of ten
+static const double kPow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+//! the largest significand that is exactly representable as a double
+static const uint64_t kMaxExactInt = uint64_t(1) << 53;
+
+//! the maximum number of significant digits that we accumulate
+static const int kMaxDigits = 19;
+
+static inline bool isDigit (char c) { return (unsigned(c) - unsigned('0')) < 10; }
+static inline bool isBlank (char c) { return (c == ' ') || (c == '\t') || (c == '\r'); }
+
+//! is a double exactly halfway between two adjacent floats?
+static inline bool isFloatMidpoint (double r)
 {
-    if (f < 0) return -f; else return f;
+    uint64_t bits;
+    memcpy (&bits, &r, sizeof(bits));
+    // the 29 low bits of the significand are dropped when rounding to a float
+    return (bits & 0x1fffffff) == 0x10000000;
 }
 
-/* OBJFindGroup: Find a group in the model */
-OBJgroup*
-OBJFindGroup(OBJmodel* model, const char* name)
+//! slow-path conversion of the text of a number to a float
+static float slowStrToF (const char *start, const char *end)
 {
-    OBJgroup* group;
-
-    assert(model);
+#if defined(__cpp_lib_to_chars)
+    float r = 0.0f;
+    std::from_chars (start, end, r);
+    return r;
+#else
+    // strtof requires a NUL-terminated string, which the input is not
+    std::string s(start, end);
+    return strtof (s.c_str(), nullptr);
+#endif
+}
 
-    group = model->groups;
-    while(group) {
-        if (!strcmp(name, group->name))
-            break;
-        group = group->next;
+/* OBJParseFloat: parse a floating-point number at p, which is advanced past it.
+ * Returns false if there is not a number at p.
+ */
+static bool OBJParseFloat (const char *&p, const char *end, float &f)
+{
+    const char *start = p;
+    const char *q = p;
+    bool neg = false;
+    if ((q < end) && ((*q == '-') || (*q == '+'))) {
+        neg = (*q == '-');
+        q++;
     }
 
-    return group;
+    uint64_t sig = 0;
+    int nDigits = 0;
+    int exp10 = 0;
+    bool truncated = false;
+    bool anyDigits = false;
+
+    while ((q < end) && isDigit(*q)) {
+        anyDigits = true;
+        if ((nDigits == 0) && (*q == '0')) {
+            // leading zeros are not significant
+        } else if (nDigits < kMaxDigits) {
+            sig = 10 * sig + (*q - '0');
+            nDigits++;
+        } else {
+            exp10++;
+            truncated |= (*q != '0');
+        }
+        q++;
+    }
+    if ((q < end) && (*q == '.')) {
+        q++;
+        while ((q < end) && isDigit(*q)) {
+            anyDigits = true;
+            if ((nDigits == 0) && (*q == '0')) {
+                exp10--;
+            } else if (nDigits < kMaxDigits) {
+                sig = 10 * sig + (*q - '0');
+                nDigits++;
+                exp10--;
+            } else {
+                truncated |= (*q != '0');
+            }
+            q++;
+        }
+    }
+    if (! anyDigits) {
+        // maybe "nan" or "inf"; let the library sort it out
+        while ((q < end) && !isBlank(*q) && (*q != '\n')) {
+            q++;
+        }
+        if (q == start) {
+            return false;
+        }
+        p = q;
+        f = slowStrToF (start, q);
+        return true;
+    }
+    if ((q < end) && ((*q == 'e') || (*q == 'E'))) {
+        const char *r = q + 1;
+        bool negExp = false;
+        if ((r < end) && ((*r == '-') || (*r == '+'))) {
+            negExp = (*r == '-');
+            r++;
+        }
+        if ((r < end) && isDigit(*r)) {
+            int e = 0;
+            while ((r < end) && isDigit(*r)) {
+                if (e < 100000) {
+                    e = 10 * e + (*r - '0');
+                }
+                r++;
+            }
+            exp10 += negExp ? -e : e;
+            q = r;
+        }
+    }
+    p = q;
+
+    if (!truncated && (sig <= kMaxExactInt) && (-22 <= exp10) && (exp10 <= 22)) {
+        double r = static_cast<double>(sig);
+        r = (exp10 < 0) ? r / kPow10[-exp10] : r * kPow10[exp10];
+        if (! isFloatMidpoint(r)) {
+            f = static_cast<float>(neg ? -r : r);
+            return true;
+        }
+    }
+    // the library does not accept a leading '+'
+    f = slowStrToF ((*start == '+') ? start + 1 : start, q);
+    return true;
 }
 
-/* OBJAddGroup: Add a group to the model */
-OBJgroup*
-OBJAddGroup(OBJmodel* model, const char* name)
+/* OBJParseInt: parse a signed integer at p, which is advanced past it.
+ * Returns false if there is not an integer at p.
+ */
+static inline bool OBJParseInt (const char *&p, const char *end, int64_t &n)
 {
-    OBJgroup* group;
-
-    group = OBJFindGroup(model, name);
-    if (!group) {
-        group = new OBJgroup;
-        group->name = strdup(name);
-        group->material = 0;
-        group->numtriangles = 0;
-        group->triangles = NULL;
-        group->next = model->groups;
-        model->groups = group;
-        model->numgroups++;
+    const char *q = p;
+    bool neg = false;
+    if ((q < end) && ((*q == '-') || (*q == '+'))) {
+        neg = (*q == '-');
+        q++;
     }
-
-    return group;
+    if ((q >= end) || !isDigit(*q)) {
+        return false;
+    }
+    int64_t v = 0;
+    while ((q < end) && isDigit(*q)) {
+        if (v < (int64_t(1) << 40)) {
+            v = 10 * v + (*q - '0');
+        }
+        q++;
+    }
+    n = neg ? -v : v;
+    p = q;
+    return true;
 }
 
+/***** the reader *****/
+
+/* OBJReader: the state of the reader */
+struct OBJReader {
+    const char *p;              /* the current position */
+    const char *end;            /* the end of the input */
+    const char *filename;       /* the file name (for error messages) */
+    uint32_t line;              /* the current line number */
+    OBJmodel *model;            /* the model being read */
+    int group;                  /* the index of the current group (-1 for none) */
+    std::string material;       /* the current material */
+    std::unordered_map<std::string, uint32_t> groupIds; /* map from group names
+                                                         * to indices */
+
+    void skipBlanks ()
+    {
+        while ((this->p < this->end) && isBlank(*this->p)) {
+            this->p++;
+        }
+    }
+
+    /* advance to the start of the next line */
+    void skipLine ()
+    {
+        const char *nl = static_cast<const char *>(
+            memchr(this->p, '\n', this->end - this->p));
+        this->p = (nl == nullptr) ? this->end : nl + 1;
+        this->line++;
+    }
 
-/* OBJFirstPass: first pass at a Wavefront OBJ file that gets all the
- * statistics of the model (such as #vertices, #normals, etc)
- *
- * model - properly initialized OBJmodel structure
- * file  - (fopen'd) file descriptor
+    /* the next whitespace-delimited word on the line */
+    std::string word ()
+    {
+        this->skipBlanks();
+        const char *start = this->p;
+        while ((this->p < this->end) && !isBlank(*this->p) && (*this->p != '\n')) {
+            this->p++;
+        }
+        return std::string(start, this->p);
+    }
+
+    /* the rest of the line with leading and trailing white space removed */
+    std::string rest ()
+    {
+        this->skipBlanks();
+        const char *start = this->p;
+        while ((this->p < this->end) && (*this->p != '\n')) {
+            this->p++;
+        }
+        const char *stop = this->p;
+        while ((stop > start) && isBlank(stop[-1])) {
+            stop--;
+        }
+        return std::string(start, stop);
+    }
+
+    [[noreturn]] void error (const char *msg)
+    {
+        fprintf(stderr, "OBJReadOBJ() failed: %s at line %u of \"%s\".\n",
+            msg, this->line, this->filename);
+        exit(1);
+    }
+
+    /* find or add a group and return its index */
+    int findGroup (std::string const &name)
+    {
+        auto ins = this->groupIds.insert (
+            std::make_pair(name, uint32_t(this->model->groups.size())));
+        if (ins.second) {
+            this->model->groups.push_back (OBJgroup());
+            this->model->groups.back().name = name;
+        }
+        return ins.first->second;
+    }
+
+    /* the current group; a default group is created for data that comes before
+     * the first "g" line.
+     */
+    OBJgroup *curGroup ()
+    {
+        if (this->group < 0) {
+            this->group = this->findGroup ("default");
+        }
+        return &this->model->groups[this->group];
+    }
+
+    void readFloats (float *v, int n)
+    {
+        for (int i = 0;  i < n;  i++) {
+            this->skipBlanks();
+            if (! OBJParseFloat (this->p, this->end, v[i])) {
+                this->error ("expected number");
+            }
+        }
+    }
+
+    /* resolve a (possibly negative) index into an array with n elements
+     * (including the unused 0th element)
+     */
+    uint32_t index (int64_t i, size_t n)
+    {
+        if (i < 0) {
+            i += int64_t(n);
+        }
+        if ((i <= 0) || (i >= int64_t(n))) {
+            this->error ("index out of range");
+        }
+        return uint32_t(i);
+    }
+
+    void readFace ();
+    void read ();
+};
+
+/* OBJReader::readFace: read a face, which can have any number of vertices of the
+ * form v, v/t, v//n, or v/t/n, and triangulate it as a fan.
  */
-static void
-OBJFirstPass(OBJmodel* model, FILE* file)
+void OBJReader::readFace ()
 {
-    uint32_t numvertices;        /* number of vertices in model */
-    uint32_t numnormals;         /* number of normals in model */
-    uint32_t numtexcoords;       /* number of texcoords in model */
-    uint32_t numtriangles;       /* number of triangles in model */
-    OBJgroup* group = 0;         /* current group */
-    int v, n, t;
-    char buf[1024];
-    char *dummy;
-
-    numvertices = numnormals = numtexcoords = numtriangles = 0;
-    while(fscanf(file, "%s", buf) != EOF) {
-        switch(buf[0]) {
-        case '#':               /* comment */
-            /* eat up rest of line */
-            dummy = fgets(buf, sizeof(buf), file);
+    OBJgroup *grp = this->curGroup();
+    OBJmodel *m = this->model;
+    uint32_t first[3] = {0, 0, 0}, prev[3] = {0, 0, 0}, cur[3];
+    int nv = 0;
+
+    while (true) {
+        this->skipBlanks();
+        if ((this->p >= this->end) || (*this->p == '\n')) {
             break;
-        case 'v':               /* v, vn, vt */
-            if (group == 0) {
-              /* make a default group */
-                group = OBJAddGroup(model, "default");
+        }
+        int64_t v, t = 0, n = 0;
+        if (! OBJParseInt (this->p, this->end, v)) {
+            this->error ("bad face");
+        }
+        cur[0] = this->index(v, m->vertices.size());
+        cur[1] = cur[2] = 0;
+        if ((this->p < this->end) && (*this->p == '/')) {
+            this->p++;
+            if (OBJParseInt (this->p, this->end, t)) {
+                cur[2] = this->index(t, m->texcoords.size());
             }
-            switch(buf[1]) {
-            case '\0':          /* vertex */
-                /* eat up rest of line */
-                dummy = fgets(buf, sizeof(buf), file);
-                numvertices++;
-                break;
-            case 'n':           /* normal */
-                /* eat up rest of line */
-                dummy = fgets(buf, sizeof(buf), file);
-                numnormals++;
-                break;
-            case 't':           /* texcoord */
-                /* eat up rest of line */
-                dummy = fgets(buf, sizeof(buf), file);
-                numtexcoords++;
-                break;
-            default:
-                printf("OBJFirstPass(): Unknown token \"%s\".\n", buf);
-                exit(1);
-                break;
+            if ((this->p < this->end) && (*this->p == '/')) {
+                this->p++;
+                if (! OBJParseInt (this->p, this->end, n)) {
+                    this->error ("bad face");
+                }
+                cur[1] = this->index(n, m->normals.size());
             }
+        }
+        if ((this->p < this->end) && !isBlank(*this->p) && (*this->p != '\n')) {
+            this->error ("bad face");
+        }
+
+        if (nv == 0) {
+            memcpy (first, cur, sizeof(cur));
+        }
+        else if (nv >= 2) {
+            OBJtriangle tri;
+            tri.vindices[0] = first[0]; tri.nindices[0] = first[1]; tri.tindices[0] = first[2];
+            tri.vindices[1] = prev[0];  tri.nindices[1] = prev[1];  tri.tindices[1] = prev[2];
+            tri.vindices[2] = cur[0];   tri.nindices[2] = cur[1];   tri.tindices[2] = cur[2];
+            grp->triangles.push_back (m->triangles.size());
+            m->triangles.push_back (tri);
+        }
+        memcpy (prev, cur, sizeof(cur));
+        nv++;
+    }
+
+    if (nv < 3) {
+        this->error ("face with fewer than three vertices");
+    }
+}
+
+/* OBJReader::read: read the contents of the file */
+void OBJReader::read ()
+{
+    OBJmodel *m = this->model;
+
+    while (this->p < this->end) {
+        this->skipBlanks();
+        if (this->p >= this->end) {
             break;
-        case 'm':
-            dummy = fgets(buf, sizeof(buf), file);
-            sscanf(buf, "%s %s", buf, buf);
-            model->mtllibname = strdup(buf);
+        }
+        const char *start = this->p;
+        while ((this->p < this->end) && !isBlank(*this->p) && (*this->p != '\n')) {
+            this->p++;
+        }
+        size_t len = this->p - start;
+
+        switch (start[0]) {
+        case 'v':               /* v, vn, vt */
+            if (len == 1) {
+                glm::vec3 v;
+                this->readFloats (&v[0], 3);
+                m->vertices.push_back (v);
+            }
+            else if ((len == 2) && (start[1] == 'n')) {
+                glm::vec3 n;
+                this->readFloats (&n[0], 3);
+                m->normals.push_back (n);
+            }
+            else if ((len == 2) && (start[1] == 't')) {
+                glm::vec2 t;
+                this->readFloats (&t[0], 2);
+                m->texcoords.push_back (t);
+            }
+            else {
+                this->error ("unknown token");
+            }
             break;
-        case 'u':
-            if (group == 0) {
-              /* make a default group */
-                group = OBJAddGroup(model, "default");
+        case 'f':               /* face */
+            if (len == 1) {
+                this->readFace ();
             }
-            /* eat up rest of line */
-            dummy = fgets(buf, sizeof(buf), file);
             break;
         case 'g':               /* group */
-            /* eat up rest of line */
-            dummy = fgets(buf, sizeof(buf), file);
-#if SINGLE_STRING_GROUP_NAMES
-            sscanf(buf, "%s", buf);
-#else
-            buf[strlen(buf)-1] = '\0';  /* nuke '\n' */
-#endif
-            group = OBJAddGroup(model, buf);
+            if (len == 1) {
+                std::string name = this->rest();
+                this->group = this->findGroup (name.empty() ? "default" : name);
+                this->curGroup()->material = this->material;
+            }
             break;
-        case 'f':               /* face */
-            if (group == 0) {
-              /* make a default group */
-                group = OBJAddGroup(model, "default");
+        case 'm':
+            if ((len == 6) && (strncmp(start, "mtllib", 6) == 0)) {
+                m->mtllibname = this->word();
             }
-            v = n = t = 0;
-            fscanf(file, "%s", buf);
-            /* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-            if (strstr(buf, "//")) {
-                /* v//n */
-                sscanf(buf, "%d//%d", &v, &n);
-                fscanf(file, "%d//%d", &v, &n);
-                fscanf(file, "%d//%d", &v, &n);
-                numtriangles++;
-                group->numtriangles++;
-                while(fscanf(file, "%d//%d", &v, &n) > 0) {
-                    numtriangles++;
-                    group->numtriangles++;
-                }
-            } else if (sscanf(buf, "%d/%d/%d", &v, &t, &n) == 3) {
-                /* v/t/n */
-                fscanf(file, "%d/%d/%d", &v, &t, &n);
-                fscanf(file, "%d/%d/%d", &v, &t, &n);
-                numtriangles++;
-                group->numtriangles++;
-                while(fscanf(file, "%d/%d/%d", &v, &t, &n) > 0) {
-                    numtriangles++;
-                    group->numtriangles++;
-                }
-            } else if (sscanf(buf, "%d/%d", &v, &t) == 2) {
-                /* v/t */
-                fscanf(file, "%d/%d", &v, &t);
-                fscanf(file, "%d/%d", &v, &t);
-                numtriangles++;
-                group->numtriangles++;
-                while(fscanf(file, "%d/%d", &v, &t) > 0) {
-                    numtriangles++;
-                    group->numtriangles++;
-                }
-            } else {
-                /* v */
-                fscanf(file, "%d", &v);
-                fscanf(file, "%d", &v);
-                numtriangles++;
-                group->numtriangles++;
-                while(fscanf(file, "%d", &v) > 0) {
-                    numtriangles++;
-                    group->numtriangles++;
+            break;
+        case 'u':
+            if ((len == 6) && (strncmp(start, "usemtl", 6) == 0)) {
+                this->material = this->word();
+                // if there is already a material associated with this group, then we
+                // ignore this material.
+                OBJgroup *grp = this->curGroup();
+                if (grp->material.empty()) {
+                    grp->material = this->material;
                 }
             }
             break;
-
-        default:
-            /* eat up rest of line */
-            dummy = fgets(buf, sizeof(buf), file);
+        default:                /* comments, blank lines, and other commands */
             break;
         }
-  }
-
-  /* set the stats in the model structure */
-  model->numvertices  = numvertices;
-  model->numnormals   = numnormals;
-  model->numtexcoords = numtexcoords;
-  model->numtriangles = numtriangles;
-
-  /* allocate memory for the triangles in each group */
-  group = model->groups;
-  while(group) {
-      group->triangles = new uint32_t[group->numtriangles];
-      group->numtriangles = 0;
-      group = group->next;
-  }
-}
 
-/* OBJSecondPass: second pass at a Wavefront OBJ file that gets all
- * the data.
- *
- * model - properly initialized OBJmodel structure
- * file  - (fopen'd) file descriptor
- */
-static void
-OBJSecondPass (OBJmodel* model, FILE* file)
-{
-    uint32_t numvertices;       /* number of vertices in model */
-    uint32_t numnormals;        /* number of normals in model */
-    uint32_t numtexcoords;      /* number of texcoords in model */
-    uint32_t numtriangles;      /* number of triangles in model */
-    glm::vec3 *vertices;     /* array of vertices  */
-    glm::vec3 *normals;      /* array of normals */
-    glm::vec2 *texcoords;    /* array of texture coordinates */
-    OBJgroup* group;            /* current group pointer */
-    char* material;             /* current material */
-    int v, n, t;
-    char buf[512];
-    char *dummy;
-
-    /* set the pointer shortcuts */
-    vertices    = model->vertices;
-    normals     = model->normals;
-    texcoords   = model->texcoords;
-    group       = model->groups;
-
-    /* on the second pass through the file, read all the data into the
-    allocated arrays */
-    numvertices = numnormals = numtexcoords = 1;
-    numtriangles = 0;
-    material = nullptr;
-    while (fscanf(file, "%s", buf) != EOF) {
-        switch (buf[0]) {
-        case '#':               /* comment */
-            /* eat up rest of line */
-            dummy = fgets(buf, sizeof(buf), file);
-            break;
-        case 'v':               /* v, vn, vt */
-            switch (buf[1]) {
-            case '\0':          /* vertex */
-                fscanf(file, "%f %f %f",
-                    &(vertices[numvertices][0]),
-                    &(vertices[numvertices][1]),
-                    &(vertices[numvertices][2]));
-                numvertices++;
-                break;
-            case 'n':           /* normal */
-                fscanf(file, "%f %f %f",
-                    &(normals[numnormals][0]),
-                    &(normals[numnormals][1]),
-                    &(normals[numnormals][2]));
-                numnormals++;
-                break;
-            case 't':           /* texcoord */
-                fscanf(file, "%f %f",
-                    &(texcoords[numtexcoords][0]),
-                    &(texcoords[numtexcoords][1]));
-                numtexcoords++;
-                break;
-            }
-            break;
-            case 'u':
-                dummy = fgets(buf, sizeof(buf), file);
-                sscanf(buf, "%s %s", buf, buf);
-                material = strdup(buf);
-              // if there is already a material associated with this group, then we
-              // ignore this material.
-/* QUESION: will this work for multiple groups with shared and different materials? */
-                if (group->material == nullptr) {
-                    group->material = material;
-                }
-                break;
-            case 'g':               /* group */
-                /* eat up rest of line */
-                dummy = fgets(buf, sizeof(buf), file);
-#if SINGLE_STRING_GROUP_NAMES
-                sscanf(buf, "%s", buf);
-#else
-                buf[strlen(buf)-1] = '\0';  /* nuke '\n' */
-#endif
-                group = OBJFindGroup(model, buf);
-                group->material = (material != nullptr) ? strdup(material) : nullptr;
-                break;
-            case 'f':               /* face */
-                v = n = t = 0;
-                fscanf(file, "%s", buf);
-                /* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-                if (strstr(buf, "//")) {
-                    /* v//n */
-                    sscanf(buf, "%d//%d", &v, &n);
-                    T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).nindices[0] = n < 0 ? n + numnormals : n;
-                    fscanf(file, "%d//%d", &v, &n);
-                    T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).nindices[1] = n < 0 ? n + numnormals : n;
-                    fscanf(file, "%d//%d", &v, &n);
-                    T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d//%d", &v, &n) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).nindices[0] = T(numtriangles-1).nindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).nindices[1] = T(numtriangles-1).nindices[2];
-                        T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                        T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                } else if (sscanf(buf, "%d/%d/%d", &v, &t, &n) == 3) {
-                    /* v/t/n */
-                    T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).tindices[0] = t < 0 ? t + numtexcoords : t;
-                    T(numtriangles).nindices[0] = n < 0 ? n + numnormals : n;
-                    fscanf(file, "%d/%d/%d", &v, &t, &n);
-                    T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).tindices[1] = t < 0 ? t + numtexcoords : t;
-                    T(numtriangles).nindices[1] = n < 0 ? n + numnormals : n;
-                    fscanf(file, "%d/%d/%d", &v, &t, &n);
-                    T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-                    T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d/%d/%d", &v, &t, &n) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).tindices[0] = T(numtriangles-1).tindices[0];
-                        T(numtriangles).nindices[0] = T(numtriangles-1).nindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).tindices[1] = T(numtriangles-1).tindices[2];
-                        T(numtriangles).nindices[1] = T(numtriangles-1).nindices[2];
-                        T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                        T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-                        T(numtriangles).nindices[2] = n < 0 ? n + numnormals : n;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                } else if (sscanf(buf, "%d/%d", &v, &t) == 2) {
-                    /* v/t */
-                    T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).tindices[0] = t < 0 ? t + numtexcoords : t;
-                    fscanf(file, "%d/%d", &v, &t);
-                    T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).tindices[1] = t < 0 ? t + numtexcoords : t;
-                    fscanf(file, "%d/%d", &v, &t);
-                    T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                    T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d/%d", &v, &t) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).tindices[0] = T(numtriangles-1).tindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).tindices[1] = T(numtriangles-1).tindices[2];
-                        T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                        T(numtriangles).tindices[2] = t < 0 ? t + numtexcoords : t;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                } else {
-                    /* v */
-                    sscanf(buf, "%d", &v);
-                    T(numtriangles).vindices[0] = v < 0 ? v + numvertices : v;
-                    fscanf(file, "%d", &v);
-                    T(numtriangles).vindices[1] = v < 0 ? v + numvertices : v;
-                    fscanf(file, "%d", &v);
-                    T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d", &v) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).vindices[2] = v < 0 ? v + numvertices : v;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                }
-                break;
-
-            default:
-                /* eat up rest of line */
-                dummy = fgets(buf, sizeof(buf), file);
-                break;
-        }
+        this->skipLine();
     }
 
 }
@@ -414,49 +439,6 @@ OBJSecondPass (OBJmodel* model, FILE* file)
 
 /* public functions */
 
-/* OBJDimensions: Calculates the dimensions (width, height, depth) of
- * a model.
- *
- * model   - initialized OBJmodel structure
- * dimensions - array of 3 GLfloats (float dimensions[3])
- */
-void
-OBJDimensions(OBJmodel* model, float* dimensions)
-{
-    uint32_t i;
-    float maxx, minx, maxy, miny, maxz, minz;
-
-    assert(model);
-    assert(model->vertices);
-    assert(dimensions);
-
-    /* get the max/mins */
-    maxx = minx = model->vertices[1][0];
-    maxy = miny = model->vertices[1][1];
-    maxz = minz = model->vertices[1][2];
-    for (i = 2; i <= model->numvertices; i++) {
-        if (maxx < model->vertices[i][0])
-            maxx = model->vertices[i][0];
-        if (minx > model->vertices[i][0])
-            minx = model->vertices[i][0];
-
-        if (maxy < model->vertices[i][1])
-            maxy = model->vertices[i][1];
-        if (miny > model->vertices[i][1])
-            miny = model->vertices[i][1];
-
-        if (maxz < model->vertices[i][2])
-            maxz = model->vertices[i][2];
-        if (minz > model->vertices[i][2])
-            minz = model->vertices[i][2];
-    }
-
-    /* calculate model width, height, and depth */
-    dimensions[0] = OBJAbs(maxx) + OBJAbs(minx);
-    dimensions[1] = OBJAbs(maxy) + OBJAbs(miny);
-    dimensions[2] = OBJAbs(maxz) + OBJAbs(minz);
-}
-
 /* OBJReadOBJ: Reads a model description from a Wavefront .OBJ file.
  * Returns a pointer to the created object which should be free'd with
  * `delete`.
@@ -466,40 +448,29 @@ OBJDimensions(OBJmodel* model, float* dimensions)
 OBJmodel*
 OBJReadOBJ (const char* filename)
 {
-    FILE* file;
-
-    /* open the file */
-    file = fopen(filename, "r");
-    if (!file) {
+    cs237::__detail::MappedFile file(filename);
+    if (! file.isValid()) {
         fprintf(stderr, "OBJReadOBJ() failed: can't open data file \"%s\".\n",
             filename);
         exit(1);
     }
 
-    /* allocate a new model */
+    /* allocate a new model; the size of the file gives us an estimate of the
+     * number of lines, which we use to avoid most of the array growth
+     */
     OBJmodel* model = new OBJmodel();
-
-    /* make a first pass through the file to get a count of the number
-    of vertices, normals, texcoords & triangles */
-    OBJFirstPass (model, file);
-
-    /* allocate memory */
-    model->vertices = new glm::vec3[model->numvertices + 1];
-    model->triangles = new OBJtriangle[model->numtriangles];
-    if (model->numnormals > 0) {
-        model->normals = new glm::vec3[model->numnormals + 1];
-    }
-    if (model->numtexcoords > 0) {
-        model->texcoords = new glm::vec2[model->numtexcoords + 1];
-    }
-
-    /* rewind to beginning of file and read in the data this pass */
-    rewind(file);
-
-    OBJSecondPass(model, file);
-
-    /* close the file */
-    fclose(file);
+    size_t estLines = file.size() / 32;
+    model->vertices.reserve (estLines / 2);
+    model->triangles.reserve (estLines / 2);
+
+    OBJReader rd;
+    rd.p = reinterpret_cast<const char *>(file.data());
+    rd.end = rd.p + file.size();
+    rd.filename = filename;
+    rd.line = 1;
+    rd.model = model;
+    rd.group = -1;
+    rd.read ();
 
     return model;
 }
@@ -507,26 +478,7 @@ OBJReadOBJ (const char* filename)
 /***** OBJmodel methods *****/
 
 OBJmodel::OBJmodel ()
-    : mtllibname(nullptr), numvertices(0), vertices(nullptr), numnormals(0),
-      normals(nullptr), numtexcoords(0), texcoords(nullptr), numtriangles(0),
-      triangles(nullptr), numgroups(0), groups(nullptr)
-{
-}
-
-OBJmodel::~OBJmodel ()
+    : mtllibname(), vertices(1, glm::vec3(0.0f)), normals(1, glm::vec3(0.0f)),
+      texcoords(1, glm::vec2(0.0f)), triangles(), groups()
 {
-    if (this->mtllibname) { delete[] this->mtllibname; }
-    if (this->vertices)   { delete[] this->vertices; }
-    if (this->normals)    { delete[] this->normals; }
-    if (this->texcoords)  { delete[] this->texcoords; }
-    if (this->triangles)  { delete[] this->triangles; }
-    while (this->groups) {
-        OBJgroup *group = this->groups;
-        this->groups = this->groups->next;
-        delete[] group->name;
-        if (group->material) { delete[] group->material; }
-        delete[] group->triangles;
-        delete[] group;
-    }
-
 }
@@ -9,7 +9,12 @@
 #include "glm/glm.hpp"
 #endif
 
-/* OBJtriangle: Structure that defines a triangle in a model.
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* OBJtriangle: Structure that defines a triangle in a model.  Indices of
+ * components that are not specified in the face are 0.
  */
 struct OBJtriangle {
   uint32_t	vindices[3];	/* array of triangle vertex indices */
@@ -20,42 +25,36 @@ struct OBJtriangle {
 /* OBJgroup: Structure that defines a group in a model.
  */
 struct OBJgroup {
-  char*		name;		/* name of this group */
-  uint32_t	numtriangles;	/* number of triangles in this group */
-  uint32_t	*triangles;	/* array of triangle indices */
-  char*		material;	/* name of material for group */
-  OBJgroup	*next;		/* pointer to next group in model */
+  std::string	name;		/* name of this group */
+  std::string	material;	/* name of material for group ("" for none) */
+  std::vector<uint32_t> triangles; /* array of triangle indices */
 };
 
 /* OBJmodel: Structure that defines a model.  Note that the vertex/normal/texcoord
  * arrays have 1-based indices, so the 0th element is unused.
  */
 struct OBJmodel {
-  char*		mtllibname;	/* name of the material library */
-
-  uint32_t	numvertices;	/* number of vertices in model */
-  glm::vec3	*vertices;	/* array of vertices  */
-
-  uint32_t	numnormals;	/* number of normals in model */
-  glm::vec3	*normals;	/* array of normals */
+  std::string	mtllibname;	/* name of the material library ("" for none) */
 
-  uint32_t	numtexcoords;	/* number of texcoords in model */
-  glm::vec2	*texcoords;	/* array of texture coordinates */
-
-  uint32_t	numtriangles;	/* number of triangles in model */
-  OBJtriangle*	triangles;	/* array of triangles */
-
-  uint32_t	numgroups;	/* number of groups in model */
-  OBJgroup*	groups;		/* linked list of groups */
+  std::vector<glm::vec3> vertices;	/* array of vertices  */
+  std::vector<glm::vec3> normals;	/* array of normals */
+  std::vector<glm::vec2> texcoords;	/* array of texture coordinates */
+  std::vector<OBJtriangle> triangles;	/* array of triangles */
+  std::vector<OBJgroup> groups;		/* groups in order of first appearance */
 
   OBJmodel ();
-  ~OBJmodel ();
+
+  uint32_t numvertices () const { return this->vertices.size() - 1; }
+  uint32_t numnormals () const { return this->normals.size() - 1; }
+  uint32_t numtexcoords () const { return this->texcoords.size() - 1; }
+  uint32_t numtriangles () const { return this->triangles.size(); }
+  uint32_t numgroups () const { return this->groups.size(); }
 
 };
 
 /* OBJReadOBJ: Reads a model description from a Wavefront .OBJ file.
  * Returns a pointer to the created object which should be free'd with
- * OBJDelete().
+ * `delete`.
  *
  * filename - name of the file containing the Wavefront .OBJ format data.
  */
@@ -12,8 +12,11 @@
 
 #include "obj.hpp"
 #include "obj-reader.hpp"
-#include <unordered_map>
+#include "mapped-file.hpp"
+#include "mesh-opt.hpp"
+#include <atomic>
 #include <cstdlib>
+#include <thread>
 
 namespace OBJ {
 
@@ -25,33 +28,184 @@ bool ReadMaterial (
     std::vector<Material> &materials);  // vector of materials
 }
 
-struct VInfo {
-    uint32_t _v, _n, _t;
+/* Vertex deduplication.  Each distinct v/n/t triple in a group becomes one mesh
+ * vertex.  We use a flat open-addressing table with linear probing, which is
+ * sized from the number of triangle corners in the group so that it never needs
+ * to grow.
+ */
+
+//! a v/n/t triple and the index of the mesh vertex that it maps to
+struct VertexSlot {
+    uint32_t v, n, t;
+    uint32_t idx;               //!< the mesh vertex (kEmpty for an empty slot)
+};
+
+constexpr uint32_t kEmpty = ~0u;
+
+//! a strong hash of a v/n/t triple (a multiply/xor-shift mix)
+static inline uint64_t hashVertex (uint32_t v, uint32_t n, uint32_t t)
+{
+    uint64_t h = (uint64_t(v) * 0x9E3779B97F4A7C15ULL)
+        ^ (uint64_t(n) * 0xC2B2AE3D27D4EB4FULL)
+        ^ (uint64_t(t) * 0x165667B19E3779F9ULL);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+//! the smallest power of two that is >= n
+static inline uint32_t ceilPow2 (uint32_t n)
+{
+    uint32_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
 
-    VInfo (uint32_t v, uint32_t n, uint32_t t) : _v(v), _n(n), _t(t) { }
+//! the allowed increase in the cache miss ratio when reordering for overdraw
+constexpr float kOverdrawLambda = 1.05f;
 
-    struct Hash {
-        std::size_t operator() (VInfo const &v) const
-        {
-            return static_cast<std::size_t>(
-                v._v +
-                (v._n << 5) * 101 +
-                (v._t << 10) * 101);
+//! the maximum number of levels of detail of a group (including the full mesh)
+constexpr uint32_t kMaxLODs = 8;
+//! each level of detail targets this fraction of the triangles of the previous level
+constexpr float kLODReduction = 0.5f;
+//! we stop generating levels when simplification fails to get below this fraction
+//! of the previous level's triangles
+constexpr float kMinLODReduction = 0.8f;
+//! we do not generate levels with fewer triangles than this
+constexpr uint32_t kMinLODTris = 16;
+
+//! generate the chain of simplified levels of detail for a group; the indices of
+//! the levels (other than the first) are appended to `indices`
+static void buildLODs (
+    Group const &g, std::vector<uint32_t> &indices, std::vector<LOD> &lods)
+{
+    uint32_t nTris = g.nIndices / 3;
+    __details::Simplifier simp (indices.data(), g.nIndices, g.nVerts, g.verts);
+    while (lods.size() < kMaxLODs) {
+        uint32_t target = uint32_t(kLODReduction * float(nTris));
+        if (target < kMinLODTris) {
+            break;
         }
-    };
-    struct Equal {
-        bool operator()(VInfo const &v1, VInfo const &v2) const
-        {
-            return (v1._v == v2._v) && (v1._n == v2._n) && (v1._t == v2._t);
+        simp.simplify (target);
+        uint32_t n = simp.nTriangles();
+        if ((n == 0) || (float(n) > kMinLODReduction * float(nTris))) {
+            break;
         }
-    };
+        // each level gets its own vertex-cache order
+        std::vector<uint32_t> lod = simp.indices();
+        __details::tipsify (lod.data(), lod.size(), g.nVerts, kVertexCacheSize);
+        lods.push_back (LOD{uint32_t(indices.size()), uint32_t(lod.size()), simp.error()});
+        indices.insert (indices.end(), lod.begin(), lod.end());
+        nTris = n;
+    }
+}
+
+//! build the vertex and index arrays of a group; this function only touches the
+//! group, so groups can be built concurrently
+static void buildGroup (
+    const OBJmodel *model, OBJgroup const &grp, bool optimize, Group &g)
+{
+    uint32_t nIndices = 3 * grp.triangles.size();
 
-}; // VInfo
+    // the table has a load factor of at most 1/2
+    uint32_t mask = ceilPow2 (2 * nIndices) - 1;
+    std::vector<VertexSlot> table(mask + 1, VertexSlot{0, 0, 0, kEmpty});
+    std::vector<VertexSlot> verts;      // the distinct triples in order
+    verts.reserve (nIndices);
 
-typedef std::unordered_map<VInfo,uint32_t,VInfo::Hash,VInfo::Equal> VertexMap_t;
+    std::vector<uint32_t> indices(nIndices);
+    uint32_t k = 0;
+    for (uint32_t triIdx : grp.triangles) {
+        OBJtriangle const &tri = model->triangles[triIdx];
+        for (int j = 0;  j < 3;  j++) {
+            uint32_t v = tri.vindices[j], n = tri.nindices[j], t = tri.tindices[j];
+            uint32_t h = static_cast<uint32_t>(hashVertex (v, n, t)) & mask;
+            while (true) {
+                VertexSlot &slot = table[h];
+                if (slot.idx == kEmpty) {
+                    slot = VertexSlot{v, n, t, uint32_t(verts.size())};
+                    verts.push_back (slot);
+                    break;
+                }
+                else if ((slot.v == v) && (slot.n == n) && (slot.t == t)) {
+                    break;
+                }
+                h = (h + 1) & mask;
+            }
+            indices[k++] = table[h].idx;
+        }
+    }
+
+  // reorder the triangles for the vertex cache and to reduce overdraw, and then
+  // renumber the vertices in order of first use
+    if (optimize) {
+        uint32_t nVerts = verts.size();
+        std::vector<uint32_t> deadEnds = __details::tipsify (
+            indices.data(), nIndices, nVerts, kVertexCacheSize);
+        std::vector<glm::vec3> pos(nVerts);
+        for (uint32_t i = 0;  i < nVerts;  i++) {
+            pos[i] = model->vertices[verts[i].v];
+        }
+        __details::sortClustersForOverdraw (
+            indices.data(), nIndices, nVerts, pos.data(), deadEnds,
+            kVertexCacheSize, kOverdrawLambda);
+        std::vector<uint32_t> remap = __details::remapForFetch (indices.data(), nIndices, nVerts);
+        std::vector<VertexSlot> oldVerts(std::move(verts));
+        verts.resize (nVerts);
+        for (uint32_t i = 0;  i < nVerts;  i++) {
+            verts[i] = oldVerts[remap[i]];
+        }
+    }
+
+  // initialize the vertex data arrays
+    g.nVerts = verts.size();
+    g.verts = new glm::vec3[g.nVerts];
+    for (uint32_t i = 0;  i < g.nVerts;  i++) {
+        g.verts[i] = model->vertices[verts[i].v];
+    }
+    if (model->numnormals() > 0) {
+        g.norms = new glm::vec3[g.nVerts];
+        for (uint32_t i = 0;  i < g.nVerts;  i++) {
+            g.norms[i] = model->normals[verts[i].n];
+        }
+    }
+    else {
+        g.norms = nullptr;
+    }
+    if (model->numtexcoords() > 0) {
+        g.txtCoords = new glm::vec2[g.nVerts];
+        for (uint32_t i = 0;  i < g.nVerts;  i++) {
+            g.txtCoords[i] = model->texcoords[verts[i].t];
+        }
+    }
+    else {
+        g.txtCoords = nullptr;
+    }
 
-Model::Model (std::string file)
-    : _path(file), _bbox()
+  // generate the levels of detail
+    g.nIndices = nIndices;
+    std::vector<LOD> lods(1, LOD{0, nIndices, 0.0f});
+    if (optimize) {
+        buildLODs (g, indices, lods);
+    }
+    g.nLODs = lods.size();
+    g.lods = new LOD[g.nLODs];
+    std::copy (lods.begin(), lods.end(), g.lods);
+
+  // initialize the group's indices array
+    g.indices = new uint32_t[indices.size()];
+    std::copy (indices.begin(), indices.end(), g.indices);
+}
+
+//! the minimum number of triangles in a model for us to build the groups in
+//! parallel; thread startup costs more than building small models
+constexpr size_t kMinParallelTris = 64 * 1024;
+
+Model::Model (std::string file, bool optimize, unsigned int nThreads)
+    : _path(file), _bbox(), _binary(nullptr)
 {
   // read the file
     OBJmodel *model = OBJReadOBJ (file.c_str());
@@ -61,7 +215,7 @@ Model::Model (std::string file)
     }
 
   // load materials
-    if (model->mtllibname != nullptr) {
+    if (! model->mtllibname.empty()) {
         this->_mtlLibName = model->mtllibname;
         if (! __details::ReadMaterial (this->_path, this->_mtlLibName, this->_materials)) {
             std::cerr << "warning: error reading material library \""
@@ -74,38 +228,51 @@ Model::Model (std::string file)
     }
 
   // compute the bounding box
-    for (uint32_t i = 0;  i < model->numvertices;  i++) {
+    for (uint32_t i = 1;  i <= model->numvertices();  i++) {
         this->_bbox.addPt (model->vertices[i]);
     }
 
-  // build mesh data structures for the groups.  We need to identify unique v/n/t
-  // triplets
-    VertexMap_t map;
-    std::vector<VInfo> verts;
-    std::vector<uint32_t> indices;
-    uint32_t idx;
-    for (OBJgroup *grp = model->groups;  grp != nullptr;  grp = grp->next) {
-        for (uint32_t i = 0;  i < grp->numtriangles;  i++) {
-            for (int j = 0;  j < 3;  j++) {
-                OBJtriangle *tri = &(model->triangles[i]);
-                VInfo v(tri->vindices[j], tri->nindices[j], tri->tindices[j]);
-                VertexMap_t::const_iterator got = map.find (v);
-                if (got == map.end()) {
-                    idx = verts.size();
-                    verts.push_back (v);
-                    map.insert (std::pair<VInfo,uint32_t>(v, idx));
-                }
-                else {
-                    idx = got->second;
-                }
-                indices.push_back(idx);
-            }
+  // the non-empty groups of the model
+    std::vector<const OBJgroup *> grps;
+    for (auto const &grp : model->groups) {
+        if (! grp.triangles.empty()) {
+            grps.push_back (&grp);
         }
-      // here we have identified the mesh vertices for the group
-        struct Group g;
-        g.name = std::string(grp->name);
+    }
+    this->_groups.resize (grps.size());
+
+  // build mesh data structures for the groups.  The groups are independent, so
+  // we build them in parallel, with each thread taking the next unbuilt group.
+    std::atomic<size_t> next(0);
+    auto worker = [&] () {
+        size_t i;
+        while ((i = next++) < grps.size()) {
+            buildGroup (model, *grps[i], optimize, this->_groups[i]);
+        }
+    };
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t nWorkers = 1;
+    if (model->numtriangles() >= kMinParallelTris) {
+        nWorkers = std::min<size_t>(nThreads, grps.size());
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 1;  i < nWorkers;  i++) {
+        workers.push_back (std::thread(worker));
+    }
+    worker ();
+    for (auto &w : workers) {
+        w.join();
+    }
+
+  // set the names and materials of the groups
+    for (size_t gi = 0;  gi < grps.size();  gi++) {
+        OBJgroup const &grp = *grps[gi];
+        Group &g = this->_groups[gi];
+        g.name = grp.name;
         g.material = -1;
-        if (grp->material == nullptr) {
+        if (grp.material.empty()) {
             for (uint32_t i = 0;  i < this->_materials.size();  i++) {
                 if (this->_materials[i].name.compare("default") == 0) {
                     g.material = i;
@@ -119,64 +286,16 @@ Model::Model (std::string file)
         }
         else {
             for (uint32_t i = 0;  i < this->_materials.size();  i++) {
-                if (this->_materials[i].name.compare(grp->material) == 0) {
+                if (this->_materials[i].name == grp.material) {
                     g.material = i;
                     break;
                 }
             }
             if (g.material == -1) {
-                std::cerr << "warning: unable to find material \"" << grp->material
+                std::cerr << "warning: unable to find material \"" << grp.material
                     << "\" for group \"" << g.name << "\"" << std::endl;
             }
         }
-      // initialize the vertex data arrays
-        g.nVerts = verts.size();
-        g.verts = new glm::vec3[g.nVerts];
-        if ((model->numnormals > 0) && (model->numtexcoords > 0)) {
-          // has all three components
-            g.norms = new glm::vec3[g.nVerts];
-            g.txtCoords = new glm::vec2[g.nVerts];
-            for (uint32_t i = 0;  i < g.nVerts;  i++) {
-                g.verts[i] = model->vertices[verts[i]._v];
-                g.norms[i] = model->normals[verts[i]._n];
-                g.txtCoords[i] = model->texcoords[verts[i]._t];
-            }
-        }
-        else if (model->numnormals > 0) {
-            g.norms = new glm::vec3[g.nVerts];
-            g.txtCoords = nullptr;
-            for (uint32_t i = 0;  i < g.nVerts;  i++) {
-                g.verts[i] = model->vertices[verts[i]._v];
-                g.norms[i] = model->normals[verts[i]._n];
-            }
-        }
-        else if (model->numtexcoords > 0) {
-            g.norms = nullptr;
-            g.txtCoords = new glm::vec2[g.nVerts];
-            for (uint32_t i = 0;  i < g.nVerts;  i++) {
-                g.verts[i] = model->vertices[verts[i]._v];
-                g.txtCoords[i] = model->texcoords[verts[i]._t];
-            }
-        }
-        else {
-            g.norms = nullptr;
-            g.txtCoords = nullptr;
-            for (uint32_t i = 0;  i < g.nVerts;  i++) {
-                g.verts[i] = model->vertices[verts[i]._v];
-            }
-        }
-      // initialize the group's indices array
-        g.nIndices = indices.size();
-        g.indices = new uint32_t[g.nIndices];
-        for (uint32_t i = 0;  i < g.nIndices;  i++) {
-            g.indices[i] = indices[i];
-        }
-      // add to this model
-        this->_groups.push_back (g);
-      // cleanup
-        map.clear();
-        verts.clear();
-        indices.clear();
     }
 
     delete model;
@@ -185,6 +304,12 @@ Model::Model (std::string file)
 
 Model::~Model ()
 {
+    if (this->_binary != nullptr) {
+      // the group data lives in the mapped binary file
+        delete this->_binary;
+        return;
+    }
+
   // free the storage for the groups
     for (uint32_t i = 0;  i < this->_groups.size();  i++) {
         assert (this->_groups[i].verts != nullptr);
@@ -195,9 +320,29 @@ Model::~Model ()
         if (this->_groups[i].txtCoords != nullptr) {
             delete[] this->_groups[i].txtCoords;
         }
-        assert (this->_groups[i].indices != nullptr);
         delete[] this->_groups[i].indices;
+        delete[] this->_groups[i].lods;
     }
 } // Model::~Model
 
+Model *Model::load (std::string const &filename, bool updateCache, unsigned int nThreads)
+{
+    std::string binFile = Model::binaryPath (filename);
+    if (Model::isBinaryCurrent (binFile, filename)) {
+        Model *model = Model::readBinary (binFile, filename);
+        if (model != nullptr) {
+            return model;
+        }
+    }
+
+    Model *model = new Model (filename, true, nThreads);
+    if (updateCache) {
+      // it is not an error if we cannot write the binary file
+        model->writeBinary (binFile);
+    }
+
+    return model;
+
+}
+
 } // namespace OBJ
@@ -0,0 +1,175 @@
+/*! \file pixel-ops.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Kernels for converting and rearranging pixel data.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "pixel-ops.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cs237 {
+
+namespace __detail {
+
+void expandRGB8 (const uint8_t *src, uint8_t *dst, size_t nPixels)
+{
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // each iteration reads 16 bytes (of which we use 12) and writes four pixels, so
+    // we stop while there are still at least 16 bytes of input left
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+    for (;  i + 6 <= nPixels;  i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3*i));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, shuf), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4*i), v);
+    }
+#endif
+    for (;  i < nPixels;  ++i) {
+        dst[4*i + 0] = src[3*i + 0];
+        dst[4*i + 1] = src[3*i + 1];
+        dst[4*i + 2] = src[3*i + 2];
+        dst[4*i + 3] = 0xff;
+    }
+}
+
+void expandRGB16 (const uint16_t *src, uint16_t *dst, size_t nPixels)
+{
+    for (size_t i = 0;  i < nPixels;  ++i) {
+        dst[4*i + 0] = src[3*i + 0];
+        dst[4*i + 1] = src[3*i + 1];
+        dst[4*i + 2] = src[3*i + 2];
+        dst[4*i + 3] = 0xffff;
+    }
+}
+
+void swapRB8 (uint8_t *data, uint32_t nChans, size_t nPixels)
+{
+    size_t i = 0;
+#if defined(__SSSE3__)
+    if (nChans == 4) {
+        const __m128i shuf = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        for (;  i + 4 <= nPixels;  i += 4) {
+            __m128i *p = reinterpret_cast<__m128i *>(data + 4*i);
+            _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), shuf));
+        }
+    }
+#endif
+    for (;  i < nPixels;  ++i) {
+        std::swap (data[nChans*i], data[nChans*i + 2]);
+    }
+}
+
+void swapBytes16 (uint16_t *data, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (;  i + 8 <= n;  i += 8) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        __m128i v = _mm_loadu_si128(p);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+    for (;  i < n;  ++i) {
+        data[i] = uint16_t((data[i] << 8) | (data[i] >> 8));
+    }
+}
+
+void flipRows (void *data, size_t bytesPerRow, uint32_t nRows)
+{
+    uint8_t *base = static_cast<uint8_t *>(data);
+    for (uint32_t r = 0;  r < nRows / 2;  ++r) {
+        uint8_t *top = base + r * bytesPerRow;
+        uint8_t *bot = base + (nRows - 1 - r) * bytesPerRow;
+        // swap the rows in chunks through a small buffer, which the compiler
+        // turns into vector loads and stores
+        for (size_t i = 0;  i < bytesPerRow;  ) {
+            uint8_t tmp[256];
+            size_t n = std::min(sizeof(tmp), bytesPerRow - i);
+            std::memcpy (tmp, top + i, n);
+            std::memcpy (top + i, bot + i, n);
+            std::memcpy (bot + i, tmp, n);
+            i += n;
+        }
+    }
+}
+
+/***** sRGB conversions *****/
+
+SRGBTables::SRGBTables ()
+{
+    for (int i = 0;  i < 256;  ++i) {
+        float c = float(i) / 255.0f;
+        this->toLinear[i] = (c <= 0.04045f)
+            ? c / 12.92f
+            : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (uint32_t i = 0;  i < kLinearTblSize;  ++i) {
+        float l = float(i) / float(kLinearTblSize - 1);
+        float c = (l <= 0.0031308f)
+            ? 12.92f * l
+            : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+        this->toSRGB[i] = uint8_t(std::min(255.0f, c * 255.0f + 0.5f));
+    }
+}
+
+SRGBTables const &srgbTables ()
+{
+    static SRGBTables tbls;
+    return tbls;
+}
+
+void srgbToLinear (const uint8_t *src, float *dst, size_t n)
+{
+    const float *tbl = srgbTables().toLinear;
+    for (size_t i = 0;  i < n;  ++i) {
+        dst[i] = tbl[src[i]];
+    }
+}
+
+void linearToSRGB (const float *src, uint8_t *dst, size_t n)
+{
+    const uint8_t *tbl = srgbTables().toSRGB;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // clamp and scale four values at a time to get the table indices
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(float(kLinearTblSize - 1));
+    alignas(16) int32_t idx[4];
+    for (;  i + 4 <= n;  i += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+        _mm_store_si128(reinterpret_cast<__m128i *>(idx), _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+        dst[i + 0] = tbl[idx[0]];
+        dst[i + 1] = tbl[idx[1]];
+        dst[i + 2] = tbl[idx[2]];
+        dst[i + 3] = tbl[idx[3]];
+    }
+#endif
+    // round the index to nearest even, as _mm_cvtps_epi32 does, so that a value
+    // converts the same way whether or not it is in the vectorized part
+    for (;  i < n;  ++i) {
+        float v = std::min(1.0f, std::max(0.0f, src[i]));
+        dst[i] = tbl[uint32_t(std::lrint(v * float(kLinearTblSize - 1)))];
+    }
+}
+
+} /* namespace __detail */
+
+} /* namespace cs237 */
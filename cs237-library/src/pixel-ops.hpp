@@ -0,0 +1,89 @@
+/*! \file pixel-ops.hpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * Kernels for converting and rearranging pixel data.  These operations touch
+ * every byte of every image that we load, so they use SIMD instructions when
+ * the target supports them (SSSE3 or SSE2), with scalar fallbacks otherwise.
+ * This header is private to the library.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _PIXEL_OPS_HPP_
+#define _PIXEL_OPS_HPP_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace cs237 {
+
+namespace __detail {
+
+    //! \brief expand 8-bit 3-channel pixels to 4-channel pixels with an opaque alpha
+    //! \param src      the source pixels
+    //! \param dst      the destination pixels (must not overlap src)
+    //! \param nPixels  the number of pixels
+    void expandRGB8 (const uint8_t *src, uint8_t *dst, size_t nPixels);
+
+    //! \brief expand 16-bit 3-channel pixels to 4-channel pixels with an opaque alpha
+    //! \param src      the source pixels
+    //! \param dst      the destination pixels (must not overlap src)
+    //! \param nPixels  the number of pixels
+    void expandRGB16 (const uint16_t *src, uint16_t *dst, size_t nPixels);
+
+    //! \brief swap the first and third channels of 8-bit pixels in place (i.e.,
+    //!        convert between RGB and BGR or between RGBA and BGRA)
+    //! \param data     the pixels
+    //! \param nChans   the number of channels per pixel (3 or 4)
+    //! \param nPixels  the number of pixels
+    void swapRB8 (uint8_t *data, uint32_t nChans, size_t nPixels);
+
+    //! \brief swap the bytes of 16-bit values in place
+    //! \param data  the values
+    //! \param n     the number of values
+    void swapBytes16 (uint16_t *data, size_t n);
+
+    //! \brief flip an image vertically in place
+    //! \param data         the image data
+    //! \param bytesPerRow  the number of bytes in a row
+    //! \param nRows        the number of rows
+    void flipRows (void *data, size_t bytesPerRow, uint32_t nRows);
+
+    //! the number of entries in the linear-to-sRGB table (i.e., 16-bit precision)
+    constexpr uint32_t kLinearTblSize = 65536;
+
+    //! tables for converting between 8-bit sRGB values and linear values
+    struct SRGBTables {
+        float toLinear[256];                //!< sRGB -> linear in [0,1]
+        uint8_t toSRGB[kLinearTblSize];     //!< linear (scaled to 16 bits) -> sRGB
+
+        SRGBTables ();
+    };
+
+    //! the (lazily initialized) sRGB conversion tables
+    SRGBTables const &srgbTables ();
+
+    //! \brief convert 8-bit sRGB-encoded values to linear values in [0,1]
+    //! \param src  the encoded values
+    //! \param dst  the linear values
+    //! \param n    the number of values
+    void srgbToLinear (const uint8_t *src, float *dst, size_t n);
+
+    //! \brief convert linear values to 8-bit sRGB-encoded values; the linear
+    //!        values are clamped to [0,1]
+    //! \param src  the linear values
+    //! \param dst  the encoded values
+    //! \param n    the number of values
+    void linearToSRGB (const float *src, uint8_t *dst, size_t n);
+
+} /* namespace __detail */
+
+} /* namespace cs237 */
+
+#endif /* !_PIXEL_OPS_HPP_ */
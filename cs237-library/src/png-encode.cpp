@@ -0,0 +1,298 @@
+/*! \file png-encode.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * A parallel PNG encoder.  The image is split into bands of rows, which are
+ * filtered and compressed concurrently; the compressed bands are then stitched
+ * together into a single IDAT chunk.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "png-encode.hpp"
+#include "pixel-ops.hpp"
+#include <zlib.h>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+
+namespace cs237 {
+
+namespace __detail {
+
+//! the minimum number of bytes of image data in a band; smaller bands compress
+//! worse, since the deflate window is reset at each band boundary
+constexpr size_t kMinBandBytes = 256 * 1024;
+
+//! PNG filter types
+enum { kFilterNone, kFilterSub, kFilterUp, kFilterAvg, kFilterPaeth, kNumFilters };
+
+//! the result of compressing a band
+struct Band {
+    uint32_t firstRow;          //!< the first row of the band (in output order)
+    uint32_t nRows;             //!< the number of rows in the band
+    std::vector<uint8_t> out;   //!< the compressed data
+    uLong adler;                //!< the Adler-32 checksum of the uncompressed band
+    size_t rawLen;              //!< the length of the uncompressed (filtered) band
+    bool ok;                    //!< true if compression succeeded
+};
+
+//! the parameters of an encoding
+struct Params {
+    const uint8_t *data;        //!< the image data
+    uint32_t ht;                //!< the image height
+    bool flip;                  //!< flip the rows?
+    size_t bytesPerRow;         //!< the number of bytes in a row
+    uint32_t bpp;               //!< bytes per pixel
+    uint32_t nChans;            //!< the number of channels
+    bool swapRB;                //!< swap the red and blue channels (for BGR formats)?
+    bool is16;                  //!< are the channels 16 bits?
+};
+
+//! copy a row of the image into PNG order (i.e., RGB order and big-endian samples)
+static void prepareRow (Params const &p, uint32_t row, uint8_t *dst)
+{
+    uint32_t srcRow = p.flip ? (p.ht - 1 - row) : row;
+    const uint8_t *src = p.data + size_t(srcRow) * p.bytesPerRow;
+    std::memcpy (dst, src, p.bytesPerRow);
+    if (p.is16) {
+        swapBytes16 (reinterpret_cast<uint16_t *>(dst), p.bytesPerRow / 2);
+    }
+    else if (p.swapRB) {
+        swapRB8 (dst, p.nChans, p.bytesPerRow / p.nChans);
+    }
+}
+
+inline uint8_t paeth (int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if ((pa <= pb) && (pa <= pc)) return uint8_t(a);
+    else if (pb <= pc) return uint8_t(b);
+    else return uint8_t(c);
+}
+
+//! filter a row using each of the filter types and return the one that minimizes
+//! the sum of absolute differences (the heuristic used by libpng)
+static int filterRow (
+    const uint8_t *cur, const uint8_t *prev, size_t n, uint32_t bpp,
+    uint8_t *out[kNumFilters])
+{
+    uint64_t cost[kNumFilters] = {0, 0, 0, 0, 0};
+    for (size_t i = 0;  i < n;  ++i) {
+        int x = cur[i];
+        int a = (i >= bpp) ? cur[i - bpp] : 0;
+        int b = prev[i];
+        int c = (i >= bpp) ? prev[i - bpp] : 0;
+        uint8_t v[kNumFilters] = {
+                uint8_t(x),
+                uint8_t(x - a),
+                uint8_t(x - b),
+                uint8_t(x - ((a + b) >> 1)),
+                uint8_t(x - paeth(a, b, c))
+            };
+        for (int f = 0;  f < kNumFilters;  ++f) {
+            out[f][i] = v[f];
+            cost[f] += uint64_t(std::abs(int(int8_t(v[f]))));
+        }
+    }
+    int best = kFilterNone;
+    for (int f = 1;  f < kNumFilters;  ++f) {
+        if (cost[f] < cost[best]) {
+            best = f;
+        }
+    }
+    return best;
+}
+
+//! filter and compress a band of rows
+static void compressBand (Params const &p, Band &band, bool last)
+{
+    size_t n = p.bytesPerRow;
+    std::vector<uint8_t> prev(n, 0), cur(n);
+    std::vector<uint8_t> filtered(kNumFilters * n);
+    uint8_t *out[kNumFilters];
+    for (int f = 0;  f < kNumFilters;  ++f) {
+        out[f] = filtered.data() + f * n;
+    }
+
+    // the filters of the first row of the band depend on the preceding row
+    if (band.firstRow > 0) {
+        prepareRow (p, band.firstRow - 1, prev.data());
+    }
+
+    // filter the rows; each row is preceded by its filter-type byte
+    band.rawLen = size_t(band.nRows) * (n + 1);
+    std::vector<uint8_t> raw(band.rawLen);
+    uint8_t *dst = raw.data();
+    for (uint32_t r = 0;  r < band.nRows;  ++r) {
+        prepareRow (p, band.firstRow + r, cur.data());
+        int f = filterRow (cur.data(), prev.data(), n, p.bpp, out);
+        *dst++ = uint8_t(f);
+        std::memcpy (dst, out[f], n);
+        dst += n;
+        std::swap (cur, prev);
+    }
+    band.adler = adler32 (adler32(0, Z_NULL, 0), raw.data(), uInt(band.rawLen));
+
+    // compress the band as a raw deflate stream
+    z_stream zs;
+    std::memset (&zs, 0, sizeof(zs));
+    if (deflateInit2 (&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK) {
+        band.ok = false;
+        return;
+    }
+    band.out.resize (deflateBound(&zs, uLong(band.rawLen)) + 16);
+    zs.next_in = raw.data();
+    zs.avail_in = uInt(band.rawLen);
+    zs.next_out = band.out.data();
+    zs.avail_out = uInt(band.out.size());
+    int sts = deflate (&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    band.ok = last ? (sts == Z_STREAM_END) : ((sts == Z_OK) && (zs.avail_in == 0));
+    band.out.resize (zs.total_out);
+    deflateEnd (&zs);
+}
+
+// write a big-endian 32-bit value
+inline void putUI32 (std::vector<uint8_t> &buf, uint32_t v)
+{
+    buf.push_back(uint8_t(v >> 24));
+    buf.push_back(uint8_t(v >> 16));
+    buf.push_back(uint8_t(v >> 8));
+    buf.push_back(uint8_t(v));
+}
+
+// write a PNG chunk
+static void writeChunk (std::ofstream &outS, const char *type, const uint8_t *data, size_t len)
+{
+    std::vector<uint8_t> hdr;
+    putUI32 (hdr, uint32_t(len));
+    hdr.insert (hdr.end(), type, type + 4);
+    uLong crc = crc32 (crc32(0, Z_NULL, 0), hdr.data() + 4, 4);
+    if (len > 0) {
+        crc = crc32 (crc, data, uInt(len));
+    }
+    outS.write (reinterpret_cast<const char *>(hdr.data()), hdr.size());
+    if (len > 0) {
+        outS.write (reinterpret_cast<const char *>(data), len);
+    }
+    std::vector<uint8_t> trailer;
+    putUI32 (trailer, uint32_t(crc));
+    outS.write (reinterpret_cast<const char *>(trailer.data()), trailer.size());
+}
+
+bool writePNGParallel (
+    std::ofstream &outS,
+    bool flip, uint32_t wid, uint32_t ht,
+    Channels fmt, ChannelTy ty, const void *data,
+    unsigned int nThreads)
+{
+    if ((wid == 0) || (ht == 0)) {
+        std::cerr << "writePNG: empty image" << std::endl;
+        return false;
+    }
+
+    Params p;
+    uint8_t colorTy;
+    switch (fmt) {
+      case Channels::R: p.nChans = 1; colorTy = 0; break;
+      case Channels::RG: p.nChans = 2; colorTy = 4; break;
+      case Channels::RGB:
+      case Channels::BGR: p.nChans = 3; colorTy = 2; break;
+      case Channels::RGBA:
+      case Channels::BGRA: p.nChans = 4; colorTy = 6; break;
+      default:
+        std::cerr << "writePNG: invalid format " << to_string(fmt) << std::endl;
+        return false;
+    }
+    if ((ty != ChannelTy::U8) && (ty != ChannelTy::U16)) {
+        std::cerr << "writePNG: unsupported pixel type " << to_string(ty) << std::endl;
+        return false;
+    }
+    p.data = static_cast<const uint8_t *>(data);
+    p.ht = ht;
+    p.flip = flip;
+    p.is16 = (ty == ChannelTy::U16);
+    p.swapRB = ((fmt == Channels::BGR) || (fmt == Channels::BGRA));
+    p.bpp = p.nChans * (p.is16 ? 2 : 1);
+    p.bytesPerRow = size_t(wid) * p.bpp;
+    if (p.is16 && p.swapRB) {
+        std::cerr << "writePNG: unsupported 16-bit BGR format" << std::endl;
+        return false;
+    }
+
+    // split the image into bands
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    uint32_t rowsPerBand = std::max<uint32_t>(1,
+        uint32_t((kMinBandBytes + p.bytesPerRow - 1) / p.bytesPerRow));
+    uint32_t nBands = (ht + rowsPerBand - 1) / rowsPerBand;
+    if (nBands > nThreads) {
+        // use one band per thread
+        nBands = nThreads;
+        rowsPerBand = (ht + nBands - 1) / nBands;
+        nBands = (ht + rowsPerBand - 1) / rowsPerBand;
+    }
+    std::vector<Band> bands(nBands);
+    for (uint32_t i = 0;  i < nBands;  ++i) {
+        bands[i].firstRow = i * rowsPerBand;
+        bands[i].nRows = std::min(rowsPerBand, ht - bands[i].firstRow);
+    }
+
+    // compress the bands; the calling thread handles the last band
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0;  i + 1 < nBands;  ++i) {
+        workers.push_back (std::thread(compressBand, std::cref(p), std::ref(bands[i]), false));
+    }
+    compressBand (p, bands[nBands - 1], true);
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    // assemble the zlib stream: header, deflate data, and the combined checksum
+    std::vector<uint8_t> idat;
+    idat.push_back (0x78);      // deflate with a 32K window
+    idat.push_back (0x9c);      // default compression level, and header check bits
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (auto &band : bands) {
+        if (! band.ok) {
+            std::cerr << "writePNG: compression error" << std::endl;
+            return false;
+        }
+        idat.insert (idat.end(), band.out.begin(), band.out.end());
+        adler = adler32_combine (adler, band.adler, z_off_t(band.rawLen));
+    }
+    putUI32 (idat, uint32_t(adler));
+
+    // write the file
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    outS.write (reinterpret_cast<const char *>(sig), sizeof(sig));
+
+    std::vector<uint8_t> ihdr;
+    putUI32 (ihdr, wid);
+    putUI32 (ihdr, ht);
+    ihdr.push_back (p.is16 ? 16 : 8);   // bit depth
+    ihdr.push_back (colorTy);
+    ihdr.push_back (0);                 // compression method
+    ihdr.push_back (0);                 // filter method
+    ihdr.push_back (0);                 // no interlacing
+    writeChunk (outS, "IHDR", ihdr.data(), ihdr.size());
+    writeChunk (outS, "IDAT", idat.data(), idat.size());
+    writeChunk (outS, "IEND", nullptr, 0);
+    outS.flush();
+
+    return !outS.fail();
+
+}
+
+} /* namespace __detail */
+
+} /* namespace cs237 */
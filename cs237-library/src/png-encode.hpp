@@ -0,0 +1,52 @@
+/*! \file png-encode.hpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * A parallel PNG encoder.  This header is private to the library.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _PNG_ENCODE_HPP_
+#define _PNG_ENCODE_HPP_
+
+#include "cs237.hpp"
+#include <fstream>
+
+namespace cs237 {
+
+namespace __detail {
+
+    //! \brief write a PNG image to an output stream, compressing bands of rows in
+    //!        parallel
+    //! \param outS the output stream
+    //! \param flip true if the rows of the image should be flipped to match OpenGL
+    //! \param wid the image width
+    //! \param ht the image height (1 for 1D images)
+    //! \param fmt the channels of the image
+    //! \param ty the channel type (U8 or U16)
+    //! \param data a pointer to the image data
+    //! \param nThreads the number of threads to use (0 means use the hardware concurrency)
+    //! \return true if the write is successful; otherwise false on error.
+    //!
+    //! Each band is filtered and deflated independently.  All but the last band are
+    //! terminated with a sync flush, which byte aligns the stream without marking
+    //! the final block, so the compressed bands can be concatenated to form a single
+    //! zlib stream.  The Adler-32 checksum of the stream is computed by combining
+    //! the checksums of the bands.
+    bool writePNGParallel (
+        std::ofstream &outS,
+        bool flip, uint32_t wid, uint32_t ht,
+        Channels fmt, ChannelTy ty, const void *data,
+        unsigned int nThreads);
+
+} /* namespace __detail */
+
+} /* namespace cs237 */
+
+#endif /* !_PNG_ENCODE_HPP_ */
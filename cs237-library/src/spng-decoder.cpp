@@ -0,0 +1,186 @@
+/*! \file spng-decoder.cpp
+ *
+ * Support code for CMSC 23700 Autumn 2023.
+ *
+ * A PNG decoder based on libspng (https://libspng.org), which is substantially
+ * faster than libpng.  This decoder is only available when the library is
+ * configured with CS237_ENABLE_SPNG and libspng is found.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+
+#ifdef CS237_HAVE_SPNG
+
+#include <spng.h>
+
+namespace cs237 {
+
+//! get the properties of the image in a spng context and determine the output
+//! format that matches the conventions of the libpng decoder
+static bool getInfo (spng_ctx *ctx, PNGInfo &info, int &fmt)
+{
+    struct spng_ihdr ihdr;
+    if (spng_get_ihdr(ctx, &ihdr) != 0) {
+#ifndef NDEBUG
+        std::cerr << "readPNG: bogus header" << std::endl;
+#endif
+        return false;
+    }
+
+    bool is16 = (ihdr.bit_depth == 16);
+    info.wid = ihdr.width;
+    info.ht = ihdr.height;
+    info.type = is16 ? ChannelTy::U16 : ChannelTy::U8;
+    info.sRGB = false;
+    switch (ihdr.color_type) {
+    case SPNG_COLOR_TYPE_GRAYSCALE:
+        info.chans = Channels::R;
+        // there is no 16-bit gray format, so we use the PNG format, which is host-endian
+        fmt = is16 ? SPNG_FMT_PNG : SPNG_FMT_G8;
+        break;
+    case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA:
+        info.chans = Channels::RG;
+        fmt = is16 ? SPNG_FMT_GA16 : SPNG_FMT_GA8;
+        break;
+    case SPNG_COLOR_TYPE_INDEXED:
+        info.chans = Channels::RGBA;
+        fmt = SPNG_FMT_RGBA8;
+        break;
+    case SPNG_COLOR_TYPE_TRUECOLOR:
+    case SPNG_COLOR_TYPE_TRUECOLOR_ALPHA:
+        info.chans = Channels::RGBA;
+        fmt = is16 ? SPNG_FMT_RGBA16 : SPNG_FMT_RGBA8;
+        // assume that any 3-channel color image is sRGB, as does the libpng decoder
+        info.sRGB = true;
+        break;
+    default:
+#ifndef NDEBUG
+        std::cerr << "unknown color type " << int(ihdr.color_type) << std::endl;
+#endif
+        return false;
+    }
+
+  /* sanity check the image dimensions: max size is 20k x 20k */
+    if ((20*1024 < info.wid) || (20*1024 < info.ht)) {
+#ifndef NDEBUG
+        std::cerr << "readPNG: image too large" << std::endl;
+#endif
+        return false;
+    }
+
+    if (spng_decoded_image_size(ctx, fmt, &info.nBytes) != 0) {
+        return false;
+    }
+
+    return true;
+}
+
+//! The PNG decoder implemented using libspng
+class SPNGDecoder : public ImageDecoder {
+  public:
+    const char *name () const override { return "spng"; }
+
+    bool readInfo (const uint8_t *data, size_t len, PNGInfo &info) override
+    {
+        info.chans = Channels::UNKNOWN;
+        spng_ctx *ctx = spng_ctx_new(0);
+        if (ctx == nullptr) {
+            return false;
+        }
+        int fmt;
+        bool ok = (spng_set_png_buffer(ctx, data, len) == 0) && getInfo(ctx, info, fmt);
+        spng_ctx_free (ctx);
+        return ok;
+    }
+
+    void *decode (
+        const uint8_t *data, size_t len, bool flip, PNGInfo &info,
+        void *buf, size_t bufSz) override
+    {
+        spng_ctx *ctx = spng_ctx_new(0);
+        if (ctx == nullptr) {
+            return nullptr;
+        }
+        int fmt;
+        if ((spng_set_png_buffer(ctx, data, len) != 0) || !getInfo(ctx, info, fmt)) {
+            spng_ctx_free (ctx);
+            return nullptr;
+        }
+
+      /* allocate image data, unless the caller has provided a large enough buffer */
+        uint8_t *img;
+        bool ownsImg = false;
+        if ((buf != nullptr) && (info.nBytes <= bufSz)) {
+            img = static_cast<uint8_t *>(buf);
+        }
+        else {
+            img = static_cast<uint8_t *>(std::malloc (info.nBytes));
+            if (img == nullptr) {
+#ifndef NDEBUG
+                std::cerr << "readPNG: unable to allocate image" << std::endl;
+#endif
+                spng_ctx_free (ctx);
+                return nullptr;
+            }
+            ownsImg = true;
+        }
+
+      /* decode the image one row at a time, so that we can flip it as we go; for
+       * interlaced images, rows are visited once per pass.
+       */
+        size_t bytesPerRow = info.nBytes / info.ht;
+        int sts = spng_decode_image(ctx, nullptr, 0, fmt, SPNG_DECODE_PROGRESSIVE);
+        if (sts == 0) {
+            struct spng_row_info row;
+            do {
+                sts = spng_get_row_info(ctx, &row);
+                if (sts != 0) {
+                    break;
+                }
+                uint32_t r = flip ? (info.ht - 1 - row.row_num) : row.row_num;
+                sts = spng_decode_row(ctx, img + r * bytesPerRow, bytesPerRow);
+            } while (sts == 0);
+        }
+        spng_ctx_free (ctx);
+
+        if (sts != SPNG_EOI) {
+#ifndef NDEBUG
+            std::cerr << "readPNG: " << spng_strerror(sts) << std::endl;
+#endif
+            if (ownsImg) {
+                std::free (img);
+            }
+            return nullptr;
+        }
+
+        return img;
+    }
+};
+
+ImageDecoder *ImageDecoder::spng ()
+{
+    static SPNGDecoder decoder;
+    return &decoder;
+}
+
+} /* namespace cs237 */
+
+#else // !CS237_HAVE_SPNG
+
+namespace cs237 {
+
+ImageDecoder *ImageDecoder::spng ()
+{
+    return nullptr;
+}
+
+} /* namespace cs237 */
+
+#endif // CS237_HAVE_SPNG
@@ -20,7 +20,14 @@ TextureBase::TextureBase (
     Application *app,
     uint32_t wid, uint32_t ht, uint32_t mipLvls,
     cs237::__detail::ImageBase const *img)
-  : _app(app), _wid(wid), _ht(ht), _nMipLevels(mipLvls), _fmt(img->format())
+  : TextureBase(app, wid, ht, mipLvls, img->format())
+{ }
+
+TextureBase::TextureBase (
+    Application *app,
+    uint32_t wid, uint32_t ht, uint32_t mipLvls,
+    vk::Format fmt)
+  : _app(app), _wid(wid), _ht(ht), _nMipLevels(mipLvls), _fmt(fmt)
 {
     vk::ImageUsageFlags usage = (mipLvls > 1)
         ? vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
@@ -111,12 +118,33 @@ static int32_t ilog2 (uint32_t n)
 
 }
 
+// can the device generate the mipmap levels for an image by blitting?
+static bool canBlitMipmaps (Application *app, Image2D const *img)
+{
+    return bool(app->formatProps(img->format()).optimalTilingFeatures
+        & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+}
+
+// can the mipmap levels for an image be computed on the CPU (see MipmapImage2D)?
+static bool canComputeMipmaps (Image2D const *img)
+{
+    return (img->type() == ChannelTy::U8)
+        && ((img->channels() == Channels::R)
+            || (img->channels() == Channels::RG)
+            || (img->channels() == Channels::RGBA));
+}
+
 // compute the number of mipmap levels for an image.  This value is log2 of
 // the larger dimension plus one for the base level image.  We require that
-// both dimensions be a power of 2.
-static uint32_t mipLevels (Image2D const *img, bool mipmap)
+// both dimensions be a power of 2.  If the levels can be computed neither on
+// the GPU nor on the CPU (e.g., for 16-bit images), then the texture has a
+// single level.
+static uint32_t mipLevels (Application *app, Image2D const *img, bool mipmap)
 {
-    if (mipmap) {
+    if (mipmap && !canBlitMipmaps(app, img) && !canComputeMipmaps(img)) {
+        return 1;
+    }
+    else if (mipmap) {
         int32_t log2Wid = ilog2(img->width());
         int32_t log2Ht = ilog2(img->height());
         if ((log2Wid < 0) || (log2Ht < 0)) {
@@ -130,13 +158,141 @@ static uint32_t mipLevels (Image2D const *img, bool mipmap)
 }
 
 Texture2D::Texture2D (Application *app, Image2D const *img, bool mipmap)
-  : __detail::TextureBase(app, img->width(), img->height(), mipLevels(img, mipmap), img)
+  : __detail::TextureBase(
+        app, img->width(), img->height(), mipLevels(app, img, mipmap), img)
 {
-    if (mipmap) {
+    if (this->_nMipLevels == 1) {
+        this->_init (img);
+    }
+    else if (canBlitMipmaps (app, img)) {
         this->_generateMipMaps (img);
+    }
+    else {
+        // the format does not support linear blitting, so we compute the
+        // levels on the CPU
+        MipmapImage2D mm(img, this->_nMipLevels);
+        this->_initLevels (&mm);
+    }
+}
+
+// determine the format used for the texture of a mipmap image.  Block-compressed
+// images are decompressed when the device cannot sample the compressed format.
+static vk::Format uploadFormat (Application *app, MipmapImage2D const *img)
+{
+    if (img->isCompressed()) {
+        vk::FormatProperties props = app->formatProps(img->format());
+        if (!(props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage)) {
+            return img->decodedFormat();
+        }
+    }
+    return img->format();
+}
+
+Texture2D::Texture2D (Application *app, MipmapImage2D const *img)
+  : __detail::TextureBase(
+        app, img->width(), img->height(), img->nLevels(), uploadFormat(app, img))
+{
+    if (this->_fmt != img->format()) {
+        MipmapImage2D *decoded = img->decompress();
+        this->_initLevels (decoded);
+        delete decoded;
     } else {
-        this->_init (img);
+        this->_initLevels (img);
+    }
+}
+
+// helper function for uploading all of the levels of a mipmap image.  We use
+// a single staging buffer and a single command buffer for the layout transitions
+// and the copy.
+void Texture2D::_initLevels (MipmapImage2D const *img)
+{
+    size_t nBytes = img->nBytes();
+    auto device = this->_app->_device;
+
+    // create a staging buffer for copying the image
+    vk::Buffer stagingBuf = this->_createBuffer (
+        nBytes,
+        vk::BufferUsageFlagBits::eTransferSrc);
+    vk::DeviceMemory stagingBufMem = this->_allocBufferMemory(
+        stagingBuf,
+        vk::MemoryPropertyFlagBits::eHostVisible
+            | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    // copy the image data to the staging buffer
+    void *stagingData = device.mapMemory(stagingBufMem, 0, nBytes, {});
+    memcpy(stagingData, img->data(), nBytes);
+    device.unmapMemory(stagingBufMem);
+
+    // one copy region per level
+    std::vector<vk::BufferImageCopy> regions;
+    regions.reserve(this->_nMipLevels);
+    for (uint32_t i = 0;  i < this->_nMipLevels;  ++i) {
+        auto const &lvl = img->level(i);
+        regions.push_back(vk::BufferImageCopy(
+            lvl.offset, /* buffer offset */
+            0, /* row length (0 means tightly packed) */
+            0, /* image height (0 means tightly packed) */
+            vk::ImageSubresourceLayers(
+                vk::ImageAspectFlagBits::eColor, /* aspect mask */
+                i, /* mip level */
+                0, /* base array layer */
+                1), /* layer count */
+            { 0, 0, 0 }, /* image offset */
+            { lvl.wid, lvl.ht, 1 })); /* image extent */
     }
+
+    vk::CommandBuffer cmdBuf = this->_app->newCommandBuf();
+
+    this->_app->beginCommands(cmdBuf, true);
+
+    vk::ImageMemoryBarrier barrier(
+        {}, /* src access mask */
+        vk::AccessFlagBits::eTransferWrite, /* dst access mask */
+        vk::ImageLayout::eUndefined, /* old layout */
+        vk::ImageLayout::eTransferDstOptimal, /* new layout */
+        VK_QUEUE_FAMILY_IGNORED, /* src queue family index */
+        VK_QUEUE_FAMILY_IGNORED, /* dst queue family index */
+        this->_img, /* image */
+        vk::ImageSubresourceRange(
+            vk::ImageAspectFlagBits::eColor, /* aspect mask */
+            0, /* base mip level */
+            this->_nMipLevels, /* level count */
+            0, /* base array layer */
+            1)); /* layer count */
+
+    cmdBuf.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe, /* src stage */
+        vk::PipelineStageFlagBits::eTransfer, /* dst stage */
+        {}, /* dependency flags */
+        nullptr, /* memory barriers */
+        nullptr, /* buffer-memory barriers */
+        barrier); /* image barriers */
+
+    cmdBuf.copyBufferToImage(
+        stagingBuf, this->_img, vk::ImageLayout::eTransferDstOptimal, regions);
+
+    barrier
+        .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+    cmdBuf.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer, /* src stage */
+        vk::PipelineStageFlagBits::eFragmentShader, /* dst stage */
+        {}, /* dependency flags */
+        nullptr, /* memory barriers */
+        nullptr, /* buffer-memory barriers */
+        barrier); /* image barriers */
+
+    this->_app->endCommands(cmdBuf);
+    this->_app->submitCommands(cmdBuf);
+    this->_app->freeCommandBuf(cmdBuf);
+
+    // free up the staging buffer
+    device.freeMemory(stagingBufMem);
+    device.destroyBuffer(stagingBuf);
+
 }
 
 // helper function for generating the mipmaps for a texture
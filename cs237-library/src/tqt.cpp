@@ -4,6 +4,11 @@
  * implementation by Thatcher Ulrich.  The main difference is that we use PNG files to
  * represent the texture data.
  *
+ * Version 2 of the file format replaces the PNG images with complete mipmap chains
+ * in a GPU-ready layout (either uncompressed RGBA or one of the BCn formats), which
+ * can be read directly into a staging buffer.  The header of a version 2 file has two
+ * additional 32-bit fields (the tile format and the number of levels per tile).
+ *
  * \author John Reppy
  */
 
@@ -14,6 +19,8 @@
 
 #include "cs237.hpp"
 #include "tqt.hpp"
+#include "mapped-file.hpp"
+#include <cstring>
 
 /***** inline utility functions *****/
 
@@ -35,30 +42,29 @@ inline uint32_t nodeIndex (uint32_t level, uint32_t row, uint32_t col)
     return fullSize(level) + (row << level) + col;
 }
 
-inline bool readUI32 (std::ifstream *inS, uint32_t &v)
-{
-    if (inS->read(reinterpret_cast<char *>(&v), sizeof(v)).fail()) {
-#ifndef NDEBUG
-        std::cerr << "TextureQTree::loadImage: error reading file" << std::endl;
-#endif
-        return false;
-    }
-    else
-        return true;
-}
+// an input cursor over the contents of a mapped file
+struct Input {
+    const uint8_t *p;           // the current position
+    const uint8_t *end;         // the end of the data
+};
 
-inline bool readUI64 (std::ifstream *inS, uint64_t &v)
+template <typename T>
+inline bool readVal (Input &in, T &v)
 {
-    if (inS->read(reinterpret_cast<char *>(&v), sizeof(v)).fail()) {
+    if (size_t(in.end - in.p) < sizeof(T)) {
 #ifndef NDEBUG
         std::cerr << "TextureQTree::loadImage: error reading file" << std::endl;
 #endif
         return false;
     }
-    else
-        return true;
+    std::memcpy (&v, in.p, sizeof(T));
+    in.p += sizeof(T);
+    return true;
 }
 
+inline bool readUI32 (Input &in, uint32_t &v) { return readVal(in, v); }
+inline bool readUI64 (Input &in, uint64_t &v) { return readVal(in, v); }
+
 namespace tqt {
 
 // file header
@@ -69,10 +75,77 @@ struct Hdr {
     uint32_t        tileSize;       // width of tiles; should be power of 2
 };
 
+// additional header fields for version 2 files
+struct HdrV2 {
+    uint32_t        format;         // tile format (see TileFormat)
+    uint32_t        nLevels;        // number of mipmap levels per tile
+};
+
 constexpr uint32_t kMagic = 0x00545154;  // "TQT\0" in little-endian order
-constexpr uint32_t kVersion = 1;
+constexpr uint32_t kVersionPNG = 1;      // tiles are PNG images
+constexpr uint32_t kVersionMipmap = 2;   // tiles are mipmap chains
+constexpr uint32_t kMaxDepth = 15;       // the largest depth for which fullSize fits
+                                         // in 32 bits
+constexpr uint32_t kMaxTileSize = 1 << 15; // the largest supported tile width
+
+// expand 8-bit R or RG pixels to RGBA pixels; the missing channels are filled
+// in the same way that the GPU samples R and RG textures (i.e., green and blue
+// are zero and alpha is one).  The expansion works from the last pixel to the
+// first, so `src` may be the start of `dst`.
+static void expandToRGBA8 (const uint8_t *src, uint32_t nChans, uint8_t *dst, size_t nPixels)
+{
+    assert ((nChans == 1) || (nChans == 2));
+    for (size_t i = nPixels;  i-- > 0;  ) {
+        uint8_t r = src[nChans * i];
+        uint8_t g = (nChans == 2) ? src[nChans * i + 1] : 0;
+        dst[4 * i] = r;
+        dst[4 * i + 1] = g;
+        dst[4 * i + 2] = 0;
+        dst[4 * i + 3] = 255;
+    }
+}
+
+// the number of channels of an 8-bit tile format that can be expanded to RGBA
+// (0 for unsupported formats)
+static uint32_t tileChannels (cs237::Channels chans, cs237::ChannelTy ty)
+{
+    if (ty != cs237::ChannelTy::U8) {
+        return 0;
+    }
+    switch (chans) {
+    case cs237::Channels::R: return 1;
+    case cs237::Channels::RG: return 2;
+    case cs237::Channels::RGBA: return 4;
+    default: return 0;
+    }
+}
 
-static bool readHeader (std::ifstream *inS, Hdr &hdr)
+// allocate an uninitialized mipmap chain for a tile
+static cs237::MipmapImage2D *allocTile (int tileSize, uint32_t nLevels, TileFormat fmt, bool sRGB)
+{
+    if (fmt == TileFormat::RGBA8) {
+        return new cs237::MipmapImage2D (
+            tileSize, tileSize, nLevels, cs237::Channels::RGBA, sRGB);
+    } else {
+        return new cs237::MipmapImage2D (
+            tileSize, tileSize, nLevels, static_cast<bcn::Format>(fmt), sRGB);
+    }
+}
+
+static bool validTileFormat (uint32_t fmt)
+{
+    switch (static_cast<TileFormat>(fmt)) {
+    case TileFormat::RGBA8:
+    case TileFormat::BC1:
+    case TileFormat::BC3:
+    case TileFormat::BC5:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool readHeader (Input &inS, Hdr &hdr, HdrV2 &hdr2)
 {
     // read header data
     if ((! readUI32(inS, hdr.magic))
@@ -83,10 +156,34 @@ static bool readHeader (std::ifstream *inS, Hdr &hdr)
     }
 
     // check data
-    if ((hdr.magic != kMagic) || (hdr.version != kVersion)) {
+    if ((hdr.magic != kMagic)
+    || ((hdr.version != kVersionPNG) && (hdr.version != kVersionMipmap))) {
         return false;
     }
-// FIXME: should also check that depth is reasonable and tileSize is power of 2
+
+    // the depth must be small enough that the node indices fit in 32 bits and the
+    // tile size must be a power of two
+    if ((hdr.depth == 0) || (hdr.depth > kMaxDepth)
+    ||  (hdr.tileSize == 0) || (hdr.tileSize > kMaxTileSize)
+    ||  ((hdr.tileSize & (hdr.tileSize - 1)) != 0)) {
+        return false;
+    }
+
+    if (hdr.version == kVersionMipmap) {
+        if ((! readUI32(inS, hdr2.format))
+        ||  (! readUI32(inS, hdr2.nLevels))) {
+            return false;
+        }
+        uint32_t maxLevels = cs237::MipmapImage2D::fullChainLength(
+            hdr.tileSize, hdr.tileSize);
+        if ((! validTileFormat(hdr2.format))
+        ||  (hdr2.nLevels == 0) || (hdr2.nLevels > maxLevels)) {
+            return false;
+        }
+    } else {
+        hdr2.format = static_cast<uint32_t>(TileFormat::RGBA8);
+        hdr2.nLevels = 1;
+    }
 
     return true;
 }
@@ -97,54 +194,54 @@ TextureQTree::TextureQTree (std::string const &filename, bool flip, bool sRGB)
     : _flip(flip), _sRGB(sRGB), _source(nullptr)
 {
     Hdr hdr;
+    HdrV2 hdr2;
 
-    std::ifstream *inS = new std::ifstream(filename);
-    if (inS->fail()) {
+    cs237::__detail::MappedFile *f = new cs237::__detail::MappedFile(filename);
+    Input inS{f->data(), f->data() + f->size()};
+    if (! f->isValid()) {
 #ifndef NDEBUG
         std::cerr << "TextureQTree::TextureQTree: unable to open \""
             << filename << "\"\n";
-        delete inS;
 #endif
+        delete f;
         exit (1);
     }
-    else if (! readHeader(inS, hdr)) {
+    else if (! readHeader(inS, hdr, hdr2)) {
 #ifndef NDEBUG
         std::cerr << "TextureQTree::TextureQTree: file \"" << filename
             << "\" has bogus header\n";
-        delete inS;
 #endif
+        delete f;
         exit (1);
     }
     else {
         this->_depth = hdr.depth;
         this->_tileSize = hdr.tileSize;
+        this->_version = hdr.version;
+        this->_tileFmt = static_cast<TileFormat>(hdr2.format);
+        this->_nLevels = hdr2.nLevels;
         int nTiles = fullSize(hdr.depth);
         this->_toc.resize(nTiles, 0);
-        this->_source = inS;
         // read the TOC
         for (int i = 0;  i < nTiles;  i++) {
             uint64_t offset;
-            if (! readUI64(inS, offset)) {
+            if ((! readUI64(inS, offset)) || (f->size() <= offset)) {
 #ifndef NDEBUG
                 std::cerr << "TextureQTree::TextureQTree: file \"" << filename
                     << "\" has bogus TOC\n";
 #endif
-                this->_source = nullptr;
-                inS->close();
-                delete inS;
+                delete f;
                 exit (1);
             }
-            this->_toc[i] = static_cast<std::streamoff>(offset);
+            this->_toc[i] = offset;
         }
+        this->_source = f;
     }
 }
 
 TextureQTree::~TextureQTree ()
 {
-    if (this->_source != nullptr) {
-        this->_source->close();
-        delete this->_source;
-    }
+    delete this->_source;
 }
 
 cs237::Image2D *TextureQTree::loadImage (int level, int row, int col)
@@ -154,39 +251,237 @@ cs237::Image2D *TextureQTree::loadImage (int level, int row, int col)
     }
     assert (level < this->_depth);
 
+    if (this->_version == kVersionMipmap) {
+        // extract the base level of the mipmap chain
+        cs237::MipmapImage2D *mm = this->loadMipmaps(level, row, col);
+        if (mm == nullptr) {
+            return nullptr;
+        }
+        // the result is always RGBA, so two-channel (BC5) tiles are decoded into
+        // the front of the image and then expanded in place.  The mipmap image
+        // is only sRGB for color data (i.e., not for BC5).
+        cs237::Image2D *img;
+        if (mm->sRGB()) {
+            img = new cs237::Image2D (
+                this->_tileSize, this->_tileSize, cs237::Channels::RGBA, cs237::ChannelTy::U8);
+        } else {
+            img = new cs237::DataImage2D (
+                this->_tileSize, this->_tileSize, cs237::Channels::RGBA, cs237::ChannelTy::U8);
+        }
+        uint32_t nChans = tileChannels (mm->channels(), cs237::ChannelTy::U8);
+        size_t nPixels = size_t(this->_tileSize) * this->_tileSize;
+        uint8_t *data = static_cast<uint8_t *>(img->data());
+        if (mm->isCompressed()) {
+            bcn::decodeImage (
+                mm->compression(), this->_tileSize, this->_tileSize,
+                static_cast<const uint8_t *>(mm->levelData(0)),
+                data);
+        } else {
+            std::memcpy (data, mm->levelData(0), nPixels * nChans);
+        }
+        if (nChans < 4) {
+            expandToRGBA8 (data, nChans, data, nPixels);
+        }
+        delete mm;
+        return img;
+    }
+
     uint32_t index = nodeIndex(level, row, col);
     assert (index < this->_toc.size());
 
-    this->_source->seekg(this->_toc[index]);
+    // decode the PNG directly from the mapped file
+    const uint8_t *tile = this->_source->data() + this->_toc[index];
+    size_t len = this->_source->size() - this->_toc[index];
     cs237::Image2D *img;
     if (this->_sRGB) {
-        img = new cs237::Image2D (*(this->_source), this->_flip);
+        img = new cs237::Image2D (tile, len, this->_flip);
     } else {
-        img = new cs237::DataImage2D (*(this->_source), this->_flip);
+        img = new cs237::DataImage2D (tile, len, this->_flip);
     }
+    uint32_t nChans = tileChannels (img->channels(), img->type());
     if ((img->width() != this->_tileSize)
     ||  (img->height() != this->_tileSize)
-    ||  (img->channels () != cs237::Channels::RGBA)) {
+    ||  (nChans == 0)) {
         delete img;
         return nullptr;
     }
+    else if (nChans < 4) {
+        // expand single and two-channel tiles to RGBA
+        cs237::Image2D *rgba;
+        if (this->_sRGB) {
+            rgba = new cs237::Image2D (
+                this->_tileSize, this->_tileSize, cs237::Channels::RGBA, cs237::ChannelTy::U8);
+        } else {
+            rgba = new cs237::DataImage2D (
+                this->_tileSize, this->_tileSize, cs237::Channels::RGBA, cs237::ChannelTy::U8);
+        }
+        expandToRGBA8 (
+            static_cast<const uint8_t *>(img->data()), nChans,
+            static_cast<uint8_t *>(rgba->data()),
+            size_t(this->_tileSize) * this->_tileSize);
+        delete img;
+        return rgba;
+    }
     else {
         return img;
     }
 }
 
+cs237::MipmapImage2D *TextureQTree::loadMipmaps (int level, int row, int col)
+{
+    if (! this->isValid()) {
+        return nullptr;
+    }
+    assert (level < this->_depth);
+
+    uint32_t index = nodeIndex(level, row, col);
+    assert (index < this->_toc.size());
+
+    const uint8_t *tile = this->_source->data() + this->_toc[index];
+    size_t len = this->_source->size() - this->_toc[index];
+
+    if (this->_version == kVersionPNG) {
+        // decode the PNG image directly into the base level and then compute
+        // the other levels from it
+        uint32_t nLevels = cs237::MipmapImage2D::fullChainLength(
+            this->_tileSize, this->_tileSize);
+        cs237::MipmapImage2D *img = allocTile (
+            this->_tileSize, nLevels, TileFormat::RGBA8, this->_sRGB);
+        cs237::PNGInfo info;
+        void *base = cs237::decodePNG (
+            tile, len, this->_flip, info, img->levelData(0), img->level(0).nBytes);
+        if (base != img->levelData(0)) {
+            // either a decoding error or the tile has the wrong size or format
+            std::free (base);
+            delete img;
+            return nullptr;
+        }
+        uint32_t nChans = tileChannels (info.chans, info.type);
+        if ((info.wid != uint32_t(this->_tileSize)) || (info.ht != uint32_t(this->_tileSize))
+        ||  (nChans == 0)) {
+            delete img;
+            return nullptr;
+        }
+        if (nChans < 4) {
+            // single and two-channel tiles are expanded to RGBA in place
+            expandToRGBA8 (
+                static_cast<const uint8_t *>(img->levelData(0)), nChans,
+                static_cast<uint8_t *>(img->levelData(0)),
+                size_t(this->_tileSize) * this->_tileSize);
+        }
+        img->generateLevels ();
+        return img;
+    }
+
+    cs237::MipmapImage2D *img = allocTile (
+        this->_tileSize, this->_nLevels, this->_tileFmt, this->_sRGB);
+
+    if (len < img->nBytes()) {
+#ifndef NDEBUG
+        std::cerr << "TextureQTree::loadMipmaps: error reading file" << std::endl;
+#endif
+        delete img;
+        return nullptr;
+    }
+    std::memcpy (img->data(), tile, img->nBytes());
+
+    if (this->_flip) {
+        img->flip();
+    }
+
+    return img;
+}
+
 // Return true if the given file looks like a .tqt file of our
 // appropriate version.  Do this by attempting to read the header.
 /* static */ bool TextureQTree::isTQTFile (std::string const &filename)
 {
-    std::ifstream inS(filename);
-    if (inS.fail()) {
+    cs237::__detail::MappedFile f(filename);
+    if (! f.isValid()) {
         return false;
     }
+    Input inS{f.data(), f.data() + f.size()};
     Hdr hdr;
-    bool sts = readHeader (&inS, hdr);
-    inS.close();
-    return sts;
+    HdrV2 hdr2;
+    return readHeader (inS, hdr, hdr2);
+}
+
+/***** Writing version 2 files *****/
+
+inline void writeUI32 (std::ofstream &outS, uint32_t v)
+{
+    outS.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+inline void writeUI64 (std::ofstream &outS, uint64_t v)
+{
+    outS.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+bool writeMipmapTQT (
+    std::string const &filename, int depth, int tileSize, TileFormat fmt,
+    std::function<cs237::MipmapImage2D *(int level, int row, int col)> const &getTile)
+{
+    std::ofstream outS(filename, std::ofstream::out | std::ofstream::binary);
+    if (outS.fail()) {
+#ifndef NDEBUG
+        std::cerr << "tqt::writeMipmapTQT: unable to open \"" << filename << "\"\n";
+#endif
+        return false;
+    }
+
+    uint32_t nLevels = cs237::MipmapImage2D::fullChainLength(tileSize, tileSize);
+    uint32_t nTiles = fullSize(depth);
+
+    writeUI32 (outS, kMagic);
+    writeUI32 (outS, kVersionMipmap);
+    writeUI32 (outS, depth);
+    writeUI32 (outS, tileSize);
+    writeUI32 (outS, static_cast<uint32_t>(fmt));
+    writeUI32 (outS, nLevels);
+
+    // reserve space for the TOC, which we fill in once the tiles have been written
+    std::streamoff tocPos = outS.tellp();
+    std::vector<uint64_t> toc(nTiles, 0);
+    for (uint32_t i = 0;  i < nTiles;  ++i) {
+        writeUI64 (outS, 0);
+    }
+
+    // the tiles are written in node-index order
+    for (int level = 0;  level < depth;  ++level) {
+        int n = (1 << level);
+        for (int row = 0;  row < n;  ++row) {
+            for (int col = 0;  col < n;  ++col) {
+                cs237::MipmapImage2D *img = getTile(level, row, col);
+                if ((img == nullptr)
+                ||  (img->width() != uint32_t(tileSize))
+                ||  (img->height() != uint32_t(tileSize))
+                ||  (img->nLevels() != nLevels)
+                ||  (img->isCompressed() != (fmt != TileFormat::RGBA8))
+                ||  (img->isCompressed() && (uint32_t(img->compression()) != uint32_t(fmt)))
+                ||  (!img->isCompressed() && (img->channels() != cs237::Channels::RGBA))) {
+#ifndef NDEBUG
+                    std::cerr << "tqt::writeMipmapTQT: bogus tile at <" << level << ","
+                        << row << "," << col << ">\n";
+#endif
+                    delete img;
+                    return false;
+                }
+                toc[nodeIndex(level, row, col)] = outS.tellp();
+                outS.write(static_cast<const char *>(img->data()), img->nBytes());
+                delete img;
+            }
+        }
+    }
+
+    outS.seekp(tocPos);
+    for (uint32_t i = 0;  i < nTiles;  ++i) {
+        writeUI64 (outS, toc[i]);
+    }
+
+    outS.close();
+
+    return !outS.fail();
 }
 
 } // namespace tqt
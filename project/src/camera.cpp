@@ -46,6 +46,27 @@ glm::mat4 Camera::projTransform () const
         this->_nearZ, this->_farZ);
 }
 
+// the world-space view frustum; the plane normals point into the frustum and
+// the side planes are computed to match the projection transform
+Frustum Camera::frustum () const
+{
+    glm::dvec3 f = glm::normalize(glm::dvec3(this->_dir));
+    glm::dvec3 r = glm::normalize(glm::cross(f, glm::dvec3(this->_up)));
+    glm::dvec3 u = glm::cross(r, f);
+    double tx = tan(double(this->_halfFOV));  // horizontal slope of the side planes
+    double ty = double(this->_aspect) * tx;   // vertical slope of the side planes
+
+    Frustum fr;
+    fr._sides[Frustum::LEFT] = cs237::Planed_t(r + tx * f, this->_pos);
+    fr._sides[Frustum::RIGHT] = cs237::Planed_t(-r + tx * f, this->_pos);
+    fr._sides[Frustum::BOTTOM] = cs237::Planed_t(u + ty * f, this->_pos);
+    fr._sides[Frustum::TOP] = cs237::Planed_t(-u + ty * f, this->_pos);
+    fr._sides[Frustum::NEAR] = cs237::Planed_t(f, this->_pos + double(this->_nearZ) * f);
+    fr._sides[Frustum::FAR] = cs237::Planed_t(-f, this->_pos + double(this->_farZ) * f);
+
+    return fr;
+}
+
 // update the camera for the aspect ratio of the given viewport.  This operation
 // will change the aspect ratio, but not the field of view.
 void Camera::setViewport (int wid, int ht)
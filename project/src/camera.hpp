@@ -15,6 +15,7 @@
 #define _CAMERA_HPP_
 
 #include "cs237.hpp"
+#include "frustum.hpp"
 
 /// The camera class encapsulates the current view and projection matrices.
 /// Note that we track the camera's position using double-precision so that
@@ -85,6 +86,9 @@ class Camera {
     /// \return the screen-space error
     float screenError (float dist, float err) const;
 
+    /// the world-space view frustum of the camera, which is used for culling
+    Frustum frustum () const;
+
   private:
     glm::dvec3 _pos;            ///< position is double precision to allow large worlds
     glm::vec3 _dir;             ///< the current direction that the camera is pointing toward
@@ -96,8 +100,6 @@ class Camera {
     mutable float _errorFactor; ///< viewport width/(2 * tan(_halfFOV)); set to -1 when invalid
     int _wid;                   ///< the width of the viewport
 
-/** HINT: you may want to add a representation of the view frustum to the camera */
-
 };
 
 /***** Output *****/
@@ -0,0 +1,146 @@
+/*! \file flat-map.hpp
+ *
+ * \author John Reppy
+ *
+ * A hash table with 64-bit integer keys that uses open addressing with linear
+ * probing.  The entries are stored in a single array, so lookups do not chase
+ * pointers and insertions only allocate when the table grows.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _FLAT_MAP_HPP_
+#define _FLAT_MAP_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+
+//! mix the bits of a 64-bit key; this function is the avalanche step used by
+//! XXH3 for short inputs, which makes every bit of the result depend on every
+//! bit of the key.
+inline uint64_t mixBits64 (uint64_t h)
+{
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+//! A map from 64-bit keys to values.  The key `FlatMap::kEmpty` is reserved.
+//! Entries cannot be removed individually.
+template <typename V>
+class FlatMap {
+  public:
+
+    //! the reserved key that marks empty slots
+    static constexpr uint64_t kEmpty = ~uint64_t(0);
+
+    //! create an empty map
+    //! \param capacity  the initial number of slots (rounded up to a power of two)
+    explicit FlatMap (size_t capacity = 1024)
+      : _size(0)
+    {
+        size_t cap = 16;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        this->_slots.resize (cap, Slot{kEmpty, V()});
+    }
+
+    //! the number of entries in the map
+    size_t size () const { return this->_size; }
+
+    //! \brief find the value for a key
+    //! \param key  the key to look up
+    //! \return a pointer to the value, or nullptr if the key is not in the map
+    V *find (uint64_t key)
+    {
+        assert (key != kEmpty);
+        size_t mask = this->_slots.size() - 1;
+        for (size_t i = mixBits64(key) & mask;  ;  i = (i + 1) & mask) {
+            Slot &s = this->_slots[i];
+            if (s.key == key) {
+                return &s.value;
+            } else if (s.key == kEmpty) {
+                return nullptr;
+            }
+        }
+    }
+
+    //! \brief insert a new entry into the map
+    //! \param key    the key, which must not already be in the map
+    //! \param value  the value to associate with the key
+    void insert (uint64_t key, V const &value)
+    {
+        assert (key != kEmpty);
+        // keep the load factor below 1/2 so that probe sequences stay short
+        if (2 * (this->_size + 1) > this->_slots.size()) {
+            this->_grow ();
+        }
+        this->_insert (key, value);
+        this->_size++;
+    }
+
+    //! apply a function to every entry in the map
+    template <typename F>
+    void forEach (F f)
+    {
+        for (auto &s : this->_slots) {
+            if (s.key != kEmpty) {
+                f (s.key, s.value);
+            }
+        }
+    }
+
+    //! remove all of the entries from the map
+    void clear ()
+    {
+        for (auto &s : this->_slots) {
+            s = Slot{kEmpty, V()};
+        }
+        this->_size = 0;
+    }
+
+  private:
+    //! a slot in the table
+    struct Slot {
+        uint64_t key;           //!< the key, or kEmpty
+        V value;                //!< the value
+    };
+
+    std::vector<Slot> _slots;   //!< the table; its size is a power of two
+    size_t _size;               //!< the number of occupied slots
+
+    //! insert an entry without checking the load factor
+    void _insert (uint64_t key, V const &value)
+    {
+        size_t mask = this->_slots.size() - 1;
+        size_t i = mixBits64(key) & mask;
+        while (this->_slots[i].key != kEmpty) {
+            assert (this->_slots[i].key != key);
+            i = (i + 1) & mask;
+        }
+        this->_slots[i] = Slot{key, value};
+    }
+
+    //! double the size of the table and rehash the entries
+    void _grow ()
+    {
+        std::vector<Slot> old(2 * this->_slots.size(), Slot{kEmpty, V()});
+        old.swap (this->_slots);
+        for (auto &s : old) {
+            if (s.key != kEmpty) {
+                this->_insert (s.key, s.value);
+            }
+        }
+    }
+
+};
+
+#endif // !_FLAT_MAP_HPP_
@@ -0,0 +1,311 @@
+/*! \file instancing.cpp
+ *
+ * \author John Reppy
+ *
+ * Instanced rendering of map objects.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "instancing.hpp"
+#include "map-objects.hpp"
+#include "map-cell.hpp"
+#include "camera.hpp"
+#include <algorithm>
+#include <cstring>
+
+//! the binding of the per-instance data
+constexpr uint32_t kInstanceBinding = 1;
+//! the location of the first per-instance attribute; locations 0-2 are used by
+//! the per-vertex attributes
+constexpr uint32_t kInstanceLocation = 3;
+//! the initial capacity of the instance buffer
+constexpr uint32_t kMinCapacity = 1024;
+
+// the sort key for a transparent draw, which orders the draws back to front.  The
+// bits of a non-negative float are ordered the same as its value, so inverting
+// them gives a key that decreases with distance; the low bits are a sequence
+// number that makes the key unique, so that no two draws are batched together.
+static uint64_t transparentKey (float dist, uint32_t seq)
+{
+    uint32_t bits;
+    std::memcpy (&bits, &dist, sizeof(bits));
+    return (uint64_t(1) << 63) | (uint64_t(0x7fffffff - (bits & 0x7fffffff)) << 32) | seq;
+}
+
+/***** class ObjectMesh member functions *****/
+
+ObjectMesh::ObjectMesh (cs237::Application *app, const OBJ::Model *model)
+  : _model(model), _groups(model->numGroups())
+{
+    for (int i = 0;  i < model->numGroups();  i++) {
+        OBJ::PackedGroup pg = OBJ::pack (model->group(i));
+        GroupBufs &g = this->_groups[i];
+        g.vBuf = new cs237::VertexBuffer<OBJ::PackedVertex>(
+            app,
+            vk::ArrayProxy<OBJ::PackedVertex>(pg.packedVerts.size(), pg.packedVerts.data()));
+        if (pg.indexSize() == 2) {
+            g.iBuf16 = new cs237::IndexBuffer<uint16_t>(
+                app,
+                vk::ArrayProxy<uint16_t>(pg.indices16.size(), pg.indices16.data()));
+            g.iBuf32 = nullptr;
+        } else {
+            g.iBuf16 = nullptr;
+            g.iBuf32 = new cs237::IndexBuffer<uint32_t>(
+                app,
+                vk::ArrayProxy<uint32_t>(pg.indices.size(), pg.indices.data()));
+        }
+        g.pc.posScale = glm::vec4(pg.posScale, 0.0f);
+        g.pc.posBias = glm::vec4(pg.posBias, 0.0f);
+        g.lods = std::move(pg.lods);
+    }
+}
+
+ObjectMesh::~ObjectMesh ()
+{
+    for (auto &g : this->_groups) {
+        delete g.vBuf;
+        delete g.iBuf16;
+        delete g.iBuf32;
+    }
+}
+
+void ObjectMesh::bind (vk::CommandBuffer cmdBuf, vk::PipelineLayout layout, int grp) const
+{
+    GroupBufs const &g = this->_groups[grp];
+
+    vk::Buffer vertBuffers[] = {g.vBuf->vkBuffer()};
+    vk::DeviceSize offsets[] = {0};
+    cmdBuf.bindVertexBuffers(0, 1, vertBuffers, offsets);
+
+    if (g.iBuf16 != nullptr) {
+        cmdBuf.bindIndexBuffer(g.iBuf16->vkBuffer(), 0, vk::IndexType::eUint16);
+    } else {
+        cmdBuf.bindIndexBuffer(g.iBuf32->vkBuffer(), 0, vk::IndexType::eUint32);
+    }
+
+    cmdBuf.pushConstants(
+        layout,
+        vk::ShaderStageFlagBits::eVertex,
+        0,
+        sizeof(ObjectPushConsts),
+        &g.pc);
+}
+
+/***** class InstanceBatcher member functions *****/
+
+InstanceBatcher::InstanceBatcher (cs237::Application *app)
+  : _app(app), _meshIds(64), _cam(nullptr), _errorLimit(0.0f),
+    _buf(nullptr), _capacity(0)
+{ }
+
+InstanceBatcher::~InstanceBatcher ()
+{
+    for (auto mesh : this->_meshes) {
+        delete mesh;
+    }
+    delete this->_buf;
+}
+
+uint32_t InstanceBatcher::_meshId (const OBJ::Model *model)
+{
+    uint64_t key = reinterpret_cast<uintptr_t>(model);
+    uint32_t *id = this->_meshIds.find (key);
+    if (id != nullptr) {
+        return *id;
+    }
+    ObjectMesh *mesh = new ObjectMesh (this->_app, model);
+    uint32_t newId;
+    if (this->_freeIds.empty()) {
+        newId = this->_meshes.size();
+        this->_meshes.push_back (mesh);
+    } else {
+        newId = this->_freeIds.back();
+        this->_freeIds.pop_back();
+        this->_meshes[newId] = mesh;
+    }
+    this->_meshIds.insert (key, newId);
+    return newId;
+}
+
+void InstanceBatcher::releaseMesh (const OBJ::Model *model)
+{
+    uint32_t *id = this->_meshIds.find (reinterpret_cast<uintptr_t>(model));
+    if (id == nullptr) {
+        return;
+    }
+    delete this->_meshes[*id];
+    this->_meshes[*id] = nullptr;
+    this->_freeIds.push_back (*id);
+
+    // the map does not support deletion, so we rebuild it from the remaining
+    // meshes; models are unloaded rarely, so this is cheap
+    this->_meshIds.clear();
+    for (uint32_t i = 0;  i < this->_meshes.size();  i++) {
+        if (this->_meshes[i] != nullptr) {
+            this->_meshIds.insert (
+                reinterpret_cast<uintptr_t>(this->_meshes[i]->model()), i);
+        }
+    }
+}
+
+void InstanceBatcher::begin (Camera const &cam, float errorLimit)
+{
+    this->_cam = &cam;
+    this->_errorLimit = errorLimit;
+    this->_instData.clear();
+    this->_items.clear();
+    this->_batches.clear();
+}
+
+void InstanceBatcher::add (InstanceArray const &objs, uint32_t i)
+{
+    assert (this->_cam != nullptr);
+    uint32_t instIdx = this->_instData.size();
+
+    // the transform from model space to camera-relative world space; the offset
+    // is computed in double precision so that it is accurate far from the origin
+    glm::dvec3 origin = objs.cell()->nwCorner() - this->_cam->position();
+    InstanceArray::Affine const &m = objs.toCell(i);
+    InstanceData d;
+    for (int r = 0;  r < 3;  r++) {
+        d.toWorld[r] = glm::vec4(
+            glm::vec3(m.rows[r]),
+            float(double(m.rows[r].w) + origin[r]));
+    }
+    d.color = glm::vec4(objs.color(i), 1.0f);
+    this->_instData.push_back (d);
+
+    // add a draw item for each group at its level of detail; transparent items
+    // are sorted by the distance from the camera to the center of the instance
+    const OBJ::Model *model = objs.model(i);
+    uint32_t meshId = this->_meshId (model);
+    cs237::AABBd_t bounds = objs.worldBounds(i);
+    double dist = bounds.distanceToPt(this->_cam->position());
+    bool transp = objs.isTransparent(i);
+    float depth = transp ? float(glm::distance(bounds.center(), this->_cam->position())) : 0.0f;
+    for (int grp = 0;  grp < model->numGroups();  grp++) {
+        uint32_t lod = objs.selectLOD (i, grp, *this->_cam, dist, this->_errorLimit);
+        uint64_t key = transp
+            ? transparentKey (depth, uint32_t(this->_items.size()))
+            : (uint64_t(meshId) << 32) | (uint64_t(grp) << 8) | lod;
+        this->_items.push_back (Item{key, instIdx, meshId, uint32_t(grp), lod});
+    }
+}
+
+void InstanceBatcher::finish ()
+{
+    std::sort (this->_items.begin(), this->_items.end(),
+        [] (Item const &a, Item const &b) { return a.key < b.key; });
+
+    // pack the instance data in batch order and find the batches
+    this->_data.resize (this->_items.size());
+    for (uint32_t i = 0;  i < this->_items.size();  ) {
+        Item const &item = this->_items[i];
+        uint64_t key = item.key;
+        Batch b;
+        b.mesh = this->_meshes[item.mesh];
+        b.grp = int(item.grp);
+        b.lod = item.lod;
+        b.transparent = ((key >> 63) != 0);
+        b.firstInstance = i;
+        for (;  (i < this->_items.size()) && (this->_items[i].key == key);  i++) {
+            this->_data[i] = this->_instData[this->_items[i].inst];
+        }
+        b.nInstances = i - b.firstInstance;
+        this->_batches.push_back (b);
+    }
+
+    if (this->_data.empty()) {
+        return;
+    }
+
+    // grow the instance buffer if necessary; the buffer is only replaced between
+    // frames, so the GPU is no longer using it
+    uint32_t n = this->_data.size();
+    if (n > this->_capacity) {
+        uint32_t cap = std::max(kMinCapacity, this->_capacity);
+        while (cap < n) {
+            cap *= 2;
+        }
+        delete this->_buf;
+        this->_buf = new InstBuffer_t (this->_app, cap);
+        this->_capacity = cap;
+    }
+    this->_buf->copyTo (vk::ArrayProxy<InstanceData>(n, this->_data.data()));
+}
+
+void InstanceBatcher::draw (
+    vk::CommandBuffer cmdBuf,
+    vk::PipelineLayout layout,
+    bool transparent,
+    std::function<void (const OBJ::Model *, int)> const &bindMaterial) const
+{
+    if (this->_batches.empty()) {
+        return;
+    }
+
+    vk::Buffer instBuffers[] = {this->_buf->vkBuffer()};
+    vk::DeviceSize offsets[] = {0};
+    cmdBuf.bindVertexBuffers(kInstanceBinding, 1, instBuffers, offsets);
+
+    // the opaque batches of a model group are adjacent, so we only rebind when
+    // the group changes (transparent batches are in depth order, so they usually
+    // need a rebind)
+    const ObjectMesh *mesh = nullptr;
+    int grp = -1;
+    for (auto const &b : this->_batches) {
+        if (b.transparent != transparent) {
+            continue;
+        }
+        if ((b.mesh != mesh) || (b.grp != grp)) {
+            mesh = b.mesh;
+            grp = b.grp;
+            bindMaterial (mesh->model(), mesh->material(grp));
+            mesh->bind (cmdBuf, layout, grp);
+        }
+        OBJ::LOD const &lod = mesh->lod(grp, b.lod);
+        cmdBuf.drawIndexed(lod.nIndices, b.nInstances, lod.firstIndex, 0, b.firstInstance);
+    }
+}
+
+std::vector<vk::VertexInputBindingDescription> InstanceBatcher::getBindingDescriptions ()
+{
+    std::vector<vk::VertexInputBindingDescription> bindings =
+        OBJ::PackedVertex::getBindingDescriptions();
+    vk::VertexInputBindingDescription inst;
+    inst.binding = kInstanceBinding;
+    inst.stride = sizeof(InstanceData);
+    inst.inputRate = vk::VertexInputRate::eInstance;
+    bindings.push_back (inst);
+
+    return bindings;
+}
+
+std::vector<vk::VertexInputAttributeDescription> InstanceBatcher::getAttributeDescriptions ()
+{
+    std::vector<vk::VertexInputAttributeDescription> attrs =
+        OBJ::PackedVertex::getAttributeDescriptions();
+    // the rows of the transform
+    for (uint32_t r = 0;  r < 3;  r++) {
+        vk::VertexInputAttributeDescription attr;
+        attr.binding = kInstanceBinding;
+        attr.location = kInstanceLocation + r;
+        attr.format = vk::Format::eR32G32B32A32Sfloat;
+        attr.offset = offsetof(InstanceData, toWorld) + r * sizeof(glm::vec4);
+        attrs.push_back (attr);
+    }
+    // color
+    vk::VertexInputAttributeDescription color;
+    color.binding = kInstanceBinding;
+    color.location = kInstanceLocation + 3;
+    color.format = vk::Format::eR32G32B32A32Sfloat;
+    color.offset = offsetof(InstanceData, color);
+    attrs.push_back (color);
+
+    return attrs;
+}
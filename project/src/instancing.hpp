@@ -0,0 +1,194 @@
+/*! \file instancing.hpp
+ *
+ * \author John Reppy
+ *
+ * Instanced rendering of map objects.  Each frame, the visible instances are
+ * collected and sorted into batches that share a model group and level of
+ * detail, and their per-instance data is packed into a single instance buffer.
+ * Each batch is then drawn with one instanced draw call, so the number of draws
+ * depends on the number of distinct model groups in view instead of the number
+ * of instances.  Transparent instances must be drawn back to front for blending
+ * to be correct, so they are not batched; each group of a transparent instance
+ * is its own draw and the draws are sorted by decreasing distance from the
+ * camera.
+ *
+ * The vertex input for objects has two bindings: binding 0 holds the quantized
+ * vertices of a model group (`OBJ::PackedVertex` at locations 0-2) and binding 1
+ * holds the per-instance data (`InstanceData` at locations 3-6).  The vertex
+ * shader decodes positions using the group's scale and bias, which are passed as
+ * push constants (`ObjectPushConsts`).  Instance transforms map to world space
+ * relative to the camera position, so the view matrix used with them should not
+ * include the camera's translation; this keeps single-precision transforms
+ * accurate in large maps.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _INSTANCING_HPP_
+#define _INSTANCING_HPP_
+
+#include "cs237.hpp"
+#include "obj.hpp"
+#include "flat-map.hpp"
+#include <functional>
+#include <vector>
+
+class Camera;
+class InstanceArray;
+
+//! the per-instance vertex data for instanced rendering of objects
+struct InstanceData {
+    glm::vec4 toWorld[3];       //!< the rows of the affine transform from model space
+                                //!  to world space relative to the camera
+    glm::vec4 color;            //!< the color of the instance (alpha is 1)
+};
+
+//! the push constants for drawing a batch, which are used to decode the
+//! quantized positions of the batch's group (see `OBJ::PackedVertex`)
+struct ObjectPushConsts {
+    glm::vec4 posScale;         //!< the group's position scale (w is 0)
+    glm::vec4 posBias;          //!< the group's position bias (w is 0)
+};
+
+//! the GPU resources for an OBJ model, which are a vertex and index buffer for
+//! each of its groups
+class ObjectMesh {
+  public:
+    //! upload the packed vertex and index data of a model's groups
+    ObjectMesh (cs237::Application *app, const OBJ::Model *model);
+    ~ObjectMesh ();
+
+    //! the model
+    const OBJ::Model *model () const { return this->_model; }
+    //! the number of groups
+    int numGroups () const { return this->_groups.size(); }
+    //! the material of a group (-1 for no material)
+    int material (int grp) const { return this->_model->group(grp).material; }
+    //! a level of detail of a group
+    OBJ::LOD const &lod (int grp, uint32_t lod) const { return this->_groups[grp].lods[lod]; }
+
+    //! record the commands to bind the vertex and index buffers of a group and to
+    //! push its decoding constants
+    void bind (vk::CommandBuffer cmdBuf, vk::PipelineLayout layout, int grp) const;
+
+  private:
+    //! the buffers for a group; exactly one of the index buffers is non-null
+    struct GroupBufs {
+        cs237::VertexBuffer<OBJ::PackedVertex> *vBuf;
+        cs237::IndexBuffer<uint16_t> *iBuf16;
+        cs237::IndexBuffer<uint32_t> *iBuf32;
+        ObjectPushConsts pc;
+        std::vector<OBJ::LOD> lods;
+    };
+
+    const OBJ::Model *_model;
+    std::vector<GroupBufs> _groups;
+};
+
+//! Collects the visible instances of a frame into batches for instanced drawing
+class InstanceBatcher {
+  public:
+    explicit InstanceBatcher (cs237::Application *app);
+    ~InstanceBatcher ();
+
+    //! \brief start collecting the instances for a new frame
+    //! \param cam         the camera, which is used to select levels of detail and
+    //!                    as the origin of the instance transforms
+    //! \param errorLimit  the screen-space error limit for selecting levels of detail
+    void begin (Camera const &cam, float errorLimit);
+
+    //! \brief add a visible instance to the frame
+    //! \param objs  the instances of a cell
+    //! \param i     the index of the instance in `objs`
+    void add (InstanceArray const &objs, uint32_t i);
+
+    //! sort the frame's instances into batches and upload the instance data; this
+    //! should be called after the previous frame's commands have completed
+    void finish ();
+
+    //! \brief record the draws for the opaque or the transparent batches.  The
+    //!        transparent batches hold a single instance each and are recorded in
+    //!        back-to-front order.
+    //! \param cmdBuf        the command buffer
+    //! \param layout        the pipeline layout, which must include the range
+    //!                      returned by `pushConstantRange`
+    //! \param transparent   which set of batches to draw
+    //! \param bindMaterial  called with the model and material index before the
+    //!                      batches of a model group are drawn, so that the
+    //!                      caller can bind the material's descriptor set
+    void draw (
+        vk::CommandBuffer cmdBuf,
+        vk::PipelineLayout layout,
+        bool transparent,
+        std::function<void (const OBJ::Model *, int)> const &bindMaterial) const;
+
+    //! \brief release the GPU resources for a model that has been unloaded; this
+    //!        should be called when the GPU is not using them
+    //! \param model  the model, which may already have been deleted
+    void releaseMesh (const OBJ::Model *model);
+
+    //! the number of instances in the current frame
+    uint32_t numInstances () const { return this->_instData.size(); }
+    //! the number of batches (i.e., draw calls) in the current frame
+    uint32_t numBatches () const { return this->_batches.size(); }
+
+    //! the vertex-input binding descriptions for drawing objects
+    static std::vector<vk::VertexInputBindingDescription> getBindingDescriptions ();
+    //! the vertex-input attribute descriptions for drawing objects
+    static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions ();
+    //! the push-constant range for `ObjectPushConsts`
+    static vk::PushConstantRange pushConstantRange ()
+    {
+        return vk::PushConstantRange(
+            vk::ShaderStageFlagBits::eVertex, 0, sizeof(ObjectPushConsts));
+    }
+
+  private:
+    using InstBuffer_t = cs237::VertexBuffer<InstanceData>;
+
+    //! a draw of one level of detail of a model group.  The key orders the opaque
+    //! items by mesh, group, and level of detail, so that the items of a batch
+    //! are adjacent, and then the transparent items by decreasing distance from
+    //! the camera; the keys of transparent items are unique.
+    struct Item {
+        uint64_t key;
+        uint32_t inst;          //!< index into _instData
+        uint32_t mesh;          //!< the mesh ID
+        uint32_t grp;           //!< the group
+        uint32_t lod;           //!< the level of detail
+    };
+
+    //! a range of the instance buffer that is drawn with one call
+    struct Batch {
+        const ObjectMesh *mesh;
+        int grp;
+        uint32_t lod;
+        bool transparent;
+        uint32_t firstInstance;
+        uint32_t nInstances;
+    };
+
+    cs237::Application *_app;
+    std::vector<ObjectMesh *> _meshes;  //!< the meshes indexed by ID (nullptr for
+                                        //!  released meshes)
+    std::vector<uint32_t> _freeIds;     //!< the IDs of released meshes
+    FlatMap<uint32_t> _meshIds;         //!< map from model addresses to mesh IDs
+    const Camera *_cam;                 //!< the camera for the current frame
+    float _errorLimit;                  //!< the error limit for the current frame
+    std::vector<InstanceData> _instData; //!< the data for the instances in the
+                                        //!  current frame
+    std::vector<Item> _items;           //!< the draws of the current frame
+    std::vector<InstanceData> _data;    //!< the instance data in batch order
+    std::vector<Batch> _batches;        //!< the batches of the current frame
+    InstBuffer_t *_buf;                 //!< the instance buffer (nullptr until needed)
+    uint32_t _capacity;                 //!< the number of instances that _buf holds
+
+    //! get the ID of the mesh for a model, creating the mesh if necessary
+    uint32_t _meshId (const OBJ::Model *model);
+};
+
+#endif //! _INSTANCING_HPP_
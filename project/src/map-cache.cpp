@@ -0,0 +1,198 @@
+/*! \file map-cache.cpp
+ *
+ * \author John Reppy
+ *
+ * Binary sidecar caches for the data that is extracted from a map's JSON files.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "map-cache.hpp"
+#include "mapped-file.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace MapCache {
+
+//! the current version of the cache format; caches with a different version
+//! are ignored and rewritten
+constexpr uint32_t kVersion = 1;
+
+//! the header of a cache file
+struct Header {
+    char magic[8];              //!< "TVCACHE\0"
+    uint32_t version;           //!< the format version (kVersion)
+    uint32_t kind;              //!< the kind of cache
+    uint64_t srcSize;           //!< the size of the source file
+    int64_t srcTime;            //!< the modification time of the source file
+    uint64_t srcHash;           //!< the hash of the contents of the source file
+    uint64_t payloadSize;       //!< the size of the payload in bytes
+};
+
+static const char kMagic[8] = { 'T', 'V', 'C', 'A', 'C', 'H', 'E', 0 };
+
+//! the stamp of a source file
+struct Stamp {
+    uint64_t size;
+    int64_t time;
+};
+
+// get the size and modification time of a file
+static bool getStamp (std::string const &file, Stamp &stamp)
+{
+    std::error_code ec;
+    stamp.size = fs::file_size (file, ec);
+    if (ec) {
+        return false;
+    }
+    auto t = fs::last_write_time (file, ec);
+    if (ec) {
+        return false;
+    }
+    stamp.time = static_cast<int64_t>(t.time_since_epoch().count());
+    return true;
+}
+
+// a 64-bit hash of a block of memory; it processes eight bytes at a time and
+// uses the multiply/xor-shift mixing from XXH3's avalanche step
+static uint64_t hashBytes (const char *data, size_t len)
+{
+    const uint64_t kMul = 0x165667919E3779F9ULL;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    size_t i = 0;
+    for (;  i + 8 <= len;  i += 8) {
+        uint64_t w;
+        std::memcpy (&w, data + i, 8);
+        h = (h ^ w) * kMul;
+        h ^= h >> 32;
+    }
+    if (i < len) {
+        uint64_t w = 0;
+        std::memcpy (&w, data + i, len - i);
+        h = (h ^ w) * kMul;
+        h ^= h >> 32;
+    }
+    h ^= h >> 37;
+    h *= kMul;
+    h ^= h >> 32;
+    return h;
+}
+
+// hash the contents of a file
+static bool hashFile (std::string const &file, uint64_t size, uint64_t &hash)
+{
+    std::ifstream inS(file, std::ios::in | std::ios::binary);
+    std::vector<char> buf(size);
+    inS.read (buf.data(), size);
+    if (inS.fail()) {
+        return false;
+    }
+    hash = hashBytes (buf.data(), size);
+    return true;
+}
+
+/***** class Reader member functions *****/
+
+Reader::Reader () : _file(), _data(nullptr), _size(0), _pos(0) { }
+
+Reader::~Reader () { }
+
+// replace the source time in the header of a cache file
+static void restamp (std::string const &file, int64_t time)
+{
+    std::fstream outS(file, std::ios::in | std::ios::out | std::ios::binary);
+    if (! outS.fail()) {
+        outS.seekp (offsetof(Header, srcTime));
+        outS.write (reinterpret_cast<const char *>(&time), sizeof(time));
+    }
+}
+
+bool load (std::string const &src, Kind kind, Reader &rd)
+{
+    std::string file = src + ".cache";
+    std::unique_ptr<cs237::__detail::MappedFile> f(new cs237::__detail::MappedFile(file));
+    if (! f->isValid() || (f->size() < sizeof(Header))) {
+        return false;
+    }
+
+    Header hdr;
+    std::memcpy (&hdr, f->data(), sizeof(hdr));
+    if ((std::memcmp (hdr.magic, kMagic, sizeof(kMagic)) != 0)
+    || (hdr.version != kVersion)
+    || (hdr.kind != static_cast<uint32_t>(kind))
+    || (hdr.payloadSize != f->size() - sizeof(Header))) {
+        return false;
+    }
+
+    // check the stamp; a matching size and time is trusted, but if only the time
+    // differs, then we check the hash of the source and update the time in the
+    // cache when the contents are unchanged
+    Stamp stamp;
+    if (! getStamp (src, stamp) || (stamp.size != hdr.srcSize)) {
+        return false;
+    }
+    if (stamp.time != hdr.srcTime) {
+        uint64_t hash;
+        if (! hashFile (src, stamp.size, hash) || (hash != hdr.srcHash)) {
+            return false;
+        }
+        restamp (file, stamp.time);
+    }
+
+    rd._data = reinterpret_cast<const char *>(f->data()) + sizeof(Header);
+    rd._size = hdr.payloadSize;
+    rd._pos = 0;
+    rd._file = std::move(f);
+
+    return true;
+
+}
+
+void save (std::string const &src, Kind kind, Writer const &wr)
+{
+    Header hdr;
+    Stamp stamp;
+    if (! getStamp (src, stamp) || ! hashFile (src, stamp.size, hdr.srcHash)) {
+        return;
+    }
+    std::memcpy (hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.kind = static_cast<uint32_t>(kind);
+    hdr.srcSize = stamp.size;
+    hdr.srcTime = stamp.time;
+    hdr.payloadSize = wr.data().size();
+
+    // write to a temporary file and then rename it, so that a reader never
+    // sees a partial cache
+    std::string file = src + ".cache";
+    std::string tmp = file + ".tmp";
+    {
+        std::ofstream outS(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (outS.fail()) {
+            return;
+        }
+        outS.write (reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+        outS.write (wr.data().data(), wr.data().size());
+        outS.close();
+        if (outS.fail()) {
+            std::error_code ec;
+            fs::remove (tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename (tmp, file, ec);
+    if (ec) {
+        fs::remove (tmp, ec);
+    }
+
+}
+
+} // namespace MapCache
@@ -0,0 +1,167 @@
+/*! \file map-cache.hpp
+ *
+ * \author John Reppy
+ *
+ * Binary sidecar caches for the data that is extracted from a map's JSON files.
+ * The cache for a file "foo.json" is stored in "foo.json.cache" and is stamped
+ * with the size, modification time, and a hash of the contents of the source
+ * file.  As with the binary OBJ files, a cache whose size and time match the
+ * source is trusted without reading the source; the hash is only checked when
+ * the time has changed but the size has not (e.g., after a fresh checkout).  The
+ * payload of a cache is a flat sequence of 4-byte aligned records and the cache
+ * file is memory mapped, so arrays of records are used in place.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _MAP_CACHE_HPP_
+#define _MAP_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace cs237 { namespace __detail { class MappedFile; } }
+
+namespace MapCache {
+
+//! the kinds of cache files
+enum class Kind : uint32_t {
+    Map = 1,            //!< the header fields of a map.json file
+    Objects = 2         //!< the instances of an objects.json file
+};
+
+//! a builder for the payload of a cache file
+class Writer {
+  public:
+    Writer () : _buf() { }
+
+    //! append a plain-data value
+    template <typename T>
+    void put (T const &v)
+    {
+        static_assert (std::is_trivially_copyable<T>::value, "put requires plain data");
+        const char *p = reinterpret_cast<const char *>(&v);
+        this->_buf.insert (this->_buf.end(), p, p + sizeof(T));
+        this->_align ();
+    }
+
+    //! append an array of plain-data values
+    template <typename T>
+    void putArray (const T *v, size_t n)
+    {
+        static_assert (std::is_trivially_copyable<T>::value, "putArray requires plain data");
+        const char *p = reinterpret_cast<const char *>(v);
+        this->_buf.insert (this->_buf.end(), p, p + n * sizeof(T));
+        this->_align ();
+    }
+
+    //! append a string (as its length followed by its characters)
+    void putString (std::string_view s)
+    {
+        this->put (static_cast<uint32_t>(s.size()));
+        this->putArray (s.data(), s.size());
+    }
+
+    //! the payload
+    std::vector<char> const &data () const { return this->_buf; }
+
+  private:
+    std::vector<char> _buf;
+
+    // pad the buffer to a multiple of four bytes
+    void _align ()
+    {
+        while ((this->_buf.size() & 3) != 0) {
+            this->_buf.push_back (0);
+        }
+    }
+};
+
+//! a cursor for reading the payload of a cache file; all of the operations check
+//! that the payload is large enough and return false (or nullptr) when it is not.
+class Reader {
+  public:
+    Reader ();
+    ~Reader ();
+
+    //! read a plain-data value
+    template <typename T>
+    bool get (T &v)
+    {
+        const T *p = this->getArray<T>(1);
+        if (p == nullptr) {
+            return false;
+        }
+        std::memcpy (&v, p, sizeof(T));
+        return true;
+    }
+
+    //! get a pointer to an array of n values in the payload; the result points
+    //! into the mapped cache file, so it is valid until the reader is destroyed
+    template <typename T>
+    const T *getArray (size_t n)
+    {
+        static_assert (alignof(T) <= 4, "payload records must be 4-byte aligned");
+        size_t nb = n * sizeof(T);
+        if ((nb / sizeof(T) != n) || (this->_size - this->_pos < nb)) {
+            return nullptr;
+        }
+        const T *p = reinterpret_cast<const T *>(this->_data + this->_pos);
+        this->_pos += (nb + 3) & ~size_t(3);
+        if (this->_pos > this->_size) {
+            this->_pos = this->_size;
+        }
+        return p;
+    }
+
+    //! read a string
+    bool getString (std::string &s)
+    {
+        uint32_t len;
+        if (! this->get (len)) {
+            return false;
+        }
+        const char *p = this->getArray<char>(len);
+        if (p == nullptr) {
+            return false;
+        }
+        s.assign (p, len);
+        return true;
+    }
+
+  private:
+    std::unique_ptr<cs237::__detail::MappedFile> _file;  //!< the mapped cache file
+    const char *_data;          //!< the payload
+    size_t _size;               //!< the size of the payload in bytes
+    size_t _pos;                //!< the current read position
+
+    friend bool load (std::string const &, Kind, Reader &);
+};
+
+//! \brief load the cache for a source file
+//! \param src   the path to the source file
+//! \param kind  the kind of cache that is expected
+//! \param[out] rd  the reader for the payload of the cache
+//! \return true if there is a cache for the source with a matching stamp
+bool load (std::string const &src, Kind kind, Reader &rd);
+
+//! \brief write the cache for a source file.  It is not an error if the cache
+//!        cannot be written (e.g., because the map directory is read only).
+//! \param src   the path to the source file
+//! \param kind  the kind of cache
+//! \param wr    the payload of the cache
+void save (std::string const &src, Kind kind, Writer const &wr);
+
+} // namespace MapCache
+
+#endif //! _MAP_CACHE_HPP_
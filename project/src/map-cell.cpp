@@ -67,7 +67,8 @@ inline uint64_t readUI64 (std::ifstream &inS) { return readVal<uint64_t>(inS); }
 
 Cell::Cell (Map *map, uint32_t r, uint32_t c, std::string const &stem)
     : _map(map), _row(r), _col(c), _stem(stem), _nLODs(0), _nTiles(0), _tiles(nullptr),
-      _colorTQT(nullptr), _normTQT(nullptr)
+      _colorTQT(nullptr), _normTQT(nullptr), _objects(this),
+      _objState(ObjectState::Unloaded)
 {
 }
 
@@ -180,7 +181,29 @@ void Cell::load ()
 void Cell::loadObjects ()
 {
 #ifdef PART2
+    assert (this->_objState == ObjectState::Parsing);
     this->_map->objects()->loadObjects (this, this->_objects);
+    this->_objState = ObjectState::Parsed;
+#endif
+}
+
+void Cell::initObjects ()
+{
+#ifdef PART2
+    assert (this->_objState == ObjectState::Parsed);
+    this->_map->objects()->finishObjects (this->_objects);
+    this->_objBVH.build (this->nwCorner(), this->_objects);
+    this->_objState = ObjectState::Loaded;
+#endif
+}
+
+void Cell::unloadObjects (std::vector<const OBJ::Model *> &unloaded)
+{
+#ifdef PART2
+    assert (this->_objState == ObjectState::Loaded);
+    this->_map->objects()->unloadObjects (this->_objects, unloaded);
+    this->_objBVH.build (this->nwCorner(), this->_objects);
+    this->_objState = ObjectState::Unloaded;
 #endif
 }
 
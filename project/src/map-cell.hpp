@@ -16,13 +16,24 @@
 #include "qtree-util.hpp"
 #include "tqt.hpp"
 #include "outcode.hpp"
+#include "object-bvh.hpp"
+#include "map-objects.hpp"
+#include <atomic>
 
 class Tile;
-struct Instance; // will be defined in Part 2
 
 class Cell {
 public:
 
+    //! the loading state of the objects on a cell
+    enum class ObjectState {
+        Unloaded,               //!< the objects are not loaded
+        Parsing,                //!< the instances are being loaded by a worker thread
+        Parsed,                 //!< the instances have been loaded, but their models
+                                //!  may still be loading
+        Loaded                  //!< the objects are loaded and ready to be drawn
+    };
+
     //! Cell constructor
     //! \param[in] map  the map containing this cell
     //! \param[in] r    this cell's row in the grid of cells
@@ -50,6 +61,9 @@ public:
     float hScale () const { return this->_map->_hScale; }
     //! get the map vertical scale
     float vScale () const { return this->_map->_vScale; }
+    //! the world-space position of this cell's north-west corner, which is the
+    //! origin of the cell's coordinate system
+    glm::dvec3 nwCorner () const { return this->_map->nwCellCorner(this->_row, this->_col); }
 
     //! return the path of a data file  for this cell
     //! \param[in] file the name of the file
@@ -62,13 +76,42 @@ public:
     //! initialize the textures for the cell
     void initTextures (class Window *win);
 
-    //! load any objects that are in the cell
+    //! the loading state of the cell's objects
+    ObjectState objectState () const { return this->_objState; }
+
+    //! load the instances of any objects that are in the cell; this function is
+    //! run on a worker thread, and the models and textures of the objects are
+    //! loaded in the background (see `MapObjects::update`)
     void loadObjects ();
 
+    //! complete the cell's objects once their models have been loaded
+    void initObjects ();
+
+    //! \brief unload the cell's objects
+    //! \param unloaded  the models that are unloaded as a result are added to
+    //!                  this vector
+    void unloadObjects (std::vector<const OBJ::Model *> &unloaded);
+
     //! the color texture-quad-tree for this cell (nullptr if not present)
     tqt::TextureQTree *colorTQT () const { return this->_colorTQT; }
     //! the normal-map texture-quad-tree for this cell (nullptr if not present)
     tqt::TextureQTree *normalTQT () const { return this->_normTQT; }
+    //! the object instances on this cell
+    InstanceArray const &objects () const { return this->_objects; }
+    //! the bounding-volume hierarchy over the objects on this cell
+    ObjectBVH const &objectBVH () const { return this->_objBVH; }
+
+    //! \brief visit the objects on this cell that are (at least partially) in the
+    //!        view frustum and within a distance of the camera
+    //! \param frustum  the world-space view frustum
+    //! \param pos      the world-space camera position
+    //! \param maxDist  the maximum distance from the camera
+    //! \param visit    called with the index of each visible instance in `objects()`
+    template <typename F>
+    void cullObjects (Frustum const &frustum, glm::dvec3 const &pos, double maxDist, F visit) const
+    {
+        this->_objBVH.cull (frustum, pos, maxDist, visit);
+    }
 
     // constants
     static const uint32_t kMagic = 0x63656C6C;  // 'cell'
@@ -86,7 +129,13 @@ private:
                                 //! not present)
     tqt::TextureQTree *_normTQT; //!< texture quadtree for the cell's normal map (nullptr if
                                 //! not present)
-    std::vector<Instance *> _objects; //!< the objects (if any) that are on this map cell
+    InstanceArray _objects;     //!< the objects (if any) that are on this map cell
+    ObjectBVH   _objBVH;        //!< the hierarchy over _objects
+    std::atomic<ObjectState> _objState; //!< the loading state of _objects; the
+                                //!  objects are only accessed by the main thread
+                                //!  in the Unloaded and Loaded states
+
+    friend class MapObjects;
 
 /** HINT: you will probably want to add additional methods to this class to
  ** support visibility testing and rendering
@@ -13,202 +13,691 @@
 #include "map-objects.hpp"
 #include "map.hpp"
 #include "map-cell.hpp"
+#include "camera.hpp"
+#include "map-cache.hpp"
 #include "json.hpp"
+#include <algorithm>
 #include <unistd.h>
+#include <unordered_map>
 
-/* helper functions to make extracting values from the JSON easier */
+/* helper functions to make extracting values from the JSON easier.  The
+ * objects.json files can have many thousands of instances, so we read them
+ * with a json::Reader instead of building a document.
+ */
 
-//! load a vec3f from a JSON object.
+using Event = json::Reader::Event;
+
+//! read a JSON object that has three numeric fields with the given names into
+//! a vec3; other fields are ignored.
 //! \return false if okay, true if there is an error.
-bool loadVec3 (json::Object const *jv, glm::vec3 &vec)
+static bool loadFields (
+    json::Reader &rd, const char *k0, const char *k1, const char *k2,
+    glm::vec3 &vec)
 {
-    if (jv == nullptr) {
+    if (rd.next() != Event::BeginObject) {
         return true;
     }
 
-    const json::Number *x = jv->fieldAsNumber("x");
-    const json::Number *y = jv->fieldAsNumber("y");
-    const json::Number *z = jv->fieldAsNumber("z");
-    if ((x == nullptr) || (y == nullptr) || (z == nullptr)) {
-        return true;
+    unsigned int seen = 0;
+    Event ev;
+    while ((ev = rd.next()) == Event::Key) {
+        std::string_view key = rd.string();
+        int i = (key == k0) ? 0 : (key == k1) ? 1 : (key == k2) ? 2 : -1;
+        if (i < 0) {
+            if (! rd.skip()) {
+                return true;
+            }
+            continue;
+        }
+        ev = rd.next();
+        if ((ev != Event::Integer) && (ev != Event::Real)) {
+            return true;
+        }
+        vec[i] = static_cast<float>(rd.realVal());
+        seen |= (1 << i);
     }
 
-    vec = glm::vec3 (
-        static_cast<float>(x->realVal()),
-        static_cast<float>(y->realVal()),
-        static_cast<float>(z->realVal()));
+    return (ev != Event::EndObject) || (seen != 7);
+}
 
-    return false;
+//! load a vec3f from a JSON object.
+//! \return false if okay, true if there is an error.
+static bool loadVec3 (json::Reader &rd, glm::vec3 &vec)
+{
+    return loadFields (rd, "x", "y", "z", vec);
 }
 
 //! load a color3f from a JSON object.
 //! \return false if okay, true if there is an error.
-bool loadColor (json::Object const *jv, glm::vec3 &color)
+static bool loadColor (json::Reader &rd, glm::vec3 &color)
 {
-    if (jv == nullptr) {
-        return true;
-    }
+    return loadFields (rd, "r", "g", "b", color);
+}
 
-    const json::Number *r = jv->fieldAsNumber("r");
-    const json::Number *g = jv->fieldAsNumber("g");
-    const json::Number *b = jv->fieldAsNumber("b");
-    if ((r == nullptr) || (g == nullptr) || (b == nullptr)) {
+//! load the axes of an object's frame from a JSON object.
+//! \return false if okay, true if there is an error.
+static bool loadFrame (json::Reader &rd, glm::vec3 axes[3])
+{
+    if (rd.next() != Event::BeginObject) {
         return true;
     }
 
-    color = glm::vec3 (
-        static_cast<float>(r->realVal()),
-        static_cast<float>(g->realVal()),
-        static_cast<float>(b->realVal()));
+    unsigned int seen = 0;
+    Event ev;
+    while ((ev = rd.next()) == Event::Key) {
+        std::string_view key = rd.string();
+        int i = (key == "x-axis") ? 0 : (key == "y-axis") ? 1 : (key == "z-axis") ? 2 : -1;
+        if (i < 0) {
+            if (! rd.skip()) {
+                return true;
+            }
+        }
+        else if (loadVec3 (rd, axes[i])) {
+            return true;
+        }
+        else {
+            seen |= (1 << i);
+        }
+    }
 
-    return false;
+    return (ev != Event::EndObject) || (seen != 7);
 }
 
+/* the cache for an objects.json file holds a table of model file names followed
+ * by a flat array of instance records.
+ */
+
+//! the cached representation of an instance
+struct InstanceRecord {
+    glm::mat4 toCell;           //!< affine transform from model space to the cell's
+                                //!  coordinate system
+    glm::vec3 color;            //!< the color of the object
+    uint32_t model;             //!< the index of the model's file name in the table
+    uint32_t transparent;       //!< is the object transparent (0 or 1)?
+};
+
 /***** class MapObjects member functions *****/
 
+MapObjects::MapObjects (Map *map)
+  : _map(map), _objs(), _texs(), _nBytes(0),
+    _loadRadius(0.0), _budget(kDefaultBudget), _loader()
+{
+    // select the PNG decoder before any of the workers use it
+    cs237::ImageDecoder::current ();
+}
+
 MapObjects::~MapObjects ()
 {
-    for (auto it : this->_objs) {
-        delete it.second;
+    // the pending loads must finish before we delete the caches
+    this->_loader.wait ();
+    for (auto &it : this->_objs) {
+        delete it.second.model;
+    }
+    for (auto &it : this->_texs) {
+        delete it.second.img;
     }
-    for (auto it : this->_texs) {
-        delete it.second;
+}
+
+double MapObjects::loadRadius () const
+{
+    if (this->_loadRadius > 0.0) {
+        return this->_loadRadius;
+    } else {
+        return kDefaultLoadCells * this->_map->cellSize().x;
     }
 }
 
-void MapObjects::loadObjects (Cell *cell, std::vector<Instance *> &objs)
+size_t MapObjects::residentBytes () const
+{
+    std::lock_guard<std::mutex> lk(this->_mutex);
+    return this->_nBytes;
+}
+
+// the horizontal distance from a point to a cell
+static double distanceToCell (Map *map, Cell *cell, glm::dvec3 const &pos)
+{
+    glm::dvec3 nw = cell->nwCorner();
+    glm::dvec3 se = nw + map->cellSize();
+    double dx = std::max(std::max(nw.x - pos.x, pos.x - se.x), 0.0);
+    double dz = std::max(std::max(nw.z - pos.z, pos.z - se.z), 0.0);
+    return std::sqrt(dx*dx + dz*dz);
+}
+
+void MapObjects::update (glm::dvec3 const &pos, std::vector<const OBJ::Model *> &unloaded)
 {
-    // check that the vector is empty
+    unloaded.clear();
+
+    // the cells in order of increasing distance from the camera
+    std::vector<std::pair<double, Cell *>> cells;
+    cells.reserve (this->_map->nRows() * this->_map->nCols());
+    for (uint32_t r = 0;  r < this->_map->nRows();  ++r) {
+        for (uint32_t c = 0;  c < this->_map->nCols();  ++c) {
+            Cell *cell = this->_map->cell(r, c);
+            cells.push_back (std::make_pair (distanceToCell (this->_map, cell, pos), cell));
+        }
+    }
+    std::sort (cells.begin(), cells.end(),
+        [] (std::pair<double, Cell *> const &a, std::pair<double, Cell *> const &b) {
+            return a.first < b.first;
+        });
+
+    double radius = this->loadRadius();
+    bool overBudget = (this->residentBytes() > this->_budget);
+
+    // complete the cells whose models have been loaded and unload the cells that
+    // are out of range, starting with the farthest
+    uint32_t nPending = 0;
+    for (auto it = cells.rbegin();  it != cells.rend();  ++it) {
+        Cell *cell = it->second;
+        Cell::ObjectState state = cell->objectState();
+        if ((state == Cell::ObjectState::Parsed) && this->isReady (cell->objects())) {
+            cell->initObjects ();
+            state = Cell::ObjectState::Loaded;
+        }
+        if (state == Cell::ObjectState::Loaded) {
+            if ((it->first > kUnloadFactor * radius)
+            || (overBudget && (it->first > radius))) {
+                cell->unloadObjects (unloaded);
+                overBudget = (this->residentBytes() > this->_budget);
+            }
+        } else if (state != Cell::ObjectState::Unloaded) {
+            nPending++;
+        }
+    }
+
+    // start loading the nearest cells that are in range
+    for (auto &it : cells) {
+        if ((it.first > radius) || (nPending >= kMaxPendingCells) || overBudget) {
+            break;
+        }
+        Cell *cell = it.second;
+        if (cell->objectState() == Cell::ObjectState::Unloaded) {
+            cell->_objState = Cell::ObjectState::Parsing;
+            this->_loader.submit ([cell] () { cell->loadObjects(); });
+            nPending++;
+        }
+    }
+}
+
+void MapObjects::loadObjects (Cell *cell, InstanceArray &objs)
+{
+    // check that the array is empty
     if (! objs.empty()) {
-        ERROR("loadObjects called with non-empty object vector");
+        ERROR("loadObjects called with non-empty object array");
     }
 
     std::string objsFile = cell->datafile("/objects.json");
 
-    // if the objects.json file does not exist, then we return the empty vector
+    // if the objects.json file does not exist, then we return the empty array
     if (access(objsFile.c_str(), F_OK) != 0) {
         return;
     }
 
+    // use the cached instances if the cache is up to date
+    {
+        MapCache::Reader cache;
+        if (MapCache::load (objsFile, MapCache::Kind::Objects, cache)
+        && this->_loadCachedObjects (cell, cache, objs)) {
+            return;
+        }
+    }
+
+    // the model file names and the instance records for the cache
+    std::vector<std::string> models;
+    std::unordered_map<std::string, uint32_t> modelIds;
+    std::vector<InstanceRecord> recs;
+
     // load the objects list
-    json::Value *root = json::parseFile(objsFile);
+    json::Reader rd(objsFile);
 
     // check for errors
-    if (root == nullptr) {
+    if (! rd.isValid()) {
         ERROR("Unable to load objects list \"" + objsFile + "\"");
-    } else if (! root->isArray()) {
+    } else if (rd.next() != Event::BeginArray) {
         ERROR("Invalid object list in \"" + objsFile + "\"; root is not an array");
     }
-    const json::Array *rootObj = root->asArray();
-
-    if (rootObj->length() != 0) {
-        // allocate space for the objects in the scene
-        objs.reserve(rootObj->length());
 
-        // load the object instances in the cell
-        for (int i = 0;  i < rootObj->length();  i++) {
-            json::Object const *object = (*rootObj)[i]->asObject();
-            if (object == nullptr) {
-                ERROR("Expected array of JSON objects in \"" + objsFile + "\"");
+    // load the object instances in the cell
+    enum { kFile = 1, kFrame = 2, kPos = 4, kColor = 8, kAll = 15 };
+    Event ev;
+    while ((ev = rd.next()) == Event::BeginObject) {
+        std::string file;
+        glm::vec3 pos, axes[3];
+        glm::vec3 color;
+        bool transparent = false;
+        unsigned int seen = 0;
+        while ((ev = rd.next()) == Event::Key) {
+            std::string_view key = rd.string();
+            bool err;
+            if (key == "file") {
+                err = (rd.next() != Event::String);
+                file = rd.string();
+                seen |= kFile;
+            } else if (key == "frame") {
+                err = loadFrame (rd, axes);
+                seen |= kFrame;
+            } else if (key == "pos") {
+                err = loadVec3 (rd, pos);
+                seen |= kPos;
+            } else if (key == "color") {
+                err = loadColor (rd, color);
+                seen |= kColor;
+            } else if (key == "transparent") {
+                // a non-boolean value is treated as false
+                ev = rd.next();
+                transparent = (ev == Event::Bool) && rd.boolVal();
+                err = (ev == Event::Error) || !rd.skip();
+            } else {
+                err = !rd.skip();
             }
-            json::String const *file = object->fieldAsString("file");
-            json::Object const *frame = object->fieldAsObject("frame");
-            glm::vec3 pos, xAxis, yAxis, zAxis;
-            glm::vec3 color;
-            if ((file == nullptr) || (frame == nullptr)
-            ||  loadVec3 (object->fieldAsObject("pos"), pos)
-            ||  loadVec3 (frame->fieldAsObject("x-axis"), xAxis)
-            ||  loadVec3 (frame->fieldAsObject("y-axis"), yAxis)
-            ||  loadVec3 (frame->fieldAsObject("z-axis"), zAxis)
-            ||  loadColor (object->fieldAsObject("color"), color)) {
+            if (err) {
                 ERROR("Invalid object description in \"" + objsFile + "\"");
             }
-            const json::Bool *transparent = object->fieldAsBool("transparent");
-            Instance *inst = this->_makeInstance(
-                file->value(),
-                cell,
-                glm::mat4 (
-                    glm::vec4 (xAxis, 0.0f),
-                    glm::vec4 (yAxis, 0.0f),
-                    glm::vec4 (zAxis, 0.0f),
-                    glm::vec4 (pos, 1.0f)),
-                color,
-                (transparent != nullptr) && transparent->value());
-          // add to objs vector
-            objs.push_back (inst);
         }
+        if ((ev != Event::EndObject) || (seen != kAll)) {
+            ERROR("Invalid object description in \"" + objsFile + "\"");
+        }
+        InstanceRecord rec;
+        rec.toCell = glm::mat4 (
+            glm::vec4 (axes[0], 0.0f),
+            glm::vec4 (axes[1], 0.0f),
+            glm::vec4 (axes[2], 0.0f),
+            glm::vec4 (pos, 1.0f));
+        rec.color = color;
+        rec.transparent = transparent ? 1 : 0;
+        auto id = modelIds.insert (std::make_pair (file, uint32_t(models.size())));
+        if (id.second) {
+            // the cell's model table has the same order as the cached table
+            models.push_back (file);
+            objs.addModel (file);
+            this->_acquireModel (file);
+        }
+        rec.model = id.first->second;
+        recs.push_back (rec);
+      // add to objs array
+        objs.add (rec.model, rec.toCell, rec.color, transparent);
+    }
+    if (ev != Event::EndArray) {
+        ERROR("Expected array of JSON objects in \"" + objsFile + "\"");
+    }
 
+    // write the cache
+    MapCache::Writer wr;
+    wr.put (static_cast<uint32_t>(models.size()));
+    for (auto &m : models) {
+        wr.putString (m);
     }
+    wr.put (static_cast<uint32_t>(recs.size()));
+    wr.putArray (recs.data(), recs.size());
+    MapCache::save (objsFile, MapCache::Kind::Objects, wr);
 
 }
 
-Instance *MapObjects::_makeInstance (
-    std::string const &file,
+bool MapObjects::_loadCachedObjects (
     Cell *cell,
-    glm::mat4 const &toCell,
-    glm::vec3 const &color,
-    bool isTransparent)
+    MapCache::Reader &cache,
+    InstanceArray &objs)
 {
-  // first we need to get the model
-    OBJ::Model *model = this->_loadModel (file);
+    uint32_t nModels;
+    if (! cache.get (nModels)) {
+        return false;
+    }
+    std::vector<std::string> models(nModels);
+    for (auto &m : models) {
+        if (! cache.getString (m)) {
+            return false;
+        }
+    }
 
-    assert (model != nullptr);
+    // the instance records are used in place
+    uint32_t nInsts;
+    const InstanceRecord *recs;
+    if (! cache.get (nInsts)
+    || ((recs = cache.getArray<InstanceRecord>(nInsts)) == nullptr)) {
+        return false;
+    }
+    for (uint32_t i = 0;  i < nInsts;  i++) {
+        if (recs[i].model >= nModels) {
+            return false;
+        }
+    }
 
-  // create the instance
-    Instance *inst = new Instance;
-    inst->model = model;
-    inst->toCell = toCell;
-    inst->color = color;
-    inst->transparent = isTransparent;
+    for (auto &m : models) {
+        objs.addModel (m);
+        this->_acquireModel (m);
+    }
+    objs.reserve (nInsts);
+    for (uint32_t i = 0;  i < nInsts;  i++) {
+        objs.add (recs[i].model, recs[i].toCell, recs[i].color, recs[i].transparent != 0);
+    }
 
-    return inst;
+    return true;
 
 }
 
-OBJ::Model *MapObjects::_loadModel (std::string const &file)
+bool MapObjects::isReady (InstanceArray const &objs) const
 {
-    auto it = this->_objs.find (file);
-    if (it == this->_objs.end()) {
-      // load the model from the OBJ file
-        OBJ::Model *model = new OBJ::Model (this->_map->assetsDir() + file);
-      // preload any textures in the materials of the model
+    std::lock_guard<std::mutex> lk(this->_mutex);
+    for (uint32_t j = 0;  j < objs.numModels();  j++) {
+        auto it = this->_objs.find (objs.modelFile(j));
+        assert (it != this->_objs.end());
+        if (it->second.model == nullptr) {
+            return false;
+        }
+        for (auto &name : it->second.texs) {
+            if (this->_texs.at(name).img == nullptr) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void MapObjects::finishObjects (InstanceArray &objs)
+{
+    {
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        for (uint32_t j = 0;  j < objs.numModels();  j++) {
+            auto it = this->_objs.find (objs.modelFile(j));
+            assert ((it != this->_objs.end()) && (it->second.model != nullptr));
+            objs.setModel (j, it->second.model);
+        }
+    }
+    objs.computeBounds ();
+}
+
+void MapObjects::unloadObjects (InstanceArray &objs, std::vector<const OBJ::Model *> &unloaded)
+{
+    {
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        for (uint32_t j = 0;  j < objs.numModels();  j++) {
+            this->_releaseModel (objs.modelFile(j), unloaded);
+        }
+    }
+    objs.clear ();
+}
+
+cs237::Image2D *MapObjects::textureByName (std::string name) const
+{
+    std::lock_guard<std::mutex> lk(this->_mutex);
+    auto it = this->_texs.find (name);
+    return (it == this->_texs.end()) ? nullptr : it->second.img;
+}
+
+// an estimate of the memory used by a model's mesh data
+static size_t modelBytes (const OBJ::Model *model)
+{
+    size_t nBytes = 0;
+    for (auto grpIt = model->beginGroups();  grpIt != model->endGroups();  grpIt++) {
+        OBJ::Group const &g = *grpIt;
+        size_t vertBytes = sizeof(glm::vec3);
+        if (g.norms != nullptr) {
+            vertBytes += sizeof(glm::vec3);
+        }
+        if (g.txtCoords != nullptr) {
+            vertBytes += sizeof(glm::vec2);
+        }
+        nBytes += size_t(g.nVerts) * vertBytes
+            + size_t(g.totalIndices()) * sizeof(uint32_t)
+            + size_t(g.nLODs) * sizeof(OBJ::LOD);
+    }
+    return nBytes;
+}
+
+void MapObjects::_acquireModel (std::string const &file)
+{
+    // is this model already loaded or being loaded?
+    {
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        auto ins = this->_objs.insert (std::make_pair (file, ModelEntry{nullptr, 1, 0, {}}));
+        if (! ins.second) {
+            ins.first->second.refCount++;
+            return;
+        }
+    }
+
+    // models are only released by cells that have been completed, which requires
+    // the model to be loaded, so the entry exists until this task is done
+    this->_loader.submit ([this, file] () {
+      // load the model from its binary model file, if it is up to date, or
+      // else from the OBJ file (which includes reading its material library).
+      // The loader already runs several of these tasks at once, so the model
+      // is built on this thread.
+        OBJ::Model *model = OBJ::Model::load (this->_map->assetsDir() + file, true, 1);
+        size_t nBytes = modelBytes (model);
+
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        ModelEntry &ent = this->_objs[file];
+        ent.model = model;
+        ent.nBytes = nBytes;
+        this->_nBytes += nBytes;
+      // acquire the textures in the materials of the model; these are loaded
+      // concurrently with the other models
         for (auto grpIt = model->beginGroups();  grpIt != model->endGroups();  grpIt++) {
+            if ((*grpIt).material < 0) {
+                continue;
+            }
             const OBJ::Material *mat = &model->material((*grpIt).material);
             /* we ignore the ambient map */
-            this->_loadTexture (mat->emissiveMap, true);
-            this->_loadTexture (mat->diffuseMap, true);
-            this->_loadTexture (mat->specularMap, false);
-            this->_loadTexture (mat->normalMap, false);
+            std::pair<std::string, bool> maps[4] = {
+                    {mat->emissiveMap, true}, {mat->diffuseMap, true},
+                    {mat->specularMap, false}, {mat->normalMap, false}
+                };
+            for (auto &m : maps) {
+                if (! m.first.empty()) {
+                    ent.texs.push_back (m.first);
+                    this->_acquireTexture (m.first, m.second);
+                }
+            }
         }
-      // cache the model
-        this->_objs[file] = model;
-        return model;
+    });
+}
+
+void MapObjects::_releaseModel (
+    std::string const &file,
+    std::vector<const OBJ::Model *> &unloaded)
+{
+    auto it = this->_objs.find (file);
+    assert ((it != this->_objs.end()) && (it->second.model != nullptr));
+    if (--it->second.refCount > 0) {
+        return;
     }
-    else {
-        return it->second;
+
+    for (auto &name : it->second.texs) {
+        this->_releaseTexture (name);
     }
+    this->_nBytes -= it->second.nBytes;
+    unloaded.push_back (it->second.model);
+    delete it->second.model;
+    this->_objs.erase (it);
 }
 
-void MapObjects::_loadTexture (std::string name, bool sRGB)
+void MapObjects::_acquireTexture (std::string const &name, bool sRGB)
 {
-    if (name.empty()) {
+    // is this texture already loaded or being loaded?
+    auto ins = this->_texs.insert (std::make_pair (name, TextureEntry{nullptr, 1}));
+    if (! ins.second) {
+        ins.first->second.refCount++;
         return;
     }
-    // have we already loaded this texture?
-    if (this->_texs.find(name) != this->_texs.end()) {
-        return;
+
+    this->_loader.submit ([this, name, sRGB] () {
+      // load the image data;
+        cs237::Image2D *img;
+        if (sRGB) {
+            img = new cs237::Image2D(this->_map->assetsDir() + name);
+        } else {
+            img = new cs237::DataImage2D(this->_map->assetsDir() + name);
+        }
+        if (img == nullptr) {
+            ERROR("Unable to find texture-image file \"" + name + "\"");
+        }
+      // add to _texs map, unless all of the references to the texture were
+      // released while it was being loaded
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        auto it = this->_texs.find (name);
+        assert (it != this->_texs.end());
+        if (it->second.refCount == 0) {
+            delete img;
+            this->_texs.erase (it);
+        } else {
+            it->second.img = img;
+            this->_nBytes += img->nBytes();
+        }
+    });
+}
+
+void MapObjects::_releaseTexture (std::string const &name)
+{
+    auto it = this->_texs.find (name);
+    assert (it != this->_texs.end());
+    if ((--it->second.refCount == 0) && (it->second.img != nullptr)) {
+        // if the image is still being loaded, then the loading task deletes it
+        this->_nBytes -= it->second.img->nBytes();
+        delete it->second.img;
+        this->_texs.erase (it);
+    }
+}
+
+/***** class InstanceArray member functions *****/
+
+void InstanceArray::reserve (uint32_t n)
+{
+    this->_model.reserve (n);
+    this->_toCell.reserve (n);
+    this->_normToCell.reserve (n);
+    this->_color.reserve (n);
+    this->_flags.reserve (n);
+    this->_scale.reserve (n);
+}
+
+void InstanceArray::clear ()
+{
+    this->_modelFiles.clear();
+    this->_models.clear();
+    this->_model.clear();
+    this->_toCell.clear();
+    this->_normToCell.clear();
+    this->_color.clear();
+    this->_flags.clear();
+    this->_bounds.clear();
+    this->_scale.clear();
+}
+
+void InstanceArray::add (
+    uint32_t model,
+    glm::mat4 const &toCell,
+    glm::vec3 const &color,
+    bool transparent)
+{
+    assert (model < this->_models.size());
+
+    this->_model.push_back (model);
+
+    Affine m;
+    for (int r = 0;  r < 3;  r++) {
+        m.rows[r] = glm::vec4(toCell[0][r], toCell[1][r], toCell[2][r], toCell[3][r]);
     }
-    // load the image data;
-    cs237::Image2D *img;
-    if (sRGB) {
-        img = new cs237::Image2D(this->_map->assetsDir() + name);
+    this->_toCell.push_back (m);
+
+    // the inverse transpose of an orthogonal frame with a uniform scale is the
+    // frame itself up to scale, which does not matter for normals that are
+    // renormalized, so we avoid the inverse in the common case
+    glm::mat3 lin(toCell);
+    float s0 = glm::length(lin[0]);
+    float s1 = glm::length(lin[1]);
+    float s2 = glm::length(lin[2]);
+    float maxScale = std::max(std::max(s0, s1), s2);
+    const float eps = 1.0e-5f * maxScale * maxScale;
+    bool isOrthogonal = (std::abs(glm::dot(lin[0], lin[1])) <= eps)
+        && (std::abs(glm::dot(lin[0], lin[2])) <= eps)
+        && (std::abs(glm::dot(lin[1], lin[2])) <= eps)
+        && (std::abs(s0 - s1) <= 1.0e-5f * maxScale)
+        && (std::abs(s0 - s2) <= 1.0e-5f * maxScale);
+    if (isOrthogonal && (maxScale > 0.0f)) {
+        this->_normToCell.push_back (lin / maxScale);
     } else {
-        img = new cs237::DataImage2D(this->_map->assetsDir() + name);
+        this->_normToCell.push_back (glm::inverseTranspose(lin));
+    }
+
+    this->_color.push_back (color);
+    this->_flags.push_back (transparent ? kTransparent : 0);
+    this->_scale.push_back (maxScale);
+}
+
+void InstanceArray::computeBounds ()
+{
+    this->_bounds.clear();
+    this->_bounds.reserve (this->size());
+    for (uint32_t i = 0;  i < this->size();  i++) {
+        assert (this->_models[this->_model[i]] != nullptr);
+        cs237::AABBf_t const &bb = this->_models[this->_model[i]]->bounds();
+        Affine const &m = this->_toCell[i];
+        cs237::AABBf_t cbb;
+        for (int k = 0;  k < 8;  k++) {
+            glm::vec4 corner(
+                (k & 1) ? bb.maxX() : bb.minX(),
+                (k & 2) ? bb.maxY() : bb.minY(),
+                (k & 4) ? bb.maxZ() : bb.minZ(),
+                1.0f);
+            cbb.addPt (glm::vec3(
+                glm::dot(m.rows[0], corner),
+                glm::dot(m.rows[1], corner),
+                glm::dot(m.rows[2], corner)));
+        }
+        this->_bounds.push_back (cbb);
+    }
+}
+
+// apply a permutation to one of the arrays
+template <typename T>
+static void permuteArray (std::vector<T> &v, std::vector<uint32_t> const &order)
+{
+    std::vector<T> old(std::move(v));
+    v.clear();
+    v.reserve (order.size());
+    for (auto i : order) {
+        v.push_back (old[i]);
+    }
+}
+
+void InstanceArray::permute (std::vector<uint32_t> const &order)
+{
+    assert (order.size() == this->size());
+
+    permuteArray (this->_model, order);
+    permuteArray (this->_toCell, order);
+    permuteArray (this->_normToCell, order);
+    permuteArray (this->_color, order);
+    permuteArray (this->_flags, order);
+    if (this->isComplete()) {
+        permuteArray (this->_bounds, order);
     }
-    if (img == nullptr) {
-        ERROR("Unable to find texture-image file \"" + name + "\"");
+    permuteArray (this->_scale, order);
+}
+
+cs237::AABBd_t InstanceArray::worldBounds (uint32_t i) const
+{
+    cs237::AABBf_t const &bb = this->_bounds[i];
+    glm::dvec3 origin = this->_cell->nwCorner();
+    return cs237::AABBd_t(origin + glm::dvec3(bb.min()), origin + glm::dvec3(bb.max()));
+}
+
+uint32_t InstanceArray::selectLOD (
+    uint32_t i, int grp, Camera const &cam, double dist, float errorLimit) const
+{
+    OBJ::Group const &g = this->model(i)->group(grp);
+    if (dist <= 0.0) {
+        return 0;
     }
-    // add to _texs map
-    this->_texs.insert (std::pair<std::string, cs237::Image2D *>(name, img));
 
+    // the largest scale factor of the instance's transform bounds how much it
+    // stretches the model-space error
+    float scale = this->_scale[i];
+    for (uint32_t lod = g.nLODs - 1;  lod > 0;  --lod) {
+        if (cam.screenError(float(dist), scale * g.lods[lod].error) <= errorLimit) {
+            return lod;
+        }
+    }
+    return 0;
 }
@@ -20,74 +20,287 @@
 
 #include "cs237.hpp"
 #include "obj.hpp"
+#include "worker-pool.hpp"
 #include <map>
+#include <mutex>
 
 class Map;
 class Cell;
+class Camera;
+namespace MapCache { class Reader; }
 
-//! an instance of a model, which has its own position and color.
-struct Instance {
-    Cell *cell;                 //!< the cell where this instance is located
-    OBJ::Model *model;          //!< pointer to the OBJ model
-    glm::mat4 toCell;           //!< affine transform from model space to the cell's
-                                //!  coordinate system
-    glm::vec3 color;            //!< the color of the object
-    bool transparent;           //!< is the object transparent?
-
-    /// return the matrix for converting normal vectors from the model's
-    /// coordinate system to the cell's coordinate system
-    glm::mat3 normToCell () const
+//! The object instances on a map cell, which are stored as parallel arrays
+//! indexed by instance.  An instance is a model with its own position and color.
+//! The per-instance data that is derived from the transform (the normal matrix,
+//! the bounding box, and the scale) is computed once when the instance is added,
+//! so iterating over the instances to cull them or to pack their data for
+//! rendering only makes linear passes over the arrays.
+//!
+//! The instances are added before their models are loaded, so the array is
+//! completed in two steps: when the models have been loaded, they are set in
+//! the model table and then the bounding boxes are computed.
+class InstanceArray {
+  public:
+    //! the rows of an affine transform; the fourth column (i.e., the w components)
+    //! holds the translation
+    struct Affine {
+        glm::vec4 rows[3];
+    };
+
+    //! the flags of an instance
+    enum : uint8_t {
+        kTransparent = 1        //!< the object is transparent
+    };
+
+    //! create an empty array for the instances on a cell
+    explicit InstanceArray (Cell *cell) : _cell(cell) { }
+
+    //! the cell where the instances are located
+    Cell *cell () const { return this->_cell; }
+
+    //! the number of instances
+    uint32_t size () const { return this->_model.size(); }
+    //! are there no instances?
+    bool empty () const { return this->_model.empty(); }
+
+    //! reserve space for instances
+    void reserve (uint32_t n);
+
+    //! remove all of the instances and models
+    void clear ();
+
+    //! \brief add a model to the table of models that are used by the instances
+    //! \param file  the file name of the model
+    //! \return the index of the model in the table
+    uint32_t addModel (std::string const &file)
     {
-        return glm::inverseTranspose(glm::mat3(this->toCell));
+        this->_modelFiles.push_back (file);
+        this->_models.push_back (nullptr);
+        return this->_models.size() - 1;
     }
 
+    //! the number of models in the model table
+    uint32_t numModels () const { return this->_models.size(); }
+    //! the file name of a model in the model table
+    std::string const &modelFile (uint32_t j) const { return this->_modelFiles[j]; }
+    //! set a model in the model table once it has been loaded
+    void setModel (uint32_t j, OBJ::Model *model) { this->_models[j] = model; }
+
+    //! compute the bounding boxes of the instances, which requires that all of
+    //! the models have been set
+    void computeBounds ();
+
+    //! \brief add an instance
+    //! \param model        the index of the instance's model in the model table
+    //! \param toCell       affine transform from model space to the cell's
+    //!                     coordinate system
+    //! \param color        the color of the object
+    //! \param transparent  is the object transparent?
+    void add (uint32_t model, glm::mat4 const &toCell, glm::vec3 const &color, bool transparent);
+
+    //! have the models been set and the bounding boxes computed?
+    bool isComplete () const { return (this->_bounds.size() == this->_model.size()); }
+
+    //! \brief reorder the instances
+    //! \param order  the new order, where `order[i]` is the current index of the
+    //!               instance that is moved to index `i`
+    void permute (std::vector<uint32_t> const &order);
+
+    //! the index of the model of an instance in the model table
+    uint32_t modelIndex (uint32_t i) const { return this->_model[i]; }
+    //! the model of an instance
+    OBJ::Model *model (uint32_t i) const { return this->_models[this->_model[i]]; }
+    //! the affine transform from model space to the cell's coordinate system
+    Affine const &toCell (uint32_t i) const { return this->_toCell[i]; }
+    //! the matrix for converting normal vectors from the model's coordinate system
+    //! to the cell's coordinate system
+    glm::mat3 const &normToCell (uint32_t i) const { return this->_normToCell[i]; }
+    //! the color of an instance
+    glm::vec3 const &color (uint32_t i) const { return this->_color[i]; }
+    //! is an instance transparent?
+    bool isTransparent (uint32_t i) const { return (this->_flags[i] & kTransparent) != 0; }
+    //! the bounding box of an instance in the cell's coordinate system
+    cs237::AABBf_t const &cellBounds (uint32_t i) const { return this->_bounds[i]; }
+
+    //! return the world-space bounding box of an instance
+    cs237::AABBd_t worldBounds (uint32_t i) const;
+
+    //! \brief select the level of detail to use for rendering one of the groups
+    //!        of an instance's model.  This is the same test that is used to
+    //!        refine the terrain: the geometric error of a level (scaled by the
+    //!        instance's transform) is projected to the screen and compared with
+    //!        the error limit.
+    //! \param i           the instance
+    //! \param grp         the index of the group in the model
+    //! \param cam         the camera
+    //! \param dist        the distance from the camera to the instance (e.g.,
+    //!                    `worldBounds(i).distanceToPt(cam.position())`)
+    //! \param errorLimit  the screen-space error limit in pixels
+    //! \return the coarsest level of detail of the group whose screen-space error
+    //!         is within the limit
+    uint32_t selectLOD (
+        uint32_t i, int grp, Camera const &cam, double dist, float errorLimit) const;
+
+  private:
+    Cell *_cell;                                //!< the cell of the instances
+    std::vector<std::string> _modelFiles;       //!< the file names of the models
+    std::vector<OBJ::Model *> _models;          //!< the models used by the instances
+                                                //!  (nullptr until they are set)
+    std::vector<uint32_t> _model;               //!< index of each instance's model in
+                                                //!  _models
+    std::vector<Affine> _toCell;                //!< model-to-cell transforms
+    std::vector<glm::mat3> _normToCell;         //!< model-to-cell normal transforms
+    std::vector<glm::vec3> _color;              //!< the instance colors
+    std::vector<uint8_t> _flags;                //!< the instance flags
+    std::vector<cs237::AABBf_t> _bounds;        //!< cell-space bounding boxes
+    std::vector<float> _scale;                  //!< the largest scale factor of each
+                                                //!  transform, which bounds how much
+                                                //!  it stretches model-space errors
 };
 
-//! a container for the objects in a map
+//! A container for the objects in a map.  The objects on a cell are loaded
+//! lazily: each frame, `update` starts loading the objects of the cells that are
+//! near the camera and unloads the objects of the cells that have moved out of
+//! range.  The models and textures are shared by the cells and are reference
+//! counted, so they are unloaded once no cell that has its objects loaded uses
+//! them.  Objects are loaded in the background by a pool of worker threads.
 class MapObjects {
   public:
 
     //! constructor
     //! \param map the map that contains the objects
-    MapObjects (Map *map) : _map(map), _objs(), _texs() { }
+    MapObjects (Map *map);
 
     ~MapObjects ();
 
-    //! load the objects instances for a map cell
+    //! \brief update which cells have their objects loaded.  This should be called
+    //!        once per frame, when the GPU is not using any of the objects.
+    //! \param pos       the world-space camera position
+    //! \param unloaded  set to the models that were unloaded by this update, so
+    //!                  that the caller can release the resources that it has
+    //!                  for them
+    void update (glm::dvec3 const &pos, std::vector<const OBJ::Model *> &unloaded);
+
+    //! the distance from the camera within which the objects of a cell are loaded;
+    //! the default is `kDefaultLoadCells` cell widths
+    double loadRadius () const;
+    //! set the distance from the camera within which the objects of a cell are loaded
+    void setLoadRadius (double r) { this->_loadRadius = r; }
+
+    //! the budget for the memory used by models and textures (in bytes)
+    size_t budget () const { return this->_budget; }
+    //! \brief set the budget for the memory used by models and textures.  Once the
+    //!        budget is exceeded, no further cells are loaded and the objects of
+    //!        out-of-range cells are unloaded immediately.
+    void setBudget (size_t nBytes) { this->_budget = nBytes; }
+
+    //! the number of bytes of model and texture data that are loaded
+    size_t residentBytes () const;
+
+    //! \brief load the objects instances for a map cell and request the models that
+    //!        they use, which are loaded (along with their textures) in the
+    //!        background.  This function is run on a worker thread (see `update`);
+    //!        once the models have been loaded (see `isReady`), the array must be
+    //!        completed with `finishObjects`.
     //! \param cell[in]   the path to the cell's subdirectory
-    //! \param objs[out]  the vector to load with the objects
-    void loadObjects (Cell *cell, std::vector<Instance *> &objs);
+    //! \param objs[out]  the array to load with the objects
+    void loadObjects (Cell *cell, InstanceArray &objs);
+
+    //! have the models that are used by an array of instances, and their textures,
+    //! been loaded?
+    bool isReady (InstanceArray const &objs) const;
+
+    //! \brief complete an array of instances by setting its models, which must
+    //!        have been loaded, and computing its bounding boxes
+    //! \param objs  the array, which was loaded by `loadObjects`
+    void finishObjects (InstanceArray &objs);
+
+    //! \brief release the models that are used by an array of instances and clear
+    //!        the array
+    //! \param objs      the array, which must have been completed
+    //! \param unloaded  the models that are unloaded as a result are added to
+    //!                  this vector
+    void unloadObjects (InstanceArray &objs, std::vector<const OBJ::Model *> &unloaded);
+
+    //! wait for all of the pending loads to complete
+    void wait () { this->_loader.wait(); }
 
     //! lookup a texture image by name
     //! \returns a pointer to the image object or nullptr if the image is not found
+    //!          or is still being loaded
     cs237::Image2D *textureByName (std::string name) const;
 
     Map *map () { return this->_map; }
 
+    //! the objects of a cell are unloaded once its distance from the camera is
+    //! more than this factor times the load radius
+    static constexpr double kUnloadFactor = 1.25;
+    //! the maximum number of cells whose objects are being loaded at one time
+    static constexpr uint32_t kMaxPendingCells = 4;
+    //! the default load radius in cell widths
+    static constexpr double kDefaultLoadCells = 2.0;
+    //! the default memory budget (1Gb)
+    static constexpr size_t kDefaultBudget = size_t(1) << 30;
+
   private:
+    //! a cached model
+    struct ModelEntry {
+        OBJ::Model *model;              //!< the model (nullptr while it is being loaded)
+        uint32_t refCount;              //!< the number of cells that use the model
+        size_t nBytes;                  //!< the size of the model's data
+        std::vector<std::string> texs;  //!< the textures that the model references
+    };
+
+    //! a cached texture image
+    struct TextureEntry {
+        cs237::Image2D *img;            //!< the image (nullptr while it is being loaded)
+        uint32_t refCount;              //!< the number of references from loaded models
+    };
+
     Map *_map;                                          //!< the map
-    std::map<std::string, OBJ::Model *> _objs;          //!< object-mesh cache
-    std::map<std::string, cs237::Image2D *> _texs;      //!< texture-image cache
+    mutable std::mutex _mutex;                          //!< protects _objs, _texs, and
+                                                        //!  _nBytes
+    std::map<std::string, ModelEntry> _objs;            //!< object-mesh cache
+    std::map<std::string, TextureEntry> _texs;          //!< texture-image cache
+    size_t _nBytes;                                     //!< the size of the loaded models
+                                                        //!  and textures
+    double _loadRadius;                                 //!< the load radius (0 for the
+                                                        //!  default)
+    size_t _budget;                                     //!< the memory budget
+    WorkerPool _loader;                                 //!< the threads that load
+                                                        //!  objects, models, and textures
 
-    //! helper function for creating instances
-    Instance *_makeInstance (
-        std::string const &file,
+    //! helper function for creating the instances of a cell from the cached
+    //! contents of its objects.json file
+    //! \return false if the cache is malformed
+    bool _loadCachedObjects (
         Cell *cell,
-        glm::mat4 const &toCell,
-        glm::vec3 const &color,
-        bool isTransparent);
+        MapCache::Reader &cache,
+        InstanceArray &objs);
 
-    //! helper function for loading OBJ models from files
-    //! \param dir  the map's asset directory
+    //! helper function for acquiring a reference to an OBJ model; the model is
+    //! loaded in the background when it is not already cached.  When the model has
+    //! been loaded, the textures of its materials are acquired.
     //! \param file  the file name of the model
-    //! \return a pointer to the model; the model data is cached so that it is only
-    //!         loaded once.
-    OBJ::Model *_loadModel (std::string const &file);
+    void _acquireModel (std::string const &file);
+
+    //! helper function for releasing a reference to a model, which is unloaded
+    //! (along with its references to textures) when it is no longer used; the
+    //! caller must hold the lock.
+    //! \param file      the file name of the model
+    //! \param unloaded  the model is added to this vector if it is unloaded
+    void _releaseModel (std::string const &file, std::vector<const OBJ::Model *> &unloaded);
 
-    //! helper function for pre-loading texture images into the _texs map
+    //! helper function for acquiring a reference to a texture image; the image is
+    //! loaded in the background when it is not already cached.  The caller must
+    //! hold the lock.
     //! \param name  the name of the file
     //! \param sRGB  argument specifying if the image is a SRGB image
-    void _loadTexture (std::string name, bool sRGB);
+    void _acquireTexture (std::string const &name, bool sRGB);
+
+    //! helper function for releasing a reference to a texture image, which is
+    //! deleted when it is no longer used; the caller must hold the lock.
+    void _releaseTexture (std::string const &name);
 
 };
 
@@ -15,6 +15,7 @@
 #include "cs237.hpp"
 #include "map.hpp"
 #include "map-cell.hpp"
+#include "map-cache.hpp"
 #ifdef PART2
 #include "map-objects.hpp"
 #endif
@@ -28,6 +29,12 @@ Map::Map (cs237::Application *app)
 
 Map::~Map ()
 {
+#ifdef PART2
+    // the worker threads may be loading the objects of cells
+    if (this->_objects != nullptr) {
+        this->_objects->wait();
+    }
+#endif
     if (this->_grid != nullptr) {
         for (int i = 0;  i < this->_nCells();  i++) {
             if (this->_grid[i] != nullptr)
@@ -73,17 +80,19 @@ static bool getThreeFloats (const json::Array *arr, float out[3])
     return false;
 }
 
-bool Map::load (std::string const &mapName, bool verbose)
+// parse the map.json file; this sets the header fields of the map, except for
+// the assets directory and the grid, which are returned in assets and grid
+bool Map::_parseJSON (
+    std::string const &mapName,
+    std::string const &mapFile,
+    bool &hasAssets,
+    std::string &assets,
+    std::vector<std::string> &grid)
 {
-    if (this->_grid != nullptr) {
-      // map file has already been loaded, so return false
-        return false;
-    }
-
-    this->_path = mapName + "/";
-
-    json::Value *map = json::parseFile(this->_path + "map.json");
-    const json::Object *root = (map != nullptr) ? map->asObject() : nullptr;
+    json::Document doc;
+    const json::Object *root = doc.parseFile(mapFile)
+        ? doc.root()->asObject()
+        : nullptr;
 
     if (root == nullptr) {
         error (mapName, "expected object");
@@ -276,12 +285,170 @@ bool Map::load (std::string const &mapName, bool verbose)
     // get assets-dir (optional)
     v = (*root)["assets-dir"];
     if (v != nullptr) {
-        const json::String *assets = v->asString();
-        if (assets == nullptr) {
+        const json::String *s = v->asString();
+        if (s == nullptr) {
             error (mapName, "bogus assets-dir field");
             return false;
         }
-        this->_assetsDir = this->_path + assets->value();
+        hasAssets = true;
+        assets = s->value();
+    }
+    else {
+        hasAssets = false;
+    }
+
+  // get array of grid filenames
+    const json::Array *gridArr = root->fieldAsArray("grid");
+    if (gridArr == nullptr) {
+        error (mapName, "missing/bogus grid field");
+        return false;
+    }
+    grid.reserve (gridArr->length());
+    for (int i = 0;  i < gridArr->length();  i++) {
+        const json::String *s = (*gridArr)[i]->asString();
+        if (s == nullptr) {
+            error (mapName, "bogus grid item");
+            return false;
+        }
+        grid.push_back (s->value());
+    }
+
+    return true;
+
+}
+
+// the flags in the map cache
+enum {
+    kHasColor = 1, kHasNormals = 2, kHasWater = 4, kHasFog = 8, kHasAssets = 16
+};
+
+// the plain-data part of the map cache
+struct MapRecord {
+    float hScale, vScale, baseElev, minElev, maxElev, minSky, maxSky;
+    uint32_t width, height, cellSize;
+    uint32_t flags;
+    glm::vec3 sunDir, sunI, ambI, fogColor;
+    float fogDensity;
+};
+
+// load the header fields from the cache for the map.json file
+bool Map::_loadCache (
+    std::string const &mapFile,
+    bool &hasAssets,
+    std::string &assets,
+    std::vector<std::string> &grid)
+{
+    MapCache::Reader rd;
+    MapRecord rec;
+    uint32_t nGrid;
+    if (! MapCache::load (mapFile, MapCache::Kind::Map, rd)
+    || ! rd.get (rec)
+    || ! rd.getString (this->_name)
+    || ! rd.getString (assets)
+    || ! rd.get (nGrid)) {
+        return false;
+    }
+    grid.resize (nGrid);
+    for (auto &g : grid) {
+        if (! rd.getString (g)) {
+            return false;
+        }
+    }
+
+    this->_hScale = rec.hScale;
+    this->_vScale = rec.vScale;
+    this->_baseElev = rec.baseElev;
+    this->_minElev = rec.minElev;
+    this->_maxElev = rec.maxElev;
+    this->_minSky = rec.minSky;
+    this->_maxSky = rec.maxSky;
+    this->_width = rec.width;
+    this->_height = rec.height;
+    this->_cellSize = rec.cellSize;
+    this->_hasColor = (rec.flags & kHasColor) != 0;
+    this->_hasNormals = (rec.flags & kHasNormals) != 0;
+    this->_hasWater = (rec.flags & kHasWater) != 0;
+    this->_hasFog = (rec.flags & kHasFog) != 0;
+    hasAssets = (rec.flags & kHasAssets) != 0;
+    this->_sunDir = rec.sunDir;
+    this->_sunI = rec.sunI;
+    this->_ambI = rec.ambI;
+    this->_fogColor = rec.fogColor;
+    this->_fogDensity = rec.fogDensity;
+
+    return true;
+
+}
+
+// save the header fields in the cache for the map.json file
+void Map::_saveCache (
+    std::string const &mapFile,
+    bool hasAssets,
+    std::string const &assets,
+    std::vector<std::string> const &grid)
+{
+    MapRecord rec;
+    rec.hScale = this->_hScale;
+    rec.vScale = this->_vScale;
+    rec.baseElev = this->_baseElev;
+    rec.minElev = this->_minElev;
+    rec.maxElev = this->_maxElev;
+    rec.minSky = this->_minSky;
+    rec.maxSky = this->_maxSky;
+    rec.width = this->_width;
+    rec.height = this->_height;
+    rec.cellSize = this->_cellSize;
+    rec.flags = (this->_hasColor ? kHasColor : 0)
+        | (this->_hasNormals ? kHasNormals : 0)
+        | (this->_hasWater ? kHasWater : 0)
+        | (this->_hasFog ? kHasFog : 0)
+        | (hasAssets ? kHasAssets : 0);
+    rec.sunDir = this->_sunDir;
+    rec.sunI = this->_sunI;
+    rec.ambI = this->_ambI;
+    rec.fogColor = this->_fogColor;
+    rec.fogDensity = this->_fogDensity;
+
+    MapCache::Writer wr;
+    wr.put (rec);
+    wr.putString (this->_name);
+    wr.putString (assets);
+    wr.put (static_cast<uint32_t>(grid.size()));
+    for (auto &g : grid) {
+        wr.putString (g);
+    }
+    MapCache::save (mapFile, MapCache::Kind::Map, wr);
+
+}
+
+bool Map::load (std::string const &mapName, bool verbose)
+{
+    if (this->_grid != nullptr) {
+      // map file has already been loaded, so return false
+        return false;
+    }
+
+    this->_path = mapName + "/";
+
+  // get the header fields from the cache, if it is up to date, or else from
+  // the map.json file
+    std::string mapFile = this->_path + "map.json";
+    bool hasAssets;
+    std::string assets;
+    std::vector<std::string> grid;
+    if (! this->_loadCache (mapFile, hasAssets, assets, grid)) {
+        if (! this->_parseJSON (mapName, mapFile, hasAssets, assets, grid)) {
+            return false;
+        }
+        this->_saveCache (mapFile, hasAssets, assets, grid);
+    }
+    else if (verbose) {
+        std::clog << "using cached map info\n";
+    }
+
+    // set the assets directory
+    if (hasAssets) {
+        this->_assetsDir = this->_path + assets;
         // check that the assetsDir exists
         if (access(this->_assetsDir.c_str(), F_OK) != 0) {
             error (mapName, "unable to access assets directory");
@@ -346,13 +513,8 @@ bool Map::load (std::string const &mapName, bool verbose)
         }
     }
 
-  // get array of grid filenames
-    const json::Array *grid = root->fieldAsArray("grid");
-    if (num == nullptr) {
-        error (mapName, "missing/bogus h-scale field");
-        return false;
-    }
-    else if (grid->length() != this->_nCells()) {
+  // create the grid of cells
+    if (grid.size() != this->_nCells()) {
         error (mapName, "incorrect number of cells in grid field");
         return false;
     }
@@ -360,11 +522,7 @@ bool Map::load (std::string const &mapName, bool verbose)
     for (int r = 0;  r < this->_nRows;  r++) {
         for (int c = 0;  c < this->_nCols;  c++) {
             int i = this->_cellIdx(r, c);
-            const json::String *s = (*grid)[i]->asString();
-            if (s == nullptr) {
-                error (mapName, "bogus grid item");
-            }
-            this->_grid[i] = new class Cell(this, r, c, this->_path + s->value());
+            this->_grid[i] = new class Cell(this, r, c, this->_path + grid[i]);
         }
     }
 
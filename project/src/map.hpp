@@ -166,6 +166,33 @@ private:
     /// the index of the cell at the given row and column
     uint32_t _cellIdx (uint32_t row, uint32_t col) const { return this->_nCols * row + col; }
 
+    /// parse the map.json file, which sets the header fields of the map
+    /// \param[out] hasAssets  set to true if the map specifies an assets directory
+    /// \param[out] assets     the assets directory (relative to the map directory)
+    /// \param[out] grid       the names of the cells (relative to the map directory)
+    /// \return false if there was an error
+    bool _parseJSON (
+        std::string const &mapName,
+        std::string const &mapFile,
+        bool &hasAssets,
+        std::string &assets,
+        std::vector<std::string> &grid);
+
+    /// set the header fields of the map from the cache for the map.json file
+    /// \return false if there is no up-to-date cache
+    bool _loadCache (
+        std::string const &mapFile,
+        bool &hasAssets,
+        std::string &assets,
+        std::vector<std::string> &grid);
+
+    /// write the cache for the map.json file
+    void _saveCache (
+        std::string const &mapFile,
+        bool hasAssets,
+        std::string const &assets,
+        std::vector<std::string> const &grid);
+
     friend class Cell;
 };
 
@@ -0,0 +1,85 @@
+/*! \file object-bvh.cpp
+ *
+ * \author John Reppy
+ *
+ * A bounding-volume hierarchy over the object instances of a map cell.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "object-bvh.hpp"
+#include "map-objects.hpp"
+#include <algorithm>
+
+void ObjectBVH::build (glm::dvec3 const &origin, InstanceArray &objs)
+{
+    this->_origin = origin;
+    this->_nodes.clear();
+    if (objs.empty()) {
+        return;
+    }
+
+    std::vector<Item> items;
+    items.reserve (objs.size());
+    for (uint32_t i = 0;  i < objs.size();  i++) {
+        cs237::AABBf_t const &bb = objs.cellBounds(i);
+        items.push_back (Item{bb, bb.center(), i});
+    }
+
+    // a median split produces fewer than 4n/kLeafSize nodes
+    this->_nodes.reserve (4 * (items.size() / kLeafSize) + 1);
+    this->_build (items, 0, items.size());
+
+    std::vector<uint32_t> order;
+    order.reserve (items.size());
+    for (auto const &item : items) {
+        order.push_back (item.inst);
+    }
+    objs.permute (order);
+}
+
+void ObjectBVH::_build (std::vector<Item> &items, uint32_t first, uint32_t count)
+{
+    uint32_t id = this->_nodes.size();
+    this->_nodes.push_back (Node());
+
+    // the bounds of the instances and of their centers
+    cs237::AABBf_t bb, centers;
+    for (uint32_t i = first;  i < first + count;  i++) {
+        bb += items[i].bounds;
+        centers.addPt (items[i].center);
+    }
+
+    Node &nd = this->_nodes[id];
+    nd.min = bb.min();
+    nd.max = bb.max();
+    nd.first = first;
+    nd.count = count;
+    nd.right = 0;
+    if (count <= kLeafSize) {
+        return;
+    }
+
+    // split at the median center along the longest axis of the centers
+    glm::vec3 ext = centers.max() - centers.min();
+    int axis = (ext.x >= ext.y)
+        ? ((ext.x >= ext.z) ? 0 : 2)
+        : ((ext.y >= ext.z) ? 1 : 2);
+    uint32_t half = count / 2;
+    std::nth_element (
+        items.begin() + first,
+        items.begin() + (first + half),
+        items.begin() + (first + count),
+        [axis] (Item const &a, Item const &b) { return a.center[axis] < b.center[axis]; });
+
+    // the left child immediately follows this node; note that building the
+    // children may reallocate the node vector, so we cannot use `nd` afterwards
+    this->_build (items, first, half);
+    uint32_t right = this->_nodes.size();
+    this->_build (items, first + half, count - half);
+    this->_nodes[id].right = right;
+}
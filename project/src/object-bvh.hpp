@@ -0,0 +1,188 @@
+/*! \file object-bvh.hpp
+ *
+ * \author John Reppy
+ *
+ * A bounding-volume hierarchy over the object instances of a map cell.  The
+ * hierarchy is built once when the cell's objects are loaded and is then used
+ * to cull the instances against the view frustum and a maximum view distance.
+ * As with the terrain tiles, the outcode of a node is passed down to its
+ * children, so planes that wholly contain a node are not tested again below it,
+ * and a subtree that is wholly inside the frustum is visited without any further
+ * tests.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _OBJECT_BVH_HPP_
+#define _OBJECT_BVH_HPP_
+
+#include "cs237.hpp"
+#include "frustum.hpp"
+#include <vector>
+
+class InstanceArray;
+
+class ObjectBVH {
+  public:
+    ObjectBVH () : _origin(0.0), _nodes() { }
+
+    //! \brief build the hierarchy for the instances of a cell.  The instances are
+    //!        reordered so that the instances of each subtree are contiguous.
+    //! \param origin  the world-space position of the cell's coordinate system
+    //! \param objs    the instances, which are reordered in place
+    void build (glm::dvec3 const &origin, InstanceArray &objs);
+
+    //! is the hierarchy empty?
+    bool isEmpty () const { return this->_nodes.empty(); }
+
+    //! the number of nodes in the hierarchy
+    uint32_t numNodes () const { return this->_nodes.size(); }
+
+    //! \brief visit the instances that are (at least partially) in the view frustum
+    //!        and within a distance of the camera.  The test is conservative: the
+    //!        instances of a leaf are visited when the leaf is visible.
+    //! \param frustum  the world-space view frustum
+    //! \param pos      the world-space camera position
+    //! \param maxDist  the maximum distance from the camera
+    //! \param visit    called with the index of each visible instance in the
+    //!                 array that was passed to `build`
+    template <typename F>
+    void cull (Frustum const &frustum, glm::dvec3 const &pos, double maxDist, F visit) const;
+
+    //! \brief visit the instances that are within a distance of a point
+    //! \param pos      a world-space point
+    //! \param maxDist  the maximum distance from the point
+    //! \param visit    called with the index of each instance that is within
+    //!                 the distance; as with `cull`, the test is conservative
+    template <typename F>
+    void nearby (glm::dvec3 const &pos, double maxDist, F visit) const;
+
+    //! the maximum number of instances in a leaf
+    static const uint32_t kLeafSize = 4;
+
+  private:
+    //! a node of the hierarchy.  The nodes are stored in depth-first order, so the
+    //! left child of an interior node immediately follows it.
+    struct Node {
+        glm::vec3 min;          //!< the minimum corner of the node's bounds in cell
+                                //!  coordinates
+        glm::vec3 max;          //!< the maximum corner of the node's bounds
+        uint32_t first;         //!< the index of the first instance in the subtree
+        uint32_t count;         //!< the number of instances in the subtree
+        uint32_t right;         //!< the index of the right child; 0 for leaves
+
+        bool isLeaf () const { return (this->right == 0); }
+    };
+
+    //! an instance and its cell-space bounds during construction
+    struct Item {
+        cs237::AABBf_t bounds;
+        glm::vec3 center;
+        uint32_t inst;          //!< the index of the instance
+    };
+
+    //! a pending node in a traversal
+    struct Pending {
+        uint32_t node;
+        Outcode code;           //!< the outcode of the node's parent
+    };
+
+    //! the maximum depth of the hierarchy; the depth of a median split is
+    //! logarithmic in the number of instances, so this is never reached
+    static const int kMaxDepth = 64;
+
+    glm::dvec3 _origin;         //!< the world-space origin of the cell
+    std::vector<Node> _nodes;   //!< the nodes in depth-first order
+
+    //! the world-space bounds of a node
+    cs237::AABBd_t _bounds (Node const &nd) const
+    {
+        return cs237::AABBd_t(
+            this->_origin + glm::dvec3(nd.min),
+            this->_origin + glm::dvec3(nd.max));
+    }
+
+    //! the maximum distance from a point to a box
+    static double _maxDistance (cs237::AABBd_t const &bb, glm::dvec3 const &pos)
+    {
+        glm::dvec3 d = glm::max(glm::abs(bb.min() - pos), glm::abs(bb.max() - pos));
+        return glm::length(d);
+    }
+
+    //! build the subtree for items[first] .. items[first+count-1]
+    void _build (std::vector<Item> &items, uint32_t first, uint32_t count);
+};
+
+template <typename F>
+void ObjectBVH::cull (
+    Frustum const &frustum,
+    glm::dvec3 const &pos,
+    double maxDist,
+    F visit) const
+{
+    if (this->_nodes.empty()) {
+        return;
+    }
+
+    Pending stk[kMaxDepth + 1];
+    int sp = 0;
+    stk[sp++] = Pending{0, Outcode()};
+    while (sp > 0) {
+        Pending p = stk[--sp];
+        Node const &nd = this->_nodes[p.node];
+        cs237::AABBd_t bb = this->_bounds(nd);
+        if (bb.distanceToPt(pos) > maxDist) {
+            continue;
+        }
+        // the frustum test requires a parent that is neither culled nor all in
+        Outcode code = p.code.allIn() ? p.code : frustum.intersectBox(bb, p.code);
+        if (code.culled()) {
+            continue;
+        }
+        if (nd.isLeaf() || (code.allIn() && (_maxDistance(bb, pos) <= maxDist))) {
+            // the whole subtree is visible
+            for (uint32_t i = nd.first;  i < nd.first + nd.count;  i++) {
+                visit (i);
+            }
+        } else {
+            assert (sp + 2 <= kMaxDepth + 1);
+            stk[sp++] = Pending{nd.right, code};
+            stk[sp++] = Pending{p.node + 1, code};
+        }
+    }
+}
+
+template <typename F>
+void ObjectBVH::nearby (glm::dvec3 const &pos, double maxDist, F visit) const
+{
+    if (this->_nodes.empty()) {
+        return;
+    }
+
+    uint32_t stk[kMaxDepth + 1];
+    int sp = 0;
+    stk[sp++] = 0;
+    while (sp > 0) {
+        uint32_t id = stk[--sp];
+        Node const &nd = this->_nodes[id];
+        cs237::AABBd_t bb = this->_bounds(nd);
+        if (bb.distanceToPt(pos) > maxDist) {
+            continue;
+        }
+        if (nd.isLeaf() || (_maxDistance(bb, pos) <= maxDist)) {
+            for (uint32_t i = nd.first;  i < nd.first + nd.count;  i++) {
+                visit (i);
+            }
+        } else {
+            assert (sp + 2 <= kMaxDepth + 1);
+            stk[sp++] = nd.right;
+            stk[sp++] = id + 1;
+        }
+    }
+}
+
+#endif //! _OBJECT_BVH_HPP_
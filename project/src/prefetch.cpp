@@ -0,0 +1,156 @@
+/*! \file prefetch.cpp
+ *
+ * \author John Reppy
+ *
+ * Predictive texture prefetching.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "prefetch.hpp"
+#include "map.hpp"
+#include "map-cell.hpp"
+#include "texture-cache.hpp"
+
+//! weight given to the most recent frame when smoothing the camera motion
+constexpr double kSmoothing = 0.25;
+//! the minimum per-frame motion (in meters) that we treat as movement
+constexpr double kMinSpeed = 0.01;
+//! the minimum per-frame change in direction that we treat as turning
+constexpr float kMinTurn = 1.0e-4f;
+//! cosine of the largest change in predicted heading that does not invalidate
+//! the outstanding requests (about 15 degrees)
+constexpr double kCosTolerance = 0.966;
+//! the number of frames between refreshing an unchanged prediction
+constexpr int kRefreshInterval = 4;
+//! the number of points along the predicted path that we sample
+constexpr int kNumSamples = 4;
+
+TexturePrefetcher::TexturePrefetcher (Map *map, TextureCache *cache, int lookahead)
+  : _map(map), _cache(cache), _lookahead(std::max(1, lookahead)),
+    _hasPrev(false), _hasPrediction(false), _framesSinceIssue(0),
+    _velocity(0.0), _turn(0.0f), _predVel(0.0), _predDir(0.0f)
+{ }
+
+void TexturePrefetcher::update (Camera const &cam, float errorLimit)
+{
+    glm::dvec3 pos = cam.position();
+    glm::vec3 dir = cam.direction();
+
+    if (! this->_hasPrev) {
+        this->_prevPos = pos;
+        this->_prevDir = dir;
+        this->_hasPrev = true;
+        return;
+    }
+
+    // update the smoothed estimates of the camera's motion
+    this->_velocity = glm::mix(this->_velocity, pos - this->_prevPos, kSmoothing);
+    this->_turn = glm::mix(this->_turn, dir - this->_prevDir, float(kSmoothing));
+    this->_prevPos = pos;
+    this->_prevDir = dir;
+
+    double speed = glm::length(this->_velocity);
+    if ((speed < kMinSpeed) && (glm::length(this->_turn) < kMinTurn)) {
+        // the camera is (nearly) stationary, so the renderer's own requests
+        // are sufficient
+        if (this->_hasPrediction) {
+            this->_cache->cancelPrefetches();
+            this->_hasPrediction = false;
+        }
+        return;
+    }
+
+    double horizon = double(this->_lookahead);
+    glm::vec3 predDir = glm::normalize(dir + float(horizon) * this->_turn);
+
+    // check to see if the prediction has changed enough to invalidate the
+    // outstanding requests
+    bool changed = !this->_hasPrediction
+        || (glm::dot(predDir, this->_predDir) < kCosTolerance);
+    if (!changed && (speed >= kMinSpeed)) {
+        double predSpeed = glm::length(this->_predVel);
+        changed = (predSpeed < kMinSpeed)
+            || (glm::dot(this->_velocity, this->_predVel) < kCosTolerance * speed * predSpeed)
+            || (speed > 2.0 * predSpeed) || (2.0 * speed < predSpeed);
+    }
+
+    if (changed) {
+        this->_cache->cancelPrefetches();
+        this->_predVel = this->_velocity;
+        this->_predDir = predDir;
+        this->_hasPrediction = true;
+    }
+    else if (++this->_framesSinceIssue < kRefreshInterval) {
+        // the outstanding requests are still valid
+        return;
+    }
+    this->_framesSinceIssue = 0;
+
+    // sample the predicted path; requests for earlier samples get higher priority
+    for (int i = 1;  i <= kNumSamples;  ++i) {
+        double t = double(i) / double(kNumSamples);
+        Camera predCam = cam;
+        predCam.move (pos + (t * horizon) * this->_velocity);
+        predCam.look (glm::normalize(dir + float(t * horizon) * this->_turn));
+        for (uint32_t r = 0;  r < this->_map->nRows();  ++r) {
+            for (uint32_t c = 0;  c < this->_map->nCols();  ++c) {
+                Cell *cell = this->_map->cell(r, c);
+                if (cell->isLoaded()) {
+                    this->_requestFrontier (predCam, errorLimit, float(t), cell, cell->tile(0));
+                }
+            }
+        }
+    }
+
+}
+
+// walk the tile tree of a cell to find the frontier as seen from the camera
+void TexturePrefetcher::_requestFrontier (
+    Camera const &cam, float errorLimit, float priority,
+    Cell *cell, Tile const &tile)
+{
+    cs237::AABBd_t const &bb = tile.bBox();
+
+    // skip tiles that are behind the camera or beyond the far plane
+    glm::dvec3 toCenter = bb.center() - cam.position();
+    double radius = 0.5 * glm::distance(bb.min(), bb.max());
+    if (glm::dot(toCenter, glm::dvec3(cam.direction())) < -radius) {
+        return;
+    }
+    double dist = bb.distanceToPt(cam.position());
+    if (dist > double(cam.far())) {
+        return;
+    }
+
+    if ((tile.numChildren() > 0)
+    && (cam.screenError(float(dist), tile.chunk().maxError) > errorLimit)) {
+        for (int i = 0;  i < 4;  ++i) {
+            this->_requestFrontier (cam, errorLimit, priority, cell, *tile.child(i));
+        }
+    } else {
+        // nearer tiles get higher priority
+        this->_requestTile (cell, tile, priority + float(dist / double(cam.far())));
+    }
+
+}
+
+// request the TQT nodes that cover a tile
+void TexturePrefetcher::_requestTile (Cell *cell, Tile const &tile, float priority)
+{
+    tqt::TextureQTree *trees[2] = { cell->colorTQT(), cell->normalTQT() };
+    for (auto tree : trees) {
+        if (tree != nullptr) {
+            // the TQT may be shallower than the tile tree
+            int level = std::min(tile.lod(), tree->depth() - 1);
+            int shift = tile.lod() - level;
+            int row = int(tile.nwRow() / tile.width()) >> shift;
+            int col = int(tile.nwCol() / tile.width()) >> shift;
+            this->_cache->prefetch (this->_cache->make(tree, level, row, col), priority);
+        }
+    }
+}
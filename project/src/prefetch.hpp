@@ -0,0 +1,68 @@
+/*! \file prefetch.hpp
+ *
+ * \author John Reppy
+ *
+ * A texture prefetcher that predicts the camera's motion over the next few
+ * frames and requests the textures that the predicted mesh frontier will need.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _PREFETCH_HPP_
+#define _PREFETCH_HPP_
+
+#include "cs237.hpp"
+#include "camera.hpp"
+
+class Map;
+class Cell;
+class Tile;
+class TextureCache;
+
+//! The TexturePrefetcher extrapolates the camera's position and direction over
+//! the next few frames and issues low-priority prefetch requests to the texture
+//! cache for the TQT nodes that are needed by the predicted mesh frontier.  When
+//! the prediction changes, any outstanding requests are cancelled.
+class TexturePrefetcher {
+  public:
+
+    //! TexturePrefetcher constructor
+    //! \param map        the map being rendered
+    //! \param cache      the texture cache that services the requests
+    //! \param lookahead  the number of frames to predict
+    TexturePrefetcher (Map *map, TextureCache *cache, int lookahead = 16);
+
+    //! \brief update the prediction for a new frame and issue prefetch requests
+    //! \param cam         the current camera state
+    //! \param errorLimit  the screen-space error limit used to refine the mesh
+    void update (Camera const &cam, float errorLimit);
+
+  private:
+    Map *_map;                  //!< the map being rendered
+    TextureCache *_cache;       //!< the cache that we issue requests to
+    int _lookahead;             //!< the number of frames to predict
+    bool _hasPrev;              //!< true once we have a previous camera sample
+    bool _hasPrediction;        //!< true when there are outstanding requests
+    int _framesSinceIssue;      //!< frames since requests were last issued
+    glm::dvec3 _prevPos;        //!< the camera position at the previous frame
+    glm::vec3 _prevDir;         //!< the camera direction at the previous frame
+    glm::dvec3 _velocity;       //!< smoothed per-frame change in camera position
+    glm::vec3 _turn;            //!< smoothed per-frame change in camera direction
+    glm::dvec3 _predVel;        //!< the velocity used for the outstanding requests
+    glm::vec3 _predDir;         //!< the predicted direction used for the outstanding requests
+
+    //! issue requests for the frontier of a cell's tile tree as seen from a
+    //! predicted camera
+    void _requestFrontier (
+        Camera const &cam, float errorLimit, float priority,
+        Cell *cell, Tile const &tile);
+
+    //! issue requests for the TQT nodes that cover a tile
+    void _requestTile (Cell *cell, Tile const &tile, float priority);
+};
+
+#endif // !_PREFETCH_HPP_
@@ -12,10 +12,16 @@
 
 #include "cs237.hpp"
 #include "texture-cache.hpp"
+#include "prefetch.hpp"
 #include "map.hpp"
 #include "window.hpp"
 #include "renderer.hpp"
 #include "vao.hpp"
+#include "map-cell.hpp"
+#include "instancing.hpp"
+
+//! the maximum number of prefetched textures to upload per frame
+constexpr int kPrefetchBudget = 4;
 
 /***** Window methods *****/
 
@@ -27,6 +33,10 @@ void Window::render (float dt)
     // count the number of frames rendered
     this->_nFrames++;
 
+    // advance the texture cache's clock, which also evicts unused textures when
+    // the cache is over its limit
+    this->_tCache->newFrame();
+
     // next buffer from the swap chain
     auto imageIndex = this->_syncObjs.acquireNextImage ();
     if (imageIndex.result != vk::Result::eSuccess) {
@@ -36,10 +46,44 @@ void Window::render (float dt)
 
     this->_syncObjs.reset();
 
+    // start loading the objects of the cells that have come into range and unload
+    // the ones that have gone out of range; acquiring the image waited for the
+    // previous frame, so the GPU is done with the meshes of the unloaded models.
+    // The instance batcher only exists when the map has objects.
+    if (this->_instances != nullptr) {
+        std::vector<const OBJ::Model *> unloaded;
+        this->_map->objects()->update (this->_cam.position(), unloaded);
+        for (auto model : unloaded) {
+            this->_instances->releaseMesh (model);
+        }
+    }
+
+    // collect the visible object instances into batches and upload their instance
+    // data; acquiring the image waited for the previous frame, so the GPU is done
+    // with the instance buffer
+    if (this->_instances != nullptr) {
+        Frustum frustum = this->_cam.frustum();
+        this->_instances->begin (this->_cam, this->_errorLimit);
+        for (uint32_t r = 0;  r < this->_map->nRows();  ++r) {
+            for (uint32_t c = 0;  c < this->_map->nCols();  ++c) {
+                Cell *cell = this->_map->cell(r, c);
+                cell->cullObjects (
+                    frustum, this->_cam.position(), this->_cam.far(),
+                    [this, cell] (uint32_t i) { this->_instances->add (cell->objects(), i); });
+            }
+        }
+        this->_instances->finish ();
+    }
+
     /** HINT: draw the objects in the scene using the current rendering mode.
      ** For the terrain mesh, you will need to iterate over the cells in
      ** the map and for each cell you will need to walk the quad tree and
      ** render the tiles that comprise the frontier of the mesh refinement.
+     ** Use the texture cache's bestResident method to get the texture for a
+     ** tile, so that tiles can be drawn using a coarser texture while their
+     ** texture is loaded.  Objects are drawn in batches with the instance
+     ** batcher's draw method, first the opaque batches and then the transparent
+     ** ones.
      */
 
     // set up submission for the graphics queue
@@ -48,6 +92,11 @@ void Window::render (float dt)
     // set up submission for the presentation queue
     this->_syncObjs.present (this->presentationQ(), idx);
 
+    // upload the textures that the workers have decoded and start decoding the
+    // textures that the predicted camera motion will need
+    this->_prefetcher->update (this->_cam, this->_errorLimit);
+    this->_tCache->processPrefetches (kPrefetchBudget);
+
     // record the time of the frame
     this->_lastFrameTime = glfwGetTime();
 }
@@ -10,31 +10,115 @@
  */
 
 #include "texture-cache.hpp"
-#include <utility>
+#include <algorithm>
 
 //! soft upper bound on the number of GPU resident textures
 constexpr uint32_t kNumActiveLimit = 1024;
+//! the priority of requests for textures that are needed to render the current
+//! frame; prefetch priorities are positive, so these requests are serviced first
+constexpr float kDemandPriority = -1.0f;
+//! the number of frames that a texture must be unused before it can be evicted;
+//! this protects textures that are referenced by frames that are still in flight
+constexpr uint32_t kEvictDelay = 2;
+//! the maximum number of textures that are being decoded at one time; requests
+//! stay in the priority queue until there is room, so that urgent requests are
+//! not stuck behind a backlog of prefetches
+constexpr uint32_t kMaxDecodes = 8;
+//! the number of threads that decode textures
+constexpr unsigned int kNumDecodeThreads = 2;
 
 // initialize the texture cache
 TextureCache::TextureCache (cs237::Application *app, bool mipmap)
-    : _app(app), _numActive(0), _clock(0)
-{ }
+    : _app(app), _numActive(0), _clock(0), _textureTbl(4 * kNumActiveLimit),
+      _lastTree(nullptr), _lastTreeId(0), _nDecoding(0), _decoder(kNumDecodeThreads)
+{
+    // select the PNG decoder before any of the workers use it
+    cs237::ImageDecoder::current ();
+}
+
+TextureCache::~TextureCache ()
+{
+    // the workers may still be decoding textures
+    this->_decoder.wait ();
+    for (auto &d : this->_decoded) {
+        delete d.mipImg;
+        delete d.img;
+    }
+    this->_textureTbl.forEach ([](uint64_t, TileTexture *txt) { delete txt; });
+}
 
 TileTexture *TextureCache::make (tqt::TextureQTree *tree, int level, int row, int col)
 {
-    TextureCache::Key key(tree, level, row, col);
-    TextureCache::TextureTbl::const_iterator got = this->_textureTbl.find(key);
-    if (got == this->_textureTbl.end()) {
+    uint64_t key = TextureCache::_key(this->_treeId(tree), level, row, col);
+    TileTexture **got = this->_textureTbl.find(key);
+    if (got == nullptr) {
         TileTexture *txt = new TileTexture(this, tree, level, row, col, true);
-        this->_textureTbl.insert(std::pair<TextureCache::Key,TileTexture *>(key, txt));
+        this->_textureTbl.insert(key, txt);
         return txt;
     }
     else {
-        return got->second;
+        return *got;
     }
 
 }
 
+ResidentTexture TextureCache::bestResident (
+    tqt::TextureQTree *tree, int level, int row, int col)
+{
+    TileTexture *txt = this->make(tree, level, row, col);
+    if (!txt->isResident() && (level == 0)) {
+        // the root is pinned, so we load it now
+        txt->_load();
+        this->_addInactive (txt);
+    }
+    if (txt->isResident()) {
+        txt->_lastUsed = this->_clock;
+        return ResidentTexture{txt, glm::vec2(1.0f), glm::vec2(0.0f), true};
+    }
+
+    // queue a request for the texture ahead of any prefetch requests; if it is
+    // already being decoded, then marking it as demanded moves it to the front
+    // of the uploads
+    if (! txt->_demanded) {
+        txt->_demanded = true;
+        if (! txt->_decoding) {
+            this->_prefetchQ.push_back(Prefetch{kDemandPriority, txt});
+            std::push_heap(this->_prefetchQ.begin(), this->_prefetchQ.end());
+        }
+    }
+
+    // search for the nearest resident ancestor
+    TileTexture *anc = txt;
+    int d = 0;
+    do {
+        d++;
+        anc = this->make(tree, level - d, row >> d, col >> d);
+    } while (!anc->isResident() && (d < level));
+
+    if (! anc->isResident()) {
+        // the root is not resident, so we load it now
+        assert (anc->_level == 0);
+        anc->_load();
+        this->_addInactive (anc);
+    }
+    anc->_lastUsed = this->_clock;
+
+    // the requested tile covers a 1/2^d by 1/2^d square of the ancestor; TQT rows
+    // run from north to south, which is the reverse of the t axis when flipped
+    int n = (1 << d);
+    float scale = 1.0f / float(n);
+    int r = row - (anc->_row << d);
+    int c = col - (anc->_col << d);
+    if (tree->flip()) {
+        r = n - 1 - r;
+    }
+
+    return ResidentTexture{
+            anc, glm::vec2(scale), glm::vec2(float(c) * scale, float(r) * scale), false
+        };
+
+}
+
 // record that the given texture is now active
 void TextureCache::_makeActive (TileTexture *txt)
 {
@@ -42,10 +126,6 @@ void TextureCache::_makeActive (TileTexture *txt)
     if (txt->_activeIdx >= 0) {
         assert (this->_inactive[txt->_activeIdx] == txt);
 
-/** TODO: check if we are over the limit and, if so, free the
- ** resources associated with the LRU TileTexture
- */
-
       // first remove txt from the inactive list by moving the last element to where it is
         TileTexture *last = this->_inactive.back();
         this->_inactive[txt->_activeIdx] = last;
@@ -72,13 +152,134 @@ void TextureCache::_release (TileTexture *txt)
     this->_active.pop_back();
     last->_activeIdx = txt->_activeIdx;
 
-  // add txt to the inactive list
+  // add txt to the inactive list; it will be evicted by `_evict` once it is
+  // the least-recently used texture and we are over the limit
     txt->_activeIdx = this->_inactive.size();
     this->_inactive.push_back(txt);
 
-/** TODO: check if we are over the limit and, if so, free the
- ** resources associated with the TileTexture
- */
+}
+
+// add a newly loaded, but not active, texture to the inactive list
+void TextureCache::_addInactive (TileTexture *txt)
+{
+    assert (! txt->_active && (txt->_activeIdx < 0));
+
+    txt->_activeIdx = this->_inactive.size();
+    this->_inactive.push_back(txt);
+}
+
+// free the least-recently-used inactive textures until we are under the limit
+void TextureCache::_evict ()
+{
+    if (this->_numActive <= kNumActiveLimit) {
+        return;
+    }
+
+    // sort the inactive textures so that the eviction candidates are at the end
+    std::sort(this->_inactive.begin(), this->_inactive.end(), TxtCompare());
+
+    while ((this->_numActive > kNumActiveLimit) && !this->_inactive.empty()) {
+        TileTexture *txt = this->_inactive.back();
+        if ((txt->_level == 0) || (txt->_lastUsed + kEvictDelay > this->_clock)) {
+            // the remaining textures are either pinned or recently used
+            break;
+        }
+        this->_inactive.pop_back();
+        txt->_activeIdx = -1;
+        txt->_unload();
+    }
+
+    // update the indices of the remaining textures
+    for (int i = 0;  i < int(this->_inactive.size());  ++i) {
+        this->_inactive[i]->_activeIdx = i;
+    }
+
+}
+
+void TextureCache::prefetch (TileTexture *txt, float priority)
+{
+    if (txt->isResident() || txt->_queued || txt->_demanded || txt->_decoding) {
+        return;
+    }
+    txt->_queued = true;
+    this->_prefetchQ.push_back(Prefetch{priority, txt});
+    std::push_heap(this->_prefetchQ.begin(), this->_prefetchQ.end());
+}
+
+void TextureCache::cancelPrefetches ()
+{
+    // keep the requests for textures that are needed by the current frame
+    auto it = std::partition(this->_prefetchQ.begin(), this->_prefetchQ.end(),
+        [](Prefetch const &req) { return req.priority == kDemandPriority; });
+    for (auto p = it;  p != this->_prefetchQ.end();  ++p) {
+        p->txt->_queued = false;
+    }
+    this->_prefetchQ.erase(it, this->_prefetchQ.end());
+    std::make_heap(this->_prefetchQ.begin(), this->_prefetchQ.end());
+}
+
+int TextureCache::processPrefetches (int budget)
+{
+    // take the textures that are ready to upload, with the ones that are needed
+    // by the current frame first; the rest wait for the next frame
+    std::vector<Decoded> ready;
+    {
+        std::lock_guard<std::mutex> lk(this->_decodedMutex);
+        std::stable_partition(this->_decoded.begin(), this->_decoded.end(),
+            [](Decoded const &d) { return d.txt->_demanded; });
+        size_t n = std::min(size_t(std::max(budget, 0)), this->_decoded.size());
+        ready.assign(this->_decoded.begin(), this->_decoded.begin() + n);
+        this->_decoded.erase(this->_decoded.begin(), this->_decoded.begin() + n);
+    }
+
+    int nLoaded = 0;
+    for (auto &d : ready) {
+        TileTexture *txt = d.txt;
+        txt->_decoding = false;
+        txt->_demanded = false;
+        this->_nDecoding--;
+        if (txt->isResident()) {
+            // the texture was activated, which loads it, while it was being decoded
+            delete d.mipImg;
+            delete d.img;
+        } else {
+            txt->_upload (d.mipImg, d.img);
+            txt->_lastUsed = this->_clock;
+            this->_addInactive (txt);
+            nLoaded++;
+        }
+    }
+
+    // hand the most urgent requests to the workers
+    while ((this->_nDecoding < kMaxDecodes) && !this->_prefetchQ.empty()) {
+        std::pop_heap(this->_prefetchQ.begin(), this->_prefetchQ.end());
+        TileTexture *txt = this->_prefetchQ.back().txt;
+        this->_prefetchQ.pop_back();
+        if (txt->isResident()) {
+            // the texture was activated since the request was made
+            txt->_queued = false;
+            txt->_demanded = false;
+            continue;
+        } else if (txt->_decoding) {
+            // a prefetch request for a texture that was demanded; the flags are
+            // cleared when it is uploaded
+            continue;
+        }
+        // the demand flag is kept until the upload, which gives it priority
+        txt->_queued = false;
+        txt->_decoding = true;
+        this->_nDecoding++;
+        this->_decoder.submit ([this, txt] () {
+            Decoded d{txt, nullptr, nullptr};
+            txt->_decode (d.mipImg, d.img);
+            std::lock_guard<std::mutex> lk(this->_decodedMutex);
+            this->_decoded.push_back (d);
+        });
+    }
+
+    this->_evict();
+
+    return nLoaded;
 }
 
 /***** class TileTexture member functions *****/
@@ -90,7 +291,8 @@ TileTexture::TileTexture (
     bool mipmaps)
     : _txt(nullptr), _sampler(VK_NULL_HANDLE), _cache(cache), _tree(tree),
       _level(level), _row(row), _col(col),
-      _lastUsed(0), _activeIdx(-1), _active(false), _mipmaps(mipmaps)
+      _lastUsed(0), _activeIdx(-1), _active(false), _mipmaps(mipmaps), _queued(false),
+      _demanded(false), _decoding(false)
 { }
 
 TileTexture::~TileTexture ()
@@ -100,34 +302,86 @@ TileTexture::~TileTexture ()
     }
 /* FIXME: remove from cache inactive list */
     if (this->_txt != nullptr) {
-        vkDestroySampler(this->_cache->_app->device(), this->_sampler, nullptr);
-        delete this->_txt;
+        this->_unload();
     }
 }
 
+// load the texture data from the TQT and create the Vulkan texture and sampler
+void TileTexture::_load ()
+{
+    cs237::MipmapImage2D *mipImg;
+    cs237::Image2D *img;
+    this->_decode (mipImg, img);
+    this->_upload (mipImg, img);
+}
+
+// load the texture data from the TQT
+void TileTexture::_decode (cs237::MipmapImage2D *&mipImg, cs237::Image2D *&img) const
+{
+    if (this->_tree->hasMipmaps() || this->_mipmaps) {
+        // the mipmap levels either are stored in the TQT or are computed on the
+        // CPU; in either case, all of the levels are uploaded with a single copy
+        mipImg = this->_tree->loadMipmaps (this->_level, this->_row, this->_col);
+        img = nullptr;
+    } else {
+        mipImg = nullptr;
+        img = this->_tree->loadImage (this->_level, this->_row, this->_col);
+    }
+}
+
+// create the Vulkan texture and sampler for the decoded texture data
+void TileTexture::_upload (cs237::MipmapImage2D *mipImg, cs237::Image2D *img)
+{
+    assert (this->_txt == nullptr);
+
+    if (mipImg != nullptr) {
+        this->_txt = new cs237::Texture2D (this->_cache->_app, mipImg);
+        delete mipImg;
+    } else {
+        this->_txt = new cs237::Texture2D (this->_cache->_app, img, this->_mipmaps);
+        delete img;
+    }
+
+    // create the sampler for the texture
+    cs237::Application::SamplerInfo samplerInfo(
+        vk::Filter::eLinear,                    // magnification filter
+        vk::Filter::eLinear,                    // minification filter
+        vk::SamplerMipmapMode::eLinear,         // mipmap mode
+        vk::SamplerAddressMode::eClampToEdge,   // addressing mode for U coordinates
+        vk::SamplerAddressMode::eClampToEdge,   // addressing mode for V coordinates
+        vk::BorderColor::eIntOpaqueBlack);      // border color
+    this->_sampler = this->_cache->_app->createSampler (samplerInfo);
+
+    this->_cache->_numActive++;
+
+}
+
+// free the Vulkan texture and sampler
+void TileTexture::_unload ()
+{
+    assert (this->_txt != nullptr);
+    assert (! this->_active);
+
+    this->_cache->_app->device().destroySampler(this->_sampler);
+    delete this->_txt;
+    this->_txt = nullptr;
+    this->_sampler = VK_NULL_HANDLE;
+    this->_cache->_numActive--;
+
+}
+
 // preload the texture data into Vulkan; this operation is a hint to the texture
 // cache that the texture is going to be used soon.
 void TileTexture::activate ()
 {
     assert (! this->_active);
     if (this->_txt == nullptr) {
-        // load the image data from the TQT and create a texture for it
-        cs237::Image2D *img = this->_tree->loadImage (this->_level, this->_row, this->_col);
-        this->_txt = new cs237::Texture2D (this->_cache->_app, img, this->_mipmaps);
-
-        // create the sampler for the texture
-        cs237::Application::SamplerInfo samplerInfo(
-            vk::Filter::eLinear,                    // magnification filter
-            vk::Filter::eLinear,                    // minification filter
-            vk::SamplerMipmapMode::eLinear,         // mipmap mode
-            vk::SamplerAddressMode::eClampToEdge,   // addressing mode for U coordinates
-            vk::SamplerAddressMode::eClampToEdge,   // addressing mode for V coordinates
-            vk::BorderColor::eIntOpaqueBlack);      // border color
-        this->_sampler = this->_cache->_app->createSampler (samplerInfo);
+        this->_load ();
     }
 
     this->_cache->_makeActive (this);
     this->_active = true;
+    this->_lastUsed = this->_cache->_clock;
 
 }
 
@@ -16,6 +16,9 @@
 
 #include "cs237.hpp"
 #include "tqt.hpp"
+#include "flat-map.hpp"
+#include "worker-pool.hpp"
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -29,6 +32,12 @@ class TileTexture {
     //! is this texture active?
     bool isActive () const { return this->_active; }
 
+    //! is the texture data resident on the GPU?
+    bool isResident () const { return this->_txt != nullptr; }
+
+    //! the TQT level of this texture
+    int level () const { return this->_level; }
+
     //! activate the texture; this operation is a hint to the texture
     //! cache that the texture is going to be used soon.
     void activate ();
@@ -62,6 +71,13 @@ class TileTexture {
     int _activeIdx;             //!< index of this texture in the cache's _active vector
     bool _active;               //!< true when this texture is in use
     bool _mipmaps;              //!< should we generate mipmaps for the texture?
+    bool _queued;               //!< true when there is a pending prefetch request for
+                                //!  this texture
+    bool _demanded;             //!< true when there is a pending request for this
+                                //!  texture from `TextureCache::bestResident`; it
+                                //!  stays set until the texture is uploaded
+    bool _decoding;             //!< true from when the texture's data is handed to a
+                                //!  worker thread until it is uploaded
 
     TileTexture (
         TextureCache *cache,
@@ -69,10 +85,37 @@ class TileTexture {
         int level, int row, int col,
         bool mipmaps);
 
+    //! load the texture data from the TQT and create the Vulkan texture and sampler
+    void _load ();
+
+    //! \brief load the texture data from the TQT; this function does not touch the
+    //!        GPU, so it can be run on a worker thread
+    //! \param[out] mipImg  set to the mipmap chain when the texture has mipmaps
+    //!                     that are stored in the TQT or computed on the CPU
+    //! \param[out] img     set to the image otherwise
+    void _decode (cs237::MipmapImage2D *&mipImg, cs237::Image2D *&img) const;
+
+    //! \brief create the Vulkan texture and sampler from the data returned by
+    //!        `_decode`, which is freed
+    void _upload (cs237::MipmapImage2D *mipImg, cs237::Image2D *img);
+
+    //! free the Vulkan texture and sampler
+    void _unload ();
+
     friend class TextureCache;
     friend struct TxtCompare;
 };
 
+//! A resident texture that can be used in place of a requested texture, along
+//! with the transform that maps the requested tile's texture coordinates into it.
+//! The texture coordinates for the tile are computed as `uvScale * uv + uvOffset`.
+struct ResidentTexture {
+    TileTexture *txt;           //!< the resident texture
+    glm::vec2 uvScale;          //!< scaling applied to the tile's texture coordinates
+    glm::vec2 uvOffset;         //!< offset applied to the scaled texture coordinates
+    bool exact;                 //!< true if `txt` is the requested texture
+};
+
 //! A cache of Vulkan textures that is backed by texture-quad-trees
 class TextureCache {
   public:
@@ -91,59 +134,124 @@ class TextureCache {
   //! \return the texture for the tile
     TileTexture *make (tqt::TextureQTree *tree, int level, int row, int col);
 
+  //! \brief get the best resident texture for the specified quad in the texture quad tree
+  //! \param tree    the TQT to get the source image data from
+  //! \param level   the TQT level of the texture
+  //! \param row     the TQT row of the texture
+  //! \param col     the TQT column of the texture
+  //! \return the requested texture, if it is resident, or else its nearest resident
+  //!         ancestor together with the transform from the requested tile's texture
+  //!         coordinates to the ancestor's.
+  //!
+  //! If the requested texture is not resident, then a high-priority request to load it
+  //! is queued.  The request is decoded by a worker thread and uploaded by
+  //! `processPrefetches` ahead of any prefetched textures, so the caller never waits
+  //! for it; the ancestor is returned until then.  The root of the TQT is loaded on
+  //! demand if necessary and is never evicted, so a texture is always returned.
+    ResidentTexture bestResident (tqt::TextureQTree *tree, int level, int row, int col);
+
   //! mark the beginning of a new frame; the texture cache uses this information to
   //! track LRU information
-    void newFrame () { this->_clock++; }
+    void newFrame ()
+    {
+        this->_clock++;
+        this->_evict();
+    }
+
+  //! \brief request that a texture be made resident ahead of its use.
+  //! \param txt       the texture to load
+  //! \param priority  the priority of the request; requests with lower values
+  //!                  are serviced first
+  //!
+  //! Prefetch requests are low priority; they are only serviced by `processPrefetches`
+  //! and may be discarded by `cancelPrefetches`.  Requests for textures that are
+  //! already resident or already queued are ignored.
+    void prefetch (TileTexture *txt, float priority);
+
+  //! discard any pending prefetch requests; requests queued by `bestResident`
+  //! are kept
+    void cancelPrefetches ();
+
+  //! \brief service pending prefetch requests.
+  //! \param budget  the maximum number of textures to upload
+  //! \return the number of textures that were made resident
+  //!
+  //! The textures are decoded (and their mipmaps are computed) by worker threads,
+  //! so this function only uploads the textures that have finished decoding, which
+  //! become resident, but are not activated, and then hands the most urgent
+  //! pending requests to the workers.
+    int processPrefetches (int budget);
+
+  //! the number of pending prefetch requests
+    size_t numPendingPrefetches () const { return this->_prefetchQ.size(); }
 
   private:
     cs237::Application *_app;   //!< application pointer
     uint64_t _numActive;        //!< number of GPU resident textures
     uint64_t _clock;            //!< counts number of frames
 
-    //! keys for hashing texture specifications
-    struct Key {
-        tqt::TextureQTree       *_tree; //!< the texture quadtree from which this texture comes
-        int                     _level; //!< the TQT level of this texture
-        int                     _row;   //!< the TQT row of this texture
-        int                     _col;   //!< the TQT column of this texture
+    //! \brief pack a texture specification into a 64-bit key
+    //! \param treeId  the cache's ID for the TQT (see `_treeId`)
+    //! \param level   the TQT level of the texture
+    //! \param row     the TQT row of the texture
+    //! \param col     the TQT column of the texture
+    //!
+    //! The key has 20 bits for the tree ID, 6 bits for the level, and 19 bits each
+    //! for the row and column, which is enough for TQTs with up to 20 levels.
+    static uint64_t _key (uint32_t treeId, int level, int row, int col)
+    {
+        assert ((treeId < (1u << 20)) && (level < 64));
+        assert ((uint32_t(row) < (1u << 19)) && (uint32_t(col) < (1u << 19)));
+        return (uint64_t(treeId) << 44) | (uint64_t(level) << 38)
+            | (uint64_t(row) << 19) | uint64_t(col);
+    }
 
-        Key (tqt::TextureQTree *t, int l, int r, int c)
-            : _tree(t), _level(l), _row(r), _col(c)
-        { }
-    };
-    //! hashing keys
-    struct Hash {
-        std::size_t operator() (Key const &k) const
-        {
-            return static_cast<std::size_t>(
-                reinterpret_cast<std::size_t>(k._tree) +
-                (static_cast<int>(k._level) << 5) * 101 +
-                (static_cast<int>(k._row) << 10) * 101 +
-                static_cast<int>(k._col));
-        }
-    };
-    //! equality test on keys
-    struct Equal {
-        bool operator()(Key const &k1, Key const &k2) const
+    // for ordering textures by timestamp (most recently used first); the roots of
+    // the TQTs are pinned, so they are ordered before all other textures
+    struct TxtCompare {
+        bool operator() (const TileTexture *lhs, const TileTexture *rhs) const
         {
-            return (k1._tree == k2._tree) && (k1._level == k2._level)
-                && (k1._row == k2._row) && (k1._col == k2._col);
+            if ((lhs->_level == 0) != (rhs->_level == 0)) {
+                return (lhs->_level == 0);
+            }
+            return (lhs->_lastUsed > rhs->_lastUsed);
         }
     };
 
-    // for ordering textures by timestamp
-    struct TxtCompare {
-        bool operator() (const TileTexture &lhs, const TileTexture &rhs) const
+    typedef FlatMap<TileTexture *> TextureTbl;
+
+    //! a pending prefetch request
+    struct Prefetch {
+        float priority;         //!< the request's priority (lower is more urgent)
+        TileTexture *txt;       //!< the texture to load
+
+        //! ordering for a min-heap on priority
+        bool operator< (Prefetch const &other) const
         {
-            return (lhs._lastUsed > rhs._lastUsed);
+            return this->priority > other.priority;
         }
     };
 
-    typedef std::unordered_map<Key,TileTexture *,Hash,Equal> TextureTbl;
+    //! a texture whose data has been decoded by a worker thread
+    struct Decoded {
+        TileTexture *txt;               //!< the texture
+        cs237::MipmapImage2D *mipImg;   //!< the mipmap chain (or nullptr)
+        cs237::Image2D *img;            //!< the image (or nullptr)
+    };
 
     TextureTbl _textureTbl;             //!< mapping from TQT spec to TileTexture
+    std::unordered_map<tqt::TextureQTree *, uint32_t> _treeIds;
+                                        //!< small integer IDs for the TQTs
+    tqt::TextureQTree *_lastTree;       //!< the most recent argument to `_treeId`
+    uint32_t _lastTreeId;               //!< the ID of `_lastTree`
     std::vector<TileTexture *> _active; //!< active textures
     std::vector<TileTexture *> _inactive; //!< inactive textures that are loaded, but may be reused.
+    std::vector<Prefetch> _prefetchQ;   //!< heap of pending prefetch requests
+    uint32_t _nDecoding;                //!< the number of textures that have been handed
+                                        //!  to the workers, but not yet uploaded
+    std::mutex _decodedMutex;           //!< protects _decoded
+    std::vector<Decoded> _decoded;      //!< textures that are ready to upload
+    WorkerPool _decoder;                //!< the threads that decode textures
 
     //! record that the given texture is now active
     void _makeActive (TileTexture *txt);
@@ -151,6 +259,25 @@ class TextureCache {
     //! record that the given texture is now inactive
     void _release (TileTexture *txt);
 
+    //! get the ID for a TQT; since consecutive requests are usually for the same
+    //! tree, the most recent result is cached
+    uint32_t _treeId (tqt::TextureQTree *tree)
+    {
+        if (tree != this->_lastTree) {
+            auto res = this->_treeIds.insert({tree, uint32_t(this->_treeIds.size())});
+            this->_lastTree = tree;
+            this->_lastTreeId = res.first->second;
+        }
+        return this->_lastTreeId;
+    }
+
+    //! add a newly loaded, but not active, texture to the inactive list
+    void _addInactive (TileTexture *txt);
+
+    //! if there are more resident textures than the limit, then free the
+    //! least-recently-used inactive textures
+    void _evict ();
+
     friend class TileTexture;
 };
 
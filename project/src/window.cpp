@@ -14,6 +14,8 @@
 #include "map-cell.hpp"
 #include "vao.hpp"
 #include "texture-cache.hpp"
+#include "prefetch.hpp"
+#include "instancing.hpp"
 
 constexpr double kTimeStep = 0.001;     //! animation/physics timestep
 
@@ -62,12 +64,13 @@ Window::Window (Project *app, cs237::CreateWindowInfo const &info, Map *map)
     for (int r = 0;  r < map->nRows(); r++) {
         for (int c = 0;  c < map->nCols();  c++) {
             Cell *cell = map->cell(r, c);
-            if (map->hasAssets()) {
-                cell->loadObjects();
-            }
             cell->initTextures (this);
         }
     }
+    this->_prefetcher = new TexturePrefetcher(map, this->_tCache);
+    // the map only has objects when it has an assets directory (and PART2 is
+    // enabled), so the batcher is only needed in that case
+    this->_instances = (map->objects() != nullptr) ? new InstanceBatcher(app) : nullptr;
 
     /***** Vulkan initialization *****/
 
@@ -98,6 +101,11 @@ Window::~Window ()
 
     vkDestroyRenderPass(device, this->_renderPass, nullptr);
 
+    delete this->_prefetcher;
+    delete this->_instances;
+    // the texture cache waits for its decoding threads, which read the map's TQTs
+    delete this->_tCache;
+
     /** HINT: release other allocated objects */
 
 }
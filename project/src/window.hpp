@@ -79,6 +79,9 @@ private:
 
     // resource management
     class TextureCache *_tCache;        ///< cache of textures
+    class TexturePrefetcher *_prefetcher; ///< predictive texture prefetcher
+    class InstanceBatcher *_instances;  ///< batches of object instances for instanced
+                                        ///  drawing (nullptr if the map has no objects)
 
     vk::RenderPass _renderPass;         ///< the render pass for drawing
     vk::CommandBuffer _cmdBuf;          ///< the command buffer
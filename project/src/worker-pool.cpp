@@ -0,0 +1,83 @@
+/*! \file worker-pool.cpp
+ *
+ * \author John Reppy
+ *
+ * A pool of worker threads for loading assets in the background.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "worker-pool.hpp"
+#include <algorithm>
+
+WorkerPool::WorkerPool (unsigned int nThreads)
+  : _nPending(0), _shutdown(false)
+{
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned int i = 0;  i < nThreads;  i++) {
+        this->_threads.push_back (std::thread(&WorkerPool::_worker, this));
+    }
+}
+
+WorkerPool::~WorkerPool ()
+{
+    this->wait ();
+    {
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        this->_shutdown = true;
+    }
+    this->_workCV.notify_all ();
+    for (auto &t : this->_threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::submit (std::function<void ()> task)
+{
+    {
+        std::lock_guard<std::mutex> lk(this->_mutex);
+        this->_queue.push_back (std::move(task));
+        this->_nPending++;
+    }
+    this->_workCV.notify_one ();
+}
+
+void WorkerPool::wait ()
+{
+    std::unique_lock<std::mutex> lk(this->_mutex);
+    this->_doneCV.wait (lk, [this] { return (this->_nPending == 0); });
+}
+
+bool WorkerPool::isIdle ()
+{
+    std::lock_guard<std::mutex> lk(this->_mutex);
+    return (this->_nPending == 0);
+}
+
+void WorkerPool::_worker ()
+{
+    std::unique_lock<std::mutex> lk(this->_mutex);
+    while (true) {
+        this->_workCV.wait (lk, [this] { return this->_shutdown || !this->_queue.empty(); });
+        if (this->_queue.empty()) {
+            // shutdown
+            return;
+        }
+        std::function<void ()> task = std::move(this->_queue.front());
+        this->_queue.pop_front();
+        lk.unlock();
+        task ();
+        lk.lock();
+        // a task that submits other tasks does so before it completes, so the
+        // count only reaches zero when the whole graph of tasks is done
+        if (--this->_nPending == 0) {
+            this->_doneCV.notify_all ();
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*! \file worker-pool.hpp
+ *
+ * \author John Reppy
+ *
+ * A pool of worker threads for loading assets in the background.  Tasks are run
+ * in the order that they are submitted, and a task may submit further tasks, which
+ * is how loads that depend on other loads (e.g., the textures of a model) are
+ * expressed.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2023)
+ *
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _WORKER_POOL_HPP_
+#define _WORKER_POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+  public:
+    //! \brief create a pool of worker threads
+    //! \param nThreads  the number of threads; 0 (the default) means use all of the
+    //!                  hardware threads
+    explicit WorkerPool (unsigned int nThreads = 0);
+
+    //! wait for the pending tasks and then stop the threads
+    ~WorkerPool ();
+
+    //! the number of worker threads
+    unsigned int numThreads () const { return this->_threads.size(); }
+
+    //! \brief add a task to the pool; this function may be called by tasks
+    //! \param task  the task to run on one of the worker threads
+    void submit (std::function<void ()> task);
+
+    //! wait until all of the submitted tasks, including any tasks that they
+    //! submit, have completed
+    void wait ();
+
+    //! are there no pending tasks?
+    bool isIdle ();
+
+  private:
+    std::mutex _mutex;                          //!< protects the following fields
+    std::condition_variable _workCV;            //!< signaled when a task is queued or on
+                                                //!  shutdown
+    std::condition_variable _doneCV;            //!< signaled when the pool becomes idle
+    std::deque<std::function<void ()>> _queue;  //!< tasks that have not started
+    uint32_t _nPending;                         //!< the number of queued and running tasks
+    bool _shutdown;                             //!< true when the threads should exit
+    std::vector<std::thread> _threads;          //!< the worker threads
+
+    //! the main loop of a worker thread
+    void _worker ();
+};
+
+#endif //! _WORKER_POOL_HPP_
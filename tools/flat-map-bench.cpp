@@ -0,0 +1,223 @@
+/*! \file flat-map-bench.cpp
+ *
+ * A benchmark that compares the `FlatMap` hash table that the texture cache uses
+ * to map tile specifications to textures with the `std::unordered_map` that it
+ * used before.  The workload mimics the texture cache: the keys are the tiles of
+ * a number of texture quadtrees, which are inserted on first use, and each frame
+ * looks up the tiles around a moving point of interest, most of which are already
+ * in the table.
+ *
+ * Usage:
+ *
+ *      flat-map-bench [ -trees <n> ] [ -depth <d> ] [ -frames <n> ]
+ *
+ * The defaults are 32 trees (i.e., 16 cells with color and normal maps), depth 9,
+ * and 2000 frames.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "flat-map.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static void usage ()
+{
+    std::cerr << "usage: flat-map-bench [ -trees <n> ] [ -depth <d> ] [ -frames <n> ]\n";
+    exit (1);
+}
+
+// a tile specification; the tree is represented by an opaque pointer, as in
+// the texture cache
+struct Tile {
+    const void *tree;
+    int level;
+    int row;
+    int col;
+};
+
+/***** the old texture table *****/
+
+struct OldKey {
+    const void *_tree;
+    int _level;
+    int _row;
+    int _col;
+
+    OldKey (const void *t, int l, int r, int c)
+        : _tree(t), _level(l), _row(r), _col(c)
+    { }
+};
+
+struct OldHash {
+    std::size_t operator() (OldKey const &k) const
+    {
+        return static_cast<std::size_t>(
+            reinterpret_cast<std::size_t>(k._tree) +
+            (static_cast<int>(k._level) << 5) * 101 +
+            (static_cast<int>(k._row) << 10) * 101 +
+            static_cast<int>(k._col));
+    }
+};
+
+struct OldEqual {
+    bool operator()(OldKey const &k1, OldKey const &k2) const
+    {
+        return (k1._tree == k2._tree) && (k1._level == k2._level)
+            && (k1._row == k2._row) && (k1._col == k2._col);
+    }
+};
+
+struct OldTable {
+    std::unordered_map<OldKey, uint32_t, OldHash, OldEqual> tbl;
+    uint32_t next = 0;
+
+    uint32_t make (Tile const &t)
+    {
+        OldKey key(t.tree, t.level, t.row, t.col);
+        auto got = this->tbl.find(key);
+        if (got == this->tbl.end()) {
+            uint32_t v = this->next++;
+            this->tbl.insert(std::pair<OldKey, uint32_t>(key, v));
+            return v;
+        }
+        return got->second;
+    }
+};
+
+/***** the new texture table *****/
+
+struct NewTable {
+    FlatMap<uint32_t> tbl;
+    std::unordered_map<const void *, uint32_t> treeIds;
+    const void *lastTree = nullptr;
+    uint32_t lastTreeId = 0;
+    uint32_t next = 0;
+
+    NewTable () : tbl(4096) { }
+
+    // the same key packing as `TextureCache::_key`
+    uint64_t key (Tile const &t)
+    {
+        if (t.tree != this->lastTree) {
+            auto res = this->treeIds.insert({t.tree, uint32_t(this->treeIds.size())});
+            this->lastTree = t.tree;
+            this->lastTreeId = res.first->second;
+        }
+        return (uint64_t(this->lastTreeId) << 44) | (uint64_t(t.level) << 38)
+            | (uint64_t(t.row) << 19) | uint64_t(t.col);
+    }
+
+    uint32_t make (Tile const &t)
+    {
+        uint64_t k = this->key(t);
+        uint32_t *got = this->tbl.find(k);
+        if (got == nullptr) {
+            uint32_t v = this->next++;
+            this->tbl.insert(k, v);
+            return v;
+        }
+        return *got;
+    }
+};
+
+// generate the tile requests for the frames.  Each frame requests, for every
+// tree, the tiles in a window around a point of interest that drifts across the
+// map, at a few of the finer levels and all of the coarser ones.
+static std::vector<std::vector<Tile>> genFrames (int nTrees, int depth, int nFrames)
+{
+    std::vector<char> trees(nTrees);      // the addresses stand in for the TQTs
+    std::mt19937 rng(23);
+    std::uniform_real_distribution<double> jitter(-0.002, 0.002);
+
+    std::vector<std::vector<Tile>> frames(nFrames);
+    double x = 0.1, y = 0.1;
+    for (int f = 0;  f < nFrames;  ++f) {
+        x = std::min(0.9, std::max(0.1, x + 0.0004 + jitter(rng)));
+        y = std::min(0.9, std::max(0.1, y + 0.0003 + jitter(rng)));
+        for (int t = 0;  t < nTrees;  ++t) {
+            for (int level = 0;  level < depth;  ++level) {
+                int n = 1 << level;
+                int r0 = int(y * n), c0 = int(x * n);
+                int rad = (level < 3) ? n : 2;
+                for (int r = std::max(0, r0 - rad);  r <= std::min(n - 1, r0 + rad);  ++r) {
+                    for (int c = std::max(0, c0 - rad);  c <= std::min(n - 1, c0 + rad);  ++c) {
+                        frames[f].push_back(Tile{&trees[t], level, r, c});
+                    }
+                }
+            }
+        }
+    }
+    return frames;
+}
+
+// run the workload on a table and report the time per lookup
+template <typename Tbl>
+static uint64_t bench (
+    const char *name,
+    std::vector<std::vector<Tile>> const &frames,
+    size_t nLookups)
+{
+    Tbl tbl;
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const &frame : frames) {
+        for (auto const &t : frame) {
+            sum += tbl.make(t);
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << ms << " ms ("
+        << (ms * 1.0e6 / double(nLookups)) << " ns/lookup, "
+        << tbl.next << " entries)\n";
+    return sum;
+}
+
+int main (int argc, char *argv[])
+{
+    int nTrees = 32;
+    int depth = 9;
+    int nFrames = 2000;
+
+    for (int i = 1;  i < argc;  ++i) {
+        std::string opt(argv[i]);
+        if (i + 1 >= argc) {
+            usage();
+        }
+        if (opt == "-trees") { nTrees = std::atoi(argv[++i]); }
+        else if (opt == "-depth") { depth = std::atoi(argv[++i]); }
+        else if (opt == "-frames") { nFrames = std::atoi(argv[++i]); }
+        else { usage(); }
+    }
+    if ((nTrees <= 0) || (depth <= 0) || (depth > 19) || (nFrames <= 0)) {
+        usage();
+    }
+
+    auto frames = genFrames (nTrees, depth, nFrames);
+    size_t nLookups = 0;
+    for (auto const &frame : frames) {
+        nLookups += frame.size();
+    }
+    std::cout << nLookups << " lookups over " << nFrames << " frames\n";
+
+    // the values are assigned in order of first use, so the checksums must agree
+    uint64_t oldSum = bench<OldTable> ("std::unordered_map", frames, nLookups);
+    uint64_t newSum = bench<NewTable> ("FlatMap", frames, nLookups);
+    if (oldSum != newSum) {
+        std::cerr << "flat-map-bench: tables disagree\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/*! \file json-bench.cpp
+ *
+ * A benchmark for the JSON parser on a generated objects.json file.
+ *
+ * Usage:
+ *
+ *      json-bench [ -n <instances> ] [ -o <file> ]
+ *
+ * An objects list with the given number of instances (default 100000) is
+ * generated, written to a file (a temporary file unless -o is specified), and
+ * then parsed both with a `json::Reader` and into a `json::Document`.  The tool
+ * also checks that the parser converts numbers with correct rounding by parsing
+ * random doubles printed with 17 significant digits, which must round trip
+ * exactly.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "json.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+static void usage ()
+{
+    std::cerr << "usage: json-bench [ -n <instances> ] [ -o <file> ]\n";
+    exit (1);
+}
+
+// append a number with the given format to a string
+static void addNum (std::string &s, const char *fmt, double x)
+{
+    char buf[64];
+    std::snprintf (buf, sizeof(buf), fmt, x);
+    s += buf;
+}
+
+// append a JSON object with three numeric fields
+static void addVec3 (
+    std::string &s, const char *k0, const char *k1, const char *k2,
+    double x, double y, double z)
+{
+    s += "{\""; s += k0; s += "\": "; addNum (s, "%.6f", x);
+    s += ", \""; s += k1; s += "\": "; addNum (s, "%.6f", y);
+    s += ", \""; s += k2; s += "\": "; addNum (s, "%.6f", z);
+    s += "}";
+}
+
+// generate an objects list with n instances
+static std::string genObjects (int n)
+{
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<double> posDist(0.0, 4096.0);
+    std::uniform_real_distribution<double> unitDist(-1.0, 1.0);
+    std::uniform_real_distribution<double> colorDist(0.0, 1.0);
+
+    std::string s = "[\n";
+    for (int i = 0;  i < n;  ++i) {
+        if (i > 0) {
+            s += ",\n";
+        }
+        s += "  { \"file\": \"models/tree-" + std::to_string(i % 8) + ".obj\",\n";
+        s += "    \"pos\": ";
+        addVec3 (s, "x", "y", "z", posDist(rng), posDist(rng) / 16.0, posDist(rng));
+        s += ",\n    \"frame\": {\n      \"x-axis\": ";
+        addVec3 (s, "x", "y", "z", unitDist(rng), unitDist(rng), unitDist(rng));
+        s += ",\n      \"y-axis\": ";
+        addVec3 (s, "x", "y", "z", unitDist(rng), unitDist(rng), unitDist(rng));
+        s += ",\n      \"z-axis\": ";
+        addVec3 (s, "x", "y", "z", unitDist(rng), unitDist(rng), unitDist(rng));
+        s += "\n    },\n    \"color\": ";
+        addVec3 (s, "r", "g", "b", colorDist(rng), colorDist(rng), colorDist(rng));
+        if (i % 10 == 0) {
+            s += ",\n    \"transparent\": true";
+        }
+        s += "\n  }";
+    }
+    s += "\n]\n";
+
+    return s;
+}
+
+// check that random doubles printed with %.17g round trip exactly
+static bool checkRounding (int n)
+{
+    std::mt19937_64 rng(42);
+    std::vector<double> vals;
+    vals.reserve (n);
+    for (int i = 0;  i < n;  ++i) {
+        // random bit patterns cover the whole range of exponents
+        uint64_t bits = rng();
+        double x;
+        std::memcpy (&x, &bits, sizeof(x));
+        if (std::isfinite(x)) {
+            vals.push_back (x);
+        }
+    }
+    // add some short decimals, which take the fast path
+    for (int i = 0;  i < n;  ++i) {
+        vals.push_back (double(rng() % 10000000) / 1000.0);
+    }
+
+    std::string s = "[";
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        if (i > 0) {
+            s += ",";
+        }
+        addNum (s, "%.17g", vals[i]);
+    }
+    s += "]";
+
+    json::Reader rd(s.data(), s.size());
+    if (rd.next() != json::Reader::Event::BeginArray) {
+        return false;
+    }
+    size_t nBad = 0;
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        json::Reader::Event ev = rd.next();
+        if (((ev != json::Reader::Event::Real) && (ev != json::Reader::Event::Integer))
+        ||  (rd.realVal() != vals[i])) {
+            if (nBad++ < 10) {
+                std::fprintf (stderr, "  mismatch: expected %.17g, got %.17g\n",
+                    vals[i], rd.realVal());
+            }
+        }
+    }
+    std::cout << "rounding check: " << vals.size() << " numbers, " << nBad << " mismatches\n";
+    return (nBad == 0);
+}
+
+int main (int argc, char *argv[])
+{
+    int nInstances = 100000;
+    std::string file;
+    int argi = 1;
+
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        std::string opt(argv[argi++]);
+        if ((opt == "-n") && (argi < argc)) { nInstances = std::atoi(argv[argi++]); }
+        else if ((opt == "-o") && (argi < argc)) { file = argv[argi++]; }
+        else { usage(); }
+    }
+    if ((argi != argc) || (nInstances <= 0)) {
+        usage();
+    }
+    bool isTmp = file.empty();
+    if (isTmp) {
+        file = (std::filesystem::temp_directory_path() / "json-bench.json").string();
+    }
+
+    {
+        std::string text = genObjects (nInstances);
+        std::ofstream outS(file, std::ios::binary);
+        outS.write (text.data(), text.size());
+        if (outS.fail()) {
+            std::cerr << "json-bench: unable to write \"" << file << "\"\n";
+            exit (1);
+        }
+        std::cout << "generated " << nInstances << " instances ("
+            << (double(text.size()) / (1024.0 * 1024.0)) << " MB)\n";
+    }
+
+    // parse with the pull parser, summing the numbers
+    {
+        auto start = std::chrono::steady_clock::now();
+        json::Reader rd(file);
+        json::Reader::Event ev;
+        size_t nNums = 0;
+        double sum = 0.0;
+        while ((ev = rd.next()) != json::Reader::Event::End) {
+            if (ev == json::Reader::Event::Error) {
+                exit (1);
+            }
+            else if ((ev == json::Reader::Event::Real) || (ev == json::Reader::Event::Integer)) {
+                sum += rd.realVal();
+                nNums++;
+            }
+        }
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        std::cout << "reader: " << (t.count() * 1000.0) << " ms; "
+            << nNums << " numbers (sum = " << sum << ")\n";
+    }
+
+    // parse into a document
+    {
+        auto start = std::chrono::steady_clock::now();
+        json::Document doc;
+        if (! doc.parseFile (file)) {
+            exit (1);
+        }
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        std::cout << "document: " << (t.count() * 1000.0) << " ms; arena = "
+            << (double(doc.arena().nBytes()) / (1024.0 * 1024.0)) << " MB\n";
+    }
+
+    if (isTmp) {
+        std::remove (file.c_str());
+    }
+
+    return checkRounding (100000) ? 0 : 1;
+
+}
@@ -0,0 +1,171 @@
+/*! \file mesh-opt-bench.cpp
+ *
+ * A benchmark for the mesh optimization that is applied to the groups of OBJ
+ * models.
+ *
+ * Usage:
+ *
+ *      mesh-opt-bench [ -n <size> ] [ <file.obj> ... ]
+ *
+ * For each OBJ file, the tool loads the model with and without optimization and
+ * reports the average cache miss ratio (ACMR) of each group for several cache
+ * sizes.  If no files are given, then a sphere with <size> x <size> quads
+ * (default 256) whose triangles are in random order is generated, written to a
+ * temporary file, and used instead.  The tool also reports the size of each
+ * group's vertex and index data before and after quantization (see
+ * `OBJ::pack`), the largest position and normal errors introduced by the
+ * quantization, and the triangle counts and geometric errors of each group's
+ * levels of detail.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "obj.hpp"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+static void usage ()
+{
+    std::cerr << "usage: mesh-opt-bench [ -n <size> ] [ <file.obj> ... ]\n";
+    exit (1);
+}
+
+// generate a UV sphere with n x n quads whose triangles are shuffled
+static void genSphere (std::string const &file, int n)
+{
+    std::ofstream outS(file);
+    for (int i = 0;  i <= n;  i++) {
+        float phi = float(M_PI) * float(i) / float(n);
+        for (int j = 0;  j <= n;  j++) {
+            float theta = 2.0f * float(M_PI) * float(j) / float(n);
+            float x = std::sin(phi) * std::cos(theta);
+            float y = std::cos(phi);
+            float z = std::sin(phi) * std::sin(theta);
+            outS << "v " << x << " " << y << " " << z << "\n";
+            outS << "vn " << x << " " << y << " " << z << "\n";
+        }
+    }
+    std::vector<std::string> faces;
+    auto vtx = [n] (int i, int j) {
+        int v = i * (n + 1) + j + 1;
+        return std::to_string(v) + "//" + std::to_string(v);
+    };
+    for (int i = 0;  i < n;  i++) {
+        for (int j = 0;  j < n;  j++) {
+            faces.push_back ("f " + vtx(i, j) + " " + vtx(i+1, j) + " " + vtx(i+1, j+1));
+            faces.push_back ("f " + vtx(i, j) + " " + vtx(i+1, j+1) + " " + vtx(i, j+1));
+        }
+    }
+    std::shuffle (faces.begin(), faces.end(), std::mt19937(17));
+    outS << "g sphere\n";
+    for (auto &f : faces) {
+        outS << f << "\n";
+    }
+    if (outS.fail()) {
+        std::cerr << "mesh-opt-bench: unable to write \"" << file << "\"\n";
+        exit (1);
+    }
+}
+
+// load a model and report the time
+static OBJ::Model *load (std::string const &file, bool optimize, double &ms)
+{
+    auto start = std::chrono::steady_clock::now();
+    OBJ::Model *model = new OBJ::Model (file, optimize, 0);
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    ms = t.count() * 1000.0;
+    return model;
+}
+
+static void bench (std::string const &file)
+{
+    double t0, t1;
+    OBJ::Model *orig = load (file, false, t0);
+    OBJ::Model *opt = load (file, true, t1);
+
+    std::cout << file << ": load " << t0 << " ms unoptimized, "
+        << t1 << " ms optimized\n";
+    std::printf ("  %-24s %10s %16s %16s %16s\n",
+        "group", "triangles", "ACMR(12)", "ACMR(16)", "ACMR(32)");
+    for (int i = 0;  i < orig->numGroups();  i++) {
+        OBJ::Group const &a = orig->group(i);
+        OBJ::Group const &b = opt->group(i);
+        std::printf ("  %-24s %10u", a.name.c_str(), a.nIndices / 3);
+        for (uint32_t k : { 12u, 16u, 32u }) {
+            std::printf ("   %5.3f -> %5.3f", OBJ::acmr(a, k), OBJ::acmr(b, k));
+        }
+        std::printf ("\n");
+    }
+
+    std::printf ("  %-24s %10s %10s %12s %12s\n",
+        "group", "bytes", "packed", "pos error", "norm error");
+    for (int i = 0;  i < opt->numGroups();  i++) {
+        OBJ::Group const &g = opt->group(i);
+        OBJ::PackedGroup pg = OBJ::pack (g);
+        size_t bytes = size_t(g.nVerts) * sizeof(glm::vec3) + size_t(g.totalIndices()) * sizeof(uint32_t);
+        if (g.norms != nullptr) { bytes += size_t(g.nVerts) * sizeof(glm::vec3); }
+        if (g.txtCoords != nullptr) { bytes += size_t(g.nVerts) * sizeof(glm::vec2); }
+        float posErr = 0.0f, normErr = 0.0f;
+        for (uint32_t j = 0;  j < g.nVerts;  j++) {
+            posErr = std::max(posErr, glm::length(pg.pos(j) - g.verts[j]));
+            if (g.norms != nullptr) {
+                float d = glm::dot(pg.norm(j), glm::normalize(g.norms[j]));
+                normErr = std::max(normErr, glm::degrees(std::acos(std::min(d, 1.0f))));
+            }
+        }
+        std::printf ("  %-24s %10zu %10zu %12.3g %10.3g deg\n",
+            g.name.c_str(), bytes, pg.sizeInBytes(), posErr, normErr);
+    }
+
+    std::printf ("  %-24s %5s %10s %12s\n", "group", "LOD", "triangles", "error");
+    for (int i = 0;  i < opt->numGroups();  i++) {
+        OBJ::Group const &g = opt->group(i);
+        for (uint32_t j = 0;  j < g.nLODs;  j++) {
+            std::printf ("  %-24s %5u %10u %12.4g\n",
+                (j == 0) ? g.name.c_str() : "", j, g.lods[j].nIndices / 3, g.lods[j].error);
+        }
+    }
+
+    delete orig;
+    delete opt;
+}
+
+int main (int argc, char *argv[])
+{
+    int size = 256;
+    int argi = 1;
+
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        std::string opt(argv[argi++]);
+        if ((opt == "-n") && (argi < argc)) { size = std::atoi(argv[argi++]); }
+        else { usage(); }
+    }
+    if (size <= 1) {
+        usage();
+    }
+
+    if (argi == argc) {
+        std::string file =
+            (std::filesystem::temp_directory_path() / "mesh-opt-bench.obj").string();
+        genSphere (file, size);
+        bench (file);
+        std::remove (file.c_str());
+    }
+    else {
+        for (;  argi < argc;  argi++) {
+            bench (argv[argi]);
+        }
+    }
+
+    return 0;
+
+}
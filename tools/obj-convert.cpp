@@ -0,0 +1,168 @@
+/*! \file obj-convert.cpp
+ *
+ * A tool for converting OBJ models to binary model files and for validating
+ * existing binary model files.
+ *
+ * Usage:
+ *
+ *      obj-convert [ -check ] <file.obj> ...
+ *
+ * For each OBJ file "foo.obj", the tool writes the binary model file
+ * "foo.obj.bin" (see `OBJ::Model::binaryPath`).  With the -check flag, the
+ * tool instead validates the existing binary files: it checks that they are up
+ * to date with respect to their sources, that their indices and material
+ * references are in range, and that their contents match the result of parsing
+ * the OBJ file.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "obj.hpp"
+#include <chrono>
+#include <cstring>
+
+static void usage ()
+{
+    std::cerr << "usage: obj-convert [ -check ] <file.obj> ...\n";
+    exit (1);
+}
+
+// compare two arrays, either of which may be null
+template <typename T>
+static bool sameArray (const T *a, const T *b, uint32_t n)
+{
+    if ((a == nullptr) || (b == nullptr)) {
+        return (a == b);
+    }
+    return (std::memcmp (a, b, n * sizeof(T)) == 0);
+}
+
+// check a binary model against its source; returns the number of problems
+static int check (std::string const &objFile)
+{
+    std::string binFile = OBJ::Model::binaryPath (objFile);
+    int nErrs = 0;
+    auto err = [&nErrs, &binFile] (std::string const &msg) {
+        std::cerr << binFile << ": " << msg << "\n";
+        nErrs++;
+    };
+
+    if (! OBJ::Model::isBinaryCurrent (binFile, objFile)) {
+        err ("missing or out of date");
+        return nErrs;
+    }
+    auto start = std::chrono::steady_clock::now();
+    OBJ::Model *bin = OBJ::Model::readBinary (binFile, objFile);
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    if (bin == nullptr) {
+        err ("invalid binary model file");
+        return nErrs;
+    }
+
+    // check the internal consistency of the binary model
+    for (int i = 0;  i < bin->numGroups();  i++) {
+        OBJ::Group const &g = bin->group(i);
+        if ((g.material < -1) || (g.material >= bin->numMaterials())) {
+            err ("group \"" + g.name + "\" has an invalid material");
+        }
+        if (g.nIndices % 3 != 0) {
+            err ("group \"" + g.name + "\" has a partial triangle");
+        }
+        for (uint32_t j = 1;  j < g.nLODs;  j++) {
+            if (g.lods[j].error < g.lods[j-1].error) {
+                err ("group \"" + g.name + "\" has levels of detail out of order");
+                break;
+            }
+        }
+        for (uint32_t j = 0;  j < g.totalIndices();  j++) {
+            if (g.indices[j] >= g.nVerts) {
+                err ("group \"" + g.name + "\" has an index out of range");
+                break;
+            }
+        }
+    }
+
+    // compare with the OBJ file
+    OBJ::Model *obj = new OBJ::Model (objFile);
+    if ((obj->numGroups() != bin->numGroups())
+    || (obj->numMaterials() != bin->numMaterials())) {
+        err ("number of groups or materials does not match the source");
+    }
+    else {
+        for (int i = 0;  i < obj->numMaterials();  i++) {
+            OBJ::Material const &a = obj->material(i);
+            OBJ::Material const &b = bin->material(i);
+            if ((a.name != b.name) || (a.illum != b.illum)
+            || (a.diffuse != b.diffuse) || (a.specular != b.specular)
+            || (a.shininess != b.shininess) || (a.diffuseMap != b.diffuseMap)
+            || (a.normalMap != b.normalMap)) {
+                err ("material \"" + a.name + "\" does not match the source");
+            }
+        }
+        for (int i = 0;  i < obj->numGroups();  i++) {
+            OBJ::Group const &a = obj->group(i);
+            OBJ::Group const &b = bin->group(i);
+            bool ok = (a.name == b.name) && (a.material == b.material)
+                && (a.nVerts == b.nVerts) && (a.nIndices == b.nIndices)
+                && (a.nLODs == b.nLODs)
+                && sameArray (a.lods, b.lods, a.nLODs)
+                && sameArray (a.verts, b.verts, a.nVerts)
+                && sameArray (a.norms, b.norms, a.nVerts)
+                && sameArray (a.txtCoords, b.txtCoords, a.nVerts)
+                && sameArray (a.indices, b.indices, a.totalIndices());
+            if (! ok) {
+                err ("group \"" + a.name + "\" does not match the source");
+            }
+        }
+    }
+
+    if (nErrs == 0) {
+        std::cout << binFile << ": ok (" << bin->numGroups() << " groups; mapped in "
+            << (t.count() * 1000.0) << " ms)\n";
+    }
+
+    delete obj;
+    delete bin;
+
+    return nErrs;
+}
+
+int main (int argc, char *argv[])
+{
+    bool checkOnly = false;
+    int argi = 1;
+
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        std::string opt(argv[argi++]);
+        if (opt == "-check") { checkOnly = true; }
+        else { usage(); }
+    }
+    if (argi == argc) {
+        usage();
+    }
+
+    int nErrs = 0;
+    for (;  argi < argc;  argi++) {
+        std::string objFile(argv[argi]);
+        if (checkOnly) {
+            nErrs += check (objFile);
+        }
+        else {
+            OBJ::Model model(objFile, true, 0);
+            std::string binFile = OBJ::Model::binaryPath (objFile);
+            if (! model.writeBinary (binFile)) {
+                std::cerr << "obj-convert: unable to write \"" << binFile << "\"\n";
+                nErrs++;
+            }
+        }
+    }
+
+    return (nErrs == 0) ? 0 : 1;
+
+}
@@ -0,0 +1,317 @@
+/*! \file pixel-ops-check.cpp
+ *
+ * A checker for the library's pixel-conversion kernels (see pixel-ops.hpp).  The
+ * kernels use SIMD instructions for the bulk of their input and scalar code for
+ * the remaining pixels, so each kernel is compared with a scalar reference
+ * implementation on random data for every length up to a few hundred elements
+ * (which covers all of the tail cases), for unaligned source and destination
+ * pointers, and for images with odd widths.
+ *
+ * Usage:
+ *
+ *      pixel-ops-check [ -seed <n> ]
+ *
+ * The tool reports the first mismatch for each kernel and exits with a non-zero
+ * status if any kernel disagrees with its reference.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "pixel-ops.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cs237::__detail;
+
+static void usage ()
+{
+    std::cerr << "usage: pixel-ops-check [ -seed <n> ]\n";
+    exit (1);
+}
+
+//! the largest number of pixels in the length sweep
+constexpr size_t kMaxLen = 300;
+//! the largest misalignment (in elements) of the source and destination
+constexpr size_t kMaxOffset = 3;
+
+static std::mt19937 rng;
+static int nFailures = 0;
+
+template <typename T>
+static std::vector<T> randomData (size_t n)
+{
+    std::uniform_int_distribution<uint32_t> dist(0, std::numeric_limits<T>::max());
+    std::vector<T> v(n);
+    for (auto &x : v) {
+        x = T(dist(rng));
+    }
+    return v;
+}
+
+// report a mismatch (only the first one for each kernel is printed)
+static void fail (bool &reported, const char *kernel, std::string const &what)
+{
+    if (! reported) {
+        std::cerr << "pixel-ops-check: " << kernel << ": " << what << "\n";
+        reported = true;
+        nFailures++;
+    }
+}
+
+/***** scalar reference implementations *****/
+
+template <typename T>
+static void refExpandRGB (const T *src, T *dst, size_t nPixels)
+{
+    for (size_t i = 0;  i < nPixels;  ++i) {
+        for (int k = 0;  k < 3;  ++k) {
+            dst[4*i + k] = src[3*i + k];
+        }
+        dst[4*i + 3] = std::numeric_limits<T>::max();
+    }
+}
+
+static void refSwapRB8 (uint8_t *data, uint32_t nChans, size_t nPixels)
+{
+    for (size_t i = 0;  i < nPixels;  ++i) {
+        uint8_t tmp = data[nChans*i];
+        data[nChans*i] = data[nChans*i + 2];
+        data[nChans*i + 2] = tmp;
+    }
+}
+
+static void refSwapBytes16 (uint16_t *data, size_t n)
+{
+    for (size_t i = 0;  i < n;  ++i) {
+        data[i] = uint16_t(((data[i] & 0xff) << 8) | (data[i] >> 8));
+    }
+}
+
+static void refFlipRows (uint8_t *data, size_t bytesPerRow, uint32_t nRows)
+{
+    std::vector<uint8_t> tmp(data, data + bytesPerRow * nRows);
+    for (uint32_t r = 0;  r < nRows;  ++r) {
+        std::memcpy (
+            data + r * bytesPerRow,
+            tmp.data() + (nRows - 1 - r) * bytesPerRow,
+            bytesPerRow);
+    }
+}
+
+static float refToLinear (uint8_t c)
+{
+    double x = double(c) / 255.0;
+    return float((x <= 0.04045) ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4));
+}
+
+// the reference for linearToSRGB uses the same table as the kernel; what we are
+// checking is the clamping and the rounding of the table index, which is the
+// single-precision product rounded to the nearest integer (ties to even)
+static uint8_t refToSRGB (float l)
+{
+    if (!(l > 0.0f)) {          // also catches NaN
+        l = 0.0f;
+    } else if (l > 1.0f) {
+        l = 1.0f;
+    }
+    float x = l * float(kLinearTblSize - 1);
+    float idx = std::floor(x);
+    float frac = x - idx;
+    if ((frac > 0.5f) || ((frac == 0.5f) && (std::fmod(idx, 2.0f) != 0.0f))) {
+        idx += 1.0f;
+    }
+    return srgbTables().toSRGB[uint32_t(idx)];
+}
+
+/***** checks *****/
+
+template <typename T>
+static void checkExpandRGB (
+    const char *name, void (*kernel)(const T *, T *, size_t))
+{
+    bool reported = false;
+    for (size_t off = 0;  off <= kMaxOffset;  ++off) {
+        for (size_t n = 0;  n <= kMaxLen;  ++n) {
+            // the source has exactly 3n elements after the offset, so reads past
+            // the end would be caught by a memory checker
+            std::vector<T> src = randomData<T>(off + 3*n);
+            std::vector<T> dst(off + 4*n, T(0)), ref(4*n, T(0));
+            kernel (src.data() + off, dst.data() + off, n);
+            refExpandRGB (src.data() + off, ref.data(), n);
+            if (! std::equal(ref.begin(), ref.end(), dst.begin() + off)) {
+                fail (reported, name,
+                    "mismatch for " + std::to_string(n) + " pixels at offset "
+                    + std::to_string(off));
+            }
+        }
+    }
+}
+
+static void checkSwapRB8 ()
+{
+    bool reported = false;
+    for (uint32_t nChans = 3;  nChans <= 4;  ++nChans) {
+        for (size_t off = 0;  off <= kMaxOffset;  ++off) {
+            for (size_t n = 0;  n <= kMaxLen;  ++n) {
+                std::vector<uint8_t> data = randomData<uint8_t>(off + nChans*n);
+                std::vector<uint8_t> ref(data);
+                swapRB8 (data.data() + off, nChans, n);
+                refSwapRB8 (ref.data() + off, nChans, n);
+                if (data != ref) {
+                    fail (reported, "swapRB8",
+                        "mismatch for " + std::to_string(n) + " "
+                        + std::to_string(nChans) + "-channel pixels at offset "
+                        + std::to_string(off));
+                }
+            }
+        }
+    }
+}
+
+static void checkSwapBytes16 ()
+{
+    bool reported = false;
+    for (size_t off = 0;  off <= kMaxOffset;  ++off) {
+        for (size_t n = 0;  n <= kMaxLen;  ++n) {
+            std::vector<uint16_t> data = randomData<uint16_t>(off + n);
+            std::vector<uint16_t> ref(data);
+            swapBytes16 (data.data() + off, n);
+            refSwapBytes16 (ref.data() + off, n);
+            if (data != ref) {
+                fail (reported, "swapBytes16",
+                    "mismatch for " + std::to_string(n) + " values at offset "
+                    + std::to_string(off));
+            }
+        }
+    }
+}
+
+static void checkFlipRows ()
+{
+    bool reported = false;
+    // odd widths and widths that are not a multiple of the kernel's 256-byte chunks
+    const size_t widths[] = {1, 3, 7, 13, 255, 256, 257, 3*101, 4*129, 1000};
+    for (size_t bpr : widths) {
+        for (uint32_t nRows = 0;  nRows <= 9;  ++nRows) {
+            std::vector<uint8_t> data = randomData<uint8_t>(bpr * nRows);
+            std::vector<uint8_t> ref(data);
+            flipRows (data.data(), bpr, nRows);
+            refFlipRows (ref.data(), bpr, nRows);
+            if (data != ref) {
+                fail (reported, "flipRows",
+                    "mismatch for " + std::to_string(nRows) + " rows of "
+                    + std::to_string(bpr) + " bytes");
+            }
+        }
+    }
+}
+
+static void checkSRGBToLinear ()
+{
+    bool reported = false;
+    // check every value against the formula, and then the kernel at every length
+    // against those values
+    std::vector<uint8_t> all(256);
+    for (int i = 0;  i < 256;  ++i) {
+        all[i] = uint8_t(i);
+    }
+    std::vector<float> dst(256);
+    srgbToLinear (all.data(), dst.data(), 256);
+    for (int i = 0;  i < 256;  ++i) {
+        if (std::fabs(dst[i] - refToLinear(uint8_t(i))) > 1.0e-6f) {
+            fail (reported, "srgbToLinear",
+                "wrong value for " + std::to_string(i) + ": " + std::to_string(dst[i]));
+        }
+    }
+    for (size_t n = 0;  n <= kMaxLen;  ++n) {
+        std::vector<uint8_t> src = randomData<uint8_t>(n);
+        std::vector<float> out(n);
+        srgbToLinear (src.data(), out.data(), n);
+        for (size_t i = 0;  i < n;  ++i) {
+            if (out[i] != dst[src[i]]) {
+                fail (reported, "srgbToLinear",
+                    "mismatch for " + std::to_string(n) + " values at " + std::to_string(i));
+            }
+        }
+    }
+}
+
+static void checkLinearToSRGB ()
+{
+    bool reported = false;
+    std::uniform_real_distribution<float> dist(-0.25f, 1.25f);
+    for (size_t off = 0;  off <= kMaxOffset;  ++off) {
+        for (size_t n = 0;  n <= kMaxLen;  ++n) {
+            std::vector<float> src(off + n);
+            for (size_t i = 0;  i < src.size();  ++i) {
+                src[i] = dist(rng);
+            }
+            // include values that land exactly halfway between two table entries,
+            // the ends of the range, and NaN
+            if (n > 0) { src[off + (n - 1)] = 0.5f / float(kLinearTblSize - 1); }
+            if (n > 1) { src[off + (n - 2)] = 1.0f; }
+            if (n > 2) { src[off + (n - 3)] = std::numeric_limits<float>::quiet_NaN(); }
+            if (n > 3) { src[off + (n - 4)] = 2.5f / float(kLinearTblSize - 1); }
+            std::vector<uint8_t> dst(n);
+            linearToSRGB (src.data() + off, dst.data(), n);
+            for (size_t i = 0;  i < n;  ++i) {
+                uint8_t ref = refToSRGB(src[off + i]);
+                if (dst[i] != ref) {
+                    fail (reported, "linearToSRGB",
+                        "mismatch for " + std::to_string(src[off + i]) + " ("
+                        + std::to_string(dst[i]) + " instead of "
+                        + std::to_string(ref) + ")");
+                }
+            }
+        }
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned int seed = 17;
+    for (int i = 1;  i < argc;  ++i) {
+        std::string opt(argv[i]);
+        if ((opt == "-seed") && (i + 1 < argc)) {
+            seed = unsigned(std::atoi(argv[++i]));
+        } else {
+            usage();
+        }
+    }
+    rng.seed (seed);
+
+#if defined(__SSSE3__)
+    std::cout << "checking the SSSE3 kernels\n";
+#elif defined(__SSE2__)
+    std::cout << "checking the SSE2 kernels\n";
+#else
+    std::cout << "checking the scalar kernels\n";
+#endif
+
+    checkExpandRGB<uint8_t> ("expandRGB8", expandRGB8);
+    checkExpandRGB<uint16_t> ("expandRGB16", expandRGB16);
+    checkSwapRB8 ();
+    checkSwapBytes16 ();
+    checkFlipRows ();
+    checkSRGBToLinear ();
+    checkLinearToSRGB ();
+
+    if (nFailures > 0) {
+        std::cout << nFailures << " kernel(s) failed\n";
+        return 1;
+    }
+    std::cout << "all kernels agree with the reference code\n";
+    return 0;
+}
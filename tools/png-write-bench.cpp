@@ -0,0 +1,78 @@
+/*! \file png-write-bench.cpp
+ *
+ * A tool for comparing the single-threaded libpng encoder with the parallel
+ * PNG encoder that `Image2D::write` uses when it is given more than one thread.
+ *
+ * Usage:
+ *
+ *      png-write-bench [ -t <threads> ] <image.png> ...
+ *
+ * Each image is loaded and then written to a temporary file using both encoders;
+ * the time and size of each result is reported.  The default for the parallel
+ * encoder is to use all of the hardware threads (i.e., `-t 0`).
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+static void usage ()
+{
+    std::cerr << "usage: png-write-bench [ -t <threads> ] <image.png> ...\n";
+    exit (1);
+}
+
+// write the image using the given number of threads and report the results
+static void bench (cs237::Image2D &img, unsigned int nThreads, const char *label)
+{
+    std::string tmp = (std::filesystem::temp_directory_path() / "png-write-bench.png").string();
+
+    auto start = std::chrono::steady_clock::now();
+    if (! img.write (tmp.c_str(), false, nThreads)) {
+        std::cerr << "png-write-bench: error writing \"" << tmp << "\"\n";
+        exit (1);
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+
+    auto size = std::filesystem::file_size(tmp);
+    std::cout << "  " << label << ": " << t.count() << " s; "
+        << (double(img.nBytes()) / (1024.0 * 1024.0) / t.count()) << " MB/s; "
+        << size << " bytes\n";
+
+    std::remove (tmp.c_str());
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned int nThreads = 0;
+    int argi = 1;
+
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        std::string opt(argv[argi++]);
+        if ((opt == "-t") && (argi < argc)) { nThreads = std::atoi(argv[argi++]); }
+        else { usage(); }
+    }
+    if (argi == argc) {
+        usage();
+    }
+
+    for (;  argi < argc;  ++argi) {
+        cs237::Image2D img(argv[argi], false);
+        std::cout << argv[argi] << " (" << img.width() << "x" << img.height() << " "
+            << cs237::to_string(img.channels()) << " " << cs237::to_string(img.type())
+            << "):\n";
+        bench (img, 1, "libpng  ");
+        bench (img, nThreads, "parallel");
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*! \file tqt-bench.cpp
+ *
+ * A tool for measuring the PNG decoding throughput of the available image decoders
+ * on the tiles of version 1 texture quadtrees (e.g., the color.tqt and norm.tqt
+ * files of a map).
+ *
+ * Usage:
+ *
+ *      tqt-bench [ -n <max-tiles> ] <file.tqt> ...
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include <chrono>
+#include <cstdlib>
+
+static void usage ()
+{
+    std::cerr << "usage: tqt-bench [ -n <max-tiles> ] <file.tqt> ...\n";
+    exit (1);
+}
+
+// decode up to maxTiles tiles of the tree (in level order) and report the throughput
+static void bench (
+    tqt::TextureQTree &tree, cs237::ImageDecoder *decoder, int maxTiles, bool report)
+{
+    cs237::ImageDecoder::setCurrent (decoder);
+
+    int nTiles = 0;
+    size_t nBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int level = 0;  (level < tree.depth()) && (nTiles < maxTiles);  ++level) {
+        int n = (1 << level);
+        for (int row = 0;  (row < n) && (nTiles < maxTiles);  ++row) {
+            for (int col = 0;  (col < n) && (nTiles < maxTiles);  ++col) {
+                cs237::Image2D *img = tree.loadImage (level, row, col);
+                if (img == nullptr) {
+                    std::cerr << "tqt-bench: error decoding tile <" << level << ","
+                        << row << "," << col << ">\n";
+                    exit (1);
+                }
+                nBytes += img->nBytes();
+                nTiles++;
+                delete img;
+            }
+        }
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    if (! report) {
+        return;
+    }
+
+    std::cout << "  " << decoder->name() << ": " << nTiles << " tiles in "
+        << t.count() << " s; " << (double(nTiles) / t.count()) << " tiles/s; "
+        << (double(nBytes) / (1024.0 * 1024.0) / t.count()) << " MB/s decoded\n";
+}
+
+int main (int argc, char *argv[])
+{
+    int maxTiles = 1 << 30;
+    int argi = 1;
+
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        std::string opt(argv[argi++]);
+        if ((opt == "-n") && (argi < argc)) { maxTiles = std::atoi(argv[argi++]); }
+        else { usage(); }
+    }
+    if (argi == argc) {
+        usage();
+    }
+
+    cs237::ImageDecoder *decoders[2] = {
+            cs237::ImageDecoder::libpng(), cs237::ImageDecoder::spng()
+        };
+
+    for (;  argi < argc;  ++argi) {
+        std::string file(argv[argi]);
+        if (! tqt::TextureQTree::isTQTFile(file)) {
+            std::cerr << "tqt-bench: \"" << file << "\" is not a TQT file\n";
+            return 1;
+        }
+        tqt::TextureQTree tree(file, true, false);
+        std::cout << file << ":\n";
+        if (tree.hasMipmaps()) {
+            std::cout << "  version " << tree.version() << " TQT; no PNG tiles\n";
+            continue;
+        }
+        // an untimed pass brings the file into the page cache, so that all of the
+        // decoders see the same I/O costs
+        bench (tree, decoders[0], maxTiles, false);
+        for (auto dec : decoders) {
+            if (dec != nullptr) {
+                bench (tree, dec, maxTiles, true);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*! \file tqt-convert.cpp
+ *
+ * A tool for converting version 1 texture quadtrees (PNG tiles) to version 2
+ * texture quadtrees, where each tile is a complete mipmap chain that is either
+ * uncompressed or block compressed.
+ *
+ * Usage:
+ *
+ *      tqt-convert [ -srgb ] [ -rgba | -bc1 | -bc3 | -bc5 ] <in.tqt> <out.tqt>
+ *
+ * The default format is BC1.  Use BC5 for normal maps.  The -srgb flag specifies
+ * that the tiles hold sRGB-encoded color, which is averaged in linear space when
+ * computing the mipmap levels.  Single and two-channel source tiles are expanded
+ * to RGBA before they are converted (e.g., use BC5 for a two-channel normal map).
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2023 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include "bcn.hpp"
+
+static void usage ()
+{
+    std::cerr << "usage: tqt-convert [ -srgb ] [ -rgba | -bc1 | -bc3 | -bc5 ] <in.tqt> <out.tqt>\n";
+    exit (1);
+}
+
+// build the mipmap chain for a tile
+static cs237::MipmapImage2D *convertTile (cs237::Image2D const *img, tqt::TileFormat fmt)
+{
+    uint32_t size = img->width();
+
+    // first compute the uncompressed chain
+    cs237::MipmapImage2D *rgba = new cs237::MipmapImage2D (img);
+    uint32_t nLevels = rgba->nLevels();
+
+    if (fmt == tqt::TileFormat::RGBA8) {
+        return rgba;
+    }
+
+    // compress the levels
+    bcn::Format bcFmt = static_cast<bcn::Format>(fmt);
+    cs237::MipmapImage2D *bc = new cs237::MipmapImage2D (
+        size, size, nLevels, bcFmt, rgba->sRGB());
+    for (uint32_t i = 0;  i < nLevels;  ++i) {
+        auto const &lvl = rgba->level(i);
+        bcn::encodeImage (
+            bcFmt, lvl.wid, lvl.ht,
+            static_cast<const uint8_t *>(rgba->levelData(i)),
+            static_cast<uint8_t *>(bc->levelData(i)));
+    }
+    delete rgba;
+
+    return bc;
+}
+
+int main (int argc, char *argv[])
+{
+    tqt::TileFormat fmt = tqt::TileFormat::BC1;
+    bool sRGB = false;
+    int argi = 1;
+
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        std::string opt(argv[argi++]);
+        if (opt == "-srgb") { sRGB = true; }
+        else if (opt == "-rgba") { fmt = tqt::TileFormat::RGBA8; }
+        else if (opt == "-bc1") { fmt = tqt::TileFormat::BC1; }
+        else if (opt == "-bc3") { fmt = tqt::TileFormat::BC3; }
+        else if (opt == "-bc5") { fmt = tqt::TileFormat::BC5; }
+        else { usage(); }
+    }
+    if (argc - argi != 2) {
+        usage();
+    }
+    std::string inFile(argv[argi]);
+    std::string outFile(argv[argi+1]);
+
+    if (! tqt::TextureQTree::isTQTFile(inFile)) {
+        std::cerr << "tqt-convert: \"" << inFile << "\" is not a TQT file\n";
+        return 1;
+    }
+
+    // we load the tiles without flipping them, since the flip is applied when the
+    // converted file is loaded
+    tqt::TextureQTree tree(inFile, false, sRGB);
+    if (tree.hasMipmaps()) {
+        std::cerr << "tqt-convert: \"" << inFile << "\" is already a version "
+            << tree.version() << " TQT\n";
+        return 1;
+    }
+
+    bool ok = tqt::writeMipmapTQT (
+        outFile, tree.depth(), tree.tileSize(), fmt,
+        [&tree, fmt](int level, int row, int col) -> cs237::MipmapImage2D * {
+            cs237::Image2D *img = tree.loadImage(level, row, col);
+            if (img == nullptr) {
+                return nullptr;
+            }
+            cs237::MipmapImage2D *tile = convertTile (img, fmt);
+            delete img;
+            return tile;
+        });
+
+    if (! ok) {
+        std::cerr << "tqt-convert: error writing \"" << outFile << "\"\n";
+        return 1;
+    }
+
+    return 0;
+}